@@ -0,0 +1,64 @@
+// Drives the dynamic resolution controller with a synthetic load: a spike that pushes the
+// scale to its minimum, then a light load it must fully recover from. The default spike is
+// heavy enough to be over budget even at the lowest minimum scale (1000 ms * 0.1^2 = 10 ms). GPU time is simulated
+// as proportional to the pixel count, and reaches the controller a few frames late, as it
+// would with frames in flight.
+// Usage: dynres_check [budgetMs] [spikeMs] [lightMs]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../dynres.h"
+
+#define FRAMES_IN_FLIGHT 2
+#define SPIKE_FRAMES 60
+#define RECOVERY_FRAMES 2000
+
+static const float MIN_SCALES[] = {0.5f, 0.25f, 0.1f};
+
+// Runs `frames` frames at `fullResMs` of full-resolution GPU time; returns the frame the scale
+// reached 1 at, or -1.
+static int run(DynamicResolution *dr, float inFlight[FRAMES_IN_FLIGHT], float fullResMs, int frames) {
+  int reached = -1;
+  for (int frame = 0; frame < frames; frame++) {
+    float oldest = inFlight[frame % FRAMES_IN_FLIGHT];
+    dynresUpdate(dr, fullResMs * oldest * oldest, oldest);
+    inFlight[frame % FRAMES_IN_FLIGHT] = dr->scale;
+    if (dr->scale == 1.0f && reached < 0) {
+      reached = frame;
+    }
+  }
+  return dr->scale == 1.0f ? reached : -1;
+}
+
+int main(int argc, char **argv) {
+  float budgetMs = argc > 1 ? strtof(argv[1], NULL) : 10.0f;
+  float spikeMs = argc > 2 ? strtof(argv[2], NULL) : 1000.0f;
+  float lightMs = argc > 3 ? strtof(argv[3], NULL) : 2.0f;
+
+  printf("budget %.1f ms, %d frames at %.1f ms, then %d at %.1f ms\n", budgetMs, SPIKE_FRAMES, spikeMs,
+         RECOVERY_FRAMES, lightMs);
+  printf("%-10s %12s %12s %10s\n", "min scale", "spike scale", "recovered at", "changes");
+
+  bool ok = true;
+  for (size_t i = 0; i < sizeof(MIN_SCALES) / sizeof(MIN_SCALES[0]); i++) {
+    DynamicResolution dr;
+    dynresInit(&dr, budgetMs, MIN_SCALES[i]);
+    float inFlight[FRAMES_IN_FLIGHT] = {1.0f, 1.0f};
+    run(&dr, inFlight, spikeMs, SPIKE_FRAMES);
+    float spikeScale = dr.scale;
+    int recovered = run(&dr, inFlight, lightMs, RECOVERY_FRAMES);
+    printf("%-10.2f %12.3f %12d %10u\n", (double)MIN_SCALES[i], (double)spikeScale, recovered, dr.changes);
+    if (spikeScale > MIN_SCALES[i]) {
+      fprintf(stderr, "min scale %.2f: the spike only reached scale %.3f; use a heavier one!\n",
+              (double)MIN_SCALES[i], (double)spikeScale);
+      ok = false;
+    }
+    if (recovered < 0) {
+      fprintf(stderr, "min scale %.2f: stuck at scale %.3f after %d light frames!\n", (double)MIN_SCALES[i],
+              (double)dr.scale, RECOVERY_FRAMES);
+      ok = false;
+    }
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
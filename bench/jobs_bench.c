@@ -0,0 +1,185 @@
+// Scaling of a synthetic frame (animation, culling, command recording, uploads) across cores.
+// Usage: jobs_bench [objectCount] [frames] [maxThreads]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../jobs.h"
+#include "../vecmath.h"
+
+#define RECORD_JOB_COUNT 8
+#define UPLOAD_JOB_COUNT 8
+#define UPLOAD_CHUNK_SIZE (1u << 20)
+
+typedef struct Frame {
+  uint32_t count;
+  float time;
+  Mat4 *models;
+  Mat4 viewProj;
+  Frustum frustum;
+  SpheresSoA local;
+  SpheresSoA world;
+  uint8_t *visible;
+  atomic_uint visibleCount;
+  uint32_t drawRecords[RECORD_JOB_COUNT];
+  uint8_t *uploadSrc;
+  uint8_t *uploadDst;
+} Frame;
+
+typedef struct RecordJob {
+  Frame *frame;
+  uint32_t index;
+} RecordJob;
+
+typedef struct UploadJob {
+  Frame *frame;
+  uint32_t index;
+} UploadJob;
+
+static double nowSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void animate(void *data, uint32_t begin, uint32_t end) {
+  Frame *frame = data;
+  for (uint32_t i = begin; i < end; i++) {
+    float phase = frame->time + (float)i * 0.001f;
+    Mat4 t = mat4Translate(vec3(sinf(phase) * 100.0f, cosf(phase * 0.7f) * 100.0f, sinf(phase * 0.3f) * 100.0f));
+    Mat4 r = mat4RotateY(phase);
+    frame->models[i] = mat4Multiply(&t, &r);
+  }
+}
+
+static void cull(void *data, uint32_t begin, uint32_t end) {
+  Frame *frame = data;
+  const VecmathKernels *k = vecmathBest();
+  uint32_t n = end - begin;
+  SpheresSoA local = {frame->local.x + begin, frame->local.y + begin, frame->local.z + begin,
+                      frame->local.radius + begin, n};
+  SpheresSoA world = {frame->world.x + begin, frame->world.y + begin, frame->world.z + begin,
+                      frame->world.radius + begin, n};
+  k->boundingSpheresBatch(frame->models + begin, &local, &world);
+  size_t visible = k->cullSpheresBatch(&frame->frustum, &world, frame->visible + begin);
+  atomic_fetch_add(&frame->visibleCount, (uint32_t)visible);
+}
+
+// Stand-in for recording a secondary command buffer per bucket of visible objects.
+static void record(void *data) {
+  RecordJob *job = data;
+  Frame *frame = job->frame;
+  uint32_t per = (frame->count + RECORD_JOB_COUNT - 1) / RECORD_JOB_COUNT;
+  uint32_t begin = job->index * per;
+  uint32_t end = begin + per < frame->count ? begin + per : frame->count;
+  uint32_t draws = 0;
+  for (uint32_t i = begin; i < end; i++) {
+    if (frame->visible[i]) {
+      Mat4 mvp = mat4Multiply(&frame->viewProj, &frame->models[i]);
+      draws += mvp.m[15] > 0.0f;
+    }
+  }
+  frame->drawRecords[job->index] = draws;
+}
+
+static void upload(void *data) {
+  UploadJob *job = data;
+  size_t offset = (size_t)job->index * UPLOAD_CHUNK_SIZE;
+  memcpy(job->frame->uploadDst + offset, job->frame->uploadSrc + offset, UPLOAD_CHUNK_SIZE);
+}
+
+static void runFrame(JobSystem *js, Frame *frame) {
+  JobCounter animated = {};
+  JobCounter culled = {};
+  JobCounter done = {};
+
+  // Uploads do not depend on anything and overlap the rest of the frame.
+  UploadJob uploads[UPLOAD_JOB_COUNT];
+  JobDecl uploadDecls[UPLOAD_JOB_COUNT];
+  for (uint32_t i = 0; i < UPLOAD_JOB_COUNT; i++) {
+    uploads[i] = (UploadJob){frame, i};
+    uploadDecls[i] = (JobDecl){upload, &uploads[i]};
+  }
+  jobRun(js, uploadDecls, UPLOAD_JOB_COUNT, &done);
+
+  jobParallelFor(js, frame->count, 256, animate, frame, &animated);
+  jobWait(js, &animated);
+
+  atomic_store(&frame->visibleCount, 0);
+  jobParallelFor(js, frame->count, 1024, cull, frame, &culled);
+
+  RecordJob records[RECORD_JOB_COUNT];
+  JobDecl recordDecls[RECORD_JOB_COUNT];
+  for (uint32_t i = 0; i < RECORD_JOB_COUNT; i++) {
+    records[i] = (RecordJob){frame, i};
+    recordDecls[i] = (JobDecl){record, &records[i]};
+  }
+  jobRunAfter(js, &culled, recordDecls, RECORD_JOB_COUNT, &done);
+
+  jobWait(js, &done);
+}
+
+int main(int argc, char **argv) {
+  uint32_t count = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 100000;
+  int frames = argc > 2 ? atoi(argv[2]) : 100;
+  long cpus = argc > 3 ? atol(argv[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+
+  Frame frame = {.count = count};
+  frame.models = aligned_alloc(32, sizeof(Mat4) * count);
+  float *sphereData = malloc(sizeof(float) * count * 8);
+  frame.local = (SpheresSoA){sphereData, sphereData + count, sphereData + 2 * count, sphereData + 3 * count, count};
+  frame.world = (SpheresSoA){sphereData + 4 * count, sphereData + 5 * count, sphereData + 6 * count,
+                             sphereData + 7 * count, count};
+  frame.visible = malloc(count);
+  frame.uploadSrc = malloc((size_t)UPLOAD_JOB_COUNT * UPLOAD_CHUNK_SIZE);
+  frame.uploadDst = malloc((size_t)UPLOAD_JOB_COUNT * UPLOAD_CHUNK_SIZE);
+  memset(frame.uploadSrc, 0xAB, (size_t)UPLOAD_JOB_COUNT * UPLOAD_CHUNK_SIZE);
+  for (uint32_t i = 0; i < count; i++) {
+    frame.local.x[i] = frame.local.y[i] = frame.local.z[i] = 0.0f;
+    frame.local.radius[i] = 1.0f;
+  }
+
+  Mat4 view = mat4LookAt(vec3(0.0f, 0.0f, 150.0f), vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
+  Mat4 proj = mat4Perspective(1.0f, 16.0f / 9.0f, 0.1f, 500.0f);
+  frame.viewProj = mat4Multiply(&proj, &view);
+  frame.frustum = frustumFromMatrix(&frame.viewProj);
+
+  printf("objects: %u, frames: %d, max threads: %ld, isa: %s\n", count, frames, cpus,
+         vecmathIsaName(vecmathDetectIsa()));
+  printf("%8s %12s %10s %10s\n", "threads", "ms/frame", "speedup", "visible");
+
+  double baseline = 0.0;
+  // Serial baseline plus powers of two up to the core count.
+  for (long threads = 1;; threads = threads * 2 > cpus && threads < cpus ? cpus : threads * 2) {
+    JobSystem *js = jobSystemCreate((uint32_t)threads - 1);
+    runFrame(js, &frame); // warm-up
+
+    double t0 = nowSeconds();
+    for (int f = 0; f < frames; f++) {
+      frame.time = (float)f * 0.016f;
+      runFrame(js, &frame);
+    }
+    double ms = (nowSeconds() - t0) * 1e3 / frames;
+    if (threads == 1) {
+      baseline = ms;
+    }
+    printf("%8u %12.3f %9.2fx %10u\n", jobSystemThreadCount(js), ms, baseline / ms,
+           atomic_load(&frame.visibleCount));
+    jobSystemDestroy(js);
+
+    if (threads >= cpus) {
+      break;
+    }
+  }
+
+  free(frame.models);
+  free(sphereData);
+  free(frame.visible);
+  free(frame.uploadSrc);
+  free(frame.uploadDst);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,130 @@
+// Scalar vs SIMD throughput of the batched vecmath kernels.
+// Usage: vecmath_bench [objectCount] [iterations]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../vecmath.h"
+
+static double nowSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static float randomFloat(float min, float max) { return min + (max - min) * ((float)rand() / (float)RAND_MAX); }
+
+static SpheresSoA allocSpheres(size_t count) {
+  SpheresSoA s = {.count = count};
+  s.x = aligned_alloc(32, ((count * sizeof(float) + 31) / 32) * 32);
+  s.y = aligned_alloc(32, ((count * sizeof(float) + 31) / 32) * 32);
+  s.z = aligned_alloc(32, ((count * sizeof(float) + 31) / 32) * 32);
+  s.radius = aligned_alloc(32, ((count * sizeof(float) + 31) / 32) * 32);
+  return s;
+}
+
+static void freeSpheres(SpheresSoA *s) {
+  free(s->x);
+  free(s->y);
+  free(s->z);
+  free(s->radius);
+}
+
+int main(int argc, char **argv) {
+  size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000;
+  int iterations = argc > 2 ? atoi(argv[2]) : 200;
+
+  Mat4 *models = aligned_alloc(32, sizeof(Mat4) * count);
+  Mat4 *mvps = aligned_alloc(32, sizeof(Mat4) * count);
+  Mat4 *reference = aligned_alloc(32, sizeof(Mat4) * count);
+  SpheresSoA local = allocSpheres(count);
+  SpheresSoA world = allocSpheres(count);
+  SpheresSoA worldReference = allocSpheres(count);
+  uint8_t *visible = malloc(count);
+
+  srand(1);
+  for (size_t i = 0; i < count; i++) {
+    Mat4 t = mat4Translate(vec3(randomFloat(-100, 100), randomFloat(-100, 100), randomFloat(-100, 100)));
+    Mat4 r = mat4RotateY(randomFloat(0.0f, 6.28f));
+    Mat4 s = mat4Scale(vec3(randomFloat(0.5f, 2.0f), randomFloat(0.5f, 2.0f), randomFloat(0.5f, 2.0f)));
+    Mat4 tr = mat4Multiply(&t, &r);
+    models[i] = mat4Multiply(&tr, &s);
+
+    local.x[i] = randomFloat(-0.5f, 0.5f);
+    local.y[i] = randomFloat(-0.5f, 0.5f);
+    local.z[i] = randomFloat(-0.5f, 0.5f);
+    local.radius[i] = randomFloat(0.5f, 2.0f);
+  }
+
+  Mat4 view = mat4LookAt(vec3(0.0f, 0.0f, 150.0f), vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
+  Mat4 proj = mat4Perspective(1.0f, 16.0f / 9.0f, 0.1f, 500.0f);
+  Mat4 viewProj = mat4Multiply(&proj, &view);
+  Frustum frustum = frustumFromMatrix(&viewProj);
+
+  const VecmathKernels *scalar = vecmathKernels(VECMATH_ISA_SCALAR);
+  scalar->mat4MulBatch(&viewProj, models, reference, count);
+  scalar->boundingSpheresBatch(models, &local, &worldReference);
+  size_t visibleReference = scalar->cullSpheresBatch(&frustum, &worldReference, visible);
+
+  printf("objects: %zu, iterations: %d, detected isa: %s\n", count, iterations,
+         vecmathIsaName(vecmathDetectIsa()));
+  printf("%-8s %14s %14s %14s %12s\n", "isa", "mvp us/10k", "sphere us/10k", "cull us/10k", "visible");
+
+  double scalarTotal = 0.0;
+  for (int isa = VECMATH_ISA_SCALAR; isa < VECMATH_ISA_COUNT; isa++) {
+    if (!vecmathIsaSupported((VecmathIsa)isa)) {
+      printf("%-8s %14s\n", vecmathIsaName((VecmathIsa)isa), "unsupported");
+      continue;
+    }
+    const VecmathKernels *k = vecmathKernels((VecmathIsa)isa);
+
+    double t0 = nowSeconds();
+    for (int it = 0; it < iterations; it++) {
+      k->mat4MulBatch(&viewProj, models, mvps, count);
+    }
+    double t1 = nowSeconds();
+    for (int it = 0; it < iterations; it++) {
+      k->boundingSpheresBatch(models, &local, &world);
+    }
+    double t2 = nowSeconds();
+    size_t visibleCount = 0;
+    for (int it = 0; it < iterations; it++) {
+      visibleCount = k->cullSpheresBatch(&frustum, &world, visible);
+    }
+    double t3 = nowSeconds();
+
+    // Cross-check against the scalar results before reporting numbers.
+    float maxError = 0.0f;
+    for (size_t i = 0; i < count; i++) {
+      for (int e = 0; e < 16; e++) {
+        maxError = fmaxf(maxError, fabsf(mvps[i].m[e] - reference[i].m[e]));
+      }
+      maxError = fmaxf(maxError, fabsf(world.x[i] - worldReference.x[i]));
+      maxError = fmaxf(maxError, fabsf(world.radius[i] - worldReference.radius[i]));
+    }
+    if (maxError > 1e-3f || visibleCount != visibleReference) {
+      fprintf(stderr, "%s results differ from scalar (max error %g, visible %zu vs %zu)!\n",
+              vecmathIsaName((VecmathIsa)isa), maxError, visibleCount, visibleReference);
+      return EXIT_FAILURE;
+    }
+
+    double scale = 1e6 / iterations * (10000.0 / (double)count);
+    double total = t3 - t0;
+    if (isa == VECMATH_ISA_SCALAR) {
+      scalarTotal = total;
+    }
+    printf("%-8s %14.2f %14.2f %14.2f %12zu  (%.2fx)\n", vecmathIsaName((VecmathIsa)isa), (t1 - t0) * scale,
+           (t2 - t1) * scale, (t3 - t2) * scale, visibleCount, scalarTotal / total);
+  }
+
+  free(models);
+  free(mvps);
+  free(reference);
+  freeSpheres(&local);
+  freeSpheres(&world);
+  freeSpheres(&worldReference);
+  free(visible);
+  return EXIT_SUCCESS;
+}
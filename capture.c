@@ -0,0 +1,331 @@
+#include "capture.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CAPTURE_ALIGN(n) (((n) + 7u) & ~(size_t)7u)
+
+static void *reserve(uint8_t **data, size_t *size, size_t *capacity, size_t bytes) {
+  size_t padded = CAPTURE_ALIGN(bytes);
+  if (*size + padded > *capacity) {
+    size_t newCapacity = *capacity ? *capacity : 4096;
+    while (newCapacity < *size + padded) {
+      newCapacity *= 2;
+    }
+    *data = realloc(*data, newCapacity);
+    if (*data == NULL) {
+      fprintf(stderr, "Out of memory while capturing frame!\n");
+      exit(EXIT_FAILURE);
+    }
+    *capacity = newCapacity;
+  }
+  void *p = *data + *size;
+  memset(p, 0, padded);
+  *size += padded;
+  return p;
+}
+
+static void *appendChunk(CaptureWriter *writer, CaptureChunkType type, size_t size) {
+  CaptureChunk *chunk = reserve(&writer->data, &writer->size, &writer->capacity, sizeof(CaptureChunk));
+  chunk->type = type;
+  chunk->size = (uint32_t)size;
+  ((CaptureHeader *)writer->data)->chunkCount++;
+  return reserve(&writer->data, &writer->size, &writer->capacity, size);
+}
+
+void captureBegin(CaptureWriter *writer, VkFormat colorFormat, VkFormat depthFormat, VkExtent2D extent) {
+  *writer = (CaptureWriter){};
+  CaptureHeader *header = reserve(&writer->data, &writer->size, &writer->capacity, sizeof(CaptureHeader));
+  header->magic = CAPTURE_MAGIC;
+  header->version = CAPTURE_VERSION;
+  header->colorFormat = (uint32_t)colorFormat;
+  header->depthFormat = (uint32_t)depthFormat;
+  header->width = extent.width;
+  header->height = extent.height;
+}
+
+uint32_t captureShader(CaptureWriter *writer, const void *code, size_t size) {
+  memcpy(appendChunk(writer, CAPTURE_CHUNK_SHADER, size), code, size);
+  return writer->shaderCount++;
+}
+
+uint32_t capturePipeline(CaptureWriter *writer, const CapturePipeline *pipeline) {
+  memcpy(appendChunk(writer, CAPTURE_CHUNK_PIPELINE, sizeof(CapturePipeline)), pipeline, sizeof(CapturePipeline));
+  return writer->pipelineCount++;
+}
+
+uint32_t captureBuffer(CaptureWriter *writer, VkBufferUsageFlags usage, const void *contents, uint64_t size) {
+  CaptureBuffer *buffer = appendChunk(writer, CAPTURE_CHUNK_BUFFER, sizeof(CaptureBuffer) + size);
+  buffer->usage = usage;
+  buffer->size = size;
+  memcpy(buffer + 1, contents, size);
+  return writer->bufferCount++;
+}
+
+void captureCmd(CaptureWriter *writer, CaptureOpcode opcode, const void *payload, uint32_t size) {
+  CaptureCommand *command =
+      reserve(&writer->commands, &writer->commandsSize, &writer->commandsCapacity, sizeof(CaptureCommand));
+  command->opcode = opcode;
+  command->size = size;
+  if (size) {
+    memcpy(reserve(&writer->commands, &writer->commandsSize, &writer->commandsCapacity, size), payload, size);
+  }
+  writer->commandCount++;
+}
+
+bool captureSave(CaptureWriter *writer, const char *path) {
+  void *commands = appendChunk(writer, CAPTURE_CHUNK_COMMANDS, writer->commandsSize);
+  if (writer->commandsSize) {
+    memcpy(commands, writer->commands, writer->commandsSize);
+  }
+
+  FILE *pFile = fopen(path, "wb");
+  if (pFile == NULL) {
+    fprintf(stderr, "Failed to open %s\n", path);
+    return false;
+  }
+  bool ok = fwrite(writer->data, 1, writer->size, pFile) == writer->size;
+  fclose(pFile);
+
+  fprintf(stderr, "Captured %u commands, %u pipelines, %u buffers to %s (%zu bytes)\n", writer->commandCount,
+          writer->pipelineCount, writer->bufferCount, path, writer->size);
+  return ok;
+}
+
+void captureFree(CaptureWriter *writer) {
+  free(writer->data);
+  free(writer->commands);
+  *writer = (CaptureWriter){};
+}
+
+// Distance from the command at `offset` of the commands chunk to the next one, or 0 if its
+// header or payload runs past the end of the chunk.
+static size_t commandSpan(const CaptureView *commands, size_t offset) {
+  size_t remaining = commands->size - offset;
+  if (offset >= commands->size || remaining < CAPTURE_ALIGN(sizeof(CaptureCommand))) {
+    return 0;
+  }
+  const CaptureCommand *command = (const CaptureCommand *)((const uint8_t *)commands->data + offset);
+  if (command->size > remaining - CAPTURE_ALIGN(sizeof(CaptureCommand))) {
+    return 0;
+  }
+  return CAPTURE_ALIGN(sizeof(CaptureCommand)) + CAPTURE_ALIGN((size_t)command->size);
+}
+
+// Smallest payload of each known opcode; unknown opcodes are skipped by the replay.
+static size_t commandPayloadSize(uint32_t opcode) {
+  switch ((CaptureOpcode)opcode) {
+  case CAPTURE_CMD_BEGIN_RENDER_PASS:
+    return sizeof(CaptureBeginRenderPass);
+  case CAPTURE_CMD_BIND_PIPELINE:
+    return sizeof(uint32_t);
+  case CAPTURE_CMD_SET_VIEWPORT:
+    return sizeof(VkViewport);
+  case CAPTURE_CMD_SET_SCISSOR:
+    return sizeof(VkRect2D);
+  case CAPTURE_CMD_BIND_VERTEX_BUFFER:
+  case CAPTURE_CMD_BIND_INDEX_BUFFER:
+    return sizeof(CaptureBindBuffer);
+  case CAPTURE_CMD_DRAW:
+    return sizeof(CaptureDraw);
+  case CAPTURE_CMD_DRAW_INDEXED:
+    return sizeof(CaptureDrawIndexed);
+  case CAPTURE_CMD_PUSH_CONSTANTS:
+    return sizeof(CapturePushConstants);
+  default:
+    return 0;
+  }
+}
+
+// Whether a chunk's payload is large enough for its type; unknown types are not checked.
+static bool chunkSizeValid(const CaptureChunk *chunk, const uint8_t *payload) {
+  switch (chunk->type) {
+  case CAPTURE_CHUNK_SHADER:
+    return chunk->size > 0 && chunk->size % 4 == 0; // SPIR-V words
+  case CAPTURE_CHUNK_PIPELINE:
+    return chunk->size >= sizeof(CapturePipeline);
+  case CAPTURE_CHUNK_BUFFER:
+    return chunk->size >= sizeof(CaptureBuffer) &&
+           ((const CaptureBuffer *)payload)->size <= chunk->size - sizeof(CaptureBuffer);
+  default:
+    return true;
+  }
+}
+
+// Pipelines must refer to shaders that exist and fit their vertex input in the fixed arrays.
+static bool validatePipelines(const CaptureFile *file, const char *path) {
+  for (uint32_t i = 0; i < file->pipelineCount; i++) {
+    const CapturePipeline *pipeline = file->pipelines[i];
+    if (pipeline->vertexShader >= file->shaderCount ||
+        (pipeline->fragmentShader != CAPTURE_NO_SHADER && pipeline->fragmentShader >= file->shaderCount) ||
+        pipeline->vertexBindingCount > CAPTURE_MAX_VERTEX_BINDINGS ||
+        pipeline->vertexAttributeCount > CAPTURE_MAX_VERTEX_ATTRIBUTES) {
+      fprintf(stderr, "%s has an invalid pipeline %u!\n", path, i);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Every command must lie within the chunk, carry the payload its opcode reads and refer to
+// chunks that exist.
+static bool validateCommands(const CaptureFile *file, const char *path) {
+  for (size_t offset = 0; offset < file->commands.size;) {
+    size_t span = commandSpan(&file->commands, offset);
+    if (span == 0) {
+      fprintf(stderr, "%s has a command running past the end of its chunk!\n", path);
+      return false;
+    }
+    const CaptureCommand *command = (const CaptureCommand *)((const uint8_t *)file->commands.data + offset);
+    const void *payload = captureCommandPayload(command);
+    bool valid = command->size >= commandPayloadSize(command->opcode);
+    if (valid && command->opcode == CAPTURE_CMD_BIND_PIPELINE) {
+      valid = *(const uint32_t *)payload < file->pipelineCount;
+    } else if (valid && (command->opcode == CAPTURE_CMD_BIND_VERTEX_BUFFER ||
+                         command->opcode == CAPTURE_CMD_BIND_INDEX_BUFFER)) {
+      valid = ((const CaptureBindBuffer *)payload)->buffer < file->bufferCount;
+    }
+    if (!valid) {
+      fprintf(stderr, "%s has an invalid command (opcode %u, %u bytes)!\n", path, command->opcode,
+              command->size);
+      return false;
+    }
+    offset += span;
+  }
+  return true;
+}
+
+bool captureOpen(const char *path, CaptureFile *file) {
+  *file = (CaptureFile){};
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Failed to open %s\n", path);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CaptureHeader)) {
+    fprintf(stderr, "%s is not a frame capture!\n", path);
+    close(fd);
+    return false;
+  }
+  file->mappingSize = (size_t)st.st_size;
+  file->mapping = mmap(NULL, file->mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (file->mapping == MAP_FAILED) {
+    fprintf(stderr, "Failed to map %s\n", path);
+    file->mapping = NULL;
+    return false;
+  }
+
+  file->header = file->mapping;
+  if (file->header->magic != CAPTURE_MAGIC || file->header->version != CAPTURE_VERSION) {
+    fprintf(stderr, "%s has an unsupported capture version!\n", path);
+    captureClose(file);
+    return false;
+  }
+
+  // First pass counts chunks per type, second pass records pointers into the mapping.
+  const uint8_t *base = file->mapping;
+  for (int pass = 0; pass < 2; pass++) {
+    size_t offset = CAPTURE_ALIGN(sizeof(CaptureHeader));
+    uint32_t shaders = 0, pipelines = 0, buffers = 0;
+    for (uint32_t i = 0; i < file->header->chunkCount; i++) {
+      if (offset + sizeof(CaptureChunk) > file->mappingSize) {
+        fprintf(stderr, "%s is truncated!\n", path);
+        captureClose(file);
+        return false;
+      }
+      const CaptureChunk *chunk = (const CaptureChunk *)(base + offset);
+      size_t payloadOffset = offset + CAPTURE_ALIGN(sizeof(CaptureChunk));
+      if (payloadOffset > file->mappingSize || chunk->size > file->mappingSize - payloadOffset) {
+        fprintf(stderr, "%s is truncated!\n", path);
+        captureClose(file);
+        return false;
+      }
+      const uint8_t *payload = base + payloadOffset;
+      if (!chunkSizeValid(chunk, payload)) {
+        fprintf(stderr, "%s has an invalid chunk %u (type %u, %u bytes)!\n", path, i, chunk->type,
+                chunk->size);
+        captureClose(file);
+        return false;
+      }
+
+      switch (chunk->type) {
+      case CAPTURE_CHUNK_SHADER:
+        if (pass) {
+          file->shaders[shaders] = (CaptureView){payload, chunk->size};
+        }
+        shaders++;
+        break;
+      case CAPTURE_CHUNK_PIPELINE:
+        if (pass) {
+          file->pipelines[pipelines] = (const CapturePipeline *)payload;
+        }
+        pipelines++;
+        break;
+      case CAPTURE_CHUNK_BUFFER:
+        if (pass) {
+          file->buffers[buffers] = (const CaptureBuffer *)payload;
+        }
+        buffers++;
+        break;
+      case CAPTURE_CHUNK_COMMANDS:
+        file->commands = (CaptureView){payload, chunk->size};
+        break;
+      default:
+        break; // unknown chunks are skipped so newer writers stay readable
+      }
+      offset += CAPTURE_ALIGN(sizeof(CaptureChunk)) + CAPTURE_ALIGN(chunk->size);
+    }
+
+    if (!pass) {
+      file->shaderCount = shaders;
+      file->pipelineCount = pipelines;
+      file->bufferCount = buffers;
+      file->shaders = calloc(shaders ? shaders : 1, sizeof(CaptureView));
+      file->pipelines = calloc(pipelines ? pipelines : 1, sizeof(CapturePipeline *));
+      file->buffers = calloc(buffers ? buffers : 1, sizeof(CaptureBuffer *));
+    }
+  }
+
+  // Everything the replay follows is checked here, so it can use the file without further checks.
+  if (!validatePipelines(file, path) || !validateCommands(file, path)) {
+    captureClose(file);
+    return false;
+  }
+  return true;
+}
+
+void captureClose(CaptureFile *file) {
+  if (file->mapping) {
+    munmap(file->mapping, file->mappingSize);
+  }
+  free(file->shaders);
+  free(file->pipelines);
+  free(file->buffers);
+  *file = (CaptureFile){};
+}
+
+const CaptureCommand *captureNextCommand(const CaptureFile *file, const CaptureCommand *command) {
+  // captureOpen() has checked every command, so a span of 0 only happens past the last one.
+  const uint8_t *begin = file->commands.data;
+  size_t offset = 0;
+  if (command != NULL) {
+    offset = (size_t)((const uint8_t *)command - begin);
+    size_t span = commandSpan(&file->commands, offset);
+    if (span == 0) {
+      return NULL;
+    }
+    offset += span;
+  }
+  if (commandSpan(&file->commands, offset) == 0) {
+    return NULL;
+  }
+  return (const CaptureCommand *)(begin + offset);
+}
@@ -0,0 +1,174 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+// Binary frame capture: everything needed to re-record and re-submit one frame without a
+// window. Layout is a CaptureHeader followed by chunks; every chunk and command starts on an
+// 8-byte boundary so payloads can be read in place from an mmap'd file.
+
+#define CAPTURE_MAGIC 0x50414356u // "VCAP"
+#define CAPTURE_VERSION 3u
+
+typedef enum CaptureChunkType {
+  CAPTURE_CHUNK_SHADER = 1,   // SPIR-V words
+  CAPTURE_CHUNK_PIPELINE = 2, // CapturePipeline
+  CAPTURE_CHUNK_BUFFER = 3,   // CaptureBuffer + contents
+  CAPTURE_CHUNK_COMMANDS = 4, // sequence of CaptureCommand
+} CaptureChunkType;
+
+typedef enum CaptureOpcode {
+  CAPTURE_CMD_BEGIN_RENDER_PASS = 1, // CaptureBeginRenderPass
+  CAPTURE_CMD_END_RENDER_PASS = 2,   // no payload
+  CAPTURE_CMD_BIND_PIPELINE = 3,     // uint32_t pipeline index
+  CAPTURE_CMD_SET_VIEWPORT = 4,      // VkViewport
+  CAPTURE_CMD_SET_SCISSOR = 5,       // VkRect2D
+  CAPTURE_CMD_BIND_VERTEX_BUFFER = 6, // CaptureBindBuffer
+  CAPTURE_CMD_BIND_INDEX_BUFFER = 7,  // CaptureBindBuffer (binding holds the VkIndexType)
+  CAPTURE_CMD_DRAW = 8,               // CaptureDraw
+  CAPTURE_CMD_DRAW_INDEXED = 9,       // CaptureDrawIndexed
+  CAPTURE_CMD_PUSH_CONSTANTS = 10,    // CapturePushConstants + data
+} CaptureOpcode;
+
+typedef struct CaptureHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t chunkCount;
+  uint32_t colorFormat; // VkFormat of the color attachment
+  uint32_t depthFormat; // VkFormat of the depth attachment
+  uint32_t width;
+  uint32_t height;
+} CaptureHeader;
+
+typedef struct CaptureChunk {
+  uint32_t type;
+  uint32_t size; // payload size, excluding padding
+} CaptureChunk;
+
+#define CAPTURE_NO_SHADER UINT32_MAX
+#define CAPTURE_MAX_VERTEX_BINDINGS 4
+#define CAPTURE_MAX_VERTEX_ATTRIBUTES 8
+#define CAPTURE_SPECIALIZATION_CONSTANTS 3 // uint32_t constant_id 0..2 of the fragment shader
+#define CAPTURE_PUSH_CONSTANT_STAGES (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT)
+
+typedef struct CapturePipeline {
+  uint32_t vertexShader;   // shader chunk index
+  uint32_t fragmentShader; // shader chunk index, or CAPTURE_NO_SHADER for depth-only pipelines
+  uint32_t topology;
+  uint32_t polygonMode;
+  uint32_t cullMode;
+  uint32_t frontFace;
+  uint32_t samples;
+  uint32_t blendEnable;
+  uint32_t colorWriteMask;
+  uint32_t depthTestEnable;
+  uint32_t depthWriteEnable;
+  uint32_t depthCompareOp;
+  uint32_t pushConstantSize; // one range at offset 0 visible to CAPTURE_PUSH_CONSTANT_STAGES
+  uint32_t vertexBindingCount;
+  uint32_t vertexAttributeCount;
+  uint32_t specialization[CAPTURE_SPECIALIZATION_CONSTANTS]; // ignored without a fragment shader
+  VkVertexInputBindingDescription vertexBindings[CAPTURE_MAX_VERTEX_BINDINGS];
+  VkVertexInputAttributeDescription vertexAttributes[CAPTURE_MAX_VERTEX_ATTRIBUTES];
+} CapturePipeline;
+
+typedef struct CaptureBuffer {
+  uint32_t usage; // VkBufferUsageFlags
+  uint32_t reserved;
+  uint64_t size; // contents follow
+} CaptureBuffer;
+
+typedef struct CaptureCommand {
+  uint32_t opcode;
+  uint32_t size; // payload size, excluding padding
+} CaptureCommand;
+
+typedef struct CaptureBeginRenderPass {
+  float clearColor[4];
+  float clearDepth;
+  uint32_t width;
+  uint32_t height;
+} CaptureBeginRenderPass;
+
+typedef struct CaptureBindBuffer {
+  uint32_t binding;
+  uint32_t buffer; // buffer chunk index
+  uint64_t offset;
+} CaptureBindBuffer;
+
+typedef struct CaptureDraw {
+  uint32_t vertexCount;
+  uint32_t instanceCount;
+  uint32_t firstVertex;
+  uint32_t firstInstance;
+} CaptureDraw;
+
+typedef struct CaptureDrawIndexed {
+  uint32_t indexCount;
+  uint32_t instanceCount;
+  uint32_t firstIndex;
+  int32_t vertexOffset;
+  uint32_t firstInstance;
+} CaptureDrawIndexed;
+
+typedef struct CapturePushConstants {
+  uint32_t stageFlags;
+  uint32_t offset; // data follows
+} CapturePushConstants;
+
+// Writer: chunks are appended to `data`, commands collected separately and emitted as a
+// single chunk by captureSave().
+typedef struct CaptureWriter {
+  uint8_t *data;
+  size_t size;
+  size_t capacity;
+  uint8_t *commands;
+  size_t commandsSize;
+  size_t commandsCapacity;
+  uint32_t shaderCount;
+  uint32_t pipelineCount;
+  uint32_t bufferCount;
+  uint32_t commandCount;
+} CaptureWriter;
+
+void captureBegin(CaptureWriter *writer, VkFormat colorFormat, VkFormat depthFormat, VkExtent2D extent);
+uint32_t captureShader(CaptureWriter *writer, const void *code, size_t size);
+uint32_t capturePipeline(CaptureWriter *writer, const CapturePipeline *pipeline);
+uint32_t captureBuffer(CaptureWriter *writer, VkBufferUsageFlags usage, const void *contents, uint64_t size);
+void captureCmd(CaptureWriter *writer, CaptureOpcode opcode, const void *payload, uint32_t size);
+bool captureSave(CaptureWriter *writer, const char *path);
+void captureFree(CaptureWriter *writer);
+
+// Reader: maps the file read-only; chunk payload pointers point into the mapping.
+typedef struct CaptureView {
+  const void *data;
+  uint32_t size;
+} CaptureView;
+
+typedef struct CaptureFile {
+  void *mapping;
+  size_t mappingSize;
+  const CaptureHeader *header;
+  uint32_t shaderCount;
+  CaptureView *shaders;
+  uint32_t pipelineCount;
+  const CapturePipeline **pipelines;
+  uint32_t bufferCount;
+  const CaptureBuffer **buffers; // contents at (const uint8_t *)buffers[i] + sizeof(CaptureBuffer)
+  CaptureView commands;
+} CaptureFile;
+
+// Rejects a file whose chunks, pipelines or commands are truncated or refer to chunks that do
+// not exist, so the reader can follow them without further checks.
+bool captureOpen(const char *path, CaptureFile *file);
+void captureClose(CaptureFile *file);
+// Iterates commands: pass NULL to get the first one; returns NULL after the last.
+const CaptureCommand *captureNextCommand(const CaptureFile *file, const CaptureCommand *command);
+
+static inline const void *captureCommandPayload(const CaptureCommand *command) { return command + 1; }
+
+#endif
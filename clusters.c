@@ -0,0 +1,224 @@
+#include "clusters.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CLUSTER_WORKGROUP_SIZE 64 // local_size_x of shaders/cluster.comp
+
+_Static_assert(sizeof(ClusterParams) == 128, "ClusterParams must match std140 in cluster.comp");
+
+static void createBuffer(Clusters *cl, VkDeviceSize size, VkBufferUsageFlags usage,
+                         VkMemoryPropertyFlags properties, VkBuffer *buffer, VkDeviceMemory *memory) {
+  VkBufferCreateInfo bufferInfo = {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                   .size = size,
+                                   .usage = usage,
+                                   .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
+  if (vkCreateBuffer(cl->device, &bufferInfo, cl->pAllocator, buffer) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create cluster buffer!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  VkMemoryRequirements memRequirements;
+  vkGetBufferMemoryRequirements(cl->device, *buffer, &memRequirements);
+  uint32_t memoryType = deviceCapsFindMemoryType(cl->caps, memRequirements.memoryTypeBits, properties);
+  // Host-visible video memory is preferred for what the GPU reads often, but not required.
+  if (memoryType == UINT32_MAX && (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+    memoryType = deviceCapsFindMemoryType(cl->caps, memRequirements.memoryTypeBits,
+                                          properties & ~VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  }
+  if (memoryType == UINT32_MAX) {
+    fprintf(stderr, "Failed to find suitable memory type!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  VkMemoryAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                                    .allocationSize = memRequirements.size,
+                                    .memoryTypeIndex = memoryType};
+  if (memoryBudgetAllocate(cl->budget, cl->device, &allocInfo, cl->pAllocator, memory) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to allocate cluster buffer memory!\n");
+    exit(EXIT_FAILURE);
+  }
+  vkBindBufferMemory(cl->device, *buffer, *memory, 0);
+}
+
+static void *createMappedBuffer(Clusters *cl, VkDeviceSize size, VkBufferUsageFlags usage,
+                                VkMemoryPropertyFlags properties, VkBuffer *buffer, VkDeviceMemory *memory) {
+  createBuffer(cl, size, usage,
+               properties | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+               buffer, memory);
+  void *mapped;
+  vkMapMemory(cl->device, *memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+  return mapped;
+}
+
+VkDescriptorSetLayout clustersCreateSetLayout(VkDevice device, const VkAllocationCallbacks *pAllocator) {
+  const VkShaderStageFlags stages = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+  VkDescriptorSetLayoutBinding bindings[] = {
+      {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, stages, NULL}, // ClusterParams
+      {1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, stages, NULL}, // lights
+      {2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, stages, NULL}, // counts
+      {3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, stages, NULL}, // indices
+  };
+  VkDescriptorSetLayoutCreateInfo setInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+                                             .bindingCount = 4,
+                                             .pBindings = bindings};
+  VkDescriptorSetLayout setLayout;
+  if (vkCreateDescriptorSetLayout(device, &setInfo, pAllocator, &setLayout) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create cluster descriptor set layout!\n");
+    exit(EXIT_FAILURE);
+  }
+  return setLayout;
+}
+
+static void createPipeline(Clusters *cl, VkShaderModule clusterShader) {
+  VkPipelineLayoutCreateInfo layoutInfo = {.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                                           .setLayoutCount = 1,
+                                           .pSetLayouts = &cl->setLayout};
+  if (vkCreatePipelineLayout(cl->device, &layoutInfo, cl->pAllocator, &cl->pipelineLayout) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create cluster pipeline layout!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  VkComputePipelineCreateInfo pipelineInfo = {
+      .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+      .stage = {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = clusterShader,
+                .pName = "main"},
+      .layout = cl->pipelineLayout,
+      .basePipelineIndex = -1};
+  if (vkCreateComputePipelines(cl->device, VK_NULL_HANDLE, 1, &pipelineInfo, cl->pAllocator, &cl->pipeline) !=
+      VK_SUCCESS) {
+    fprintf(stderr, "Failed to create cluster pipeline!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void clustersCreate(Clusters *cl, const DeviceCaps *caps, VkDevice device,
+                    const VkAllocationCallbacks *pAllocator, MemoryBudget *budget,
+                    VkShaderModule clusterShader, VkDescriptorSetLayout setLayout, const Scene *scene,
+                    uint32_t frameCount) {
+  *cl = (Clusters){.caps = caps,
+                   .device = device,
+                   .pAllocator = pAllocator,
+                   .budget = budget,
+                   .lightCount = scene->lightCount,
+                   .frameCount = frameCount,
+                   .setLayout = setLayout};
+  arenaInit(&cl->arena, 1024);
+  cl->frames = arenaPushArray(&cl->arena, ClusterFrame, frameCount);
+  memset(cl->frames, 0, sizeof(ClusterFrame) * frameCount);
+
+  createPipeline(cl, clusterShader);
+
+  VkDescriptorPoolSize poolSizes[] = {{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frameCount},
+                                      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * frameCount}};
+  VkDescriptorPoolCreateInfo poolInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                                         .maxSets = frameCount,
+                                         .poolSizeCount = 2,
+                                         .pPoolSizes = poolSizes};
+  if (vkCreateDescriptorPool(device, &poolInfo, pAllocator, &cl->descriptorPool) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create cluster descriptor pool!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Every fragment of the naive loop reads every light, so they should be in video memory.
+  VkDeviceSize lightsSize = sizeof(SceneLight) * (scene->lightCount ? scene->lightCount : 1);
+  void *lights = createMappedBuffer(cl, lightsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &cl->lightBuffer, &cl->lightMemory);
+  memcpy(lights, scene->lights, sizeof(SceneLight) * scene->lightCount);
+  vkUnmapMemory(device, cl->lightMemory);
+
+  for (uint32_t i = 0; i < frameCount; i++) {
+    ClusterFrame *frame = &cl->frames[i];
+    frame->params = createMappedBuffer(cl, sizeof(ClusterParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 0,
+                                       &frame->paramsBuffer, &frame->paramsMemory);
+    createBuffer(cl, sizeof(uint32_t) * CLUSTER_COUNT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &frame->countsBuffer, &frame->countsMemory);
+    createBuffer(cl, sizeof(uint32_t) * CLUSTER_COUNT * CLUSTER_MAX_LIGHTS,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                 &frame->indicesBuffer, &frame->indicesMemory);
+
+    VkDescriptorSetAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                                             .descriptorPool = cl->descriptorPool,
+                                             .descriptorSetCount = 1,
+                                             .pSetLayouts = &cl->setLayout};
+    if (vkAllocateDescriptorSets(device, &allocInfo, &frame->set) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to allocate cluster descriptor set!\n");
+      exit(EXIT_FAILURE);
+    }
+    VkDescriptorBufferInfo buffers[] = {{frame->paramsBuffer, 0, VK_WHOLE_SIZE},
+                                        {cl->lightBuffer, 0, VK_WHOLE_SIZE},
+                                        {frame->countsBuffer, 0, VK_WHOLE_SIZE},
+                                        {frame->indicesBuffer, 0, VK_WHOLE_SIZE}};
+    VkWriteDescriptorSet writes[4];
+    for (uint32_t binding = 0; binding < 4; binding++) {
+      writes[binding] = (VkWriteDescriptorSet){
+          .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+          .dstSet = frame->set,
+          .dstBinding = binding,
+          .descriptorCount = 1,
+          .descriptorType = binding ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+          .pBufferInfo = &buffers[binding]};
+    }
+    vkUpdateDescriptorSets(device, 4, writes, 0, NULL);
+  }
+}
+
+void clustersRecord(Clusters *cl, VkCommandBuffer commandBuffer, uint32_t frameIndex, const Mat4 *view,
+                    float aspect, float zFar, VkExtent2D renderExtent, uint32_t lightCount, float rangeScale,
+                    bool build) {
+  ClusterFrame *frame = &cl->frames[frameIndex];
+  float tanHalfFovY = tanf(0.5f * SCENE_FOV_Y);
+  float logDepthRange = logf(zFar / SCENE_Z_NEAR);
+
+  // The frame's fence has signaled, so the parameters are free to rewrite.
+  *frame->params = (ClusterParams){
+      .view = *view,
+      .tanHalfFov = {tanHalfFovY * aspect, tanHalfFovY},
+      .zNear = SCENE_Z_NEAR,
+      .zFar = zFar,
+      .tileScale = {(float)CLUSTER_GRID_X / (float)renderExtent.width,
+                    (float)CLUSTER_GRID_Y / (float)renderExtent.height},
+      .sliceScale = (float)CLUSTER_GRID_Z / logDepthRange,
+      .sliceBias = (float)CLUSTER_GRID_Z * logf(SCENE_Z_NEAR) / logDepthRange,
+      .gridSize = {CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z},
+      .lightCount = lightCount < cl->lightCount ? lightCount : cl->lightCount,
+      .rangeScale = rangeScale,
+      .maxClusterLights = CLUSTER_MAX_LIGHTS};
+  if (!build) {
+    return;
+  }
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cl->pipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cl->pipelineLayout, 0, 1,
+                          &frame->set, 0, NULL);
+  vkCmdDispatch(commandBuffer, (CLUSTER_COUNT + CLUSTER_WORKGROUP_SIZE - 1) / CLUSTER_WORKGROUP_SIZE, 1, 1);
+
+  VkMemoryBarrier toShading = {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                               .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                               .dstAccessMask = VK_ACCESS_SHADER_READ_BIT};
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &toShading, 0, NULL, 0, NULL);
+}
+
+void clustersDestroy(Clusters *cl) {
+  for (uint32_t i = 0; i < cl->frameCount; i++) {
+    ClusterFrame *frame = &cl->frames[i];
+    vkDestroyBuffer(cl->device, frame->paramsBuffer, cl->pAllocator);
+    memoryBudgetFree(cl->budget, cl->device, frame->paramsMemory, cl->pAllocator);
+    vkDestroyBuffer(cl->device, frame->countsBuffer, cl->pAllocator);
+    memoryBudgetFree(cl->budget, cl->device, frame->countsMemory, cl->pAllocator);
+    vkDestroyBuffer(cl->device, frame->indicesBuffer, cl->pAllocator);
+    memoryBudgetFree(cl->budget, cl->device, frame->indicesMemory, cl->pAllocator);
+  }
+  vkDestroyBuffer(cl->device, cl->lightBuffer, cl->pAllocator);
+  memoryBudgetFree(cl->budget, cl->device, cl->lightMemory, cl->pAllocator);
+
+  vkDestroyDescriptorPool(cl->device, cl->descriptorPool, cl->pAllocator);
+  vkDestroyPipeline(cl->device, cl->pipeline, cl->pAllocator);
+  vkDestroyPipelineLayout(cl->device, cl->pipelineLayout, cl->pAllocator);
+  arenaDestroy(&cl->arena);
+}
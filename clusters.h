@@ -0,0 +1,93 @@
+#ifndef CLUSTERS_H
+#define CLUSTERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "devicecaps.h"
+#include "hostalloc.h"
+#include "membudget.h"
+#include "scene.h"
+#include "vecmath.h"
+
+// Clustered forward lighting. The view frustum is split into a grid of clusters: tiles of the
+// render area times depth slices that get exponentially thicker with distance, so clusters
+// stay roughly as deep as they are wide. Each frame a compute pass lists, for every cluster,
+// the scene lights whose range reaches it. The fragment shader finds its cluster from its
+// window position and depth and shades only that list, so its cost follows the number of
+// lights near it rather than the number in the scene.
+//
+// Everything the shading reads is in one descriptor set, bound at set 0 of the scene pipeline
+// layout. Without the cluster pass the same set serves the naive loop over every light.
+
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_COUNT (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+#define CLUSTER_MAX_LIGHTS 256 // per cluster; lights beyond it are dropped from the cluster
+
+// Uniform block of shaders/cluster.comp and shaders/shader.frag (std140).
+typedef struct ClusterParams {
+  Mat4 view;
+  float tanHalfFov[2]; // x, y
+  float zNear;
+  float zFar;
+  float tileScale[2]; // clusters per pixel of the render area
+  float sliceScale;   // slice = log(depth) * sliceScale - sliceBias
+  float sliceBias;
+  uint32_t gridSize[3];
+  uint32_t lightCount; // first lights of the light buffer that are used
+  float rangeScale;    // applied to every light's range
+  uint32_t maxClusterLights;
+  uint32_t padding[2];
+} ClusterParams;
+
+typedef struct ClusterFrame {
+  VkBuffer paramsBuffer;
+  VkDeviceMemory paramsMemory;
+  ClusterParams *params;
+  VkBuffer countsBuffer; // lights per cluster
+  VkDeviceMemory countsMemory;
+  VkBuffer indicesBuffer; // CLUSTER_MAX_LIGHTS light indices per cluster
+  VkDeviceMemory indicesMemory;
+  VkDescriptorSet set;
+} ClusterFrame;
+
+typedef struct Clusters {
+  const DeviceCaps *caps;
+  VkDevice device;
+  const VkAllocationCallbacks *pAllocator;
+  MemoryBudget *budget;
+  uint32_t lightCount; // in the light buffer
+  VkBuffer lightBuffer; // the scene's SceneLights, world space
+  VkDeviceMemory lightMemory;
+
+  uint32_t frameCount;
+  ClusterFrame *frames;
+  Arena arena; // frames
+
+  VkDescriptorSetLayout setLayout; // owned by the caller
+  VkPipelineLayout pipelineLayout;
+  VkPipeline pipeline;
+  VkDescriptorPool descriptorPool;
+} Clusters;
+
+// The layout of ClusterFrame::set, for both the cluster pass and the scene's fragment shader.
+// Owned by the caller, who must keep it alive for as long as any Clusters uses it.
+VkDescriptorSetLayout clustersCreateSetLayout(VkDevice device, const VkAllocationCallbacks *pAllocator);
+void clustersCreate(Clusters *cl, const DeviceCaps *caps, VkDevice device,
+                    const VkAllocationCallbacks *pAllocator, MemoryBudget *budget,
+                    VkShaderModule clusterShader, VkDescriptorSetLayout setLayout, const Scene *scene,
+                    uint32_t frameCount);
+// Outside a render pass, before the frame's draws. Sets up the frame's descriptor set for
+// the first `lightCount` lights with their ranges times `rangeScale`, seen with the scene's
+// camera at `view`. With `build` the cluster lists are built too; otherwise only the naive
+// loop over every light may read the set.
+void clustersRecord(Clusters *cl, VkCommandBuffer commandBuffer, uint32_t frameIndex, const Mat4 *view,
+                    float aspect, float zFar, VkExtent2D renderExtent, uint32_t lightCount, float rangeScale,
+                    bool build);
+void clustersDestroy(Clusters *cl);
+
+#endif
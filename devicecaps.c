@@ -0,0 +1,81 @@
+#include "devicecaps.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void deviceCapsInit(DeviceCaps *caps, VkPhysicalDevice physicalDevice) {
+  *caps = (DeviceCaps){.physicalDevice = physicalDevice};
+
+  vkGetPhysicalDeviceProperties(physicalDevice, &caps->properties);
+  vkGetPhysicalDeviceFeatures(physicalDevice, &caps->features);
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &caps->memoryProperties);
+
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &caps->queueFamilyCount, NULL);
+  caps->queueFamilies = malloc(sizeof(VkQueueFamilyProperties) * caps->queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &caps->queueFamilyCount, caps->queueFamilies);
+
+  vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &caps->extensionCount, NULL);
+  caps->extensions = malloc(sizeof(VkExtensionProperties) * caps->extensionCount);
+  vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &caps->extensionCount, caps->extensions);
+
+  caps->driverQueries += 7;
+}
+
+void deviceCapsSetSurface(DeviceCaps *caps, VkSurfaceKHR surface) {
+  free(caps->surfaceSupport);
+  free(caps->formats);
+  free(caps->presentModes);
+  caps->surface = surface;
+
+  caps->surfaceSupport = malloc(sizeof(VkBool32) * caps->queueFamilyCount);
+  for (uint32_t i = 0; i < caps->queueFamilyCount; i++) {
+    vkGetPhysicalDeviceSurfaceSupportKHR(caps->physicalDevice, i, surface, &caps->surfaceSupport[i]);
+  }
+
+  vkGetPhysicalDeviceSurfaceFormatsKHR(caps->physicalDevice, surface, &caps->formatCount, NULL);
+  caps->formats = malloc(sizeof(VkSurfaceFormatKHR) * (caps->formatCount ? caps->formatCount : 1));
+  vkGetPhysicalDeviceSurfaceFormatsKHR(caps->physicalDevice, surface, &caps->formatCount, caps->formats);
+
+  vkGetPhysicalDeviceSurfacePresentModesKHR(caps->physicalDevice, surface, &caps->presentModeCount, NULL);
+  caps->presentModes =
+      malloc(sizeof(VkPresentModeKHR) * (caps->presentModeCount ? caps->presentModeCount : 1));
+  vkGetPhysicalDeviceSurfacePresentModesKHR(caps->physicalDevice, surface, &caps->presentModeCount,
+                                            caps->presentModes);
+
+  caps->driverQueries += caps->queueFamilyCount + 4;
+  deviceCapsRefreshSurfaceCapabilities(caps);
+}
+
+void deviceCapsRefreshSurfaceCapabilities(DeviceCaps *caps) {
+  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(caps->physicalDevice, caps->surface, &caps->surfaceCapabilities);
+  caps->driverQueries++;
+}
+
+void deviceCapsDestroy(DeviceCaps *caps) {
+  free(caps->queueFamilies);
+  free(caps->extensions);
+  free(caps->surfaceSupport);
+  free(caps->formats);
+  free(caps->presentModes);
+  *caps = (DeviceCaps){};
+}
+
+bool deviceCapsHasExtension(const DeviceCaps *caps, const char *name) {
+  for (uint32_t i = 0; i < caps->extensionCount; i++) {
+    if (strcmp(caps->extensions[i].extensionName, name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint32_t deviceCapsFindMemoryType(const DeviceCaps *caps, uint32_t typeBits,
+                                  VkMemoryPropertyFlags properties) {
+  for (uint32_t i = 0; i < caps->memoryProperties.memoryTypeCount; i++) {
+    if ((typeBits & (1u << i)) &&
+        (caps->memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+      return i;
+    }
+  }
+  return UINT32_MAX;
+}
@@ -0,0 +1,44 @@
+#ifndef DEVICECAPS_H
+#define DEVICECAPS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+// Everything the renderer needs to know about a physical device, queried once. Surface
+// dependent parts are filled by deviceCapsSetSurface() and only re-queried when the surface
+// changes; swapchain recreation only refreshes the surface capabilities (current extent).
+
+typedef struct DeviceCaps {
+  VkPhysicalDevice physicalDevice;
+  VkPhysicalDeviceProperties properties;
+  VkPhysicalDeviceFeatures features;
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+  uint32_t queueFamilyCount;
+  VkQueueFamilyProperties *queueFamilies;
+  uint32_t extensionCount;
+  VkExtensionProperties *extensions;
+
+  VkSurfaceKHR surface;
+  VkBool32 *surfaceSupport; // per queue family
+  VkSurfaceCapabilitiesKHR surfaceCapabilities;
+  uint32_t formatCount;
+  VkSurfaceFormatKHR *formats;
+  uint32_t presentModeCount;
+  VkPresentModeKHR *presentModes;
+
+  uint32_t driverQueries; // vkGetPhysicalDevice* / vkEnumerate* calls made so far
+} DeviceCaps;
+
+void deviceCapsInit(DeviceCaps *caps, VkPhysicalDevice physicalDevice);
+void deviceCapsSetSurface(DeviceCaps *caps, VkSurfaceKHR surface);
+void deviceCapsRefreshSurfaceCapabilities(DeviceCaps *caps);
+void deviceCapsDestroy(DeviceCaps *caps);
+
+bool deviceCapsHasExtension(const DeviceCaps *caps, const char *name);
+// UINT32_MAX if no memory type in `typeBits` has all of `properties`.
+uint32_t deviceCapsFindMemoryType(const DeviceCaps *caps, uint32_t typeBits,
+                                  VkMemoryPropertyFlags properties);
+
+#endif
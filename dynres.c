@@ -0,0 +1,53 @@
+#include "dynres.h"
+
+#include <math.h>
+
+#define DYNRES_HEADROOM 0.9f   // aim below the budget so frame-to-frame noise stays within it
+#define DYNRES_RISE 0.5f       // smoothing weight of a sample slower than the average
+#define DYNRES_FALL 0.1f       // ... and of a faster one
+#define DYNRES_MAX_DOWN 0.10f  // largest relative scale change per frame when over budget
+#define DYNRES_MAX_UP 0.02f    // ... and when under it
+#define DYNRES_DEAD_BAND 0.01f // closer targets are ignored, so the extent does not flicker
+
+static float clampf(float value, float min, float max) {
+  return value < min ? min : value > max ? max : value;
+}
+
+void dynresInit(DynamicResolution *dr, float budgetMs, float minScale) {
+  *dr = (DynamicResolution){.budgetMs = budgetMs, .minScale = clampf(minScale, 0.1f, 1.0f), .scale = 1.0f};
+}
+
+void dynresUpdate(DynamicResolution *dr, float gpuMs, float frameScale) {
+  if (gpuMs <= 0.0f || frameScale <= 0.0f) {
+    return;
+  }
+
+  // Load spikes are followed at once; recovery is averaged over more frames.
+  float fullResMs = gpuMs / (frameScale * frameScale);
+  if (dr->fullResMs == 0.0f) {
+    dr->fullResMs = fullResMs;
+  } else {
+    float weight = fullResMs > dr->fullResMs ? DYNRES_RISE : DYNRES_FALL;
+    dr->fullResMs += weight * (fullResMs - dr->fullResMs);
+  }
+
+  // The dead band applies to the distance to the target, not to the rate-limited step: near
+  // minScale a step up can be smaller than the band, and must still be taken.
+  float target = clampf(sqrtf(DYNRES_HEADROOM * dr->budgetMs / dr->fullResMs), dr->minScale, 1.0f);
+  if (fabsf(target - dr->scale) < DYNRES_DEAD_BAND && target > dr->minScale && target < 1.0f) {
+    return;
+  }
+  float next = clampf(target, dr->scale * (1.0f - DYNRES_MAX_DOWN), dr->scale * (1.0f + DYNRES_MAX_UP));
+  next = clampf(next, dr->minScale, 1.0f);
+  if (next != dr->scale) {
+    dr->scale = next;
+    dr->changes++;
+  }
+}
+
+VkExtent2D dynresExtent(const DynamicResolution *dr, VkExtent2D full) {
+  uint32_t width = (uint32_t)((float)full.width * dr->scale + 0.5f);
+  uint32_t height = (uint32_t)((float)full.height * dr->scale + 0.5f);
+  return (VkExtent2D){width < 1 ? 1 : width > full.width ? full.width : width,
+                      height < 1 ? 1 : height > full.height ? full.height : height};
+}
@@ -0,0 +1,33 @@
+#ifndef DYNRES_H
+#define DYNRES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+// Dynamic resolution: a controller that picks the fraction of the output extent the scene is
+// rendered at, per axis, so the measured GPU frame time stays within a budget. The renderer
+// draws into that corner of a full-size offscreen target and scales it up into the swapchain
+// image, so changing the scale never reallocates anything.
+//
+// GPU time is modelled as proportional to the pixel count (scale squared). Culling and the
+// upscale do not shrink with the scale, so the model overestimates the gain of going down;
+// the step limits below let the feedback loop settle instead of oscillating.
+
+typedef struct DynamicResolution {
+  float budgetMs;
+  float minScale;
+  float scale;      // next frame's scale, in [minScale, 1]
+  float fullResMs;  // smoothed GPU time extrapolated to scale 1; 0 until the first sample
+  uint32_t changes; // scale changes so far
+} DynamicResolution;
+
+void dynresInit(DynamicResolution *dr, float budgetMs, float minScale);
+// Feeds the GPU time of a finished frame that was rendered at `frameScale` (frames in flight
+// mean it is not necessarily the current scale) and updates `dr->scale`.
+void dynresUpdate(DynamicResolution *dr, float gpuMs, float frameScale);
+// `full` scaled by the current scale, at least 1x1.
+VkExtent2D dynresExtent(const DynamicResolution *dr, VkExtent2D full);
+
+#endif
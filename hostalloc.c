@@ -0,0 +1,286 @@
+#include "hostalloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct ArenaBlock {
+  ArenaBlock *next;
+  size_t size;
+  size_t used;
+  max_align_t data[];
+};
+
+static uintptr_t alignUp(uintptr_t value, size_t alignment) {
+  return (value + alignment - 1) & ~(uintptr_t)(alignment - 1);
+}
+
+void arenaInit(Arena *arena, size_t blockSize) {
+  *arena = (Arena){.blockSize = blockSize};
+}
+
+void *arenaPush(Arena *arena, size_t size, size_t alignment) {
+  for (;;) {
+    ArenaBlock *block = arena->current;
+    if (block) {
+      uintptr_t base = (uintptr_t)block->data;
+      uintptr_t start = alignUp(base + block->used, alignment);
+      if (start + size <= base + block->size) {
+        size_t end = start + size - base;
+        arena->used += end - block->used;
+        block->used = end;
+        if (arena->used > arena->peak) {
+          arena->peak = arena->used;
+        }
+        return (void *)start;
+      }
+      // Blocks kept by a reset are reused in order before growing.
+      if (block->next) {
+        arena->current = block->next;
+        continue;
+      }
+    }
+
+    size_t blockSize = arena->blockSize;
+    if (size + alignment > blockSize) {
+      blockSize = size + alignment;
+    }
+    ArenaBlock *fresh = malloc(sizeof(ArenaBlock) + blockSize);
+    if (fresh == NULL) {
+      fprintf(stderr, "Arena out of memory!\n");
+      exit(EXIT_FAILURE);
+    }
+    *fresh = (ArenaBlock){.size = blockSize};
+    if (block) {
+      block->next = fresh;
+    } else {
+      arena->first = fresh;
+    }
+    arena->current = fresh;
+    arena->reserved += blockSize;
+    arena->blockAllocations++;
+  }
+}
+
+void arenaReset(Arena *arena) {
+  for (ArenaBlock *block = arena->first; block; block = block->next) {
+    block->used = 0;
+  }
+  arena->current = arena->first;
+  arena->used = 0;
+}
+
+void arenaDestroy(Arena *arena) {
+  ArenaBlock *block = arena->first;
+  while (block) {
+    ArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+  *arena = (Arena){.blockSize = arena->blockSize};
+}
+
+// Sits directly in front of every pointer handed to the driver. Chunks start 16-byte aligned
+// and the user pointer is aligned up from chunk + header, so `offset` recovers the chunk.
+typedef struct HostHeader {
+  uint8_t scope;
+  uint8_t sizeClass; // HOST_SIZE_CLASSES: allocated with malloc
+  uint16_t unused;
+  uint32_t offset;
+  size_t size;
+} HostHeader;
+
+_Static_assert(sizeof(HostHeader) == 16, "chunk layout assumes a 16 byte header");
+
+#define HOST_MIN_CLASS_SIZE 32
+
+static size_t classSize(uint32_t sizeClass) {
+  return (size_t)HOST_MIN_CLASS_SIZE << sizeClass;
+}
+
+static HostHeader *headerOf(void *memory) {
+  return (HostHeader *)memory - 1;
+}
+
+static void trackLive(HostScopeStats *stats, size_t added, size_t removed) {
+  stats->liveBytes = stats->liveBytes + added - removed;
+  if (stats->liveBytes > stats->peakBytes) {
+    stats->peakBytes = stats->liveBytes;
+  }
+}
+
+static void *hostAlloc(HostAllocator *allocator, size_t size, size_t alignment,
+                       VkSystemAllocationScope scope) {
+  HostPool *pool = &allocator->pools[scope];
+  if (alignment < sizeof(HostHeader)) {
+    alignment = sizeof(HostHeader);
+  }
+  size_t needed = size + alignment; // header plus worst-case padding
+
+  uint32_t sizeClass = 0;
+  while (sizeClass < HOST_SIZE_CLASSES && classSize(sizeClass) < needed) {
+    sizeClass++;
+  }
+
+  char *chunk;
+  pthread_mutex_lock(&pool->mutex);
+  if (sizeClass == HOST_SIZE_CLASSES) {
+    chunk = malloc(needed);
+    if (chunk == NULL) {
+      pthread_mutex_unlock(&pool->mutex);
+      return NULL;
+    }
+    pool->stats.largeBytes += size;
+    if (pool->stats.largeBytes > pool->stats.largePeakBytes) {
+      pool->stats.largePeakBytes = pool->stats.largeBytes;
+    }
+  } else if (pool->freeLists[sizeClass]) {
+    chunk = pool->freeLists[sizeClass];
+    pool->freeLists[sizeClass] = *(void **)chunk;
+  } else {
+    chunk = arenaPush(&pool->arena, classSize(sizeClass), sizeof(HostHeader));
+  }
+  pool->stats.allocations++;
+  trackLive(&pool->stats, size, 0);
+  pthread_mutex_unlock(&pool->mutex);
+
+  char *memory = (char *)alignUp((uintptr_t)chunk + sizeof(HostHeader), alignment);
+  *headerOf(memory) = (HostHeader){.scope = (uint8_t)scope,
+                                   .sizeClass = (uint8_t)sizeClass,
+                                   .offset = (uint32_t)(memory - chunk),
+                                   .size = size};
+  return memory;
+}
+
+static void hostFree(HostAllocator *allocator, void *memory) {
+  HostHeader header = *headerOf(memory);
+  HostPool *pool = &allocator->pools[header.scope];
+  char *chunk = (char *)memory - header.offset;
+
+  pthread_mutex_lock(&pool->mutex);
+  if (header.sizeClass == HOST_SIZE_CLASSES) {
+    free(chunk);
+    pool->stats.largeBytes -= header.size;
+  } else {
+    *(void **)chunk = pool->freeLists[header.sizeClass];
+    pool->freeLists[header.sizeClass] = chunk;
+  }
+  pool->stats.frees++;
+  trackLive(&pool->stats, 0, header.size);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+static void *VKAPI_CALL allocationCallback(void *pUserData, size_t size, size_t alignment,
+                                           VkSystemAllocationScope scope) {
+  return hostAlloc(pUserData, size, alignment, scope);
+}
+
+static void *VKAPI_CALL reallocationCallback(void *pUserData, void *pOriginal, size_t size, size_t alignment,
+                                             VkSystemAllocationScope scope) {
+  HostAllocator *allocator = pUserData;
+  if (pOriginal == NULL) {
+    return hostAlloc(allocator, size, alignment, scope);
+  }
+  if (size == 0) {
+    hostFree(allocator, pOriginal);
+    return NULL;
+  }
+
+  // The alignment of a reallocation always matches the original, so the chunk can be kept
+  // whenever the new size still fits behind the existing offset.
+  HostHeader *header = headerOf(pOriginal);
+  if (header->scope == scope && header->sizeClass < HOST_SIZE_CLASSES &&
+      header->offset + size <= classSize(header->sizeClass)) {
+    HostPool *pool = &allocator->pools[scope];
+    pthread_mutex_lock(&pool->mutex);
+    pool->stats.reallocations++;
+    trackLive(&pool->stats, size, header->size);
+    pthread_mutex_unlock(&pool->mutex);
+    header->size = size;
+    return pOriginal;
+  }
+
+  void *memory = hostAlloc(allocator, size, alignment, scope);
+  if (memory == NULL) {
+    return NULL; // the original stays valid
+  }
+  memcpy(memory, pOriginal, size < header->size ? size : header->size);
+  hostFree(allocator, pOriginal);
+
+  HostPool *pool = &allocator->pools[scope];
+  pthread_mutex_lock(&pool->mutex);
+  pool->stats.reallocations++;
+  pthread_mutex_unlock(&pool->mutex);
+  return memory;
+}
+
+static void VKAPI_CALL freeCallback(void *pUserData, void *pMemory) {
+  if (pMemory) {
+    hostFree(pUserData, pMemory);
+  }
+}
+
+static void VKAPI_CALL internalAllocationCallback(void *pUserData, size_t size, VkInternalAllocationType type,
+                                                  VkSystemAllocationScope scope) {
+  (void)type;
+  HostPool *pool = &((HostAllocator *)pUserData)->pools[scope];
+  pthread_mutex_lock(&pool->mutex);
+  pool->stats.internalBytes += size;
+  if (pool->stats.internalBytes > pool->stats.internalPeakBytes) {
+    pool->stats.internalPeakBytes = pool->stats.internalBytes;
+  }
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+static void VKAPI_CALL internalFreeCallback(void *pUserData, size_t size, VkInternalAllocationType type,
+                                            VkSystemAllocationScope scope) {
+  (void)type;
+  HostPool *pool = &((HostAllocator *)pUserData)->pools[scope];
+  pthread_mutex_lock(&pool->mutex);
+  pool->stats.internalBytes -= size;
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+void hostAllocatorInit(HostAllocator *allocator) {
+  *allocator = (HostAllocator){.callbacks = {.pUserData = allocator,
+                                             .pfnAllocation = allocationCallback,
+                                             .pfnReallocation = reallocationCallback,
+                                             .pfnFree = freeCallback,
+                                             .pfnInternalAllocation = internalAllocationCallback,
+                                             .pfnInternalFree = internalFreeCallback}};
+
+  for (uint32_t i = 0; i < HOST_SCOPE_COUNT; i++) {
+    pthread_mutex_init(&allocator->pools[i].mutex, NULL);
+    // Command scope memory lives for one call; it only ever needs a small arena.
+    arenaInit(&allocator->pools[i].arena,
+              i == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND ? 16 * 1024 : 64 * 1024);
+  }
+}
+
+void hostAllocatorReport(HostAllocator *allocator, FILE *out) {
+  static const char *scopeNames[HOST_SCOPE_COUNT] = {"command", "object", "cache", "device", "instance"};
+
+  fprintf(out, "Host allocations   allocs  reallocs     frees  peak KiB  arena KiB  large peak KiB  "
+               "internal peak KiB\n");
+  for (uint32_t i = 0; i < HOST_SCOPE_COUNT; i++) {
+    HostPool *pool = &allocator->pools[i];
+    pthread_mutex_lock(&pool->mutex);
+    HostScopeStats stats = pool->stats;
+    size_t reserved = pool->arena.reserved;
+    pthread_mutex_unlock(&pool->mutex);
+
+    fprintf(out, "  %-10s %12llu %9llu %9llu %9.1f %10.1f %15.1f %18.1f\n", scopeNames[i],
+            (unsigned long long)stats.allocations, (unsigned long long)stats.reallocations,
+            (unsigned long long)stats.frees, stats.peakBytes / 1024.0, reserved / 1024.0,
+            stats.largePeakBytes / 1024.0, stats.internalPeakBytes / 1024.0);
+    if (stats.liveBytes) {
+      fprintf(out, "  %-10s %zu bytes still allocated\n", "", stats.liveBytes);
+    }
+  }
+}
+
+void hostAllocatorDestroy(HostAllocator *allocator) {
+  for (uint32_t i = 0; i < HOST_SCOPE_COUNT; i++) {
+    arenaDestroy(&allocator->pools[i].arena);
+    pthread_mutex_destroy(&allocator->pools[i].mutex);
+  }
+}
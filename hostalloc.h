@@ -0,0 +1,72 @@
+#ifndef HOSTALLOC_H
+#define HOSTALLOC_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vulkan/vulkan.h>
+
+// Host memory for the renderer. An Arena is a pointer-bump allocator over chained blocks that
+// is released all at once; resetting keeps its blocks, so work that repeats with the same
+// shape (swapchain recreation) stops touching the heap after the first round.
+//
+// HostAllocator implements VkAllocationCallbacks on top of one arena per allocation scope:
+// freed chunks go to per-size-class free lists of their scope instead of back to libc, so
+// short-lived command allocations never fragment device- or instance-lifetime ones.
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct Arena {
+  ArenaBlock *first;
+  ArenaBlock *current;
+  size_t blockSize;
+  size_t used;     // bytes handed out since the last reset
+  size_t peak;     // highest `used`
+  size_t reserved; // bytes held in blocks
+  uint32_t blockAllocations;
+} Arena;
+
+void arenaInit(Arena *arena, size_t blockSize);
+// Never fails; exits on out of memory like the rest of the renderer.
+void *arenaPush(Arena *arena, size_t size, size_t alignment);
+#define arenaPushArray(arena, type, count)                                                                  \
+  ((type *)arenaPush((arena), sizeof(type) * (count), _Alignof(type)))
+void arenaReset(Arena *arena);
+void arenaDestroy(Arena *arena);
+
+#define HOST_SCOPE_COUNT (VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1)
+#define HOST_SIZE_CLASSES 12 // 32 bytes .. 64 KiB; larger requests go straight to malloc
+
+typedef struct HostScopeStats {
+  uint64_t allocations;
+  uint64_t reallocations;
+  uint64_t frees;
+  size_t liveBytes; // as requested by the driver, excluding headers and rounding
+  size_t peakBytes;
+  size_t largeBytes; // part of liveBytes above the largest class, held outside the arena
+  size_t largePeakBytes;
+  size_t internalBytes; // driver-internal allocations reported through notifications
+  size_t internalPeakBytes;
+} HostScopeStats;
+
+typedef struct HostPool {
+  pthread_mutex_t mutex;
+  Arena arena;
+  void *freeLists[HOST_SIZE_CLASSES];
+  HostScopeStats stats;
+} HostPool;
+
+typedef struct HostAllocator {
+  VkAllocationCallbacks callbacks; // pass &callbacks as pAllocator
+  HostPool pools[HOST_SCOPE_COUNT];
+} HostAllocator;
+
+void hostAllocatorInit(HostAllocator *allocator);
+// Per-scope counters and peaks; live bytes at exit are reported as leaks.
+void hostAllocatorReport(HostAllocator *allocator, FILE *out);
+// Only once every object created with the callbacks has been destroyed.
+void hostAllocatorDestroy(HostAllocator *allocator);
+
+#endif
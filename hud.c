@@ -0,0 +1,544 @@
+#include "hud.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The atlas is a row-major grid of 8x8 cells: glyphs for ' ' through '_', then a solid cell.
+#define FIRST_GLYPH ' '
+#define GLYPH_COUNT 64
+#define SOLID_CELL GLYPH_COUNT
+#define CELL_SIZE 8
+#define ATLAS_COLUMNS 16
+#define ATLAS_WIDTH (ATLAS_COLUMNS * CELL_SIZE)
+#define ATLAS_HEIGHT (((GLYPH_COUNT + 1 + ATLAS_COLUMNS - 1) / ATLAS_COLUMNS) * CELL_SIZE)
+
+// 5x7 glyphs, one byte per row from the top, bit 4 the leftmost column.
+static const uint8_t FONT[GLYPH_COUNT][7] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // ' '
+    {0x04, 0x04, 0x04, 0x04, 0x00, 0x00, 0x04}, // !
+    {0x0A, 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00}, // "
+    {0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A}, // #
+    {0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04}, // $
+    {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03}, // %
+    {0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D}, // &
+    {0x0C, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00}, // '
+    {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02}, // (
+    {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08}, // )
+    {0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00}, // *
+    {0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00}, // +
+    {0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08}, // ,
+    {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00}, // -
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C}, // .
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}, // /
+    {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}, // 0
+    {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E}, // 1
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}, // 2
+    {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E}, // 3
+    {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}, // 4
+    {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E}, // 5
+    {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}, // 6
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}, // 7
+    {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}, // 8
+    {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}, // 9
+    {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00}, // :
+    {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08}, // ;
+    {0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02}, // <
+    {0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00}, // =
+    {0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08}, // >
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04}, // ?
+    {0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E}, // @
+    {0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11}, // A
+    {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E}, // B
+    {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E}, // C
+    {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C}, // D
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F}, // E
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10}, // F
+    {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F}, // G
+    {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, // H
+    {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}, // I
+    {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C}, // J
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}, // K
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F}, // L
+    {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11}, // M
+    {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}, // N
+    {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, // O
+    {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10}, // P
+    {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D}, // Q
+    {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11}, // R
+    {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E}, // S
+    {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, // T
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, // U
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04}, // V
+    {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A}, // W
+    {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11}, // X
+    {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04}, // Y
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F}, // Z
+    {0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E}, // [
+    {0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00}, // backslash
+    {0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E}, // ]
+    {0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00}, // ^
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F}, // _
+};
+
+typedef struct HudPushConstants {
+  float pixelToNdc[2];
+} HudPushConstants;
+
+static VkDeviceMemory allocate(Hud *hud, VkMemoryRequirements requirements,
+                               VkMemoryPropertyFlags properties) {
+  uint32_t memoryType = deviceCapsFindMemoryType(hud->caps, requirements.memoryTypeBits, properties);
+  VkMemoryAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                                    .allocationSize = requirements.size,
+                                    .memoryTypeIndex = memoryType};
+  VkDeviceMemory memory;
+  if (memoryType == UINT32_MAX ||
+      memoryBudgetAllocate(hud->budget, hud->device, &allocInfo, hud->pAllocator, &memory) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to allocate HUD memory!\n");
+    exit(EXIT_FAILURE);
+  }
+  return memory;
+}
+
+static VkBuffer createBuffer(Hud *hud, VkDeviceSize size, VkBufferUsageFlags usage, VkDeviceMemory *memory) {
+  VkBufferCreateInfo bufferInfo = {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                   .size = size,
+                                   .usage = usage,
+                                   .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
+  VkBuffer buffer;
+  if (vkCreateBuffer(hud->device, &bufferInfo, hud->pAllocator, &buffer) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create HUD buffer!\n");
+    exit(EXIT_FAILURE);
+  }
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(hud->device, buffer, &requirements);
+  *memory =
+      allocate(hud, requirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  vkBindBufferMemory(hud->device, buffer, *memory, 0);
+  return buffer;
+}
+
+// Rasterizes the font into the staging buffer and creates the atlas image it is copied to.
+static void createAtlas(Hud *hud) {
+  hud->stagingBuffer = createBuffer(hud, ATLAS_WIDTH * ATLAS_HEIGHT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                    &hud->stagingMemory);
+  uint8_t *pixels;
+  vkMapMemory(hud->device, hud->stagingMemory, 0, ATLAS_WIDTH * ATLAS_HEIGHT, 0, (void **)&pixels);
+  memset(pixels, 0, ATLAS_WIDTH * ATLAS_HEIGHT);
+  for (uint32_t cell = 0; cell <= SOLID_CELL; cell++) {
+    uint8_t *origin =
+        pixels + (cell / ATLAS_COLUMNS) * CELL_SIZE * ATLAS_WIDTH + (cell % ATLAS_COLUMNS) * CELL_SIZE;
+    for (uint32_t y = 0; y < CELL_SIZE; y++) {
+      for (uint32_t x = 0; x < CELL_SIZE; x++) {
+        bool set = cell == SOLID_CELL || (y < 7 && x < 5 && (FONT[cell][y] >> (4 - x) & 1));
+        origin[y * ATLAS_WIDTH + x] = set ? 255 : 0;
+      }
+    }
+  }
+  vkUnmapMemory(hud->device, hud->stagingMemory);
+
+  VkImageCreateInfo imageInfo = {.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                                 .imageType = VK_IMAGE_TYPE_2D,
+                                 .format = VK_FORMAT_R8_UNORM,
+                                 .extent = {ATLAS_WIDTH, ATLAS_HEIGHT, 1},
+                                 .mipLevels = 1,
+                                 .arrayLayers = 1,
+                                 .samples = VK_SAMPLE_COUNT_1_BIT,
+                                 .tiling = VK_IMAGE_TILING_OPTIMAL,
+                                 .usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                 .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                                 .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+  if (vkCreateImage(hud->device, &imageInfo, hud->pAllocator, &hud->atlas) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create HUD font atlas!\n");
+    exit(EXIT_FAILURE);
+  }
+  VkMemoryRequirements requirements;
+  vkGetImageMemoryRequirements(hud->device, hud->atlas, &requirements);
+  hud->atlasMemory = allocate(hud, requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  vkBindImageMemory(hud->device, hud->atlas, hud->atlasMemory, 0);
+
+  VkImageViewCreateInfo viewInfo = {.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                                    .image = hud->atlas,
+                                    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                                    .format = VK_FORMAT_R8_UNORM,
+                                    .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                    .subresourceRange.levelCount = 1,
+                                    .subresourceRange.layerCount = 1};
+  if (vkCreateImageView(hud->device, &viewInfo, hud->pAllocator, &hud->atlasView) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create HUD font atlas view!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void createRenderPass(Hud *hud, VkFormat format) {
+  // Loads what the frame left in the image and keeps it presentable.
+  VkAttachmentDescription colorAttachment = {.format = format,
+                                             .samples = VK_SAMPLE_COUNT_1_BIT,
+                                             .loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
+                                             .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                                             .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                                             .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                                             .initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                                             .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+  VkAttachmentReference colorAttachmentRef = {.attachment = 0,
+                                              .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  VkSubpassDescription subpass = {.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                  .colorAttachmentCount = 1,
+                                  .pColorAttachments = &colorAttachmentRef};
+  // The image was last written by the scene pass or the upscale blit, and may have been read
+  // by a readback copy.
+  VkSubpassDependency dependency = {
+      .srcSubpass = VK_SUBPASS_EXTERNAL,
+      .dstSubpass = 0,
+      .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+      .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+      .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT};
+  VkRenderPassCreateInfo renderPassInfo = {.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+                                           .attachmentCount = 1,
+                                           .pAttachments = &colorAttachment,
+                                           .subpassCount = 1,
+                                           .pSubpasses = &subpass,
+                                           .dependencyCount = 1,
+                                           .pDependencies = &dependency};
+  if (vkCreateRenderPass(hud->device, &renderPassInfo, hud->pAllocator, &hud->renderPass) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create HUD render pass!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void createPipeline(Hud *hud, VkShaderModule vertShader, VkShaderModule fragShader) {
+  VkDescriptorSetLayoutBinding binding = {0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+                                          VK_SHADER_STAGE_FRAGMENT_BIT, NULL};
+  VkDescriptorSetLayoutCreateInfo setInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+                                             .bindingCount = 1,
+                                             .pBindings = &binding};
+  if (vkCreateDescriptorSetLayout(hud->device, &setInfo, hud->pAllocator, &hud->setLayout) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create HUD descriptor set layout!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  VkPushConstantRange pushConstants = {VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(HudPushConstants)};
+  VkPipelineLayoutCreateInfo layoutInfo = {.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                                           .setLayoutCount = 1,
+                                           .pSetLayouts = &hud->setLayout,
+                                           .pushConstantRangeCount = 1,
+                                           .pPushConstantRanges = &pushConstants};
+  if (vkCreatePipelineLayout(hud->device, &layoutInfo, hud->pAllocator, &hud->pipelineLayout) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create HUD pipeline layout!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  VkPipelineShaderStageCreateInfo stages[] = {
+      {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+       .stage = VK_SHADER_STAGE_VERTEX_BIT,
+       .module = vertShader,
+       .pName = "main"},
+      {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+       .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+       .module = fragShader,
+       .pName = "main"}};
+  VkVertexInputBindingDescription bindingDescription = {0, sizeof(HudVertex), VK_VERTEX_INPUT_RATE_VERTEX};
+  VkVertexInputAttributeDescription attributes[] = {
+      {0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(HudVertex, position)},
+      {1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(HudVertex, uv)},
+      {2, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(HudVertex, color)}};
+  VkPipelineVertexInputStateCreateInfo vertexInput = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+      .vertexBindingDescriptionCount = 1,
+      .pVertexBindingDescriptions = &bindingDescription,
+      .vertexAttributeDescriptionCount = 3,
+      .pVertexAttributeDescriptions = attributes};
+  VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+      .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST};
+  VkPipelineViewportStateCreateInfo viewportState = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO, .viewportCount = 1, .scissorCount = 1};
+  VkPipelineRasterizationStateCreateInfo rasterizer = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+      .polygonMode = VK_POLYGON_MODE_FILL,
+      .cullMode = VK_CULL_MODE_NONE,
+      .frontFace = VK_FRONT_FACE_CLOCKWISE,
+      .lineWidth = 1.0f};
+  VkPipelineMultisampleStateCreateInfo multisampling = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+      .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT};
+  VkPipelineColorBlendAttachmentState blend = {
+      .blendEnable = VK_TRUE,
+      .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+      .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+      .colorBlendOp = VK_BLEND_OP_ADD,
+      .srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+      .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+      .alphaBlendOp = VK_BLEND_OP_ADD,
+      .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT |
+                        VK_COLOR_COMPONENT_A_BIT};
+  VkPipelineColorBlendStateCreateInfo colorBlending = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+      .attachmentCount = 1,
+      .pAttachments = &blend};
+  VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+  VkPipelineDynamicStateCreateInfo dynamicState = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+      .dynamicStateCount = 2,
+      .pDynamicStates = dynamicStates};
+  VkGraphicsPipelineCreateInfo pipelineInfo = {.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                                               .stageCount = 2,
+                                               .pStages = stages,
+                                               .pVertexInputState = &vertexInput,
+                                               .pInputAssemblyState = &inputAssembly,
+                                               .pViewportState = &viewportState,
+                                               .pRasterizationState = &rasterizer,
+                                               .pMultisampleState = &multisampling,
+                                               .pColorBlendState = &colorBlending,
+                                               .pDynamicState = &dynamicState,
+                                               .layout = hud->pipelineLayout,
+                                               .renderPass = hud->renderPass,
+                                               .subpass = 0,
+                                               .basePipelineIndex = -1};
+  if (vkCreateGraphicsPipelines(hud->device, VK_NULL_HANDLE, 1, &pipelineInfo, hud->pAllocator,
+                                &hud->pipeline) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create HUD pipeline!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void createDescriptorSet(Hud *hud) {
+  // Nearest filtering keeps the glyphs sharp at integer scales.
+  VkSamplerCreateInfo samplerInfo = {.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+                                     .magFilter = VK_FILTER_NEAREST,
+                                     .minFilter = VK_FILTER_NEAREST,
+                                     .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+                                     .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                                     .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                                     .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE};
+  if (vkCreateSampler(hud->device, &samplerInfo, hud->pAllocator, &hud->sampler) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create HUD sampler!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  VkDescriptorPoolSize poolSize = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1};
+  VkDescriptorPoolCreateInfo poolInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                                         .maxSets = 1,
+                                         .poolSizeCount = 1,
+                                         .pPoolSizes = &poolSize};
+  if (vkCreateDescriptorPool(hud->device, &poolInfo, hud->pAllocator, &hud->descriptorPool) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create HUD descriptor pool!\n");
+    exit(EXIT_FAILURE);
+  }
+  VkDescriptorSetAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                                           .descriptorPool = hud->descriptorPool,
+                                           .descriptorSetCount = 1,
+                                           .pSetLayouts = &hud->setLayout};
+  if (vkAllocateDescriptorSets(hud->device, &allocInfo, &hud->set) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to allocate HUD descriptor set!\n");
+    exit(EXIT_FAILURE);
+  }
+  VkDescriptorImageInfo imageInfo = {hud->sampler, hud->atlasView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+  VkWriteDescriptorSet write = {.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                .dstSet = hud->set,
+                                .dstBinding = 0,
+                                .descriptorCount = 1,
+                                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                .pImageInfo = &imageInfo};
+  vkUpdateDescriptorSets(hud->device, 1, &write, 0, NULL);
+}
+
+static void createFramebuffers(Hud *hud, const VkImageView *imageViews, uint32_t imageCount,
+                               VkExtent2D extent) {
+  hud->extent = extent;
+  // Integer scales keep the glyphs' pixels square; 1 is only for windows too small for more.
+  hud->scale = extent.height >= 1440 ? 3.0f : extent.height >= 480 ? 2.0f : 1.0f;
+  hud->framebufferCount = imageCount;
+  hud->framebuffers = arenaPushArray(&hud->framebufferArena, VkFramebuffer, imageCount);
+  for (uint32_t i = 0; i < imageCount; i++) {
+    VkFramebufferCreateInfo framebufferInfo = {.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+                                               .renderPass = hud->renderPass,
+                                               .attachmentCount = 1,
+                                               .pAttachments = &imageViews[i],
+                                               .width = extent.width,
+                                               .height = extent.height,
+                                               .layers = 1};
+    if (vkCreateFramebuffer(hud->device, &framebufferInfo, hud->pAllocator, &hud->framebuffers[i]) !=
+        VK_SUCCESS) {
+      fprintf(stderr, "Failed to create HUD framebuffer!\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+static void destroyFramebuffers(Hud *hud) {
+  for (uint32_t i = 0; i < hud->framebufferCount; i++) {
+    vkDestroyFramebuffer(hud->device, hud->framebuffers[i], hud->pAllocator);
+  }
+  hud->framebufferCount = 0;
+  arenaReset(&hud->framebufferArena);
+}
+
+void hudCreate(Hud *hud, const DeviceCaps *caps, VkDevice device, const VkAllocationCallbacks *pAllocator,
+               MemoryBudget *budget, VkShaderModule vertShader, VkShaderModule fragShader, VkFormat format,
+               uint32_t frameCount, const VkImageView *imageViews, uint32_t imageCount, VkExtent2D extent) {
+  *hud = (Hud){
+      .caps = caps, .device = device, .pAllocator = pAllocator, .budget = budget, .frameCount = frameCount};
+  arenaInit(&hud->framebufferArena, 256);
+
+  createAtlas(hud);
+  createRenderPass(hud, format);
+  createPipeline(hud, vertShader, fragShader);
+  createDescriptorSet(hud);
+  createFramebuffers(hud, imageViews, imageCount, extent);
+
+  VkDeviceSize size = sizeof(HudVertex) * 6 * HUD_MAX_QUADS * frameCount;
+  hud->vertexBuffer = createBuffer(hud, size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &hud->vertexMemory);
+  vkMapMemory(device, hud->vertexMemory, 0, size, 0, (void **)&hud->vertices);
+}
+
+void hudResize(Hud *hud, const VkImageView *imageViews, uint32_t imageCount, VkExtent2D extent) {
+  destroyFramebuffers(hud);
+  createFramebuffers(hud, imageViews, imageCount, extent);
+}
+
+void hudBegin(Hud *hud, uint32_t frameIndex) {
+  hud->frameVertices = hud->vertices + (size_t)frameIndex * 6 * HUD_MAX_QUADS;
+  hud->quadCount = 0;
+  hud->droppedQuads = 0;
+}
+
+// Texture coordinates are in atlas pixels from the top-left of `cell`.
+static void pushQuad(Hud *hud, float x, float y, float width, float height, uint32_t cell, float u0, float v0,
+                     float u1, float v1, uint32_t color) {
+  if (hud->quadCount == HUD_MAX_QUADS) {
+    hud->droppedQuads++;
+    return;
+  }
+  float cellU = (float)(cell % ATLAS_COLUMNS * CELL_SIZE), cellV = (float)(cell / ATLAS_COLUMNS * CELL_SIZE);
+  float s0 = (cellU + u0) / ATLAS_WIDTH, s1 = (cellU + u1) / ATLAS_WIDTH;
+  float t0 = (cellV + v0) / ATLAS_HEIGHT, t1 = (cellV + v1) / ATLAS_HEIGHT;
+  HudVertex *v = hud->frameVertices + 6 * hud->quadCount++;
+  v[0] = (HudVertex){{x, y}, {s0, t0}, color};
+  v[1] = (HudVertex){{x + width, y}, {s1, t0}, color};
+  v[2] = (HudVertex){{x, y + height}, {s0, t1}, color};
+  v[3] = v[2];
+  v[4] = v[1];
+  v[5] = (HudVertex){{x + width, y + height}, {s1, t1}, color};
+}
+
+void hudRect(Hud *hud, float x, float y, float width, float height, uint32_t color) {
+  // Sampled at the centre of the solid cell, away from its neighbours.
+  float middle = CELL_SIZE * 0.5f;
+  pushQuad(hud, x, y, width, height, SOLID_CELL, middle, middle, middle, middle, color);
+}
+
+float hudText(Hud *hud, float x, float y, uint32_t color, const char *format, ...) {
+  char text[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+
+  float advance = HUD_GLYPH_WIDTH * hud->scale;
+  for (const char *c = text; *c; c++, x += advance) {
+    int glyph = toupper((unsigned char)*c) - FIRST_GLYPH;
+    if (glyph == 0) {
+      continue;
+    }
+    if (glyph < 0 || glyph >= GLYPH_COUNT) {
+      glyph = '?' - FIRST_GLYPH;
+    }
+    // The spacing column and row are part of the quad, so glyphs tile without gaps.
+    pushQuad(hud, x, y, advance, (HUD_LINE_HEIGHT - 1) * hud->scale, (uint32_t)glyph, 0.0f, 0.0f,
+             HUD_GLYPH_WIDTH, HUD_LINE_HEIGHT - 1, color);
+  }
+  return x;
+}
+
+void hudGraph(Hud *hud, float x, float y, float width, float height, const float *values, uint32_t count,
+              uint32_t first, float maxValue, uint32_t color) {
+  hudRect(hud, x, y, width, height, HUD_RGBA(0, 0, 0, 160));
+  if (count == 0 || maxValue <= 0.0f) {
+    return;
+  }
+  float barWidth = width / (float)count;
+  for (uint32_t i = 0; i < count; i++) {
+    float value = values[(first + i) % count];
+    float barHeight = value >= maxValue ? height : height * value / maxValue;
+    if (barHeight > 0.0f) {
+      hudRect(hud, x + barWidth * (float)i, y + height - barHeight, barWidth, barHeight, color);
+    }
+  }
+}
+
+void hudRecord(Hud *hud, VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t imageIndex) {
+  if (!hud->atlasUploaded) {
+    VkImageMemoryBarrier toTransfer = {.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                                       .srcAccessMask = 0,
+                                       .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                                       .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                                       .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                       .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                       .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                       .image = hud->atlas,
+                                       .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                       .subresourceRange.levelCount = 1,
+                                       .subresourceRange.layerCount = 1};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         0, NULL, 0, NULL, 1, &toTransfer);
+    VkBufferImageCopy region = {
+        .imageSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1},
+        .imageExtent = {ATLAS_WIDTH, ATLAS_HEIGHT, 1}};
+    vkCmdCopyBufferToImage(commandBuffer, hud->stagingBuffer, hud->atlas,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    VkImageMemoryBarrier toShader = toTransfer;
+    toShader.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toShader.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    toShader.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    toShader.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         0, 0, NULL, 0, NULL, 1, &toShader);
+    hud->atlasUploaded = true;
+  }
+  if (hud->quadCount == 0) {
+    return;
+  }
+
+  VkRenderPassBeginInfo renderPassInfo = {.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+                                          .renderPass = hud->renderPass,
+                                          .framebuffer = hud->framebuffers[imageIndex],
+                                          .renderArea.extent = hud->extent};
+  vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+  VkViewport viewport = {0.0f, 0.0f, (float)hud->extent.width, (float)hud->extent.height, 0.0f, 1.0f};
+  VkRect2D scissor = {{0, 0}, hud->extent};
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, hud->pipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, hud->pipelineLayout, 0, 1,
+                          &hud->set, 0, NULL);
+  VkDeviceSize offset = sizeof(HudVertex) * 6 * HUD_MAX_QUADS * frameIndex;
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, &hud->vertexBuffer, &offset);
+  HudPushConstants pushConstants = {{2.0f / (float)hud->extent.width, 2.0f / (float)hud->extent.height}};
+  vkCmdPushConstants(commandBuffer, hud->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushConstants),
+                     &pushConstants);
+  vkCmdDraw(commandBuffer, 6 * hud->quadCount, 1, 0, 0);
+  vkCmdEndRenderPass(commandBuffer);
+}
+
+void hudDestroy(Hud *hud) {
+  destroyFramebuffers(hud);
+  arenaDestroy(&hud->framebufferArena);
+  vkUnmapMemory(hud->device, hud->vertexMemory);
+  vkDestroyBuffer(hud->device, hud->vertexBuffer, hud->pAllocator);
+  memoryBudgetFree(hud->budget, hud->device, hud->vertexMemory, hud->pAllocator);
+  vkDestroyBuffer(hud->device, hud->stagingBuffer, hud->pAllocator);
+  memoryBudgetFree(hud->budget, hud->device, hud->stagingMemory, hud->pAllocator);
+  vkDestroyDescriptorPool(hud->device, hud->descriptorPool, hud->pAllocator);
+  vkDestroySampler(hud->device, hud->sampler, hud->pAllocator);
+  vkDestroyImageView(hud->device, hud->atlasView, hud->pAllocator);
+  vkDestroyImage(hud->device, hud->atlas, hud->pAllocator);
+  memoryBudgetFree(hud->budget, hud->device, hud->atlasMemory, hud->pAllocator);
+  vkDestroyPipeline(hud->device, hud->pipeline, hud->pAllocator);
+  vkDestroyPipelineLayout(hud->device, hud->pipelineLayout, hud->pAllocator);
+  vkDestroyDescriptorSetLayout(hud->device, hud->setLayout, hud->pAllocator);
+  vkDestroyRenderPass(hud->device, hud->renderPass, hud->pAllocator);
+}
@@ -0,0 +1,92 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "devicecaps.h"
+#include "hostalloc.h"
+#include "membudget.h"
+
+// On-screen overlay: text, filled rectangles and bar graphs, drawn over the finished
+// swapchain image. Everything is a textured quad from one atlas (a baked 5x7 bitmap font and
+// a solid cell) written into a per-frame slice of one host-visible vertex buffer, so the
+// whole HUD is a single draw call in its own render pass.
+//
+// Positions are in pixels from the top-left corner. Text is ASCII; lowercase is drawn as
+// uppercase and anything the font lacks as '?'.
+
+#define HUD_MAX_QUADS 4096
+#define HUD_GLYPH_WIDTH 6 // advance in atlas pixels, including spacing
+#define HUD_LINE_HEIGHT 9
+
+// Packed as VK_FORMAT_R8G8B8A8_UNORM.
+#define HUD_RGBA(r, g, b, a) ((uint32_t)(r) | (uint32_t)(g) << 8 | (uint32_t)(b) << 16 | (uint32_t)(a) << 24)
+
+typedef struct HudVertex {
+  float position[2];
+  float uv[2];
+  uint32_t color;
+} HudVertex;
+
+typedef struct Hud {
+  const DeviceCaps *caps;
+  VkDevice device;
+  const VkAllocationCallbacks *pAllocator;
+  MemoryBudget *budget;
+  uint32_t frameCount;
+  float scale; // screen pixels per atlas pixel; follows the extent
+
+  VkRenderPass renderPass;
+  VkDescriptorSetLayout setLayout;
+  VkPipelineLayout pipelineLayout;
+  VkPipeline pipeline;
+  VkDescriptorPool descriptorPool;
+  VkDescriptorSet set;
+  VkSampler sampler;
+
+  VkImage atlas;
+  VkDeviceMemory atlasMemory;
+  VkImageView atlasView;
+  VkBuffer stagingBuffer; // atlas pixels, copied on the first hudRecord()
+  VkDeviceMemory stagingMemory;
+  bool atlasUploaded;
+
+  VkBuffer vertexBuffer; // HUD_MAX_QUADS quads per frame in flight
+  VkDeviceMemory vertexMemory;
+  HudVertex *vertices; // persistently mapped
+  HudVertex *frameVertices; // slice being filled since hudBegin()
+  uint32_t quadCount;
+  uint32_t droppedQuads; // beyond HUD_MAX_QUADS in the current frame
+
+  Arena framebufferArena; // reset on resize
+  VkFramebuffer *framebuffers;
+  uint32_t framebufferCount;
+  VkExtent2D extent;
+} Hud;
+
+// Draws into `imageViews` (the swapchain images, left in PRESENT_SRC layout by the frame)
+// and leaves them in PRESENT_SRC layout. The font is scaled up with the extent.
+void hudCreate(Hud *hud, const DeviceCaps *caps, VkDevice device, const VkAllocationCallbacks *pAllocator,
+               MemoryBudget *budget, VkShaderModule vertShader, VkShaderModule fragShader, VkFormat format,
+               uint32_t frameCount, const VkImageView *imageViews, uint32_t imageCount, VkExtent2D extent);
+// Swapchain recreation: the device must be idle.
+void hudResize(Hud *hud, const VkImageView *imageViews, uint32_t imageCount, VkExtent2D extent);
+
+// Starts filling frame `frameIndex`'s vertices; its previous use must have completed.
+void hudBegin(Hud *hud, uint32_t frameIndex);
+void hudRect(Hud *hud, float x, float y, float width, float height, uint32_t color);
+// Returns the x after the last character.
+float hudText(Hud *hud, float x, float y, uint32_t color, const char *format, ...)
+    __attribute__((format(printf, 5, 6)));
+// One bar per value, oldest first starting at `values[first]`, over a translucent
+// background. Bars are scaled so `maxValue` fills the height; taller ones are clipped.
+void hudGraph(Hud *hud, float x, float y, float width, float height, const float *values, uint32_t count,
+              uint32_t first, float maxValue, uint32_t color);
+// Records the HUD render pass with one draw. Does nothing if no quad was added.
+void hudRecord(Hud *hud, VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t imageIndex);
+void hudDestroy(Hud *hud);
+
+#endif
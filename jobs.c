@@ -0,0 +1,422 @@
+#include "jobs.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define cpuRelax() _mm_pause()
+#else
+#define cpuRelax() ((void)0)
+#endif
+
+// Deque capacity per thread; a full deque runs the job inline instead. A thread's pool slots
+// are held by its queued jobs plus at most one per thread being taken, so twice the deque is
+// enough as long as there are no more threads than deque entries.
+#define JOB_DEQUE_CAPACITY 4096u
+#define JOB_POOL_CAPACITY (2u * JOB_DEQUE_CAPACITY)
+#define JOB_SPIN_COUNT 64
+
+typedef struct Job {
+  JobFunc func;
+  JobRangeFunc rangeFunc;
+  void *data;
+  uint32_t begin;
+  uint32_t end;
+  uint32_t grainSize;
+  JobCounter *counter;
+} Job;
+
+// A queued job. The thread that takes it copies the job out and frees the slot before running
+// it, so the owner can reuse the slot while the job is still running elsewhere.
+typedef struct JobSlot {
+  Job job;
+  atomic_bool busy;
+} JobSlot;
+
+struct JobContinuation {
+  JobContinuation *next;
+  JobCounter *counter;
+  uint32_t count;
+  JobDecl jobs[];
+};
+
+// Chase-Lev deque (Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models").
+typedef struct JobDeque {
+  _Alignas(64) atomic_llong top;
+  _Alignas(64) atomic_llong bottom;
+  _Atomic(JobSlot *) buffer[JOB_DEQUE_CAPACITY];
+} JobDeque;
+
+typedef struct JobThread {
+  JobDeque deque;
+  JobSlot pool[JOB_POOL_CAPACITY];
+  uint32_t poolNext;
+  uint32_t stealSeed;
+  pthread_t handle;
+  JobSystem *js;
+  uint32_t index;
+} JobThread;
+
+struct JobSystem {
+  uint32_t threadCount;
+  JobThread *threads;
+  atomic_bool quit;
+  atomic_int queued;
+  atomic_int sleeping;
+  pthread_mutex_t sleepMutex;
+  pthread_cond_t sleepCond;
+};
+
+static _Thread_local JobThread *tlsThread = NULL;
+
+static bool dequePush(JobDeque *d, JobSlot *slot) {
+  long long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+  long long t = atomic_load_explicit(&d->top, memory_order_acquire);
+  if (b - t >= (long long)JOB_DEQUE_CAPACITY) {
+    return false;
+  }
+  atomic_store_explicit(&d->buffer[b & (JOB_DEQUE_CAPACITY - 1)], slot, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+  return true;
+}
+
+static JobSlot *dequePop(JobDeque *d) {
+  long long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  long long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+  if (t > b) {
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return NULL;
+  }
+
+  JobSlot *slot = atomic_load_explicit(&d->buffer[b & (JOB_DEQUE_CAPACITY - 1)], memory_order_relaxed);
+  if (t == b) {
+    // Last element: race against thieves for it.
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, memory_order_seq_cst,
+                                                 memory_order_relaxed)) {
+      slot = NULL;
+    }
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+  }
+  return slot;
+}
+
+static JobSlot *dequeSteal(JobDeque *d) {
+  long long t = atomic_load_explicit(&d->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  long long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+  if (t >= b) {
+    return NULL;
+  }
+
+  JobSlot *slot = atomic_load_explicit(&d->buffer[t & (JOB_DEQUE_CAPACITY - 1)], memory_order_relaxed);
+  if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+    return NULL;
+  }
+  return slot;
+}
+
+// Only the owning thread allocates from its pool; any thread frees.
+static JobSlot *allocSlot(JobThread *thread) {
+  for (uint32_t i = 0; i < JOB_POOL_CAPACITY; i++) {
+    JobSlot *slot = &thread->pool[thread->poolNext++ & (JOB_POOL_CAPACITY - 1)];
+    if (!atomic_load_explicit(&slot->busy, memory_order_acquire)) {
+      atomic_store_explicit(&slot->busy, true, memory_order_relaxed);
+      return slot;
+    }
+  }
+  fprintf(stderr, "Job pool exhausted!\n");
+  exit(EXIT_FAILURE);
+}
+
+static void freeSlot(JobSlot *slot) { atomic_store_explicit(&slot->busy, false, memory_order_release); }
+
+static void wakeWorkers(JobSystem *js, int count) {
+  atomic_fetch_add(&js->queued, count);
+  if (atomic_load(&js->sleeping) > 0) {
+    pthread_mutex_lock(&js->sleepMutex);
+    if (count > 1) {
+      pthread_cond_broadcast(&js->sleepCond);
+    } else {
+      pthread_cond_signal(&js->sleepCond);
+    }
+    pthread_mutex_unlock(&js->sleepMutex);
+  }
+}
+
+static void runJob(JobSystem *js, Job job);
+
+static void pushJob(JobSystem *js, const Job *job) {
+  JobSlot *slot = allocSlot(tlsThread);
+  slot->job = *job;
+  if (!dequePush(&tlsThread->deque, slot)) {
+    freeSlot(slot);
+    runJob(js, *job);
+    return;
+  }
+  wakeWorkers(js, 1);
+}
+
+static void pushDecls(JobSystem *js, const JobDecl *jobs, uint32_t count, JobCounter *counter) {
+  for (uint32_t i = 0; i < count; i++) {
+    pushJob(js, &(Job){.func = jobs[i].func, .data = jobs[i].data, .counter = counter});
+  }
+}
+
+static void counterLock(JobCounter *counter) {
+  while (atomic_flag_test_and_set_explicit(&counter->lock, memory_order_acquire)) {
+    cpuRelax();
+  }
+}
+
+static void counterUnlock(JobCounter *counter) { atomic_flag_clear_explicit(&counter->lock, memory_order_release); }
+
+static void counterDecrement(JobSystem *js, JobCounter *counter) {
+  int value = atomic_load(&counter->value);
+  while (value > 1) {
+    if (atomic_compare_exchange_weak(&counter->value, &value, value - 1)) {
+      return;
+    }
+  }
+
+  // Possibly the last job: the counter only reaches zero under its lock, so a waiter that
+  // takes the lock afterwards knows nobody touches the counter any more (it usually lives on
+  // the waiter's stack).
+  JobContinuation *continuation = NULL;
+  counterLock(counter);
+  if (atomic_fetch_sub(&counter->value, 1) == 1) {
+    continuation = counter->continuations;
+    counter->continuations = NULL;
+  }
+  counterUnlock(counter);
+
+  while (continuation) {
+    JobContinuation *next = continuation->next;
+    pushDecls(js, continuation->jobs, continuation->count, continuation->counter);
+    free(continuation);
+    continuation = next;
+  }
+}
+
+// `job` is a copy: once the function has run, the job may be reused and its counter gone.
+static void runJob(JobSystem *js, Job job) {
+  if (job.rangeFunc) {
+    // Keep halving: the upper half goes back on the deque for thieves.
+    while (job.end - job.begin > job.grainSize) {
+      uint32_t mid = job.begin + (job.end - job.begin) / 2;
+      Job split = job;
+      split.begin = mid;
+      if (job.counter) {
+        atomic_fetch_add(&job.counter->value, 1);
+      }
+      job.end = mid;
+      pushJob(js, &split);
+    }
+    job.rangeFunc(job.data, job.begin, job.end);
+  } else {
+    job.func(job.data);
+  }
+
+  if (job.counter) {
+    counterDecrement(js, job.counter);
+  }
+}
+
+static void executeJob(JobSystem *js, JobSlot *slot) {
+  Job job = slot->job;
+  freeSlot(slot);
+  runJob(js, job);
+}
+
+static JobSlot *findJob(JobSystem *js) {
+  JobThread *self = tlsThread;
+  JobSlot *slot = dequePop(&self->deque);
+  if (slot) {
+    atomic_fetch_sub(&js->queued, 1);
+    return slot;
+  }
+
+  if (js->threadCount == 1) {
+    return NULL;
+  }
+
+  // xorshift to pick a victim so thieves do not all hammer the same deque.
+  uint32_t seed = self->stealSeed;
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  self->stealSeed = seed;
+
+  for (uint32_t i = 0; i < js->threadCount; i++) {
+    JobThread *victim = &js->threads[(seed + i) % js->threadCount];
+    if (victim == self) {
+      continue;
+    }
+    slot = dequeSteal(&victim->deque);
+    if (slot) {
+      atomic_fetch_sub(&js->queued, 1);
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+static void *workerMain(void *arg) {
+  JobThread *thread = arg;
+  JobSystem *js = thread->js;
+  tlsThread = thread;
+
+  int spins = 0;
+  while (!atomic_load_explicit(&js->quit, memory_order_acquire)) {
+    JobSlot *slot = findJob(js);
+    if (slot) {
+      executeJob(js, slot);
+      spins = 0;
+      continue;
+    }
+
+    if (++spins < JOB_SPIN_COUNT) {
+      cpuRelax();
+      continue;
+    }
+    if (spins < 2 * JOB_SPIN_COUNT) {
+      sched_yield();
+      continue;
+    }
+
+    pthread_mutex_lock(&js->sleepMutex);
+    atomic_fetch_add(&js->sleeping, 1);
+    while (atomic_load(&js->queued) <= 0 && !atomic_load(&js->quit)) {
+      pthread_cond_wait(&js->sleepCond, &js->sleepMutex);
+    }
+    atomic_fetch_sub(&js->sleeping, 1);
+    pthread_mutex_unlock(&js->sleepMutex);
+    spins = 0;
+  }
+
+  return NULL;
+}
+
+JobSystem *jobSystemCreate(uint32_t workerCount) {
+  if (workerCount == JOB_WORKERS_AUTO) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    workerCount = cpus > 1 ? (uint32_t)cpus - 1 : 0;
+  }
+  if (workerCount >= JOB_DEQUE_CAPACITY) {
+    fprintf(stderr, "Too many job workers: %u!\n", workerCount);
+    exit(EXIT_FAILURE);
+  }
+
+  JobSystem *js = calloc(1, sizeof(JobSystem));
+  js->threadCount = workerCount + 1;
+  js->threads = aligned_alloc(64, sizeof(JobThread) * js->threadCount);
+  memset(js->threads, 0, sizeof(JobThread) * js->threadCount);
+  pthread_mutex_init(&js->sleepMutex, NULL);
+  pthread_cond_init(&js->sleepCond, NULL);
+
+  for (uint32_t i = 0; i < js->threadCount; i++) {
+    js->threads[i].js = js;
+    js->threads[i].index = i;
+    js->threads[i].stealSeed = 0x9E3779B9u * (i + 1);
+  }
+
+  tlsThread = &js->threads[0];
+  for (uint32_t i = 1; i < js->threadCount; i++) {
+    if (pthread_create(&js->threads[i].handle, NULL, workerMain, &js->threads[i]) != 0) {
+      fprintf(stderr, "Failed to create job worker thread!\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  return js;
+}
+
+void jobSystemDestroy(JobSystem *js) {
+  pthread_mutex_lock(&js->sleepMutex);
+  atomic_store(&js->quit, true);
+  pthread_cond_broadcast(&js->sleepCond);
+  pthread_mutex_unlock(&js->sleepMutex);
+
+  for (uint32_t i = 1; i < js->threadCount; i++) {
+    pthread_join(js->threads[i].handle, NULL);
+  }
+
+  if (tlsThread == &js->threads[0]) {
+    tlsThread = NULL;
+  }
+  pthread_cond_destroy(&js->sleepCond);
+  pthread_mutex_destroy(&js->sleepMutex);
+  free(js->threads);
+  free(js);
+}
+
+uint32_t jobSystemThreadCount(const JobSystem *js) { return js->threadCount; }
+
+void jobRun(JobSystem *js, const JobDecl *jobs, uint32_t count, JobCounter *counter) {
+  if (counter) {
+    atomic_fetch_add(&counter->value, (int)count);
+  }
+  pushDecls(js, jobs, count, counter);
+}
+
+void jobRunAfter(JobSystem *js, JobCounter *dependency, const JobDecl *jobs, uint32_t count,
+                 JobCounter *counter) {
+  if (counter) {
+    atomic_fetch_add(&counter->value, (int)count);
+  }
+
+  counterLock(dependency);
+  if (atomic_load(&dependency->value) == 0) {
+    counterUnlock(dependency);
+    pushDecls(js, jobs, count, counter);
+    return;
+  }
+
+  JobContinuation *continuation = malloc(sizeof(JobContinuation) + sizeof(JobDecl) * count);
+  continuation->counter = counter;
+  continuation->count = count;
+  memcpy(continuation->jobs, jobs, sizeof(JobDecl) * count);
+  continuation->next = dependency->continuations;
+  dependency->continuations = continuation;
+  counterUnlock(dependency);
+}
+
+void jobParallelFor(JobSystem *js, uint32_t count, uint32_t grainSize, JobRangeFunc func, void *data,
+                    JobCounter *counter) {
+  if (count == 0) {
+    return;
+  }
+  if (counter) {
+    atomic_fetch_add(&counter->value, 1);
+  }
+
+  pushJob(js, &(Job){.rangeFunc = func,
+                     .data = data,
+                     .begin = 0,
+                     .end = count,
+                     .grainSize = grainSize ? grainSize : 1,
+                     .counter = counter});
+}
+
+void jobWait(JobSystem *js, JobCounter *counter) {
+  while (atomic_load_explicit(&counter->value, memory_order_acquire) > 0) {
+    JobSlot *slot = findJob(js);
+    if (slot) {
+      executeJob(js, slot);
+    } else {
+      cpuRelax();
+    }
+  }
+
+  counterLock(counter);
+  counterUnlock(counter);
+}
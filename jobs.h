@@ -0,0 +1,53 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Work-stealing job system. Every thread (workers plus the thread that created the system)
+// owns a deque: it pushes and pops at the bottom, idle threads steal from the top.
+// Completion is tracked with counters; waiting on a counter runs other jobs instead of blocking.
+
+typedef struct JobSystem JobSystem;
+typedef struct JobContinuation JobContinuation;
+
+typedef void (*JobFunc)(void *data);
+typedef void (*JobRangeFunc)(void *data, uint32_t begin, uint32_t end);
+
+typedef struct JobDecl {
+  JobFunc func;
+  void *data;
+} JobDecl;
+
+// Number of outstanding jobs. Zero-initialize before first use; may be reused once it
+// has drained back to zero.
+typedef struct JobCounter {
+  atomic_int value;
+  atomic_flag lock;
+  JobContinuation *continuations; // jobs to launch when value reaches zero
+} JobCounter;
+
+// One worker per additional hardware thread.
+#define JOB_WORKERS_AUTO UINT32_MAX
+
+// The calling thread becomes thread 0 and takes part in jobWait(); workerCount == 0 runs
+// everything on it.
+JobSystem *jobSystemCreate(uint32_t workerCount);
+void jobSystemDestroy(JobSystem *js);
+// Workers plus the owning thread.
+uint32_t jobSystemThreadCount(const JobSystem *js);
+
+// Queues `count` jobs on the calling thread's deque. `counter` (optional) is incremented
+// now and decremented as each job finishes.
+void jobRun(JobSystem *js, const JobDecl *jobs, uint32_t count, JobCounter *counter);
+// Like jobRun, but the jobs are only queued once `dependency` has drained to zero.
+void jobRunAfter(JobSystem *js, JobCounter *dependency, const JobDecl *jobs, uint32_t count,
+                 JobCounter *counter);
+// Splits [0, count) into ranges of at most `grainSize` items. Ranges are split lazily in
+// halves so thieves take large chunks and the owner keeps cache locality.
+void jobParallelFor(JobSystem *js, uint32_t count, uint32_t grainSize, JobRangeFunc func, void *data,
+                    JobCounter *counter);
+// Runs queued jobs until `counter` reaches zero.
+void jobWait(JobSystem *js, JobCounter *counter);
+
+#endif
@@ -0,0 +1,229 @@
+#include "latency.h"
+
+#include <string.h>
+#include <time.h>
+
+// Low-latency mode gives up on a frame that takes longer than this to be displayed, as one
+// of an occluded window may never be.
+#define LATENCY_WAIT_TIMEOUT_MS 100.0
+
+static const char *const STAGE_NAMES[LATENCY_STAGE_COUNT] = {"wait", "record", "submit", "present",
+                                                             "display"};
+
+static double nowMs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec * 1e-6;
+}
+
+static void histogramAdd(LatencyHistogram *h, double ms) {
+  uint32_t bin = ms > 0.0 ? (uint32_t)(ms / LATENCY_BIN_MS) : 0;
+  h->counts[bin < LATENCY_BINS ? bin : LATENCY_BINS - 1]++;
+  h->total++;
+  if ((float)ms > h->maxMs) {
+    h->maxMs = (float)ms;
+  }
+}
+
+// Upper edge of the bin holding the percentile; the maximum itself for the last bin.
+static double histogramPercentile(const LatencyHistogram *h, double fraction) {
+  uint32_t rank = (uint32_t)(fraction * (double)(h->total - 1) + 0.5);
+  uint32_t seen = 0;
+  for (uint32_t i = 0; i < LATENCY_BINS - 1; i++) {
+    seen += h->counts[i];
+    if (seen > rank) {
+      double edge = (i + 1) * LATENCY_BIN_MS;
+      return edge < h->maxMs ? edge : h->maxMs;
+    }
+  }
+  return h->maxMs;
+}
+
+static void histogramMerge(LatencyHistogram *into, const LatencyHistogram *h) {
+  for (uint32_t i = 0; i < LATENCY_BINS; i++) {
+    into->counts[i] += h->counts[i];
+  }
+  into->total += h->total;
+  if (h->maxMs > into->maxMs) {
+    into->maxMs = h->maxMs;
+  }
+}
+
+static void statsMerge(LatencyStats *into, const LatencyStats *stats) {
+  histogramMerge(&into->inputToDisplay, &stats->inputToDisplay);
+  histogramMerge(&into->sampleToDisplay, &stats->sampleToDisplay);
+  for (uint32_t i = 0; i < LATENCY_STAGE_COUNT; i++) {
+    into->stageMs[i] += stats->stageMs[i];
+  }
+  into->uncertaintyMs += stats->uncertaintyMs;
+  into->frames += stats->frames;
+  into->dropped += stats->dropped;
+}
+
+// The interval goes into the session totals of the mode it was measured in.
+static void endInterval(LatencyTracker *lt) {
+  statsMerge(&lt->session[lt->lowLatency], &lt->interval);
+  memset(&lt->interval, 0, sizeof(lt->interval));
+}
+
+void latencyInit(LatencyTracker *lt, VkDevice device, bool hasPresentWait, bool lowLatency) {
+  memset(lt, 0, sizeof(*lt));
+  lt->device = device;
+  lt->lowLatency = lowLatency;
+  if (hasPresentWait) {
+    lt->waitForPresent = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(device, "vkWaitForPresentKHR");
+  }
+}
+
+void latencySetLowLatency(LatencyTracker *lt, bool lowLatency) {
+  endInterval(lt);
+  lt->lowLatency = lowLatency;
+}
+
+void latencyInput(LatencyTracker *lt, double nowMs) {
+  if (lt->inputMs == 0.0) {
+    lt->inputMs = nowMs;
+  }
+}
+
+static LatencyFrame *oldestPending(LatencyTracker *lt) { return &lt->pending[lt->pendingHead]; }
+
+static void popPending(LatencyTracker *lt) {
+  lt->pendingHead = (lt->pendingHead + 1) % LATENCY_MAX_PENDING;
+  lt->pendingCount--;
+}
+
+static void frameDisplayed(LatencyTracker *lt, const LatencyFrame *frame, double displayedMs) {
+  LatencyStats *stats = &lt->interval;
+  if (frame->inputMs > 0.0) {
+    histogramAdd(&stats->inputToDisplay, displayedMs - frame->inputMs);
+  }
+  histogramAdd(&stats->sampleToDisplay, displayedMs - frame->sampledMs);
+  stats->stageMs[LATENCY_STAGE_WAIT] += frame->waitMs;
+  stats->stageMs[LATENCY_STAGE_RECORD] += frame->recordedMs - frame->sampledMs;
+  stats->stageMs[LATENCY_STAGE_SUBMIT] += frame->submittedMs - frame->recordedMs;
+  stats->stageMs[LATENCY_STAGE_PRESENT] += frame->presentedMs - frame->submittedMs;
+  stats->stageMs[LATENCY_STAGE_DISPLAY] += displayedMs - frame->presentedMs;
+  stats->uncertaintyMs += displayedMs - frame->pendingAtMs;
+  stats->frames++;
+}
+
+// Without a timeout this only checks; returns false if the frame is not displayed yet.
+static bool waitDisplayed(LatencyTracker *lt, const LatencyFrame *frame, uint64_t timeoutNs, bool *lost) {
+  VkResult result = frame->presentId
+                        ? lt->waitForPresent(lt->device, frame->swapChain, frame->presentId, timeoutNs)
+                        : (timeoutNs ? vkWaitForFences(lt->device, 1, &frame->fence, VK_TRUE, timeoutNs)
+                                     : vkGetFenceStatus(lt->device, frame->fence));
+  *lost = result != VK_SUCCESS && result != VK_TIMEOUT && result != VK_NOT_READY;
+  return result == VK_SUCCESS;
+}
+
+void latencyPoll(LatencyTracker *lt) {
+  double now = nowMs();
+  while (lt->pendingCount > 0) {
+    LatencyFrame *frame = oldestPending(lt);
+    bool lost;
+    if (waitDisplayed(lt, frame, 0, &lost)) {
+      frameDisplayed(lt, frame, now);
+    } else if (lost) {
+      lt->interval.dropped++; // out of date or lost surface: it will never be displayed
+    } else {
+      break;
+    }
+    popPending(lt);
+  }
+  // Frames are displayed in order, so the rest are pending too.
+  for (uint32_t i = 0; i < lt->pendingCount; i++) {
+    lt->pending[(lt->pendingHead + i) % LATENCY_MAX_PENDING].pendingAtMs = now;
+  }
+}
+
+void latencyWait(LatencyTracker *lt) {
+  lt->frameWaitMs = 0.0;
+  if (!lt->lowLatency || lt->pendingCount == 0) {
+    return;
+  }
+  double start = nowMs();
+  const LatencyFrame *newest = &lt->pending[(lt->pendingHead + lt->pendingCount - 1) % LATENCY_MAX_PENDING];
+  bool lost;
+  waitDisplayed(lt, newest, (uint64_t)(LATENCY_WAIT_TIMEOUT_MS * 1e6), &lost);
+  latencyPoll(lt);
+  lt->frameWaitMs = nowMs() - start;
+}
+
+void latencyFrameSampled(LatencyTracker *lt, double nowMs) {
+  lt->frameSampledMs = nowMs;
+  if (lt->frameInputMs == 0.0) {
+    lt->frameInputMs = lt->inputMs;
+  }
+  lt->inputMs = 0.0;
+}
+
+uint64_t latencyNextPresentId(LatencyTracker *lt) { return lt->waitForPresent ? ++lt->lastPresentId : 0; }
+
+void latencyFramePresented(LatencyTracker *lt, VkSwapchainKHR swapChain, uint64_t presentId, VkFence fence,
+                           double recordedMs, double submittedMs, double presentedMs) {
+  if (lt->pendingCount == LATENCY_MAX_PENDING) {
+    popPending(lt);
+    lt->interval.dropped++;
+  }
+  lt->pending[(lt->pendingHead + lt->pendingCount) % LATENCY_MAX_PENDING] =
+      (LatencyFrame){.swapChain = swapChain,
+                     .presentId = presentId,
+                     .fence = fence,
+                     .inputMs = lt->frameInputMs,
+                     .waitMs = lt->frameWaitMs,
+                     .sampledMs = lt->frameSampledMs,
+                     .recordedMs = recordedMs,
+                     .submittedMs = submittedMs,
+                     .presentedMs = presentedMs,
+                     .pendingAtMs = presentedMs};
+  lt->pendingCount++;
+  lt->frameInputMs = 0.0;
+  lt->frameWaitMs = 0.0;
+}
+
+void latencySwapchainRecreated(LatencyTracker *lt) {
+  lt->interval.dropped += lt->pendingCount;
+  lt->pendingCount = 0;
+}
+
+static void printStats(const LatencyStats *stats, FILE *out) {
+  if (stats->frames == 0) {
+    fprintf(out, " no frames displayed\n");
+    return;
+  }
+  const LatencyHistogram *input = &stats->inputToDisplay, *sample = &stats->sampleToDisplay;
+  if (input->total > 0) {
+    fprintf(out, " input to display %.1f/%.1f/%.1f ms (%u inputs),", histogramPercentile(input, 0.5),
+            histogramPercentile(input, 0.99), (double)input->maxMs, input->total);
+  }
+  fprintf(out, " sample to display %.1f/%.1f/%.1f ms (median/p99/max); mean",
+          histogramPercentile(sample, 0.5), histogramPercentile(sample, 0.99), (double)sample->maxMs);
+  for (uint32_t i = 0; i < LATENCY_STAGE_COUNT; i++) {
+    fprintf(out, " %s %.2f", STAGE_NAMES[i], stats->stageMs[i] / stats->frames);
+  }
+  fprintf(out, " ms, display seen within %.2f ms, %u dropped\n", stats->uncertaintyMs / stats->frames,
+          stats->dropped);
+}
+
+void latencyReport(LatencyTracker *lt, FILE *out) {
+  fprintf(out, "Latency (%s, %s):", lt->lowLatency ? "low-latency" : "normal",
+          lt->waitForPresent ? "present wait" : "to GPU done");
+  printStats(&lt->interval, out);
+  endInterval(lt);
+}
+
+void latencySessionReport(const LatencyTracker *lt, FILE *out) {
+  LatencyStats current[2];
+  memcpy(current, lt->session, sizeof(current));
+  statsMerge(&current[lt->lowLatency], &lt->interval);
+  for (uint32_t mode = 0; mode < 2; mode++) {
+    if (current[mode].frames == 0 && current[mode].dropped == 0) {
+      continue;
+    }
+    fprintf(out, "Session latency, %s mode (%s):", mode ? "low-latency" : "normal",
+            lt->waitForPresent ? "present wait" : "to GPU done");
+    printStats(&current[mode], out);
+  }
+}
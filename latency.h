@@ -0,0 +1,112 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vulkan/vulkan.h>
+
+// Input-to-photon latency of the main window. Input events are timestamped as they are
+// dispatched; each frame records when it sampled input, finished recording, was submitted
+// and was presented, and is then followed until it reaches the display. With
+// VK_KHR_present_wait that is when its present id completes; without it the frame's fence
+// signaling, i.e. the GPU being done, stands in for the display.
+//
+// Completion is found by polling between the frame loop's blocking calls, so a display time
+// can be late by as long as the call that hid it; the report gives that uncertainty.
+//
+// Low-latency mode moves the wait to the start of the frame: before sampling input, the
+// previous frame is waited on until it is displayed (or GPU-complete), so at most one frame
+// is queued and the input a frame shows is as fresh as possible, at the cost of throughput.
+
+#define LATENCY_MAX_PENDING 8 // frames presented but not yet displayed; older ones are dropped
+#define LATENCY_BIN_MS 0.1
+#define LATENCY_BINS 1000 // up to 100 ms; slower samples count in the last bin
+
+typedef enum LatencyStage {
+  LATENCY_STAGE_WAIT,    // low-latency mode: blocked on the previous frame before sampling
+  LATENCY_STAGE_RECORD,  // input sampled to command buffers recorded
+  LATENCY_STAGE_SUBMIT,  // recorded to vkQueueSubmit() returned
+  LATENCY_STAGE_PRESENT, // submitted to vkQueuePresentKHR() returned
+  LATENCY_STAGE_DISPLAY, // presented to displayed
+  LATENCY_STAGE_COUNT
+} LatencyStage;
+
+typedef struct LatencyHistogram {
+  uint32_t counts[LATENCY_BINS];
+  uint32_t total;
+  float maxMs;
+} LatencyHistogram;
+
+typedef struct LatencyStats {
+  LatencyHistogram inputToDisplay;  // frames that carried input
+  LatencyHistogram sampleToDisplay; // every frame
+  double stageMs[LATENCY_STAGE_COUNT];
+  double uncertaintyMs; // display observed this long after a poll that found it pending
+  uint32_t frames;
+  uint32_t dropped; // presented but never seen displayed
+} LatencyStats;
+
+typedef struct LatencyFrame {
+  VkSwapchainKHR swapChain;
+  uint64_t presentId; // 0: followed through `fence`
+  VkFence fence;
+  double inputMs; // earliest input the frame reflects; 0: none
+  double waitMs;
+  double sampledMs;
+  double recordedMs;
+  double submittedMs;
+  double presentedMs;
+  double pendingAtMs; // last poll that found it not yet displayed
+} LatencyFrame;
+
+typedef struct LatencyTracker {
+  VkDevice device;
+  PFN_vkWaitForPresentKHR waitForPresent; // NULL without VK_KHR_present_wait
+  bool lowLatency;
+  uint64_t lastPresentId;
+
+  double inputMs;      // earliest input not yet sampled by a frame
+  double frameInputMs; // sampled by the frame being built
+  double frameWaitMs;
+  double frameSampledMs;
+
+  LatencyFrame pending[LATENCY_MAX_PENDING]; // oldest first from pendingHead
+  uint32_t pendingHead;
+  uint32_t pendingCount;
+
+  LatencyStats interval;   // since the last report
+  LatencyStats session[2]; // by mode: normal, low-latency
+} LatencyTracker;
+
+// With `hasPresentWait` the device has VK_KHR_present_id and VK_KHR_present_wait enabled.
+void latencyInit(LatencyTracker *lt, VkDevice device, bool hasPresentWait, bool lowLatency);
+// Starts a new interval, so a report covers one mode only.
+void latencySetLowLatency(LatencyTracker *lt, bool lowLatency);
+// An input event dispatched at `nowMs` (the nowMs() clock: CLOCK_MONOTONIC, milliseconds).
+void latencyInput(LatencyTracker *lt, double nowMs);
+
+// Low-latency mode: blocks until the last frame presented is displayed. Call right before
+// sampling input. Does nothing in normal mode.
+void latencyWait(LatencyTracker *lt);
+// The frame about to be built sampled input at `nowMs`. Input of a frame that is never
+// presented carries over to the next one.
+void latencyFrameSampled(LatencyTracker *lt, double nowMs);
+// Present id to chain to the frame's present with VkPresentIdKHR; 0 without present wait.
+uint64_t latencyNextPresentId(LatencyTracker *lt);
+// The frame was presented to `swapChain` with `presentId` and signals `fence` when done.
+void latencyFramePresented(LatencyTracker *lt, VkSwapchainKHR swapChain, uint64_t presentId, VkFence fence,
+                           double recordedMs, double submittedMs, double presentedMs);
+// Records the frames displayed since the last poll. Call between the frame loop's blocking
+// calls, and before a frame's fence is reset.
+void latencyPoll(LatencyTracker *lt);
+// The main window's swapchain is being replaced: frames still pending on it are dropped.
+void latencySwapchainRecreated(LatencyTracker *lt);
+
+// Prints the interval's distributions and stage means, then starts a new interval.
+void latencyReport(LatencyTracker *lt, FILE *out);
+// Both modes over the whole session.
+void latencySessionReport(const LatencyTracker *lt, FILE *out);
+
+#endif
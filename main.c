@@ -3,23 +3,101 @@
 // TODO; remove rateDeviceSuitability(); we have only one GPU card
 
 #include <limits.h>
+#include <math.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include "capture.h"
+#include "clusters.h"
+#include "devicecaps.h"
+#include "dynres.h"
+#include "hostalloc.h"
+#include "hud.h"
+#include "jobs.h"
+#include "latency.h"
+#include "membudget.h"
+#include "occlusion.h"
+#include "ondemand.h"
+#include "pacing.h"
+#include "pipelinelib.h"
+#include "post.h"
+#include "readback.h"
+#include "scene.h"
+#include "variants.h"
+
 const char *WIN_TITLE = "SeEngine";
 const uint32_t WIN_WIDTH = 800;
 const uint32_t WIN_HEIGHT = 600;
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
+const char *VERT_SHADER_PATH = "shaders/vert.spv";
+const char *FRAG_SHADER_PATH = "shaders/frag.spv";
+const char *CULL_SHADER_PATH = "shaders/cull.spv";
+const char *HIZ_SHADER_PATH = "shaders/hiz.spv";
+const char *HIZ_MS_SHADER_PATH = "shaders/hiz_ms.spv";
+const char *BLUR_SHADER_PATH = "shaders/blur.spv";
+const char *TONEMAP_SHADER_PATH = "shaders/tonemap.spv";
+const char *SHARPEN_SHADER_PATH = "shaders/sharpen.spv";
+const char *HUD_VERT_SHADER_PATH = "shaders/hud_vert.spv";
+const char *HUD_FRAG_SHADER_PATH = "shaders/hud_frag.spv";
+const char *FRAG_LIGHTS_SHADER_PATH = "shaders/frag_lights.spv";
+const char *CLUSTER_SHADER_PATH = "shaders/cluster.spv";
+
+const uint32_t DEFAULT_SCENE_OBJECTS = 4096;
+const uint32_t DEFAULT_SCENE_LIGHTS = 4096;
+const uint32_t STATS_REPORT_INTERVAL = 240; // frames
+const float DEFAULT_MIN_RENDER_SCALE = 0.5f;
+const VkPresentModeKHR PRESENT_MODE_CYCLE[] = {VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_MAILBOX_KHR,
+                                               VK_PRESENT_MODE_IMMEDIATE_KHR};
+// An acquire blocked this long means the compositor is not taking frames: the window is
+// occluded. It is then left alone until an event or the next probe frame.
+const double OCCLUDED_ACQUIRE_MS = 250.0;
+const double OCCLUDED_PROBE_MS = 1000.0;
+// Views are spread evenly around the camera orbit of sceneViewProj(), which takes this long.
+const double CAMERA_ORBIT_SECONDS = 62.83185307179586;
+#define MAX_VIEWS 8
+
+// Keys of the scene shading pipeline variants. The low bits are the specialization constants
+// of shaders/shader.frag; the top bits select how the pipeline is built.
+const uint32_t SCENE_FEATURE_INSTANCE_COLOR = 1u << 0;
+const uint32_t SCENE_FEATURE_LIGHTING = 1u << 1;
+const uint32_t SCENE_FEATURE_LIGHT_BUFFER = 1u << 2; // the scene's lights, not the ring: frag_lights.spv
+const uint32_t SCENE_FEATURE_CLUSTERED = 1u << 3;    // only the lights of the fragment's cluster
+const uint32_t SCENE_FEATURE_MASK = 0xffu;
+const uint32_t SCENE_LIGHT_COUNT_SHIFT = 8;
+const uint32_t SCENE_LIGHT_COUNT_MASK = 0xffu << 8;
+const uint32_t SCENE_VARIANT_BRANCHING = 1u << 30;   // not specialized: branches on push constants
+const uint32_t SCENE_VARIANT_DEPTH_EQUAL = 1u << 31; // shading after the depth pre-pass
+const uint32_t SCENE_VARIANT_DEFAULT = (1u << 0) | (1u << 1);
+const uint32_t LIGHT_COUNT_CYCLE[] = {0, 8, 32, 64};
+#define LIGHT_COUNT_CYCLE_LENGTH (sizeof(LIGHT_COUNT_CYCLE) / sizeof(LIGHT_COUNT_CYCLE[0]))
+const uint32_t LIGHT_SWEEP_COUNTS[] = {256, 512, 1024, 2048, 4096};
+#define LIGHT_SWEEP_LENGTH (sizeof(LIGHT_SWEEP_COUNTS) / sizeof(LIGHT_SWEEP_COUNTS[0]))
+#define HUD_HISTORY 120            // frames in the HUD's graphs
+const float HUD_GRAPH_MAX_MS = 33.3f; // full height of the HUD's graphs
+
 uint32_t currentFrame = 0;
-bool framebufferResized = false;
+bool captureRequested = false; // F12: write the next frame to capture_NNN.vkcap
+uint32_t captureCount = 0;
+bool depthPrepassEnabled = true;     // Z; SE_DEPTH_PREPASS=0 starts without
+bool occlusionCullingEnabled = true; // O; SE_OCCLUSION=0 starts without
+bool presentModeSwitchRequested = false; // P: next mode of PRESENT_MODE_CYCLE
+uint32_t sceneVariant = SCENE_VARIANT_DEFAULT; // C: instance color, L: light count, B: branching,
+                                               // K: light buffer
+bool frameInvalidated = false;        // input or window events since the last main loop iteration
+bool onDemandToggleRequested = false; // R
+bool animationToggleRequested = false; // Space
+bool lowLatencyToggleRequested = false; // I
+bool hudEnabled = false;               // H; SE_HUD=1 starts with it
 
 const bool isEnabledValidationLayers = true;
 const uint32_t validationLayerCount = 1;
@@ -27,14 +105,6 @@ const char *validationLayers[] = {"VK_LAYER_KHRONOS_validation"};
 const uint32_t deviceExtensionCount = 1;
 const char *deviceExtensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 
-typedef struct SwapChainSupportDetails {
-  VkSurfaceCapabilitiesKHR capabilities;
-  uint32_t formatCount;
-  VkSurfaceFormatKHR *formats;
-  uint32_t presentModeCount;
-  VkPresentModeKHR *presentModes;
-} SwapChainSupportDetails;
-
 typedef struct QueueFamilyIndices {
   uint32_t graphicsFamily;
   bool isGraphicsFamily;
@@ -42,74 +112,297 @@ typedef struct QueueFamilyIndices {
   bool isSurfaceFamily;
 } QueueFamilyIndices;
 
-typedef struct App {
+// Push constants of shaders/shader.vert and shaders/shader.frag.
+typedef struct ScenePushConstants {
+  Mat4 viewProj;
+  uint32_t features;   // read by SCENE_VARIANT_BRANCHING pipelines only
+  uint32_t lightCount; // likewise
+  float lightRadius;
+} ScenePushConstants;
+
+// Create info shared by every scene pipeline; variants differ only in the depth test and the
+// fragment shader's specialization constants.
+typedef struct ScenePipelineState {
+  VkShaderModule vertShaderModule;
+  VkShaderModule fragShaderModule;
+  VkShaderModule fragLightsShaderModule; // for keys with SCENE_FEATURE_LIGHT_BUFFER
+  VkPipelineShaderStageCreateInfo shaderStages[2];
+  VkVertexInputBindingDescription vertexBindings[2];
+  VkVertexInputAttributeDescription vertexAttributes[7];
+  VkPipelineVertexInputStateCreateInfo vertexInput;
+  VkPipelineInputAssemblyStateCreateInfo inputAssembly;
+  VkPipelineViewportStateCreateInfo viewportState;
+  VkPipelineRasterizationStateCreateInfo rasterizer;
+  VkPipelineMultisampleStateCreateInfo multisampling;
+  VkPipelineColorBlendAttachmentState colorBlendAttachment;
+  VkPipelineColorBlendStateCreateInfo colorBlending;
+  VkPipelineDepthStencilStateCreateInfo depthStencil;
+  VkDynamicState dynamicStates[2];
+  VkPipelineDynamicStateCreateInfo dynamicState;
+  VkGraphicsPipelineCreateInfo pipelineInfo; // points into this struct
+  // With graphics pipeline libraries: the parts every variant shares, in PIPELINE_LIBRARY_PARTS
+  // order. The fragment shader slot stays empty; each variant compiles its own.
+  VkPipeline libraries[PIPELINE_LIBRARY_PART_COUNT];
+} ScenePipelineState;
+
+// A window and everything sized by it. Views share the device, render pass, pipelines, scene
+// and command pool; the views of a frame are submitted in one batch and presented with one
+// vkQueuePresentKHR(). views[0] is the main window: readback, captures and the pipeline
+// statistics are taken from it only.
+typedef struct View {
+  struct App *app;
+  uint32_t index;
   GLFWwindow *window;
+  VkSurfaceKHR surface;
+  VkSurfaceCapabilitiesKHR surfaceCapabilities; // refreshed on swapchain recreation
+  Arena swapChainArena;                         // per-swapchain-image arrays; reset on recreation
+  VkSwapchainKHR swapChain;
+  uint32_t swapChainImageCount;
+  VkImage *swapChainImages;
+  VkExtent2D swapChainExtent;
+  VkImageView *swapChainImageViews;
+  uint32_t switchablePresentModeCount;
+  VkPresentModeKHR switchablePresentModes[3]; // subset of PRESENT_MODE_CYCLE; the first is presentMode
+  VkImage colorImage;                         // multisampled, transient; only with msaaSamples > 1
+  VkDeviceMemory colorImageMemory;
+  VkImageView colorImageView;
+  bool colorImageLazy; // colorImageMemory is lazily allocated
+  VkImage sceneImage;  // single-sampled render target at swapchain size; see rendersOffscreen()
+  VkDeviceMemory sceneImageMemory;
+  VkImageView sceneImageView;
+  VkImage depthImage; // recreated with the swapchain; sampled by the Hi-Z build after the pass
+  VkDeviceMemory depthImageMemory;
+  VkImageView depthImageView;
+  VkFramebuffer *swapChainFramebuffers;
+  Occlusion occlusion; // against this view's depth
+  Clusters clusters;   // with this view's camera
+  PostChain post;
+  VkExtent2D renderExtent; // render area of the frame being recorded
+  VkCommandBuffer *commandBuffers;
+  VkSemaphore *imageAvailableSemaphores;
+  uint32_t imageIndex; // acquired for the frame being recorded
+  bool framebufferResized;
+  double occludedUntilMs; // see OCCLUDED_ACQUIRE_MS
+  // The attachments and framebuffers, evicted under memory pressure while the view is hidden
+  // or inactive; recreated with the swapchain before it is drawn again.
+  MemoryEvictable evictable;
+} View;
+
+typedef struct App {
+  uint32_t viewCount; // SE_VIEWS=<n>, at most MAX_VIEWS
+  View views[MAX_VIEWS];
+  uint32_t activeViewCount; // views rendered; fewer than viewCount only during SE_VIEW_SWEEP
   VkInstance instance;
   VkDebugUtilsMessengerEXT debugMessenger;
-  VkSurfaceKHR surface;
+  bool hasSurfaceMaintenance1; // VK_EXT_surface_maintenance1 and VK_KHR_get_surface_capabilities2
+  HostAllocator hostAllocator;
+  const VkAllocationCallbacks *pAllocator; // &hostAllocator.callbacks; NULL with SE_HOST_ALLOCATOR=0
+  Arena deviceArena;                       // arrays that live as long as the device
   VkPhysicalDevice physicalDevice;
+  DeviceCaps deviceCaps; // queried once in pickPhysicalDevice()
+  MemoryBudget memoryBudget; // every device allocation; SE_MEMORY_WATERMARK=<fraction of budget>
   QueueFamilyIndices queueFamilyIndices;
   VkDevice device; // Logical device
   VkQueue graphicsQueue;
   VkQueue presentQueue;
-  VkSwapchainKHR swapChain;
-  uint32_t swapChainImageCount;
-  VkImage *swapChainImages;
-  VkFormat swapChainImageFormat;
-  VkExtent2D swapChainExtent;
-  VkImageView *swapChainImageViews;
+  VkFormat swapChainImageFormat;         // of every view: they share the render pass
+  VkImageUsageFlags swapChainImageUsage;
+  VkPresentModeKHR presentMode;  // SE_PRESENT_MODE=fifo|mailbox|immediate; P switches
+  bool hasSwapchainMaintenance1; // present mode can change per present, see switchablePresentModes
+  VkSampleCountFlagBits msaaSamples; // SE_MSAA
+  VkFormat sceneFormat;     // color format rendered to: POST_FORMAT with post-processing
+  bool isDynamicResolution; // SE_GPU_BUDGET_MS=<ms>, SE_MIN_RENDER_SCALE=<fraction>
+  DynamicResolution dynres;
+  bool isPostProcessing; // SE_POST=<effect,...>, see post.h
+  uint32_t postEffectCount;
+  PostEffect postEffects[POST_EFFECT_COUNT];
+  VkFormat depthFormat;
   VkRenderPass renderPass;
   VkPipelineLayout pipelineLayout;
-  VkPipeline graphicsPipeline;
-  VkFramebuffer *swapChainFramebuffers;
+  VkDescriptorSetLayout clusterSetLayout; // set 0 of pipelineLayout: the lights, see clusters.h
+  bool hasPipelineLibrary; // VK_EXT_graphics_pipeline_library; SE_PIPELINE_LIBRARY=0 disables
+  ScenePipelineState scenePipeline;
+  PipelineVariants sceneVariants;  // shading pipelines by SCENE_* key; SE_PIPELINE_CACHE=<path>
+  VkPipeline depthPrepassPipeline; // depth only, no fragment shader
+  CapturePipeline graphicsPipelineDesc; // state of the pipelines above for frame captures
+  CapturePipeline depthPrepassPipelineDesc;
+  CapturePipeline depthEqualPipelineDesc;
+  Scene scene; // SE_SCENE_OBJECTS boxes, SE_SCENE_LIGHTS lights
+  uint32_t bufferLightCount; // lights shaded from the light buffer; all of them but in SE_LIGHT_SWEEP
+  VkBuffer vertexBuffer;
+  VkDeviceMemory vertexBufferMemory;
+  VkBuffer indexBuffer;
+  VkDeviceMemory indexBufferMemory;
+  RenderOnDemand onDemand; // SE_RENDER_ON_DEMAND=1, SE_ANIMATION_FPS=<fps>; also the animation clock
+  double sessionEndMs;     // SE_SESSION_SECONDS=<s> closes the window then; 0: never
+  VkQueryPool statsQueryPool; // one pipeline statistics query per frame in flight, if supported
+  bool *framePending;         // frame slots with a view recorded: timestamps and render scale to read
+  bool *statsPending;         // ... with the main window recorded: its statistics and visible count
+  uint32_t statsFrames;
+  uint32_t statsMainFrames;
+  uint64_t statsDrawn;
+  uint64_t statsPrimitives;
+  uint64_t statsFragments;
+  VkQueryPool timestampQueryPool; // start and end of each frame in flight, if supported
+  float *frameRenderScale;        // render scale each frame in flight was recorded with
+  double statsGpuMs;
+  double statsRenderScale;
+  uint32_t statsCpuFrames; // CPU cost of the frames presented, split by step
+  uint32_t statsViewsPresented;
+  double statsAcquireMs;
+  double statsRecordMs;
+  double statsSubmitMs; // submit and present
   VkCommandPool commandPool;
-  VkCommandBuffer *commandBuffers;
-  VkSemaphore *imageAvailableSemaphores;
-  VkSemaphore *renderFinishedSemaphores;
+  VkSemaphore *renderFinishedSemaphores; // one for all views of a frame
   VkFence *inFlightFences;
+  JobSystem *jobSystem; // background work: optimized links of the pipeline library variants
+  FramePacer pacer;     // SE_FPS_LIMIT=<fps>
+  bool hasPresentWait;    // VK_KHR_present_id and VK_KHR_present_wait
+  LatencyTracker latency; // of the main window; SE_LOW_LATENCY=1 starts in low-latency mode
+  bool isVariantSweep;  // SE_VARIANT_SWEEP=1
+  uint32_t sweepStep;
+  double sweepGpuMs[2 * LIGHT_COUNT_CYCLE_LENGTH]; // per light count: specialized, then branching
+  bool isViewSweep; // SE_VIEW_SWEEP=1
+  uint32_t viewSweepStep;
+  double viewSweepCpuMs[MAX_VIEWS]; // per active view count: record, submit and present per frame
+  double viewSweepGpuMs[MAX_VIEWS];
+  bool isLightSweep; // SE_LIGHT_SWEEP=1
+  uint32_t lightSweepStep;
+  double lightSweepGpuMs[2 * LIGHT_SWEEP_LENGTH]; // per light count: every light, then clustered
+  double lightSweepFragments[2 * LIGHT_SWEEP_LENGTH];
+  bool isReadbackEnabled; // SE_READBACK=<path|pattern%d|-||command>, SE_READBACK_FORMAT=ppm|y4m|raw
+  Readback readback;
+  // Drawn over the main window in its own command buffer after the views', so it is not part
+  // of the frame's GPU time, pipeline statistics, readback or captures.
+  Hud hud;
+  VkCommandBuffer *hudCommandBuffers;
+  float hudFrameMs[HUD_HISTORY]; // present to present
+  uint32_t hudFrameHead;         // oldest entry
+  float hudGpuMs[HUD_HISTORY];
+  uint32_t hudGpuHead;
+  double lastPresentedMs;
+  uint32_t frameDraws; // scene pass commands of the frame last recorded, all views
+  uint32_t framePipelineBinds;
+  uint32_t frameStateChanges; // viewport, scissor, buffer binds and push constants
+  double hudPostMs[POST_EFFECT_COUNT]; // per effect, as of the last report
+  uint32_t statsHudFrames;
+  double statsHudMs; // building and recording the HUD
 } App;
 
+// The scene is rendered into sceneImage and then blitted to the swapchain image, instead of
+// straight into the swapchain image.
+static bool rendersOffscreen(const App *pApp) {
+  return pApp->isDynamicResolution || pApp->isPostProcessing;
+}
+
+double nowMs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec * 1e-6;
+}
+
 static void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
+  if (action != GLFW_RELEASE) {
+    frameInvalidated = true;
+    View *view = glfwGetWindowUserPointer(window);
+    latencyInput(&view->app->latency, nowMs());
+  }
   if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
     glfwSetWindowShouldClose(window, GLFW_TRUE);
-}
-
-void cleanupSwapChain(App *pApp) {
-  for (uint32_t i = 0; i < pApp->swapChainImageCount; i++) {
-    vkDestroyFramebuffer(pApp->device, pApp->swapChainFramebuffers[i], NULL);
+  if (key == GLFW_KEY_F12 && action == GLFW_PRESS)
+    captureRequested = true;
+  if (key == GLFW_KEY_Z && action == GLFW_PRESS) {
+    depthPrepassEnabled = !depthPrepassEnabled;
+    fprintf(stderr, "Depth pre-pass %s\n", depthPrepassEnabled ? "on" : "off");
   }
-
-  for (uint32_t i = 0; i < pApp->swapChainImageCount; i++) {
-    vkDestroyImageView(pApp->device, pApp->swapChainImageViews[i], NULL);
+  if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+    occlusionCullingEnabled = !occlusionCullingEnabled;
+    fprintf(stderr, "Occlusion culling %s\n", occlusionCullingEnabled ? "on" : "off");
+  }
+  if (key == GLFW_KEY_P && action == GLFW_PRESS)
+    presentModeSwitchRequested = true;
+  if (key == GLFW_KEY_R && action == GLFW_PRESS)
+    onDemandToggleRequested = true;
+  if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
+    animationToggleRequested = true;
+  if (key == GLFW_KEY_I && action == GLFW_PRESS)
+    lowLatencyToggleRequested = true;
+  if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+    hudEnabled = !hudEnabled;
+    fprintf(stderr, "HUD %s\n", hudEnabled ? "on" : "off");
+  }
+  if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+    sceneVariant ^= SCENE_FEATURE_INSTANCE_COLOR;
+    fprintf(stderr, "Instance colors %s\n", sceneVariant & SCENE_FEATURE_INSTANCE_COLOR ? "on" : "off");
+  }
+  if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+    sceneVariant ^= SCENE_VARIANT_BRANCHING;
+    fprintf(stderr, "Shading %s\n", sceneVariant & SCENE_VARIANT_BRANCHING ? "branching" : "specialized");
+  }
+  if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+    uint32_t lights = (sceneVariant & SCENE_LIGHT_COUNT_MASK) >> SCENE_LIGHT_COUNT_SHIFT;
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < LIGHT_COUNT_CYCLE_LENGTH; i++) {
+      if (LIGHT_COUNT_CYCLE[i] == lights) {
+        next = LIGHT_COUNT_CYCLE[(i + 1) % LIGHT_COUNT_CYCLE_LENGTH];
+      }
+    }
+    sceneVariant = (sceneVariant & ~SCENE_LIGHT_COUNT_MASK) | next << SCENE_LIGHT_COUNT_SHIFT;
+    fprintf(stderr, "%u point lights\n", next);
+  }
+  if (key == GLFW_KEY_K && action == GLFW_PRESS) {
+    // Off, then every light of the buffer, then clustered.
+    uint32_t lightBuffer = sceneVariant & (SCENE_FEATURE_LIGHT_BUFFER | SCENE_FEATURE_CLUSTERED);
+    sceneVariant &= ~(SCENE_FEATURE_LIGHT_BUFFER | SCENE_FEATURE_CLUSTERED);
+    if (lightBuffer == 0) {
+      sceneVariant |= SCENE_FEATURE_LIGHT_BUFFER;
+    } else if (!(lightBuffer & SCENE_FEATURE_CLUSTERED)) {
+      sceneVariant |= SCENE_FEATURE_LIGHT_BUFFER | SCENE_FEATURE_CLUSTERED;
+    }
+    fprintf(stderr, "Light buffer %s\n",
+            sceneVariant & SCENE_FEATURE_CLUSTERED      ? "clustered"
+            : sceneVariant & SCENE_FEATURE_LIGHT_BUFFER ? "every light"
+                                                        : "off");
   }
-
-  vkDestroySwapchainKHR(pApp->device, pApp->swapChain, NULL);
 }
 
-SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device, VkSurfaceKHR surface) {
-  SwapChainSupportDetails details;
+// Handles are cleared so that destroying an evicted view's attachments again does nothing.
+void destroyAttachments(App *pApp, View *view) {
+  for (uint32_t i = 0; i < view->swapChainImageCount; i++) {
+    vkDestroyFramebuffer(pApp->device, view->swapChainFramebuffers[i], pApp->pAllocator);
+    view->swapChainFramebuffers[i] = VK_NULL_HANDLE;
+  }
 
-  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
+  vkDestroyImageView(pApp->device, view->depthImageView, pApp->pAllocator);
+  vkDestroyImage(pApp->device, view->depthImage, pApp->pAllocator);
+  memoryBudgetFree(&pApp->memoryBudget, pApp->device, view->depthImageMemory, pApp->pAllocator);
+  vkDestroyImageView(pApp->device, view->colorImageView, pApp->pAllocator);
+  vkDestroyImage(pApp->device, view->colorImage, pApp->pAllocator);
+  memoryBudgetFree(&pApp->memoryBudget, pApp->device, view->colorImageMemory, pApp->pAllocator);
+  vkDestroyImageView(pApp->device, view->sceneImageView, pApp->pAllocator);
+  vkDestroyImage(pApp->device, view->sceneImage, pApp->pAllocator);
+  memoryBudgetFree(&pApp->memoryBudget, pApp->device, view->sceneImageMemory, pApp->pAllocator);
+  view->depthImageView = VK_NULL_HANDLE;
+  view->depthImage = VK_NULL_HANDLE;
+  view->depthImageMemory = VK_NULL_HANDLE;
+  view->colorImageView = VK_NULL_HANDLE;
+  view->colorImage = VK_NULL_HANDLE;
+  view->colorImageMemory = VK_NULL_HANDLE;
+  view->sceneImageView = VK_NULL_HANDLE;
+  view->sceneImage = VK_NULL_HANDLE;
+  view->sceneImageMemory = VK_NULL_HANDLE;
+}
 
-  uint32_t formatCount;
-  vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, NULL);
-  details.formatCount = formatCount;
-  VkSurfaceFormatKHR formats[formatCount];
-  details.formats = formats;
-  if (formatCount != 0) {
-    vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, details.formats);
-  }
+void cleanupSwapChain(App *pApp, View *view) {
+  destroyAttachments(pApp, view);
 
-  uint32_t presentCount;
-  vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentCount, NULL);
-  details.presentModeCount = presentCount;
-  VkPresentModeKHR presentModes[presentCount];
-  details.presentModes = presentModes;
-  if (presentCount != 0) {
-    vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentCount, details.presentModes);
+  for (uint32_t i = 0; i < view->swapChainImageCount; i++) {
+    vkDestroyImageView(pApp->device, view->swapChainImageViews[i], pApp->pAllocator);
   }
 
-  return details;
+  vkDestroySwapchainKHR(pApp->device, view->swapChain, pApp->pAllocator);
+  arenaReset(&view->swapChainArena);
+  view->swapChainFramebuffers = NULL;
 }
 
 VkSurfaceFormatKHR chooseSwapSurfaceFormat(uint32_t formatCount, VkSurfaceFormatKHR *availableFormats) {
@@ -131,6 +424,137 @@ VkPresentModeKHR chooseSwapPresentMode(uint32_t presentModeCount, VkPresentModeK
   return VK_PRESENT_MODE_FIFO_KHR;
 }
 
+const char *presentModeName(VkPresentModeKHR mode) {
+  switch (mode) {
+  case VK_PRESENT_MODE_FIFO_KHR:
+    return "fifo";
+  case VK_PRESENT_MODE_MAILBOX_KHR:
+    return "mailbox";
+  case VK_PRESENT_MODE_IMMEDIATE_KHR:
+    return "immediate";
+  default:
+    return "other";
+  }
+}
+
+bool isPresentModeSupported(const DeviceCaps *caps, VkPresentModeKHR mode) {
+  for (uint32_t i = 0; i < caps->presentModeCount; i++) {
+    if (caps->presentModes[i] == mode) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// DeviceCaps has the present modes of the main window's surface; other views query theirs.
+bool viewSupportsPresentMode(App *pApp, const View *view, VkPresentModeKHR mode) {
+  if (view->index == 0) {
+    return isPresentModeSupported(&pApp->deviceCaps, mode);
+  }
+  uint32_t count = 0;
+  vkGetPhysicalDeviceSurfacePresentModesKHR(pApp->physicalDevice, view->surface, &count, NULL);
+  VkPresentModeKHR modes[count ? count : 1];
+  vkGetPhysicalDeviceSurfacePresentModesKHR(pApp->physicalDevice, view->surface, &count, modes);
+  pApp->deviceCaps.driverQueries += 2;
+  for (uint32_t i = 0; i < count; i++) {
+    if (modes[i] == mode) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// SE_PRESENT_MODE if the surface supports it; otherwise mailbox, else fifo.
+void choosePresentMode(App *pApp) {
+  const DeviceCaps *caps = &pApp->deviceCaps;
+  pApp->presentMode = chooseSwapPresentMode(caps->presentModeCount, caps->presentModes);
+
+  const char *requested = getenv("SE_PRESENT_MODE");
+  if (requested != NULL) {
+    bool found = false;
+    for (uint32_t i = 0; i < sizeof(PRESENT_MODE_CYCLE) / sizeof(PRESENT_MODE_CYCLE[0]); i++) {
+      if (strcmp(requested, presentModeName(PRESENT_MODE_CYCLE[i])) == 0 &&
+          isPresentModeSupported(caps, PRESENT_MODE_CYCLE[i])) {
+        pApp->presentMode = PRESENT_MODE_CYCLE[i];
+        found = true;
+      }
+    }
+    if (!found) {
+      fprintf(stderr, "Present mode '%s' not supported\n", requested);
+    }
+  }
+  fprintf(stderr, "Present mode %s (P to switch)%s\n", presentModeName(pApp->presentMode),
+          pApp->hasSwapchainMaintenance1 ? "" : "; switching recreates the swap chain");
+}
+
+// The other views render with the main window's render pass and present from its queue, so
+// their surfaces must take the same format and present mode from the same queue family.
+void checkViewSurfaces(App *pApp) {
+  const DeviceCaps *caps = &pApp->deviceCaps;
+  VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(caps->formatCount, caps->formats);
+  for (uint32_t i = 1; i < pApp->viewCount; i++) {
+    View *view = &pApp->views[i];
+    VkBool32 presentable = VK_FALSE;
+    vkGetPhysicalDeviceSurfaceSupportKHR(pApp->physicalDevice, pApp->queueFamilyIndices.surfaceFamily,
+                                         view->surface, &presentable);
+    uint32_t formatCount = 0;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(pApp->physicalDevice, view->surface, &formatCount, NULL);
+    VkSurfaceFormatKHR formats[formatCount ? formatCount : 1];
+    vkGetPhysicalDeviceSurfaceFormatsKHR(pApp->physicalDevice, view->surface, &formatCount, formats);
+    pApp->deviceCaps.driverQueries += 3;
+
+    bool hasFormat = false;
+    for (uint32_t j = 0; j < formatCount; j++) {
+      hasFormat |=
+          formats[j].format == surfaceFormat.format && formats[j].colorSpace == surfaceFormat.colorSpace;
+    }
+    if (!presentable || !hasFormat || !viewSupportsPresentMode(pApp, view, pApp->presentMode)) {
+      fprintf(stderr, "Surface of view %u does not support the main window's swap chain!\n", i);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+// Modes the view's surface can switch to from `presentMode` without a new swapchain; the
+// swapchain is created with all of them so any one can be requested per present.
+void querySwitchablePresentModes(App *pApp, View *view) {
+  view->switchablePresentModeCount = 1;
+  view->switchablePresentModes[0] = pApp->presentMode;
+  if (!pApp->hasSwapchainMaintenance1) {
+    return;
+  }
+
+  PFN_vkGetPhysicalDeviceSurfaceCapabilities2KHR getSurfaceCapabilities2 =
+      (PFN_vkGetPhysicalDeviceSurfaceCapabilities2KHR)vkGetInstanceProcAddr(
+          pApp->instance, "vkGetPhysicalDeviceSurfaceCapabilities2KHR");
+  VkPresentModeKHR compatible[8];
+  VkSurfacePresentModeCompatibilityEXT compatibility = {
+      .sType = VK_STRUCTURE_TYPE_SURFACE_PRESENT_MODE_COMPATIBILITY_EXT,
+      .presentModeCount = sizeof(compatible) / sizeof(compatible[0]),
+      .pPresentModes = compatible};
+  VkSurfaceCapabilities2KHR capabilities = {.sType = VK_STRUCTURE_TYPE_SURFACE_CAPABILITIES_2_KHR,
+                                            .pNext = &compatibility};
+  VkSurfacePresentModeEXT presentMode = {.sType = VK_STRUCTURE_TYPE_SURFACE_PRESENT_MODE_EXT,
+                                         .presentMode = pApp->presentMode};
+  VkPhysicalDeviceSurfaceInfo2KHR surfaceInfo = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SURFACE_INFO_2_KHR,
+      .pNext = &presentMode,
+      .surface = view->surface};
+  if (getSurfaceCapabilities2 == NULL ||
+      getSurfaceCapabilities2(pApp->physicalDevice, &surfaceInfo, &capabilities) != VK_SUCCESS) {
+    return;
+  }
+  pApp->deviceCaps.driverQueries++;
+
+  for (uint32_t i = 0; i < compatibility.presentModeCount; i++) {
+    for (uint32_t j = 0; j < sizeof(PRESENT_MODE_CYCLE) / sizeof(PRESENT_MODE_CYCLE[0]); j++) {
+      if (compatible[i] == PRESENT_MODE_CYCLE[j] && compatible[i] != pApp->presentMode) {
+        view->switchablePresentModes[view->switchablePresentModeCount++] = compatible[i];
+      }
+    }
+  }
+}
+
 uint32_t clamp(uint32_t n, uint32_t min, uint32_t max) {
   return n < min ? min : n > max ? max : n;
 }
@@ -153,49 +577,53 @@ VkExtent2D chooseSwapExtent(GLFWwindow *window, VkSurfaceCapabilitiesKHR capabil
   }
 }
 
-QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surface) {
+QueueFamilyIndices findQueueFamilies(const DeviceCaps *caps) {
   QueueFamilyIndices indices = {};
 
-  uint32_t queueFamilyCount = 0;
-  vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, NULL);
-
-  VkQueueFamilyProperties queueFamilyProperties[queueFamilyCount];
-  vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilyProperties);
-
-  for (uint32_t i = 0; i < queueFamilyCount; i++) {
-    if (queueFamilyProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+  for (uint32_t i = 0; i < caps->queueFamilyCount; i++) {
+    if (!indices.isGraphicsFamily && (caps->queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
       indices.graphicsFamily = i;
       indices.isGraphicsFamily = true;
-      break;
     }
-    VkBool32 surfaceSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &surfaceSupport);
-    if (surfaceSupport) {
+    if (!indices.isSurfaceFamily && caps->surfaceSupport[i]) {
       indices.surfaceFamily = i;
       indices.isSurfaceFamily = true;
     }
   }
 
+  // One family for both avoids concurrent sharing of the swapchain images.
+  if (indices.isGraphicsFamily && caps->surfaceSupport[indices.graphicsFamily]) {
+    indices.surfaceFamily = indices.graphicsFamily;
+  }
+
   return indices;
 }
 
-void createSwapChain(App *pApp) {
-  SwapChainSupportDetails swapChainSupport = querySwapChainSupport(pApp->physicalDevice, pApp->surface);
+// Every view uses the format chosen for the main window's surface; checkViewSurfaces() made
+// sure the other surfaces support it.
+void createSwapChain(App *pApp, View *view) {
+  const DeviceCaps *caps = &pApp->deviceCaps;
 
-  VkSurfaceFormatKHR surfaceFormat =
-      chooseSwapSurfaceFormat(swapChainSupport.formatCount, swapChainSupport.formats);
-  VkPresentModeKHR presentMode =
-      chooseSwapPresentMode(swapChainSupport.presentModeCount, swapChainSupport.presentModes);
-  VkExtent2D extent = chooseSwapExtent(pApp->window, swapChainSupport.capabilities);
+  // DeviceCaps tracks the main window's surface only; the others are queried every time.
+  if (view->index == 0) {
+    view->surfaceCapabilities = caps->surfaceCapabilities;
+  } else {
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(pApp->physicalDevice, view->surface,
+                                              &view->surfaceCapabilities);
+    pApp->deviceCaps.driverQueries++;
+  }
+  const VkSurfaceCapabilitiesKHR *capabilities = &view->surfaceCapabilities;
+
+  VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(caps->formatCount, caps->formats);
+  VkExtent2D extent = chooseSwapExtent(view->window, *capabilities);
 
-  uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-  if (swapChainSupport.capabilities.maxImageCount > 0 &&
-      imageCount > swapChainSupport.capabilities.maxImageCount) {
-    imageCount = swapChainSupport.capabilities.maxImageCount;
+  uint32_t imageCount = capabilities->minImageCount + 1;
+  if (capabilities->maxImageCount > 0 && imageCount > capabilities->maxImageCount) {
+    imageCount = capabilities->maxImageCount;
   }
 
   VkSwapchainCreateInfoKHR createInfo = {.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-                                         .surface = pApp->surface,
+                                         .surface = view->surface,
                                          .minImageCount = imageCount,
                                          .imageFormat = surfaceFormat.format,
                                          .imageColorSpace = surfaceFormat.colorSpace,
@@ -203,7 +631,34 @@ void createSwapChain(App *pApp) {
                                          .imageArrayLayers = 1,
                                          .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT};
 
-  QueueFamilyIndices indices = findQueueFamilies(pApp->physicalDevice, pApp->surface);
+  querySwitchablePresentModes(pApp, view);
+  VkSwapchainPresentModesCreateInfoEXT presentModes = {
+      .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_MODES_CREATE_INFO_EXT,
+      .presentModeCount = view->switchablePresentModeCount,
+      .pPresentModes = view->switchablePresentModes};
+  if (pApp->hasSwapchainMaintenance1) {
+    createInfo.pNext = &presentModes;
+  }
+
+  // Frame readback copies straight out of the swapchain images.
+  if (getenv("SE_READBACK") && (capabilities->supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+    createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  }
+  // Dynamic resolution and post-processing blit their final image into the swapchain image.
+  if ((getenv("SE_GPU_BUDGET_MS") || getenv("SE_POST")) &&
+      (capabilities->supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)) {
+    createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  }
+  // The other views record the same commands, so they need the main window's usage.
+  if (view->index > 0) {
+    if (pApp->swapChainImageUsage & ~capabilities->supportedUsageFlags) {
+      fprintf(stderr, "Surface of view %u does not support the main window's image usage!\n", view->index);
+      exit(EXIT_FAILURE);
+    }
+    createInfo.imageUsage = pApp->swapChainImageUsage;
+  }
+
+  QueueFamilyIndices indices = pApp->queueFamilyIndices;
   uint32_t queueFamilyIndices[] = {indices.graphicsFamily, indices.surfaceFamily};
 
   if (indices.graphicsFamily != indices.surfaceFamily) {
@@ -216,33 +671,34 @@ void createSwapChain(App *pApp) {
     createInfo.pQueueFamilyIndices = NULL; // Optional
   }
 
-  createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
+  createInfo.preTransform = capabilities->currentTransform;
   createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-  createInfo.presentMode = presentMode;
+  createInfo.presentMode = pApp->presentMode;
   createInfo.clipped = VK_TRUE;
   createInfo.oldSwapchain = VK_NULL_HANDLE;
 
-  if (vkCreateSwapchainKHR(pApp->device, &createInfo, NULL, &pApp->swapChain) != VK_SUCCESS) {
+  if (vkCreateSwapchainKHR(pApp->device, &createInfo, pApp->pAllocator, &view->swapChain) != VK_SUCCESS) {
     fprintf(stderr, "Failed to create Swap Chain!\n");
     exit(EXIT_FAILURE);
   }
 
-  vkGetSwapchainImagesKHR(pApp->device, pApp->swapChain, &imageCount, NULL);
-  pApp->swapChainImages = malloc(sizeof(VkImage) * imageCount);
+  vkGetSwapchainImagesKHR(pApp->device, view->swapChain, &imageCount, NULL);
+  view->swapChainImages = arenaPushArray(&view->swapChainArena, VkImage, imageCount);
 
-  vkGetSwapchainImagesKHR(pApp->device, pApp->swapChain, &imageCount, pApp->swapChainImages);
-  pApp->swapChainImageCount = imageCount;
+  vkGetSwapchainImagesKHR(pApp->device, view->swapChain, &imageCount, view->swapChainImages);
+  view->swapChainImageCount = imageCount;
+  view->swapChainExtent = extent;
 
   pApp->swapChainImageFormat = surfaceFormat.format;
-  pApp->swapChainExtent = extent;
+  pApp->swapChainImageUsage = createInfo.imageUsage;
 }
 
-void createImageViews(App *pApp) {
-  pApp->swapChainImageViews = malloc(sizeof(VkImageView) * pApp->swapChainImageCount);
+void createImageViews(App *pApp, View *view) {
+  view->swapChainImageViews = arenaPushArray(&view->swapChainArena, VkImageView, view->swapChainImageCount);
 
-  for (uint32_t i = 0; i < pApp->swapChainImageCount; i++) {
+  for (uint32_t i = 0; i < view->swapChainImageCount; i++) {
     VkImageViewCreateInfo createInfo = {.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-                                        .image = pApp->swapChainImages[i],
+                                        .image = view->swapChainImages[i],
                                         .viewType = VK_IMAGE_VIEW_TYPE_2D,
                                         .format = pApp->swapChainImageFormat,
                                         .components.r = VK_COMPONENT_SWIZZLE_IDENTITY,
@@ -255,85 +711,428 @@ void createImageViews(App *pApp) {
                                         .subresourceRange.baseArrayLayer = 0,
                                         .subresourceRange.layerCount = 1};
 
-    if (vkCreateImageView(pApp->device, &createInfo, NULL, &pApp->swapChainImageViews[i]) != VK_SUCCESS) {
+    if (vkCreateImageView(pApp->device, &createInfo, pApp->pAllocator, &view->swapChainImageViews[i]) !=
+        VK_SUCCESS) {
       fprintf(stderr, "Failed to create image views!\n");
       exit(EXIT_FAILURE);
     }
   }
 }
 
-void createFramebuffers(App *pApp) {
-  pApp->swapChainFramebuffers = malloc(pApp->swapChainImageCount * sizeof(VkFramebuffer));
+// First format usable both as depth attachment and sampled by the Hi-Z build.
+void chooseDepthFormat(App *pApp) {
+  const VkFormat candidates[] = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D16_UNORM};
+  const VkFormatFeatureFlags features =
+      VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+
+  for (uint32_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(pApp->physicalDevice, candidates[i], &properties);
+    if ((properties.optimalTilingFeatures & features) == features) {
+      pApp->depthFormat = candidates[i];
+      return;
+    }
+  }
+
+  fprintf(stderr, "Failed to find a sampleable depth format!\n");
+  exit(EXIT_FAILURE);
+}
+
+// Highest supported sample count not above SE_MSAA (1, 2, 4 or 8; default 1). The depth buffer
+// is multisampled too and sampled by the Hi-Z build, so all three limits apply.
+void chooseMsaaSamples(App *pApp) {
+  const VkPhysicalDeviceLimits *limits = &pApp->deviceCaps.properties.limits;
+  VkSampleCountFlags supported = limits->framebufferColorSampleCounts & limits->framebufferDepthSampleCounts &
+                                 limits->sampledImageDepthSampleCounts;
+
+  const char *msaa = getenv("SE_MSAA");
+  int requested = msaa ? atoi(msaa) : 1;
+  pApp->msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+  for (uint32_t samples = VK_SAMPLE_COUNT_8_BIT; samples > VK_SAMPLE_COUNT_1_BIT; samples >>= 1) {
+    if ((int)samples <= requested && (supported & samples)) {
+      pApp->msaaSamples = (VkSampleCountFlagBits)samples;
+      break;
+    }
+  }
+  if (requested > 1 && pApp->msaaSamples != (VkSampleCountFlagBits)requested) {
+    fprintf(stderr, "%dx MSAA not supported; using %ux\n", requested, pApp->msaaSamples);
+  }
+}
+
+// Whether an image of `format` can be rendered to and then blitted, with linear filtering,
+// into a swapchain image.
+bool canBlitToSwapChain(App *pApp, VkFormat format) {
+  const VkFormatFeatureFlags srcFeatures = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT |
+                                           VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+                                           VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  VkFormatProperties src, dst;
+  vkGetPhysicalDeviceFormatProperties(pApp->physicalDevice, format, &src);
+  vkGetPhysicalDeviceFormatProperties(pApp->physicalDevice, pApp->swapChainImageFormat, &dst);
+  return (pApp->swapChainImageUsage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) &&
+         (src.optimalTilingFeatures & srcFeatures) == srcFeatures &&
+         (dst.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
+}
+
+// Post-processing renders the scene in a float format, so bloom and tonemapping see values
+// above 1, and runs its compute passes on storage images of the same format.
+void choosePostProcessing(App *pApp) {
+  pApp->sceneFormat = pApp->swapChainImageFormat;
+  const char *effects = getenv("SE_POST");
+  if (effects == NULL) {
+    return;
+  }
+  if (!postParseEffects(effects, pApp->postEffects, &pApp->postEffectCount) || pApp->postEffectCount == 0) {
+    fprintf(stderr, "SE_POST is not a list of bloom, tonemap and sharpen; post-processing disabled.\n");
+    return;
+  }
+
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(pApp->physicalDevice, POST_FORMAT, &properties);
+  if (!(properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) ||
+      !canBlitToSwapChain(pApp, POST_FORMAT)) {
+    fprintf(stderr, "Post-processing images cannot be stored to or blitted; post-processing disabled.\n");
+    return;
+  }
+
+  pApp->isPostProcessing = true;
+  pApp->sceneFormat = POST_FORMAT;
+  fprintf(stderr, "Post-processing:");
+  for (uint32_t i = 0; i < pApp->postEffectCount; i++) {
+    fprintf(stderr, " %s", postEffectName(pApp->postEffects[i]));
+  }
+  fprintf(stderr, "\n");
+}
+
+// Dynamic resolution needs GPU timestamps to measure against the budget and a scene format
+// that can be blitted with linear filtering.
+void chooseDynamicResolution(App *pApp) {
+  const char *budget = getenv("SE_GPU_BUDGET_MS");
+  if (budget == NULL) {
+    return;
+  }
+  const DeviceCaps *caps = &pApp->deviceCaps;
+  if (atof(budget) <= 0.0) {
+    fprintf(stderr, "SE_GPU_BUDGET_MS is not a positive time in ms; dynamic resolution disabled.\n");
+    return;
+  }
+
+  if (!canBlitToSwapChain(pApp, pApp->sceneFormat)) {
+    fprintf(stderr, "Swap chain images cannot be blitted to; dynamic resolution disabled.\n");
+    return;
+  }
+  if (caps->queueFamilies[pApp->queueFamilyIndices.graphicsFamily].timestampValidBits == 0 ||
+      caps->properties.limits.timestampPeriod <= 0.0f) {
+    fprintf(stderr, "GPU timestamps not supported; dynamic resolution disabled.\n");
+    return;
+  }
+
+  const char *minScale = getenv("SE_MIN_RENDER_SCALE");
+  dynresInit(&pApp->dynres, (float)atof(budget), minScale ? (float)atof(minScale) : DEFAULT_MIN_RENDER_SCALE);
+  pApp->isDynamicResolution = true;
+  fprintf(stderr, "Dynamic resolution: %.2f ms GPU budget, scale %.2f..1\n", pApp->dynres.budgetMs,
+          pApp->dynres.minScale);
+}
+
+// Transient attachments go to lazily allocated memory where the device has it: on tilers
+// they then live only in tile memory and never get physical pages.
+bool createAttachment(App *pApp, VkExtent2D extent, VkFormat format, VkSampleCountFlagBits samples,
+                      VkImageUsageFlags usage, VkImageAspectFlags aspect, VkImage *image,
+                      VkDeviceMemory *memory, VkImageView *view) {
+  VkImageCreateInfo imageInfo = {.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                                 .imageType = VK_IMAGE_TYPE_2D,
+                                 .format = format,
+                                 .extent = {extent.width, extent.height, 1},
+                                 .mipLevels = 1,
+                                 .arrayLayers = 1,
+                                 .samples = samples,
+                                 .tiling = VK_IMAGE_TILING_OPTIMAL,
+                                 .usage = usage,
+                                 .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                                 .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+  if (vkCreateImage(pApp->device, &imageInfo, pApp->pAllocator, image) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create attachment image!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  VkMemoryRequirements memRequirements;
+  vkGetImageMemoryRequirements(pApp->device, *image, &memRequirements);
+  uint32_t memoryType = UINT32_MAX;
+  if (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) {
+    memoryType = deviceCapsFindMemoryType(&pApp->deviceCaps, memRequirements.memoryTypeBits,
+                                          VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+  }
+  bool lazy = memoryType != UINT32_MAX;
+  if (!lazy) {
+    memoryType = deviceCapsFindMemoryType(&pApp->deviceCaps, memRequirements.memoryTypeBits,
+                                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  }
+  VkMemoryAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                                    .allocationSize = memRequirements.size,
+                                    .memoryTypeIndex = memoryType};
+  if (memoryType == UINT32_MAX ||
+      memoryBudgetAllocate(&pApp->memoryBudget, pApp->device, &allocInfo, pApp->pAllocator, memory) !=
+          VK_SUCCESS) {
+    fprintf(stderr, "Failed to allocate attachment memory!\n");
+    exit(EXIT_FAILURE);
+  }
+  vkBindImageMemory(pApp->device, *image, *memory, 0);
+
+  VkImageViewCreateInfo viewInfo = {.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                                    .image = *image,
+                                    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                                    .format = format,
+                                    .subresourceRange.aspectMask = aspect,
+                                    .subresourceRange.levelCount = 1,
+                                    .subresourceRange.layerCount = 1};
+  if (vkCreateImageView(pApp->device, &viewInfo, pApp->pAllocator, view) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create attachment image view!\n");
+    exit(EXIT_FAILURE);
+  }
+  return lazy;
+}
+
+// The multisampled color image is only ever touched inside the render pass: cleared on load,
+// resolved into the swapchain image at the end of the subpass and never stored.
+void createAttachments(App *pApp, View *view) {
+  VkExtent2D extent = view->swapChainExtent;
+  if (pApp->msaaSamples > VK_SAMPLE_COUNT_1_BIT) {
+    view->colorImageLazy =
+        createAttachment(pApp, extent, pApp->sceneFormat, pApp->msaaSamples,
+                         VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+                         VK_IMAGE_ASPECT_COLOR_BIT, &view->colorImage, &view->colorImageMemory,
+                         &view->colorImageView);
+  }
+  createAttachment(pApp, extent, pApp->depthFormat, pApp->msaaSamples,
+                   VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                   VK_IMAGE_ASPECT_DEPTH_BIT, &view->depthImage, &view->depthImageMemory,
+                   &view->depthImageView);
+  // Allocated at full size: the controller only changes the render area, never the image.
+  // Post-processing reads it as a storage image; otherwise it is blitted from.
+  if (rendersOffscreen(pApp)) {
+    VkImageUsageFlags read =
+        pApp->isPostProcessing ? VK_IMAGE_USAGE_STORAGE_BIT : VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    createAttachment(pApp, extent, pApp->sceneFormat, VK_SAMPLE_COUNT_1_BIT,
+                     VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | read, VK_IMAGE_ASPECT_COLOR_BIT, &view->sceneImage,
+                     &view->sceneImageMemory, &view->sceneImageView);
+  }
+}
+
+// Attachment memory for every supported sample count at the main window's extent, per view.
+// Only the color image is transient; depth is stored for the Hi-Z build.
+void reportMsaaFootprint(App *pApp) {
+  const VkPhysicalDeviceLimits *limits = &pApp->deviceCaps.properties.limits;
+  VkSampleCountFlags supported = limits->framebufferColorSampleCounts & limits->framebufferDepthSampleCounts &
+                                 limits->sampledImageDepthSampleCounts;
+  VkExtent2D extent = pApp->views[0].swapChainExtent;
+
+  fprintf(stderr, "MSAA attachment footprint at %ux%u:\n", extent.width, extent.height);
+  for (uint32_t samples = VK_SAMPLE_COUNT_1_BIT; samples <= VK_SAMPLE_COUNT_8_BIT; samples <<= 1) {
+    if (!(supported & samples)) {
+      continue;
+    }
+
+    VkImageCreateInfo imageInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = pApp->depthFormat,
+        .extent = {extent.width, extent.height, 1},
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = (VkSampleCountFlagBits)samples,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+    VkImage image;
+    VkMemoryRequirements depth, color = {};
+    vkCreateImage(pApp->device, &imageInfo, pApp->pAllocator, &image);
+    vkGetImageMemoryRequirements(pApp->device, image, &depth);
+    vkDestroyImage(pApp->device, image, pApp->pAllocator);
+
+    bool lazy = false;
+    if (samples > VK_SAMPLE_COUNT_1_BIT) {
+      imageInfo.format = pApp->sceneFormat;
+      imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+      vkCreateImage(pApp->device, &imageInfo, pApp->pAllocator, &image);
+      vkGetImageMemoryRequirements(pApp->device, image, &color);
+      vkDestroyImage(pApp->device, image, pApp->pAllocator);
+      lazy = deviceCapsFindMemoryType(&pApp->deviceCaps, color.memoryTypeBits,
+                                      VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != UINT32_MAX;
+    }
+
+    fprintf(stderr, "  %ux: color %6.1f MiB%s, depth %6.1f MiB%s\n", samples,
+            (double)color.size / (1024.0 * 1024.0), lazy ? " (lazily allocated)" : "",
+            (double)depth.size / (1024.0 * 1024.0), samples == pApp->msaaSamples ? "  <- selected" : "");
+  }
+}
+
+// The array lives as long as the swapchain; a view restored after eviction reuses it.
+void createFramebuffers(App *pApp, View *view) {
+  if (view->swapChainFramebuffers == NULL) {
+    view->swapChainFramebuffers =
+        arenaPushArray(&view->swapChainArena, VkFramebuffer, view->swapChainImageCount);
+  }
 
-  for (uint32_t i = 0; i < pApp->swapChainImageCount; i++) {
-    VkImageView attachments[] = {pApp->swapChainImageViews[i]};
+  for (uint32_t i = 0; i < view->swapChainImageCount; i++) {
+    // Same order as the render pass: color, depth, then the resolve target when multisampled.
+    // Rendering offscreen, the final image is the scene image, not the swapchain image.
+    bool msaa = pApp->msaaSamples > VK_SAMPLE_COUNT_1_BIT;
+    VkImageView target = rendersOffscreen(pApp) ? view->sceneImageView : view->swapChainImageViews[i];
+    VkImageView attachments[] = {msaa ? view->colorImageView : target, view->depthImageView, target};
 
     VkFramebufferCreateInfo framebufferInfo = {};
     framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
     framebufferInfo.renderPass = pApp->renderPass;
-    framebufferInfo.attachmentCount = 1;
+    framebufferInfo.attachmentCount = msaa ? 3 : 2;
     framebufferInfo.pAttachments = attachments;
-    framebufferInfo.width = pApp->swapChainExtent.width;
-    framebufferInfo.height = pApp->swapChainExtent.height;
+    framebufferInfo.width = view->swapChainExtent.width;
+    framebufferInfo.height = view->swapChainExtent.height;
     framebufferInfo.layers = 1;
 
-    if (vkCreateFramebuffer(pApp->device, &framebufferInfo, NULL, &pApp->swapChainFramebuffers[i]) !=
-        VK_SUCCESS) {
+    if (vkCreateFramebuffer(pApp->device, &framebufferInfo, pApp->pAllocator,
+                            &view->swapChainFramebuffers[i]) != VK_SUCCESS) {
       fprintf(stderr, "failed to create framebuffer!\n");
       exit(EXIT_FAILURE);
     }
   }
 }
 
-void recreateSwapChain(App *pApp) {
+// Only `view` is recreated; the other views keep their swapchains.
+void recreateSwapChain(App *pApp, View *view) {
   int width = 0, height = 0;
-  glfwGetFramebufferSize(pApp->window, &width, &height);
+  glfwGetFramebufferSize(view->window, &width, &height);
   while (width == 0 || height == 0) {
-    glfwGetFramebufferSize(pApp->window, &width, &height);
+    glfwGetFramebufferSize(view->window, &width, &height);
     glfwWaitEvents();
   }
 
   vkDeviceWaitIdle(pApp->device);
 
-  cleanupSwapChain(pApp);
+  double start = nowMs();
+  uint32_t driverQueries = pApp->deviceCaps.driverQueries;
 
-  createSwapChain(pApp);
-  createImageViews(pApp);
-  createFramebuffers(pApp);
+  // Present ids belong to the swapchain; what the idle device displayed is still recorded.
+  if (view->index == 0) {
+    latencyPoll(&pApp->latency);
+    latencySwapchainRecreated(&pApp->latency);
+  }
+  cleanupSwapChain(pApp, view);
+
+  // Formats and present modes only change with the surface; the extent changes every resize.
+  if (view->index == 0) {
+    deviceCapsRefreshSurfaceCapabilities(&pApp->deviceCaps);
+  }
+  createSwapChain(pApp, view);
+  createImageViews(pApp, view);
+  createAttachments(pApp, view);
+  createFramebuffers(pApp, view);
+  occlusionResize(&view->occlusion, view->depthImageView, view->swapChainExtent);
+  if (pApp->isPostProcessing) {
+    postResize(&view->post, view->sceneImageView, view->swapChainExtent);
+  }
+
+  if (pApp->isReadbackEnabled && view->index == 0) {
+    readbackResize(&pApp->readback, pApp->swapChainImageFormat, view->swapChainExtent);
+  }
+  if (view->index == 0) {
+    hudResize(&pApp->hud, view->swapChainImageViews, view->swapChainImageCount, view->swapChainExtent);
+  }
+
+  fprintf(stderr, "Swap chain of view %u recreated in %.3f ms (%u device queries)\n", view->index,
+          nowMs() - start, pApp->deviceCaps.driverQueries - driverQueries);
 }
 
-void recordCommandBuffer(App *pApp, VkCommandBuffer commandBuffer, uint32_t imageIndex) {
-  VkCommandBufferBeginInfo beginInfo = {};
-  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  beginInfo.flags = 0;               // Optional
-  beginInfo.pInheritanceInfo = NULL; // Optional
+// Called from memoryBudgetUpdate() once the view has not been drawn for MAX_FRAMES_IN_FLIGHT
+// frames. The swapchain stays; drawFrame() brings the attachments back with restoreView().
+static void evictView(void *data) {
+  View *view = data;
+  destroyAttachments(view->app, view);
+  fprintf(stderr, "View %u evicted under memory pressure\n", view->index);
+}
 
-  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-    fprintf(stderr, "failed to begin recording command buffer!\n");
-    exit(EXIT_FAILURE);
+// Recreates what evictView() released, and what refers to it: the framebuffers and the Hi-Z
+// and post-processing inputs. The GPU has been done with the view since before it was
+// evicted, so unlike recreateSwapChain() this does not wait for the device to idle. A resize
+// while evicted still goes through recreateSwapChain() once the acquire reports it.
+void restoreView(App *pApp, View *view) {
+  createAttachments(pApp, view);
+  createFramebuffers(pApp, view);
+  occlusionResize(&view->occlusion, view->depthImageView, view->swapChainExtent);
+  if (pApp->isPostProcessing) {
+    postResize(&view->post, view->sceneImageView, view->swapChainExtent);
   }
+}
 
+typedef struct ShaderFile {
+  size_t size;
+  char *code;
+} ShaderFile;
+
+void readFile(const char *filename, ShaderFile *shader);
+
+// Starts a capture of the frame about to be recorded: shaders first, so the pipeline
+// descriptions can refer to them by index.
+void beginFrameCapture(App *pApp, CaptureWriter *capture) {
+  captureBegin(capture, pApp->sceneFormat, pApp->depthFormat, pApp->views[0].swapChainExtent);
+
+  ShaderFile vertShader = {};
+  ShaderFile fragShader = {};
+  readFile(VERT_SHADER_PATH, &vertShader);
+  readFile(FRAG_SHADER_PATH, &fragShader);
+  uint32_t vert = captureShader(capture, vertShader.code, vertShader.size);
+  uint32_t frag = captureShader(capture, fragShader.code, fragShader.size);
+  free(vertShader.code);
+  free(fragShader.code);
+
+  pApp->graphicsPipelineDesc.vertexShader = vert;
+  pApp->graphicsPipelineDesc.fragmentShader = frag;
+  pApp->depthPrepassPipelineDesc.vertexShader = vert;
+  pApp->depthEqualPipelineDesc.vertexShader = vert;
+  pApp->depthEqualPipelineDesc.fragmentShader = frag;
+}
+
+// Specialization constants of shader.frag for a scene variant key.
+void sceneVariantConstants(uint32_t key, uint32_t constants[CAPTURE_SPECIALIZATION_CONSTANTS]) {
+  constants[0] = !(key & SCENE_VARIANT_BRANCHING);
+  constants[1] = key & SCENE_FEATURE_MASK;
+  constants[2] = (key & SCENE_LIGHT_COUNT_MASK) >> SCENE_LIGHT_COUNT_SHIFT;
+}
+
+// The scene pass is recorded through the sceneCmd functions, which append each command to the
+// frame capture as well when there is one, so the capture cannot drift from what is drawn.
+// Culling results only exist on the GPU, so a capture draws every instance of the scene; the
+// replay then measures the passes without culling.
+
+void sceneCmdBeginRenderPass(App *pApp, View *view, VkCommandBuffer commandBuffer, CaptureWriter *capture) {
   VkRenderPassBeginInfo renderPassInfo = {};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   renderPassInfo.renderPass = pApp->renderPass;
-  renderPassInfo.framebuffer = pApp->swapChainFramebuffers[imageIndex];
+  renderPassInfo.framebuffer = view->swapChainFramebuffers[view->imageIndex];
   renderPassInfo.renderArea.offset.x = 0;
   renderPassInfo.renderArea.offset.y = 0;
-  renderPassInfo.renderArea.extent = pApp->swapChainExtent;
+  renderPassInfo.renderArea.extent = view->renderExtent;
 
-  VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-  renderPassInfo.clearValueCount = 1;
-  renderPassInfo.pClearValues = &clearColor;
+  // The resolve attachment is not cleared; its entry is ignored.
+  VkClearValue clearValues[] = {{.color = {{0.0f, 0.0f, 0.0f, 1.0f}}}, {.depthStencil = {1.0f, 0}}, {}};
+  renderPassInfo.clearValueCount = pApp->msaaSamples > VK_SAMPLE_COUNT_1_BIT ? 3 : 2;
+  renderPassInfo.pClearValues = clearValues;
 
   vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+  if (capture) {
+    CaptureBeginRenderPass begin = {.clearDepth = clearValues[1].depthStencil.depth,
+                                    .width = view->renderExtent.width,
+                                    .height = view->renderExtent.height};
+    memcpy(begin.clearColor, clearValues[0].color.float32, sizeof(begin.clearColor));
+    captureCmd(capture, CAPTURE_CMD_BEGIN_RENDER_PASS, &begin, sizeof(begin));
+  }
+}
 
-  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pApp->graphicsPipeline);
-
+void sceneCmdSetViewport(View *view, VkCommandBuffer commandBuffer, CaptureWriter *capture) {
   VkViewport viewport = {};
   viewport.x = 0.0f;
   viewport.y = 0.0f;
-  viewport.width = (float)pApp->swapChainExtent.width;
-  viewport.height = (float)pApp->swapChainExtent.height;
+  viewport.width = (float)view->renderExtent.width;
+  viewport.height = (float)view->renderExtent.height;
   viewport.minDepth = 0.0f;
   viewport.maxDepth = 1.0f;
   vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
@@ -341,55 +1140,696 @@ void recordCommandBuffer(App *pApp, VkCommandBuffer commandBuffer, uint32_t imag
   VkRect2D scissor = {};
   scissor.offset.x = 0;
   scissor.offset.y = 0;
-  scissor.extent = pApp->swapChainExtent;
+  scissor.extent = view->renderExtent;
   vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-  vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+  if (capture) {
+    captureCmd(capture, CAPTURE_CMD_SET_VIEWPORT, &viewport, sizeof(viewport));
+    captureCmd(capture, CAPTURE_CMD_SET_SCISSOR, &scissor, sizeof(scissor));
+  }
+}
+
+// `instanceBuffer` holds the visible instances; a capture gets all of them.
+void sceneCmdBindBuffers(App *pApp, VkCommandBuffer commandBuffer, CaptureWriter *capture,
+                         VkBuffer instanceBuffer) {
+  VkBuffer vertexBuffers[] = {pApp->vertexBuffer, instanceBuffer};
+  VkDeviceSize offsets[] = {0, 0};
+  vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+  vkCmdBindIndexBuffer(commandBuffer, pApp->indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+
+  if (capture) {
+    const Scene *scene = &pApp->scene;
+    CaptureBindBuffer vertices = {
+        .binding = 0,
+        .buffer = captureBuffer(capture, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, scene->vertices,
+                                sizeof(SceneVertex) * scene->vertexCount)};
+    CaptureBindBuffer instances = {
+        .binding = 1,
+        .buffer = captureBuffer(capture, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, scene->instances,
+                                sizeof(SceneInstance) * scene->instanceCount)};
+    CaptureBindBuffer indices = {
+        .binding = VK_INDEX_TYPE_UINT16,
+        .buffer = captureBuffer(capture, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, scene->indices,
+                                sizeof(uint16_t) * scene->indexCount)};
+    captureCmd(capture, CAPTURE_CMD_BIND_VERTEX_BUFFER, &vertices, sizeof(vertices));
+    captureCmd(capture, CAPTURE_CMD_BIND_VERTEX_BUFFER, &instances, sizeof(instances));
+    captureCmd(capture, CAPTURE_CMD_BIND_INDEX_BUFFER, &indices, sizeof(indices));
+  }
+}
+
+void sceneCmdPushConstants(App *pApp, VkCommandBuffer commandBuffer, CaptureWriter *capture,
+                           const ScenePushConstants *pushConstants) {
+  vkCmdPushConstants(commandBuffer, pApp->pipelineLayout, CAPTURE_PUSH_CONSTANT_STAGES, 0,
+                     sizeof(*pushConstants), pushConstants);
+  if (capture) {
+    // The data follows the header directly; a struct would pad it to the alignment of Mat4.
+    CapturePushConstants header = {.stageFlags = CAPTURE_PUSH_CONSTANT_STAGES};
+    uint8_t push[sizeof(header) + sizeof(*pushConstants)];
+    memcpy(push, &header, sizeof(header));
+    memcpy(push + sizeof(header), pushConstants, sizeof(*pushConstants));
+    captureCmd(capture, CAPTURE_CMD_PUSH_CONSTANTS, push, sizeof(push));
+  }
+}
+
+// `desc` describes `pipeline` for the capture.
+void sceneCmdBindPipeline(VkCommandBuffer commandBuffer, CaptureWriter *capture, VkPipeline pipeline,
+                          const CapturePipeline *desc) {
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+  if (capture) {
+    uint32_t index = capturePipeline(capture, desc);
+    captureCmd(capture, CAPTURE_CMD_BIND_PIPELINE, &index, sizeof(index));
+  }
+}
+
+void sceneCmdDraw(App *pApp, VkCommandBuffer commandBuffer, CaptureWriter *capture, VkBuffer indirectBuffer) {
+  vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+  if (capture) {
+    CaptureDrawIndexed draw = {.indexCount = pApp->scene.indexCount,
+                               .instanceCount = pApp->scene.instanceCount};
+    captureCmd(capture, CAPTURE_CMD_DRAW_INDEXED, &draw, sizeof(draw));
+  }
+}
+
+void sceneCmdEndRenderPass(VkCommandBuffer commandBuffer, CaptureWriter *capture) {
+  vkCmdEndRenderPass(commandBuffer);
+  if (capture) {
+    captureCmd(capture, CAPTURE_CMD_END_RENDER_PASS, NULL, 0);
+  }
+}
+
+// Scales the render area of `image` up to the whole swapchain image, converting the format on
+// the way. The swapchain image ends in PRESENT_SRC layout, as the render pass would have left it.
+void recordUpscale(View *view, VkCommandBuffer commandBuffer, VkImage image, VkImageLayout layout) {
+  VkImage swapChainImage = view->swapChainImages[view->imageIndex];
+  VkImageMemoryBarrier toTransfer = {.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                                     .srcAccessMask = 0,
+                                     .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                                     .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                                     .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                     .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                     .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                     .image = swapChainImage,
+                                     .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                     .subresourceRange.levelCount = 1,
+                                     .subresourceRange.layerCount = 1};
+  // The submit waits for the acquire semaphore at the transfer stage.
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                       NULL, 0, NULL, 1, &toTransfer);
+
+  VkImageBlit region = {
+      .srcSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1},
+      .srcOffsets = {{0, 0, 0}, {(int32_t)view->renderExtent.width, (int32_t)view->renderExtent.height, 1}},
+      .dstSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1},
+      .dstOffsets = {{0, 0, 0},
+                     {(int32_t)view->swapChainExtent.width, (int32_t)view->swapChainExtent.height, 1}}};
+  vkCmdBlitImage(commandBuffer, image, layout, swapChainImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                 &region, VK_FILTER_LINEAR);
+
+  // Readback copies the image next; its barrier waits on color attachment output.
+  VkImageMemoryBarrier toPresent = toTransfer;
+  toPresent.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  toPresent.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  toPresent.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  toPresent.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                       NULL, 0, NULL, 1, &toPresent);
+}
+
+// The frame's GPU time is measured from the first view of the batch to the end of the last.
+void recordCommandBuffer(App *pApp, View *view, VkCommandBuffer commandBuffer, bool firstView, bool lastView,
+                         CaptureWriter *capture) {
+  VkCommandBufferBeginInfo beginInfo = {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = 0;               // Optional
+  beginInfo.pInheritanceInfo = NULL; // Optional
+
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+    fprintf(stderr, "failed to begin recording command buffer!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (pApp->timestampQueryPool && firstView) {
+    vkCmdResetQueryPool(commandBuffer, pApp->timestampQueryPool, currentFrame * 2, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pApp->timestampQueryPool,
+                        currentFrame * 2);
+  }
+
+  // The render area shrinks with the scale; the aspect ratio and the images stay the same.
+  view->renderExtent =
+      pApp->isDynamicResolution ? dynresExtent(&pApp->dynres, view->swapChainExtent) : view->swapChainExtent;
+  if (pApp->frameRenderScale && firstView) {
+    pApp->frameRenderScale[currentFrame] =
+        (float)view->renderExtent.width / (float)view->swapChainExtent.width;
+  }
+
+  // Each view has its own camera, spread evenly around the orbit.
+  double seconds = onDemandAnimationSeconds(&pApp->onDemand, nowMs()) +
+                   CAMERA_ORBIT_SECONDS * view->index / pApp->viewCount;
+  float aspect = (float)view->swapChainExtent.width / (float)view->swapChainExtent.height;
+  Mat4 viewProj = sceneViewProj(&pApp->scene, seconds, aspect);
+
+  // Visible instances are compacted into this frame's instance buffer before anything is drawn.
+  occlusionRecordCull(&view->occlusion, commandBuffer, currentFrame, &viewProj, occlusionCullingEnabled);
+
+  // With fewer lights than the buffer holds, each reaches further, so a point of the scene is
+  // lit by about as many lights whatever their number.
+  bool lightBuffer = sceneVariant & SCENE_FEATURE_LIGHT_BUFFER;
+  if (lightBuffer) {
+    Mat4 cameraView = sceneView(&pApp->scene, seconds);
+    float rangeScale = sqrtf((float)pApp->scene.lightCount / (float)pApp->bufferLightCount);
+    clustersRecord(&view->clusters, commandBuffer, currentFrame, &cameraView, aspect, sceneZFar(&pApp->scene),
+                   view->renderExtent, pApp->bufferLightCount, rangeScale,
+                   sceneVariant & SCENE_FEATURE_CLUSTERED);
+  }
+
+  bool mainView = view->index == 0;
+  if (pApp->statsQueryPool && mainView) {
+    vkCmdResetQueryPool(commandBuffer, pApp->statsQueryPool, currentFrame, 1);
+    vkCmdBeginQuery(commandBuffer, pApp->statsQueryPool, currentFrame, 0);
+  }
+
+  sceneCmdBeginRenderPass(pApp, view, commandBuffer, capture);
+  sceneCmdSetViewport(view, commandBuffer, capture);
+  pApp->frameStateChanges += 2;
+
+  const OcclusionFrame *culled = &view->occlusion.frames[currentFrame];
+  sceneCmdBindBuffers(pApp, commandBuffer, capture, culled->visibleBuffer);
+  ScenePushConstants pushConstants = {
+      .viewProj = viewProj,
+      .features = sceneVariant & SCENE_FEATURE_MASK,
+      .lightCount = (sceneVariant & SCENE_LIGHT_COUNT_MASK) >> SCENE_LIGHT_COUNT_SHIFT,
+      .lightRadius = 0.5f * pApp->scene.extent};
+  sceneCmdPushConstants(pApp, commandBuffer, capture, &pushConstants);
+  pApp->frameStateChanges += 3;
+  if (lightBuffer) {
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pApp->pipelineLayout, 0, 1,
+                            &view->clusters.frames[currentFrame].set, 0, NULL);
+    pApp->frameStateChanges++;
+  }
+
+  // With the pre-pass every covered pixel is shaded once: the second pass only passes the
+  // depth test where its fragment is the one that ended up nearest.
+  if (depthPrepassEnabled) {
+    sceneCmdBindPipeline(commandBuffer, capture, pApp->depthPrepassPipeline, &pApp->depthPrepassPipelineDesc);
+    sceneCmdDraw(pApp, commandBuffer, capture, culled->indirectBuffer);
+    pApp->framePipelineBinds++;
+    pApp->frameDraws++;
+  }
+  // A key drawn with for the first time is compiled here, stalling this frame.
+  uint32_t variant = sceneVariant | (depthPrepassEnabled ? SCENE_VARIANT_DEPTH_EQUAL : 0);
+  const CapturePipeline *desc =
+      depthPrepassEnabled ? &pApp->depthEqualPipelineDesc : &pApp->graphicsPipelineDesc;
+  CapturePipeline variantDesc;
+  if (capture) {
+    variantDesc = *desc;
+    sceneVariantConstants(variant, variantDesc.specialization);
+    desc = &variantDesc;
+  }
+  sceneCmdBindPipeline(commandBuffer, capture, pipelineVariantsGet(&pApp->sceneVariants, variant), desc);
+  sceneCmdDraw(pApp, commandBuffer, capture, culled->indirectBuffer);
+  pApp->framePipelineBinds++;
+  pApp->frameDraws++;
+
+  sceneCmdEndRenderPass(commandBuffer, capture);
+
+  if (pApp->statsQueryPool && mainView) {
+    vkCmdEndQuery(commandBuffer, pApp->statsQueryPool, currentFrame);
+  }
+  if (firstView) {
+    pApp->framePending[currentFrame] = true;
+  }
+  if (mainView) {
+    pApp->statsPending[currentFrame] = true;
+  }
+
+  if (occlusionCullingEnabled) {
+    occlusionRecordBuild(&view->occlusion, commandBuffer, &viewProj, view->renderExtent);
+  } else {
+    occlusionInvalidate(&view->occlusion);
+  }
+
+  // Post-processing works on the render area only; the blit scales its result up.
+  if (pApp->isPostProcessing) {
+    VkImage result = postRecord(&view->post, commandBuffer, currentFrame, view->renderExtent);
+    recordUpscale(view, commandBuffer, result, VK_IMAGE_LAYOUT_GENERAL);
+  } else if (pApp->isDynamicResolution) {
+    recordUpscale(view, commandBuffer, view->sceneImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+  }
+  if (pApp->timestampQueryPool && lastView) {
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pApp->timestampQueryPool,
+                        currentFrame * 2 + 1);
+  }
+
+  if (pApp->isReadbackEnabled && mainView) {
+    readbackRecordCopy(&pApp->readback, commandBuffer, view->swapChainImages[view->imageIndex], currentFrame);
+  }
+
+  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+    fprintf(stderr, "failed to record command buffer!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// SE_VARIANT_SWEEP: after one warm-up report interval, draws one interval with each light
+// count of LIGHT_COUNT_CYCLE, specialized and then branching, prints their GPU times and quits.
+void advanceVariantSweep(App *pApp, double gpuMs) {
+  const uint32_t stepCount = 2 * LIGHT_COUNT_CYCLE_LENGTH;
+  if (pApp->sweepStep > 0) {
+    pApp->sweepGpuMs[pApp->sweepStep - 1] = gpuMs;
+  }
+  if (pApp->sweepStep == stepCount) {
+    fprintf(stderr, "Shading variants, GPU ms per frame:\n  lights  specialized  branching\n");
+    for (uint32_t i = 0; i < LIGHT_COUNT_CYCLE_LENGTH; i++) {
+      double specialized = pApp->sweepGpuMs[2 * i], branching = pApp->sweepGpuMs[2 * i + 1];
+      fprintf(stderr, "  %6u  %11.3f  %9.3f (%+.1f%%)\n", LIGHT_COUNT_CYCLE[i], specialized, branching,
+              100.0 * (branching - specialized) / specialized);
+    }
+    glfwSetWindowShouldClose(pApp->views[0].window, GLFW_TRUE);
+    return;
+  }
+
+  uint32_t lights = LIGHT_COUNT_CYCLE[pApp->sweepStep / 2];
+  sceneVariant &= ~(SCENE_LIGHT_COUNT_MASK | SCENE_VARIANT_BRANCHING);
+  sceneVariant |= lights << SCENE_LIGHT_COUNT_SHIFT | (pApp->sweepStep % 2 ? SCENE_VARIANT_BRANCHING : 0);
+  pApp->sweepStep++;
+}
+
+// SE_VIEW_SWEEP: after one warm-up report interval, renders one interval with each number of
+// views from 1 to SE_VIEWS, prints their cost per frame and quits. Present mode immediate keeps
+// vsync out of the CPU times.
+void advanceViewSweep(App *pApp, double cpuMs, double gpuMs) {
+  if (pApp->viewSweepStep > 0) {
+    pApp->viewSweepCpuMs[pApp->viewSweepStep - 1] = cpuMs;
+    pApp->viewSweepGpuMs[pApp->viewSweepStep - 1] = gpuMs;
+  }
+  if (pApp->viewSweepStep == pApp->viewCount) {
+    fprintf(stderr, "Views, ms per frame (CPU: record, submit and present):\n"
+                    "  views      CPU  per view  added view      GPU\n");
+    for (uint32_t i = 0; i < pApp->viewCount; i++) {
+      double cpu = pApp->viewSweepCpuMs[i];
+      double added = i > 0 ? cpu - pApp->viewSweepCpuMs[i - 1] : cpu;
+      fprintf(stderr, "  %5u  %7.3f  %8.3f  %10.3f  %7.3f\n", i + 1, cpu, cpu / (i + 1), added,
+              pApp->viewSweepGpuMs[i]);
+    }
+    glfwSetWindowShouldClose(pApp->views[0].window, GLFW_TRUE);
+    return;
+  }
+  pApp->activeViewCount = ++pApp->viewSweepStep;
+}
+
+// SE_LIGHT_SWEEP: after one warm-up report interval, shades one interval with each light count
+// of LIGHT_SWEEP_COUNTS the light buffer holds, looping over every light and then clustered,
+// prints their GPU times and quits. The cost per fragment needs the pipeline statistics.
+void advanceLightSweep(App *pApp, double gpuMs, double fragments) {
+  uint32_t countsUsed = 0;
+  while (countsUsed < LIGHT_SWEEP_LENGTH && LIGHT_SWEEP_COUNTS[countsUsed] <= pApp->scene.lightCount) {
+    countsUsed++;
+  }
+  if (pApp->lightSweepStep > 0) {
+    pApp->lightSweepGpuMs[pApp->lightSweepStep - 1] = gpuMs;
+    pApp->lightSweepFragments[pApp->lightSweepStep - 1] = fragments;
+  }
+  if (pApp->lightSweepStep == 2 * countsUsed) {
+    fprintf(stderr, "Light buffer, GPU ms per frame (ns per fragment):\n"
+                    "  lights  every light         clustered\n");
+    for (uint32_t i = 0; i < countsUsed; i++) {
+      double naive = pApp->lightSweepGpuMs[2 * i], clustered = pApp->lightSweepGpuMs[2 * i + 1];
+      double naiveFragments = pApp->lightSweepFragments[2 * i];
+      double clusteredFragments = pApp->lightSweepFragments[2 * i + 1];
+      fprintf(stderr, "  %6u  %7.3f (%6.2f)  %7.3f (%6.2f)  %.1fx\n", LIGHT_SWEEP_COUNTS[i], naive,
+              naiveFragments > 0.0 ? 1e6 * naive / naiveFragments : 0.0, clustered,
+              clusteredFragments > 0.0 ? 1e6 * clustered / clusteredFragments : 0.0, naive / clustered);
+    }
+    glfwSetWindowShouldClose(pApp->views[0].window, GLFW_TRUE);
+    return;
+  }
+
+  pApp->bufferLightCount = LIGHT_SWEEP_COUNTS[pApp->lightSweepStep / 2];
+  sceneVariant &= ~(SCENE_FEATURE_LIGHT_BUFFER | SCENE_FEATURE_CLUSTERED);
+  sceneVariant |= SCENE_FEATURE_LIGHTING | SCENE_FEATURE_LIGHT_BUFFER |
+                  (pApp->lightSweepStep % 2 ? SCENE_FEATURE_CLUSTERED : 0);
+  pApp->lightSweepStep++;
+}
+
+// Called once the frame slot's fence has signaled: its queries and visible count are final.
+// Instance and pipeline statistics are those of the main window.
+void collectFrameStats(App *pApp) {
+  if (pApp->isPostProcessing) {
+    for (uint32_t i = 0; i < pApp->viewCount; i++) {
+      postCollectTimings(&pApp->views[i].post, currentFrame);
+    }
+  }
+  if (!pApp->framePending[currentFrame]) {
+    return;
+  }
+  pApp->framePending[currentFrame] = false;
+
+  // Only the main window's commands reset and fill its queries and visible count.
+  if (pApp->statsPending[currentFrame]) {
+    pApp->statsPending[currentFrame] = false;
+    pApp->statsMainFrames++;
+    pApp->statsDrawn += occlusionVisibleCount(&pApp->views[0].occlusion, currentFrame);
+    if (pApp->statsQueryPool) {
+      // Results are ordered by statistic bit: input assembly primitives, then fragment invocations.
+      uint64_t results[2];
+      if (vkGetQueryPoolResults(pApp->device, pApp->statsQueryPool, currentFrame, 1, sizeof(results), results,
+                                sizeof(results), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        pApp->statsPrimitives += results[0];
+        pApp->statsFragments += results[1];
+      }
+    }
+  }
+
+  if (pApp->timestampQueryPool) {
+    const DeviceCaps *caps = &pApp->deviceCaps;
+    uint32_t validBits = caps->queueFamilies[pApp->queueFamilyIndices.graphicsFamily].timestampValidBits;
+    uint64_t mask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+    uint64_t timestamps[2];
+    if (vkGetQueryPoolResults(pApp->device, pApp->timestampQueryPool, currentFrame * 2, 2, sizeof(timestamps),
+                              timestamps, sizeof(timestamps[0]), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+      uint64_t ticks = (timestamps[1] - timestamps[0]) & mask;
+      double gpuMs = (double)ticks * caps->properties.limits.timestampPeriod * 1e-6;
+      float frameScale = pApp->frameRenderScale[currentFrame];
+      pApp->statsGpuMs += gpuMs;
+      pApp->statsRenderScale += frameScale;
+      pApp->hudGpuMs[pApp->hudGpuHead] = (float)gpuMs;
+      pApp->hudGpuHead = (pApp->hudGpuHead + 1) % HUD_HISTORY;
+      if (pApp->isDynamicResolution) {
+        dynresUpdate(&pApp->dynres, (float)gpuMs, frameScale);
+      }
+    }
+  }
+
+  if (++pApp->statsFrames < STATS_REPORT_INTERVAL) {
+    return;
+  }
+  // Frames the main window was not recorded in (minimized, say) do not count towards its averages.
+  double frames = (double)pApp->statsFrames;
+  double mainFrames = pApp->statsMainFrames > 0 ? (double)pApp->statsMainFrames : 1.0;
+  fprintf(stderr, "Pre-pass %s, occlusion %s: %.0f/%u instances drawn", depthPrepassEnabled ? "on" : "off",
+          occlusionCullingEnabled ? "on" : "off", (double)pApp->statsDrawn / mainFrames,
+          pApp->scene.instanceCount);
+  if (pApp->statsQueryPool) {
+    fprintf(stderr, ", %.0f primitives, %.0f fragment invocations per frame",
+            (double)pApp->statsPrimitives / mainFrames, (double)pApp->statsFragments / mainFrames);
+  }
+  if (pApp->timestampQueryPool) {
+    fprintf(stderr, ", GPU %.2f ms at %.0f%% resolution", pApp->statsGpuMs / frames,
+            100.0 * pApp->statsRenderScale / frames);
+  }
+  uint32_t lights = (sceneVariant & SCENE_LIGHT_COUNT_MASK) >> SCENE_LIGHT_COUNT_SHIFT;
+  if (sceneVariant & SCENE_FEATURE_LIGHT_BUFFER) {
+    fprintf(stderr, ", %u buffer lights %s", pApp->bufferLightCount,
+            sceneVariant & SCENE_FEATURE_CLUSTERED ? "clustered" : "unculled");
+  } else {
+    fprintf(stderr, ", %u point lights", lights);
+  }
+  fprintf(stderr, " %s\n", sceneVariant & SCENE_VARIANT_BRANCHING ? "branching" : "specialized");
+  double cpuFrames = pApp->statsCpuFrames > 0 ? (double)pApp->statsCpuFrames : 1.0;
+  double cpuMs = (pApp->statsRecordMs + pApp->statsSubmitMs) / cpuFrames;
+  if (pApp->viewCount > 1) {
+    double views = (double)pApp->statsViewsPresented / cpuFrames;
+    fprintf(stderr,
+            "%.1f views per frame: CPU acquire %.3f ms, record %.3f ms, submit and present %.3f ms "
+            "(%.3f ms per view)\n",
+            views, pApp->statsAcquireMs / cpuFrames, pApp->statsRecordMs / cpuFrames,
+            pApp->statsSubmitMs / cpuFrames, views > 0.0 ? cpuMs / views : 0.0);
+  }
+  if (pApp->isVariantSweep) {
+    advanceVariantSweep(pApp, pApp->statsGpuMs / frames);
+  }
+  if (pApp->isViewSweep) {
+    advanceViewSweep(pApp, cpuMs, pApp->statsGpuMs / frames);
+  }
+  if (pApp->isLightSweep) {
+    advanceLightSweep(pApp, pApp->statsGpuMs / frames, (double)pApp->statsFragments / mainFrames);
+  }
+  framePacerReport(&pApp->pacer, stderr, presentModeName(pApp->presentMode));
+  latencyReport(&pApp->latency, stderr);
+  memoryBudgetReport(&pApp->memoryBudget, stderr);
+  if (pApp->statsHudFrames > 0) {
+    fprintf(stderr, "HUD: CPU %.3f ms per frame, %u quads\n", pApp->statsHudMs / pApp->statsHudFrames,
+            pApp->hud.quadCount);
+  }
+  if (pApp->isPostProcessing) {
+    // postReport() starts the next interval, so the HUD keeps this one's averages.
+    const PostChain *post = &pApp->views[0].post;
+    for (uint32_t i = 0; i < POST_EFFECT_COUNT && post->timedFrames > 0; i++) {
+      pApp->hudPostMs[i] = post->gpuMs[i] / (double)post->timedFrames;
+    }
+    postReport(&pApp->views[0].post, stderr);
+  }
+  pApp->statsHudFrames = 0;
+  pApp->statsHudMs = 0.0;
+  pApp->statsCpuFrames = 0;
+  pApp->statsViewsPresented = 0;
+  pApp->statsAcquireMs = 0.0;
+  pApp->statsRecordMs = 0.0;
+  pApp->statsSubmitMs = 0.0;
+  pApp->statsFrames = 0;
+  pApp->statsMainFrames = 0;
+  pApp->statsDrawn = 0;
+  pApp->statsPrimitives = 0;
+  pApp->statsFragments = 0;
+  pApp->statsGpuMs = 0.0;
+  pApp->statsRenderScale = 0.0;
+}
+
+// Moves to the next mode of PRESENT_MODE_CYCLE every view supports. Within a swapchain's
+// switchable modes only the next present changes; any other mode needs a new swapchain.
+void cyclePresentMode(App *pApp) {
+  const uint32_t cycleLength = sizeof(PRESENT_MODE_CYCLE) / sizeof(PRESENT_MODE_CYCLE[0]);
+  uint32_t current = 0;
+  for (uint32_t i = 0; i < cycleLength; i++) {
+    if (PRESENT_MODE_CYCLE[i] == pApp->presentMode) {
+      current = i;
+    }
+  }
+
+  VkPresentModeKHR next = pApp->presentMode;
+  for (uint32_t step = 1; step < cycleLength && next == pApp->presentMode; step++) {
+    VkPresentModeKHR mode = PRESENT_MODE_CYCLE[(current + step) % cycleLength];
+    bool supported = true;
+    for (uint32_t i = 0; i < pApp->viewCount; i++) {
+      supported &= viewSupportsPresentMode(pApp, &pApp->views[i], mode);
+    }
+    if (supported) {
+      next = mode;
+    }
+  }
+  if (next == pApp->presentMode) {
+    fprintf(stderr, "No other present mode supported\n");
+    return;
+  }
+
+  bool switchable[MAX_VIEWS];
+  uint32_t recreateCount = 0;
+  for (uint32_t i = 0; i < pApp->viewCount; i++) {
+    const View *view = &pApp->views[i];
+    switchable[i] = false;
+    for (uint32_t j = 0; j < view->switchablePresentModeCount; j++) {
+      switchable[i] |= view->switchablePresentModes[j] == next;
+    }
+    recreateCount += !switchable[i];
+  }
+  pApp->presentMode = next;
+  if (recreateCount == 0) {
+    fprintf(stderr, "Present mode %s\n", presentModeName(next));
+    return;
+  }
+  fprintf(stderr, "Present mode %s; recreating %u swap chains\n", presentModeName(next), recreateCount);
+  for (uint32_t i = 0; i < pApp->viewCount; i++) {
+    if (!switchable[i]) {
+      recreateSwapChain(pApp, &pApp->views[i]);
+    }
+  }
+}
 
-  vkCmdEndRenderPass(commandBuffer);
+// Iconified, or inferred occluded until its next probe frame.
+static bool isViewHidden(const View *view, double now) {
+  return glfwGetWindowAttrib(view->window, GLFW_ICONIFIED) ||
+         !glfwGetWindowAttrib(view->window, GLFW_VISIBLE) || now < view->occludedUntilMs;
+}
 
-  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-    fprintf(stderr, "failed to record command buffer!\n");
-    exit(EXIT_FAILURE);
+// Frame and GPU time graphs, post-processing passes, device memory and the scene pass's
+// command counts, in the main window's top-left corner.
+static void buildHud(App *pApp) {
+  Hud *hud = &pApp->hud;
+  const uint32_t white = HUD_RGBA(255, 255, 255, 255);
+  const uint32_t grey = HUD_RGBA(180, 180, 180, 255);
+  float line = HUD_LINE_HEIGHT * hud->scale;
+  float graphWidth = 2.0f * HUD_HISTORY * hud->scale, graphHeight = 4.0f * line;
+  float x = 4.0f * hud->scale, y = x;
+
+  uint32_t last = (pApp->hudFrameHead + HUD_HISTORY - 1) % HUD_HISTORY;
+  float frameMs = pApp->hudFrameMs[last];
+  hudText(hud, x, y, white, "Frame %.2f ms (%.0f fps), %s", frameMs,
+          frameMs > 0.0f ? 1000.0f / frameMs : 0.0f, presentModeName(pApp->presentMode));
+  y += line;
+  hudGraph(hud, x, y, graphWidth, graphHeight, pApp->hudFrameMs, HUD_HISTORY, pApp->hudFrameHead,
+           HUD_GRAPH_MAX_MS, HUD_RGBA(96, 200, 96, 220));
+  y += graphHeight + line / 2;
+
+  if (pApp->timestampQueryPool) {
+    last = (pApp->hudGpuHead + HUD_HISTORY - 1) % HUD_HISTORY;
+    hudText(hud, x, y, white, "GPU %.2f ms at %.0f%% resolution", pApp->hudGpuMs[last],
+            100.0f * pApp->frameRenderScale[currentFrame]);
+    y += line;
+    hudGraph(hud, x, y, graphWidth, graphHeight, pApp->hudGpuMs, HUD_HISTORY, pApp->hudGpuHead,
+             HUD_GRAPH_MAX_MS, HUD_RGBA(96, 160, 240, 220));
+    y += graphHeight + line / 2;
+  }
+  if (pApp->isPostProcessing) {
+    float end = hudText(hud, x, y, grey, "Post:");
+    for (uint32_t i = 0; i < pApp->postEffectCount; i++) {
+      PostEffect effect = pApp->postEffects[i];
+      end = hudText(hud, end, y, grey, " %s %.3f ms", postEffectName(effect), pApp->hudPostMs[effect]);
+    }
+    y += line;
+  }
+
+  const MemoryBudget *mb = &pApp->memoryBudget;
+  for (uint32_t i = 0; i < mb->heapCount; i++) {
+    const MemoryHeapBudget *heap = &mb->heaps[i];
+    if (heap->allocationCount == 0) {
+      continue;
+    }
+    double mib = 1024.0 * 1024.0;
+    hudText(hud, x, y, grey, "Heap %u: %.1f/%.0f MiB, ours %.1f MiB in %u", i, (double)heap->usage / mib,
+            (double)heap->budget / mib, (double)heap->allocated / mib, heap->allocationCount);
+    y += line;
   }
+  hudText(hud, x, y, grey, "Scene: %u draws, %u pipeline binds, %u state changes", pApp->frameDraws,
+          pApp->framePipelineBinds, pApp->frameStateChanges);
+  y += line;
+  hudText(hud, x, y, grey, "%u views, %.0f/%u instances drawn", pApp->activeViewCount,
+          (double)occlusionVisibleCount(&pApp->views[0].occlusion, currentFrame), pApp->scene.instanceCount);
 }
 
+// Every visible view is acquired and recorded into its own command buffer; the command buffers
+// go to the queue in one submit and the images to the presentation engine in one present.
 void drawFrame(App *pApp) {
-  vkWaitForFences(pApp->device, 1, &pApp->inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+  if (presentModeSwitchRequested) {
+    presentModeSwitchRequested = false;
+    cyclePresentMode(pApp);
+  }
 
-  vkResetFences(pApp->device, 1, &pApp->inFlightFences[currentFrame]);
+  vkWaitForFences(pApp->device, 1, &pApp->inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+  latencyPoll(&pApp->latency);
 
-  uint32_t imageIndex;
-  VkResult result =
-      vkAcquireNextImageKHR(pApp->device, pApp->swapChain, UINT64_MAX,
-                            pApp->imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+  // The copy recorded the last time this frame slot was used is now complete.
+  if (pApp->isReadbackEnabled) {
+    readbackFrameComplete(&pApp->readback, currentFrame);
+  }
+  collectFrameStats(pApp);
+  memoryBudgetUpdate(&pApp->memoryBudget);
+
+  // A view whose swapchain is out of date sits this frame out once it has been recreated.
+  View *batch[MAX_VIEWS];
+  uint32_t batchCount = 0;
+  double acquireStart = nowMs();
+  for (uint32_t i = 0; i < pApp->activeViewCount; i++) {
+    View *view = &pApp->views[i];
+    if (isViewHidden(view, nowMs())) {
+      continue;
+    }
+    if (!memoryBudgetTouch(&pApp->memoryBudget, &view->evictable)) {
+      restoreView(pApp, view);
+    }
+    double start = nowMs();
+    VkResult result = vkAcquireNextImageKHR(pApp->device, view->swapChain, UINT64_MAX,
+                                            view->imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE,
+                                            &view->imageIndex);
+    double end = nowMs();
+    if (end - start > OCCLUDED_ACQUIRE_MS) {
+      view->occludedUntilMs = end + OCCLUDED_PROBE_MS;
+    }
 
-  if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-    recreateSwapChain(pApp);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+      recreateSwapChain(pApp, view);
+      continue;
+    } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+      fprintf(stderr, "Failed to acquire swap chain image!\n");
+      exit(EXIT_FAILURE);
+    }
+    batch[batchCount++] = view;
+  }
+  double acquired = nowMs();
+  latencyPoll(&pApp->latency);
+  if (batchCount == 0) {
     return;
-  } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-    fprintf(stderr, "Failed to acquire swap chain image!\n");
-    exit(EXIT_FAILURE);
   }
 
   // Only reset the fence if we are submitting work
   vkResetFences(pApp->device, 1, &pApp->inFlightFences[currentFrame]);
 
-  vkResetCommandBuffer(pApp->commandBuffers[currentFrame], 0);
-  recordCommandBuffer(pApp, pApp->commandBuffers[currentFrame], imageIndex);
+  // Captures are of the main window; a request waits until it is rendered. The capture format
+  // has no descriptor sets, so the light buffer variants, which shade from one, are refused
+  // rather than replayed with a different shader.
+  if (captureRequested && (sceneVariant & SCENE_FEATURE_LIGHT_BUFFER)) {
+    fprintf(stderr, "Frame capture is not supported with the light buffer on; turn it off (K) first.\n");
+    captureRequested = false;
+  }
+  CaptureWriter capture;
+  bool capturing = captureRequested && batch[0]->index == 0;
+  if (capturing) {
+    beginFrameCapture(pApp, &capture);
+  }
+
+  VkCommandBuffer commandBuffers[MAX_VIEWS + 1];
+  VkSemaphore waitSemaphores[MAX_VIEWS];
+  VkPipelineStageFlags waitStages[MAX_VIEWS];
+  pApp->frameDraws = 0;
+  pApp->framePipelineBinds = 0;
+  pApp->frameStateChanges = 0;
+  for (uint32_t i = 0; i < batchCount; i++) {
+    View *view = batch[i];
+    commandBuffers[i] = view->commandBuffers[currentFrame];
+    vkResetCommandBuffer(commandBuffers[i], 0);
+    recordCommandBuffer(pApp, view, commandBuffers[i], i == 0, i + 1 == batchCount,
+                        capturing && i == 0 ? &capture : NULL);
+
+    waitSemaphores[i] = view->imageAvailableSemaphores[currentFrame];
+    // Rendering offscreen the swapchain image is first written by the final blit, so the scene
+    // can be rendered and post-processed before the image is available.
+    waitStages[i] = rendersOffscreen(pApp) ? VK_PIPELINE_STAGE_TRANSFER_BIT
+                                           : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  }
+  double recorded = nowMs();
+
+  // Last in the batch, after the main window's image is complete.
+  uint32_t commandBufferCount = batchCount;
+  if (hudEnabled && batch[0]->index == 0) {
+    VkCommandBuffer hudCommandBuffer = pApp->hudCommandBuffers[currentFrame];
+    vkResetCommandBuffer(hudCommandBuffer, 0);
+    VkCommandBufferBeginInfo beginInfo = {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    if (vkBeginCommandBuffer(hudCommandBuffer, &beginInfo) != VK_SUCCESS) {
+      fprintf(stderr, "failed to begin recording command buffer!\n");
+      exit(EXIT_FAILURE);
+    }
+    hudBegin(&pApp->hud, currentFrame);
+    buildHud(pApp);
+    hudRecord(&pApp->hud, hudCommandBuffer, currentFrame, batch[0]->imageIndex);
+    if (vkEndCommandBuffer(hudCommandBuffer) != VK_SUCCESS) {
+      fprintf(stderr, "failed to record command buffer!\n");
+      exit(EXIT_FAILURE);
+    }
+    commandBuffers[commandBufferCount++] = hudCommandBuffer;
+  }
+  double hudRecorded = nowMs();
 
   VkSubmitInfo submitInfo = {};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-  VkSemaphore waitSemaphores[] = {pApp->imageAvailableSemaphores[currentFrame]};
-  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  submitInfo.waitSemaphoreCount = 1;
+  submitInfo.waitSemaphoreCount = batchCount;
   submitInfo.pWaitSemaphores = waitSemaphores;
   submitInfo.pWaitDstStageMask = waitStages;
 
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &pApp->commandBuffers[currentFrame];
+  submitInfo.commandBufferCount = commandBufferCount;
+  submitInfo.pCommandBuffers = commandBuffers;
 
+  // One semaphore for the whole batch: the present waits for every view anyway.
   VkSemaphore signalSemaphores[] = {pApp->renderFinishedSemaphores[currentFrame]};
   submitInfo.signalSemaphoreCount = 1;
   submitInfo.pSignalSemaphores = signalSemaphores;
@@ -398,6 +1838,31 @@ void drawFrame(App *pApp) {
     fprintf(stderr, "Failed to submit draw command buffer!\n");
     exit(EXIT_FAILURE);
   }
+  double submitted = nowMs();
+
+  if (capturing) {
+    char path[32];
+    snprintf(path, sizeof(path), "capture_%03u.vkcap", captureCount++);
+    captureSave(&capture, path);
+    captureFree(&capture);
+    captureRequested = false;
+  }
+
+  VkSwapchainKHR swapChains[MAX_VIEWS];
+  uint32_t imageIndices[MAX_VIEWS];
+  VkPresentModeKHR presentModes[MAX_VIEWS];
+  VkResult results[MAX_VIEWS];
+  uint64_t presentIds[MAX_VIEWS] = {0}; // 0: no id
+  for (uint32_t i = 0; i < batchCount; i++) {
+    swapChains[i] = batch[i]->swapChain;
+    imageIndices[i] = batch[i]->imageIndex;
+    presentModes[i] = pApp->presentMode;
+  }
+  // Latency is followed on the main window only.
+  bool mainPresented = batch[0]->index == 0;
+  if (mainPresented) {
+    presentIds[0] = latencyNextPresentId(&pApp->latency);
+  }
 
   VkPresentInfoKHR presentInfo = {};
   presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -405,22 +1870,65 @@ void drawFrame(App *pApp) {
   presentInfo.waitSemaphoreCount = 1;
   presentInfo.pWaitSemaphores = signalSemaphores;
 
-  VkSwapchainKHR swapChains[] = {pApp->swapChain};
-  presentInfo.swapchainCount = 1;
+  presentInfo.swapchainCount = batchCount;
   presentInfo.pSwapchains = swapChains;
-  presentInfo.pImageIndices = &imageIndex;
+  presentInfo.pImageIndices = imageIndices;
 
-  presentInfo.pResults = NULL; // Optional
+  // Per swapchain: one out of date view must not hide the others' results.
+  presentInfo.pResults = results;
+
+  VkSwapchainPresentModeInfoEXT presentModeInfo = {.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_MODE_INFO_EXT,
+                                                   .swapchainCount = batchCount,
+                                                   .pPresentModes = presentModes};
+  if (pApp->hasSwapchainMaintenance1) {
+    presentInfo.pNext = &presentModeInfo;
+  }
+  VkPresentIdKHR presentIdInfo = {.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+                                  .pNext = presentInfo.pNext,
+                                  .swapchainCount = batchCount,
+                                  .pPresentIds = presentIds};
+  if (pApp->hasPresentWait) {
+    presentInfo.pNext = &presentIdInfo;
+  }
 
   VkResult queueResult = vkQueuePresentKHR(pApp->presentQueue, &presentInfo);
+  double presented = nowMs();
+  if (mainPresented) {
+    latencyFramePresented(&pApp->latency, batch[0]->swapChain, presentIds[0],
+                          pApp->inFlightFences[currentFrame], recorded, submitted, presented);
+  }
+  framePacerRecord(&pApp->pacer, acquireStart, acquired, presented);
+  pApp->statsCpuFrames++;
+  pApp->statsViewsPresented += batchCount;
+  pApp->statsAcquireMs += acquired - acquireStart;
+  pApp->statsRecordMs += recorded - acquired;
+  pApp->statsSubmitMs += presented - hudRecorded;
+  if (commandBufferCount > batchCount) {
+    pApp->statsHudFrames++;
+    pApp->statsHudMs += hudRecorded - recorded;
+  }
+  if (pApp->lastPresentedMs > 0.0) {
+    pApp->hudFrameMs[pApp->hudFrameHead] = (float)(presented - pApp->lastPresentedMs);
+    pApp->hudFrameHead = (pApp->hudFrameHead + 1) % HUD_HISTORY;
+  }
+  pApp->lastPresentedMs = presented;
 
-  if (queueResult == VK_ERROR_OUT_OF_DATE_KHR || queueResult == VK_SUBOPTIMAL_KHR || framebufferResized) {
-    framebufferResized = false;
-    recreateSwapChain(pApp);
-  } else if (queueResult != VK_SUCCESS) {
+  if (queueResult != VK_SUCCESS && queueResult != VK_SUBOPTIMAL_KHR &&
+      queueResult != VK_ERROR_OUT_OF_DATE_KHR) {
     fprintf(stderr, "Failed to present swap chain image!\n");
     exit(EXIT_FAILURE);
   }
+  for (uint32_t i = 0; i < batchCount; i++) {
+    View *view = batch[i];
+    if (results[i] == VK_ERROR_OUT_OF_DATE_KHR || results[i] == VK_SUBOPTIMAL_KHR ||
+        view->framebufferResized) {
+      view->framebufferResized = false;
+      recreateSwapChain(pApp, view);
+    } else if (results[i] != VK_SUCCESS) {
+      fprintf(stderr, "Failed to present swap chain image!\n");
+      exit(EXIT_FAILURE);
+    }
+  }
 
   currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
@@ -435,55 +1943,223 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT
 }
 
 void framebufferResizeCallback(GLFWwindow *window, int width, int height) {
-  // App *app = glfwGetWindowUserPointer(window);
-  framebufferResized = true;
+  View *view = glfwGetWindowUserPointer(window);
+  view->framebufferResized = true;
+  frameInvalidated = true;
 }
 
+// Exposed, restored or focused: the window's contents may be needed again.
+void windowRefreshCallback(GLFWwindow *window) { frameInvalidated = true; }
+void windowIconifyCallback(GLFWwindow *window, int iconified) { frameInvalidated = true; }
+void windowFocusCallback(GLFWwindow *window, int focused) { frameInvalidated = true; }
+
+// One window per view, all taking the same keys. Closing any of them ends the session.
 void initWindow(App *pApp) {
   glfwInit();
 
   glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
-  pApp->window = glfwCreateWindow(WIN_WIDTH, WIN_HEIGHT, WIN_TITLE, NULL, NULL);
-  // glfwSetWindowUserPointer(pApp->window, pApp);
-  glfwSetFramebufferSizeCallback(pApp->window, framebufferResizeCallback);
-  glfwSetKeyCallback(pApp->window, key_callback);
+  for (uint32_t i = 0; i < pApp->viewCount; i++) {
+    View *view = &pApp->views[i];
+    char title[64];
+    snprintf(title, sizeof(title), "%s (view %u)", WIN_TITLE, i);
+    view->app = pApp;
+    view->index = i;
+    view->window = glfwCreateWindow(WIN_WIDTH, WIN_HEIGHT, i == 0 ? WIN_TITLE : title, NULL, NULL);
+    arenaInit(&view->swapChainArena, 1024);
+    glfwSetWindowUserPointer(view->window, view);
+    glfwSetFramebufferSizeCallback(view->window, framebufferResizeCallback);
+    glfwSetKeyCallback(view->window, key_callback);
+    glfwSetWindowRefreshCallback(view->window, windowRefreshCallback);
+    glfwSetWindowIconifyCallback(view->window, windowIconifyCallback);
+    glfwSetWindowFocusCallback(view->window, windowFocusCallback);
+  }
+}
+
+static bool anyWindowShouldClose(const App *pApp) {
+  for (uint32_t i = 0; i < pApp->viewCount; i++) {
+    if (glfwWindowShouldClose(pApp->views[i].window)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Applies what the GLFW callbacks recorded since the last main loop iteration.
+static void applyWindowEvents(App *pApp, double now) {
+  if (onDemandToggleRequested) {
+    onDemandToggleRequested = false;
+    onDemandSetEnabled(&pApp->onDemand, !pApp->onDemand.enabled, now);
+    fprintf(stderr, "Render on demand %s\n", pApp->onDemand.enabled ? "on" : "off");
+  }
+  if (animationToggleRequested) {
+    animationToggleRequested = false;
+    onDemandSetAnimating(&pApp->onDemand, !pApp->onDemand.animating, now);
+    fprintf(stderr, "Animation %s\n", pApp->onDemand.animating ? "running" : "paused");
+  }
+  if (lowLatencyToggleRequested) {
+    lowLatencyToggleRequested = false;
+    latencySetLowLatency(&pApp->latency, !pApp->latency.lowLatency);
+    fprintf(stderr, "Low-latency mode %s\n", pApp->latency.lowLatency ? "on" : "off");
+  }
+  if (frameInvalidated) {
+    frameInvalidated = false;
+    for (uint32_t i = 0; i < pApp->viewCount; i++) {
+      pApp->views[i].occludedUntilMs = 0.0;
+    }
+    onDemandInvalidate(&pApp->onDemand);
+  }
 }
 
+// Without render on demand frames are rendered back to back, except while every view is
+// iconified or occluded: nothing would be shown, so the loop waits for events instead.
 void mainLoop(App *pApp) {
-  while (!glfwWindowShouldClose(pApp->window)) {
+  RenderOnDemand *od = &pApp->onDemand;
+  while (!anyWindowShouldClose(pApp)) {
+    double now = nowMs();
+    if (pApp->sessionEndMs > 0.0 && now >= pApp->sessionEndMs) {
+      break;
+    }
+    applyWindowEvents(pApp, now);
+
+    // Occlusion is only inferred, so an occluded view gets a probe frame once its time is up
+    // to check whether it still holds.
+    double timeoutMs = onDemandTimeoutMs(od, now);
+    bool hidden = true;
+    double probeMs = INFINITY;
+    for (uint32_t i = 0; i < pApp->activeViewCount; i++) {
+      const View *view = &pApp->views[i];
+      hidden &= isViewHidden(view, now);
+      if (now < view->occludedUntilMs) {
+        probeMs = fmin(probeMs, view->occludedUntilMs - now);
+      }
+    }
+    if (hidden) {
+      timeoutMs = fmax(timeoutMs, probeMs);
+    }
+    if (timeoutMs > 0.0) {
+      if (pApp->sessionEndMs > 0.0) {
+        timeoutMs = fmin(timeoutMs, pApp->sessionEndMs - now);
+      }
+      if (isinf(timeoutMs)) {
+        glfwWaitEvents();
+      } else {
+        glfwWaitEventsTimeout(timeoutMs * 1e-3);
+      }
+      onDemandWaited(od, nowMs() - now, hidden);
+      continue;
+    }
+
+    // In low-latency mode input is sampled only once the previous frame is on screen, so the
+    // frame is recorded right before the GPU can start on it.
+    framePacerWait(&pApp->pacer);
+    latencyWait(&pApp->latency);
     glfwPollEvents();
+    latencyFrameSampled(&pApp->latency, nowMs());
     drawFrame(pApp);
+    onDemandFrameRendered(od, nowMs());
   }
+  onDemandReport(od, stderr, nowMs());
+  latencySessionReport(&pApp->latency, stderr);
 
   vkDeviceWaitIdle(pApp->device);
 }
 
 void cleanup(App *pApp) {
-  cleanupSwapChain(pApp);
+  if (pApp->isReadbackEnabled) {
+    readbackDestroy(&pApp->readback);
+  }
 
-  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-    vkDestroySemaphore(pApp->device, pApp->imageAvailableSemaphores[i], NULL);
-    vkDestroySemaphore(pApp->device, pApp->renderFinishedSemaphores[i], NULL);
-    vkDestroyFence(pApp->device, pApp->inFlightFences[i], NULL);
+  if (pApp->views[0].colorImageLazy && pApp->views[0].colorImageMemory != VK_NULL_HANDLE) {
+    VkDeviceSize committed;
+    vkGetDeviceMemoryCommitment(pApp->device, pApp->views[0].colorImageMemory, &committed);
+    fprintf(stderr, "MSAA color attachment: %llu bytes committed (lazily allocated)\n",
+            (unsigned long long)committed);
+  }
+
+  hudDestroy(&pApp->hud);
+  for (uint32_t i = 0; i < pApp->viewCount; i++) {
+    memoryBudgetUnregister(&pApp->memoryBudget, &pApp->views[i].evictable);
+    cleanupSwapChain(pApp, &pApp->views[i]);
   }
 
-  vkDestroyCommandPool(pApp->device, pApp->commandPool, NULL);
+  if (pApp->statsQueryPool) {
+    vkDestroyQueryPool(pApp->device, pApp->statsQueryPool, pApp->pAllocator);
+  }
+  if (pApp->timestampQueryPool) {
+    vkDestroyQueryPool(pApp->device, pApp->timestampQueryPool, pApp->pAllocator);
+  }
+  if (pApp->isDynamicResolution) {
+    fprintf(stderr, "Dynamic resolution: %u scale changes, final scale %.2f\n", pApp->dynres.changes,
+            pApp->dynres.scale);
+  }
+  for (uint32_t i = 0; i < pApp->viewCount; i++) {
+    if (pApp->isPostProcessing) {
+      postDestroy(&pApp->views[i].post);
+    }
+    clustersDestroy(&pApp->views[i].clusters);
+    occlusionDestroy(&pApp->views[i].occlusion);
+  }
+  vkDestroyBuffer(pApp->device, pApp->indexBuffer, pApp->pAllocator);
+  memoryBudgetFree(&pApp->memoryBudget, pApp->device, pApp->indexBufferMemory, pApp->pAllocator);
+  vkDestroyBuffer(pApp->device, pApp->vertexBuffer, pApp->pAllocator);
+  memoryBudgetFree(&pApp->memoryBudget, pApp->device, pApp->vertexBufferMemory, pApp->pAllocator);
+  sceneDestroy(&pApp->scene);
 
-  vkDestroyPipeline(pApp->device, pApp->graphicsPipeline, NULL);
-  vkDestroyPipelineLayout(pApp->device, pApp->pipelineLayout, NULL);
-  vkDestroyRenderPass(pApp->device, pApp->renderPass, NULL);
+  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    for (uint32_t j = 0; j < pApp->viewCount; j++) {
+      vkDestroySemaphore(pApp->device, pApp->views[j].imageAvailableSemaphores[i], pApp->pAllocator);
+    }
+    vkDestroySemaphore(pApp->device, pApp->renderFinishedSemaphores[i], pApp->pAllocator);
+    vkDestroyFence(pApp->device, pApp->inFlightFences[i], pApp->pAllocator);
+  }
 
-  DestroyDebugUtilsMessengerEXT(pApp->instance, pApp->debugMessenger, NULL);
+  vkDestroyCommandPool(pApp->device, pApp->commandPool, pApp->pAllocator);
 
-  vkDestroyDevice(pApp->device, NULL);
+  pipelineVariantsReport(&pApp->sceneVariants, stderr);
+  pipelineVariantsDestroy(&pApp->sceneVariants, getenv("SE_PIPELINE_CACHE"));
+  vkDestroyPipeline(pApp->device, pApp->depthPrepassPipeline, pApp->pAllocator);
+  for (uint32_t i = 0; i < PIPELINE_LIBRARY_PART_COUNT; i++) {
+    vkDestroyPipeline(pApp->device, pApp->scenePipeline.libraries[i], pApp->pAllocator);
+  }
+  vkDestroyShaderModule(pApp->device, pApp->scenePipeline.fragLightsShaderModule, pApp->pAllocator);
+  vkDestroyShaderModule(pApp->device, pApp->scenePipeline.fragShaderModule, pApp->pAllocator);
+  vkDestroyShaderModule(pApp->device, pApp->scenePipeline.vertShaderModule, pApp->pAllocator);
+  vkDestroyPipelineLayout(pApp->device, pApp->pipelineLayout, pApp->pAllocator);
+  vkDestroyDescriptorSetLayout(pApp->device, pApp->clusterSetLayout, pApp->pAllocator);
+  vkDestroyRenderPass(pApp->device, pApp->renderPass, pApp->pAllocator);
+
+  DestroyDebugUtilsMessengerEXT(pApp->instance, pApp->debugMessenger, pApp->pAllocator);
+
+  memoryBudgetReport(&pApp->memoryBudget, stderr);
+  memoryBudgetDestroy(&pApp->memoryBudget);
+  vkDestroyDevice(pApp->device, pApp->pAllocator);
+  deviceCapsDestroy(&pApp->deviceCaps);
+
+  for (uint32_t i = 0; i < pApp->viewCount; i++) {
+    vkDestroySurfaceKHR(pApp->instance, pApp->views[i].surface, pApp->pAllocator);
+  }
+  vkDestroyInstance(pApp->instance, pApp->pAllocator);
 
-  vkDestroySurfaceKHR(pApp->instance, pApp->surface, NULL);
-  vkDestroyInstance(pApp->instance, NULL);
+  if (pApp->pAllocator) {
+    hostAllocatorReport(&pApp->hostAllocator, stderr);
+  }
+  for (uint32_t i = 0; i < pApp->viewCount; i++) {
+    View *view = &pApp->views[i];
+    fprintf(stderr, "Swap chain arena of view %u: peak %zu bytes, %u heap allocations\n", i,
+            view->swapChainArena.peak, view->swapChainArena.blockAllocations);
+    arenaDestroy(&view->swapChainArena);
+  }
+  arenaDestroy(&pApp->deviceArena);
+  hostAllocatorDestroy(&pApp->hostAllocator);
 
-  glfwDestroyWindow(pApp->window);
+  for (uint32_t i = 0; i < pApp->viewCount; i++) {
+    glfwDestroyWindow(pApp->views[i].window);
+  }
 
   glfwTerminate();
+
+  jobSystemDestroy(pApp->jobSystem);
 }
 
 bool verifyExtensionSupport(uint32_t extensionCount, VkExtensionProperties *extensions,
@@ -504,6 +2180,14 @@ bool verifyExtensionSupport(uint32_t extensionCount, VkExtensionProperties *exte
   return true;
 }
 
+bool hasInstanceExtension(const char *name) {
+  uint32_t extensionCount = 0;
+  vkEnumerateInstanceExtensionProperties(NULL, &extensionCount, NULL);
+  VkExtensionProperties extensions[extensionCount];
+  vkEnumerateInstanceExtensionProperties(NULL, &extensionCount, extensions);
+  return verifyExtensionSupport(extensionCount, extensions, 1, &name);
+}
+
 bool checkValidationLayerSupport() {
   uint32_t layerCount;
   vkEnumerateInstanceLayerProperties(&layerCount, NULL);
@@ -558,40 +2242,46 @@ void createInstance(App *pApp) {
       .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
       .pEngineName = "No Engine",
       .engineVersion = VK_MAKE_VERSION(1, 0, 0),
-      .apiVersion = VK_API_VERSION_1_0,
+      .apiVersion = VK_API_VERSION_1_1,
   };
 
   uint32_t glfwExtensionCount;
   const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-  const char *glfwExtensionsWithDebug[glfwExtensionCount + 1];
+  const char *enabledExtensions[glfwExtensionCount + 3];
+  uint32_t enabledExtensionCount = 0;
   for (uint32_t i = 0; i < glfwExtensionCount; i++) {
-    glfwExtensionsWithDebug[i] = glfwExtensions[i];
+    enabledExtensions[enabledExtensionCount++] = glfwExtensions[i];
   }
   if (isEnabledValidationLayers) {
-    glfwExtensionsWithDebug[glfwExtensionCount] = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
+    enabledExtensions[enabledExtensionCount++] = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
+  }
+  // Needed for VK_EXT_swapchain_maintenance1 on the device.
+  pApp->hasSurfaceMaintenance1 = hasInstanceExtension(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME) &&
+                                 hasInstanceExtension(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME);
+  if (pApp->hasSurfaceMaintenance1) {
+    enabledExtensions[enabledExtensionCount++] = VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME;
+    enabledExtensions[enabledExtensionCount++] = VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME;
   }
 
   VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo = {};
   VkInstanceCreateInfo createInfo = {.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
-                                     .pApplicationInfo = &appInfo};
+                                     .pApplicationInfo = &appInfo,
+                                     .enabledExtensionCount = enabledExtensionCount,
+                                     .ppEnabledExtensionNames = enabledExtensions};
   // TODO: this is for backward compatiblility; remove it!
   if (isEnabledValidationLayers) {
     createInfo.enabledLayerCount = validationLayerCount;
     createInfo.ppEnabledLayerNames = validationLayers;
-    createInfo.enabledExtensionCount = glfwExtensionCount + 1;
-    createInfo.ppEnabledExtensionNames = glfwExtensionsWithDebug;
 
     populateDebugMessengerCreateInfo(&debugCreateInfo);
     createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT *)&debugCreateInfo;
   } else {
     createInfo.enabledLayerCount = 0;
-    createInfo.enabledExtensionCount = glfwExtensionCount;
-    createInfo.ppEnabledExtensionNames = glfwExtensions;
     createInfo.pNext = NULL;
   }
 
-  if (vkCreateInstance(&createInfo, NULL, &pApp->instance)) {
+  if (vkCreateInstance(&createInfo, pApp->pAllocator, &pApp->instance)) {
     fprintf(stderr, "Failed to create Vulkan Instance!\n");
     exit(EXIT_FAILURE);
   }
@@ -610,27 +2300,19 @@ void createInstance(App *pApp) {
 }
 
 void createSurface(App *pApp) {
-  if (glfwCreateWindowSurface(pApp->instance, pApp->window, NULL, &pApp->surface) != VK_SUCCESS) {
-    fprintf(stderr, "Failed to create window surface!\n");
-    exit(EXIT_FAILURE);
+  for (uint32_t i = 0; i < pApp->viewCount; i++) {
+    View *view = &pApp->views[i];
+    if (glfwCreateWindowSurface(pApp->instance, view->window, pApp->pAllocator, &view->surface) !=
+        VK_SUCCESS) {
+      fprintf(stderr, "Failed to create window surface!\n");
+      exit(EXIT_FAILURE);
+    }
   }
 }
 
-bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
-  uint32_t extensionCount;
-  vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, NULL);
-  VkExtensionProperties availableExtensions[extensionCount];
-  vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, availableExtensions);
-
+bool checkDeviceExtensionSupport(const DeviceCaps *caps) {
   for (uint32_t i = 0; i < deviceExtensionCount; i++) {
-    bool extensionFound = false;
-    for (uint32_t j = 0; j < extensionCount; j++) {
-      if (strcmp(deviceExtensions[i], availableExtensions[j].extensionName) == 0) {
-        extensionFound = true;
-        break;
-      }
-    }
-    if (!extensionFound) {
+    if (!deviceCapsHasExtension(caps, deviceExtensions[i])) {
       return false;
     }
   }
@@ -638,24 +2320,19 @@ bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
   return true;
 }
 
-uint32_t rateDeviceSuitability(VkPhysicalDevice device, VkSurfaceKHR surface) {
-  VkPhysicalDeviceProperties deviceProperties;
-  VkPhysicalDeviceFeatures deviceFeatures;
-  vkGetPhysicalDeviceProperties(device, &deviceProperties);
-  vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-
+uint32_t rateDeviceSuitability(const DeviceCaps *caps) {
   uint32_t score = 0;
 
   // Discrete GPUs have a significant performance advantage
-  if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
+  if (caps->properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
     score += 1000;
   }
 
   // Maximum possible size of textures affects graphics quality
-  score += deviceProperties.limits.maxImageDimension2D;
+  score += caps->properties.limits.maxImageDimension2D;
 
   // Applications can't function without geometry shaders
-  if (!deviceFeatures.geometryShader) {
+  if (!caps->features.geometryShader) {
     return 0;
   }
 
@@ -663,20 +2340,19 @@ uint32_t rateDeviceSuitability(VkPhysicalDevice device, VkSurfaceKHR surface) {
   // Note: to improve performance, we could favour queue families that have both
   // graphcs and present support. We could check the returned indices and if
   // they are the same, increase the score.
-  QueueFamilyIndices indices = findQueueFamilies(device, surface);
+  QueueFamilyIndices indices = findQueueFamilies(caps);
   if (!indices.isGraphicsFamily) {
     fprintf(stderr, "Queue Family not supported!\n");
     return 0;
   }
 
-  bool extensionsSupported = checkDeviceExtensionSupport(device);
+  bool extensionsSupported = checkDeviceExtensionSupport(caps);
   if (!extensionsSupported) {
     fprintf(stderr, "Required device extensions not supported!\n");
     return 0;
   }
 
-  SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device, surface);
-  if (swapChainSupport.formatCount == 0 || swapChainSupport.presentModeCount == 0) {
+  if (caps->formatCount == 0 || caps->presentModeCount == 0) {
     fprintf(stderr, "Swap chain not adequately supported!\n");
     return 0;
   }
@@ -697,24 +2373,39 @@ void pickPhysicalDevice(App *pApp) {
   VkPhysicalDevice devices[numDevices];
   vkEnumeratePhysicalDevices(pApp->instance, &numDevices, devices);
 
-  VkPhysicalDevice device;
+  // Capabilities are queried once per device here; everything later reads pApp->deviceCaps.
+  DeviceCaps caps[numDevices];
+  uint32_t driverQueries = 0;
+  int32_t device = -1;
   uint32_t deviceScore = 0;
   for (uint32_t i = 0; i < numDevices; i++) {
-    uint32_t score = rateDeviceSuitability(devices[i], pApp->surface);
+    deviceCapsInit(&caps[i], devices[i]);
+    deviceCapsSetSurface(&caps[i], pApp->views[0].surface);
+    driverQueries += caps[i].driverQueries;
+
+    uint32_t score = rateDeviceSuitability(&caps[i]);
     if (score > deviceScore) {
       deviceScore = score;
-      device = devices[i];
+      device = (int32_t)i;
     }
   }
 
-  if (device == NULL) {
+  if (device < 0) {
     fprintf(stderr, "Failed to find a stuitable GPU!\n");
     exit(EXIT_FAILURE);
   }
-  pApp->physicalDevice = device;
-  fprintf(stderr, "GPU selected.\n");
 
-  pApp->queueFamilyIndices = findQueueFamilies(device, pApp->surface);
+  for (uint32_t i = 0; i < numDevices; i++) {
+    if ((int32_t)i != device) {
+      deviceCapsDestroy(&caps[i]);
+    }
+  }
+  pApp->deviceCaps = caps[device];
+  pApp->physicalDevice = devices[device];
+  fprintf(stderr, "GPU selected: %s (%u device queries)\n", pApp->deviceCaps.properties.deviceName,
+          driverQueries);
+
+  pApp->queueFamilyIndices = findQueueFamilies(&pApp->deviceCaps);
 }
 
 void getFamilyDeviceQueues(VkDeviceQueueCreateInfo *queues, QueueFamilyIndices indices) {
@@ -737,22 +2428,99 @@ void getFamilyDeviceQueues(VkDeviceQueueCreateInfo *queues, QueueFamilyIndices i
   queues[1] = presentQueueCreateInfo;
 }
 
-void createLogicalDevice(App *pApp) {
-  QueueFamilyIndices indices = findQueueFamilies(pApp->physicalDevice, pApp->surface);
+// The extension alone is not enough; the feature has to be reported too.
+bool supportsSwapchainMaintenance1(const DeviceCaps *caps) {
+  if (!deviceCapsHasExtension(caps, VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME) ||
+      caps->properties.apiVersion < VK_API_VERSION_1_1) {
+    return false;
+  }
+  VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT maintenance1 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT};
+  VkPhysicalDeviceFeatures2 features = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+                                        .pNext = &maintenance1};
+  vkGetPhysicalDeviceFeatures2(caps->physicalDevice, &features);
+  return maintenance1.swapchainMaintenance1;
+}
+
+// Likewise; present wait needs present ids to wait for.
+bool supportsPresentWait(const DeviceCaps *caps) {
+  if (!deviceCapsHasExtension(caps, VK_KHR_PRESENT_ID_EXTENSION_NAME) ||
+      !deviceCapsHasExtension(caps, VK_KHR_PRESENT_WAIT_EXTENSION_NAME) ||
+      caps->properties.apiVersion < VK_API_VERSION_1_1) {
+    return false;
+  }
+  VkPhysicalDevicePresentIdFeaturesKHR presentId = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR};
+  VkPhysicalDevicePresentWaitFeaturesKHR presentWait = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR, .pNext = &presentId};
+  VkPhysicalDeviceFeatures2 features = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+                                        .pNext = &presentWait};
+  vkGetPhysicalDeviceFeatures2(caps->physicalDevice, &features);
+  return presentId.presentId && presentWait.presentWait;
+}
 
-  VkPhysicalDeviceFeatures deviceFeatures;
-  vkGetPhysicalDeviceFeatures(pApp->physicalDevice, &deviceFeatures);
+void createLogicalDevice(App *pApp) {
+  QueueFamilyIndices indices = pApp->queueFamilyIndices;
 
   VkDeviceQueueCreateInfo queues[2];
   getFamilyDeviceQueues(queues, indices);
 
+  const char *extensions[deviceExtensionCount + 6];
+  uint32_t extensionCount = 0;
+  for (uint32_t i = 0; i < deviceExtensionCount; i++) {
+    extensions[extensionCount++] = deviceExtensions[i];
+  }
+  VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT maintenance1 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT,
+      .swapchainMaintenance1 = VK_TRUE};
+  pApp->hasSwapchainMaintenance1 =
+      pApp->hasSurfaceMaintenance1 && supportsSwapchainMaintenance1(&pApp->deviceCaps);
+  if (pApp->hasSwapchainMaintenance1) {
+    extensions[extensionCount++] = VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME;
+  }
+  const char *pipelineLibrary = getenv("SE_PIPELINE_LIBRARY");
+  pApp->hasPipelineLibrary = !(pipelineLibrary && strcmp(pipelineLibrary, "0") == 0) &&
+                             pipelineLibrarySupported(&pApp->deviceCaps);
+  VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipelineLibraryFeature =
+      pipelineLibraryFeatures(pApp->hasSwapchainMaintenance1 ? &maintenance1 : NULL);
+  if (pApp->hasPipelineLibrary) {
+    extensions[extensionCount++] = VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME;
+    extensions[extensionCount++] = VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME;
+  }
+  // Without VK_EXT_memory_budget the budget is the heap size and usage only our allocations.
+  bool hasMemoryBudget = memoryBudgetSupported(&pApp->deviceCaps);
+  if (hasMemoryBudget) {
+    extensions[extensionCount++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+  }
+  // Lets the latency tracker see when a frame reaches the display, not just the GPU's end.
+  VkPhysicalDevicePresentIdFeaturesKHR presentId = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR, .presentId = VK_TRUE};
+  VkPhysicalDevicePresentWaitFeaturesKHR presentWait = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+      .pNext = &presentId,
+      .presentWait = VK_TRUE};
+  pApp->hasPresentWait = supportsPresentWait(&pApp->deviceCaps);
+  if (pApp->hasPresentWait) {
+    extensions[extensionCount++] = VK_KHR_PRESENT_ID_EXTENSION_NAME;
+    extensions[extensionCount++] = VK_KHR_PRESENT_WAIT_EXTENSION_NAME;
+  }
+
   VkDeviceCreateInfo createInfo = {.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
                                    //.pQueueCreateInfos = &queueCreateInfo,
                                    .pQueueCreateInfos = queues,
                                    .queueCreateInfoCount = 1,
-                                   .pEnabledFeatures = &deviceFeatures,
-                                   .enabledExtensionCount = deviceExtensionCount,
-                                   .ppEnabledExtensionNames = deviceExtensions};
+                                   .pEnabledFeatures = &pApp->deviceCaps.features,
+                                   .enabledExtensionCount = extensionCount,
+                                   .ppEnabledExtensionNames = extensions};
+  if (pApp->hasPipelineLibrary) {
+    createInfo.pNext = &pipelineLibraryFeature;
+  } else if (pApp->hasSwapchainMaintenance1) {
+    createInfo.pNext = &maintenance1;
+  }
+  if (pApp->hasPresentWait) {
+    presentId.pNext = (void *)createInfo.pNext;
+    createInfo.pNext = &presentWait;
+  }
 
   if (isEnabledValidationLayers) {
     createInfo.enabledLayerCount = validationLayerCount;
@@ -761,19 +2529,32 @@ void createLogicalDevice(App *pApp) {
     createInfo.enabledLayerCount = 0;
   }
 
-  if (vkCreateDevice(pApp->physicalDevice, &createInfo, NULL, &pApp->device) != VK_SUCCESS) {
+  if (vkCreateDevice(pApp->physicalDevice, &createInfo, pApp->pAllocator, &pApp->device) != VK_SUCCESS) {
     fprintf(stderr, "Failed to create logical device!\n");
     exit(EXIT_FAILURE);
   }
 
   vkGetDeviceQueue(pApp->device, pApp->queueFamilyIndices.graphicsFamily, 0, &pApp->graphicsQueue);
   vkGetDeviceQueue(pApp->device, pApp->queueFamilyIndices.surfaceFamily, 0, &pApp->presentQueue);
-}
 
-typedef struct ShaderFile {
-  size_t size;
-  char *code;
-} ShaderFile;
+  // Evicted resources must not be used by a frame still in flight.
+  const char *watermark = getenv("SE_MEMORY_WATERMARK");
+  float fraction = watermark ? (float)atof(watermark) : MEMORY_BUDGET_DEFAULT_WATERMARK;
+  if (fraction <= 0.0f) {
+    fprintf(stderr, "SE_MEMORY_WATERMARK is not a positive fraction of the budget; using %.2f.\n",
+            MEMORY_BUDGET_DEFAULT_WATERMARK);
+    fraction = MEMORY_BUDGET_DEFAULT_WATERMARK;
+  }
+  memoryBudgetInit(&pApp->memoryBudget, &pApp->deviceCaps, hasMemoryBudget, fraction, MAX_FRAMES_IN_FLIGHT);
+  fprintf(stderr, "Device memory budget: %s, eviction above %.0f%%\n",
+          hasMemoryBudget ? "VK_EXT_memory_budget" : "heap sizes", 100.0 * fraction);
+
+  const char *lowLatency = getenv("SE_LOW_LATENCY");
+  latencyInit(&pApp->latency, pApp->device, pApp->hasPresentWait, lowLatency && strcmp(lowLatency, "0") != 0);
+  fprintf(stderr, "Latency measured to %s; low-latency mode %s (I)\n",
+          pApp->hasPresentWait ? "display (VK_KHR_present_wait)" : "GPU completion",
+          pApp->latency.lowLatency ? "on" : "off");
+}
 
 VkShaderModule createShaderModule(App *pApp, ShaderFile *shaderFile) {
   VkShaderModuleCreateInfo createInfo = {.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
@@ -781,7 +2562,7 @@ VkShaderModule createShaderModule(App *pApp, ShaderFile *shaderFile) {
                                          .pCode = (uint32_t *)shaderFile->code};
 
   VkShaderModule shaderModule;
-  if (vkCreateShaderModule(pApp->device, &createInfo, NULL, &shaderModule) != VK_SUCCESS) {
+  if (vkCreateShaderModule(pApp->device, &createInfo, pApp->pAllocator, &shaderModule) != VK_SUCCESS) {
     fprintf(stderr, "failed to create shader module!\n");
     exit(EXIT_FAILURE);
   }
@@ -811,135 +2592,325 @@ void readFile(const char *filename, ShaderFile *shader) {
 }
 
 void createRenderPass(App *pApp) {
+  bool msaa = pApp->msaaSamples > VK_SAMPLE_COUNT_1_BIT;
+  // Rendering offscreen, the final image is post-processed in GENERAL layout or blitted to the
+  // swapchain image after the pass.
+  VkImageLayout targetLayout = pApp->isPostProcessing      ? VK_IMAGE_LAYOUT_GENERAL
+                               : pApp->isDynamicResolution ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                                           : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+  // With MSAA the multisampled image is resolved into the swapchain image (attachment 2) at
+  // the end of the subpass; its samples are never written back to memory.
   VkAttachmentDescription colorAttachment = {};
-  colorAttachment.format = pApp->swapChainImageFormat;
-  colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  colorAttachment.format = pApp->sceneFormat;
+  colorAttachment.samples = pApp->msaaSamples;
   colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  colorAttachment.storeOp = msaa ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
   colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  colorAttachment.finalLayout = msaa ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : targetLayout;
+
+  VkAttachmentDescription resolveAttachment = {};
+  resolveAttachment.format = pApp->sceneFormat;
+  resolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  resolveAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  resolveAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  resolveAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  resolveAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  resolveAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  resolveAttachment.finalLayout = targetLayout;
+
+  // Depth is kept after the pass: the Hi-Z build reads it in the read-only layout.
+  VkAttachmentDescription depthAttachment = {};
+  depthAttachment.format = pApp->depthFormat;
+  depthAttachment.samples = pApp->msaaSamples;
+  depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
 
   VkAttachmentReference colorAttachmentRef = {};
   colorAttachmentRef.attachment = 0;
   colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+  VkAttachmentReference depthAttachmentRef = {};
+  depthAttachmentRef.attachment = 1;
+  depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference resolveAttachmentRef = {};
+  resolveAttachmentRef.attachment = 2;
+  resolveAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
   VkSubpassDescription subpass = {};
   subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
   subpass.colorAttachmentCount = 1;
   subpass.pColorAttachments = &colorAttachmentRef;
-
-  VkSubpassDependency dependency = {};
-  dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-  dependency.dstSubpass = 0;
-  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.srcAccessMask = 0;
-  dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
+  subpass.pResolveAttachments = msaa ? &resolveAttachmentRef : NULL;
+  subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+  // One depth image serves every frame in flight, so clearing it waits for the previous
+  // frame's depth writes and for its Hi-Z build to finish reading; the same goes for the
+  // scene image and the previous frame's blit.
+  VkSubpassDependency dependencies[2] = {};
+  dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[0].dstSubpass = 0;
+  dependencies[0].srcStageMask =
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+  dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dstStageMask =
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                  VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                  VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+  dependencies[1].srcSubpass = 0;
+  dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[1].srcStageMask =
+      VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[1].srcAccessMask =
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+  dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+
+  VkAttachmentDescription attachments[] = {colorAttachment, depthAttachment, resolveAttachment};
   VkRenderPassCreateInfo renderPassInfo = {};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-  renderPassInfo.attachmentCount = 1;
-  renderPassInfo.pAttachments = &colorAttachment;
+  renderPassInfo.attachmentCount = msaa ? 3 : 2;
+  renderPassInfo.pAttachments = attachments;
   renderPassInfo.subpassCount = 1;
   renderPassInfo.pSubpasses = &subpass;
-  renderPassInfo.dependencyCount = 1;
-  renderPassInfo.pDependencies = &dependency;
+  renderPassInfo.dependencyCount = 2;
+  renderPassInfo.pDependencies = dependencies;
 
-  if (vkCreateRenderPass(pApp->device, &renderPassInfo, NULL, &pApp->renderPass) != VK_SUCCESS) {
+  if (vkCreateRenderPass(pApp->device, &renderPassInfo, pApp->pAllocator, &pApp->renderPass) != VK_SUCCESS) {
     fprintf(stderr, "failed to create render pass!\n");
     exit(EXIT_FAILURE);
   }
 }
 
+// Create info of one scene variant; pipelineInfo points into the struct.
+typedef struct SceneVariantInfo {
+  VkPipelineDepthStencilStateCreateInfo depthStencil;
+  uint32_t constants[CAPTURE_SPECIALIZATION_CONSTANTS];
+  VkSpecializationMapEntry entries[CAPTURE_SPECIALIZATION_CONSTANTS];
+  VkSpecializationInfo specialization;
+  VkPipelineShaderStageCreateInfo shaderStages[2];
+  VkGraphicsPipelineCreateInfo pipelineInfo;
+} SceneVariantInfo;
+
+void initSceneVariantInfo(const ScenePipelineState *state, uint32_t key, SceneVariantInfo *info) {
+  // Shading after the pre-pass: depth is already final, so only the nearest fragment passes.
+  info->depthStencil = state->depthStencil;
+  if (key & SCENE_VARIANT_DEPTH_EQUAL) {
+    info->depthStencil.depthWriteEnable = VK_FALSE;
+    info->depthStencil.depthCompareOp = VK_COMPARE_OP_EQUAL;
+  }
+
+  sceneVariantConstants(key, info->constants);
+  for (uint32_t i = 0; i < CAPTURE_SPECIALIZATION_CONSTANTS; i++) {
+    info->entries[i] = (VkSpecializationMapEntry){i, i * sizeof(uint32_t), sizeof(uint32_t)};
+  }
+  info->specialization = (VkSpecializationInfo){.mapEntryCount = CAPTURE_SPECIALIZATION_CONSTANTS,
+                                                .pMapEntries = info->entries,
+                                                .dataSize = sizeof(info->constants),
+                                                .pData = info->constants};
+  info->shaderStages[0] = state->shaderStages[0];
+  info->shaderStages[1] = state->shaderStages[1];
+  if (key & SCENE_FEATURE_LIGHT_BUFFER) {
+    info->shaderStages[1].module = state->fragLightsShaderModule;
+  }
+  info->shaderStages[1].pSpecializationInfo = &info->specialization;
+
+  info->pipelineInfo = state->pipelineInfo;
+  info->pipelineInfo.pStages = info->shaderStages;
+  info->pipelineInfo.pDepthStencilState = &info->depthStencil;
+}
+
+VkPipeline createSceneVariant(App *pApp, uint32_t key, VkPipelineCache cache) {
+  SceneVariantInfo info;
+  initSceneVariantInfo(&pApp->scenePipeline, key, &info);
+  VkPipeline pipeline;
+  if (vkCreateGraphicsPipelines(pApp->device, cache, 1, &info.pipelineInfo, pApp->pAllocator, &pipeline) !=
+      VK_SUCCESS) {
+    fprintf(stderr, "Failed to create graphics pipeline!\n");
+    exit(9);
+  }
+  return pipeline;
+}
+
+// Builds the shading pipeline for a SCENE_VARIANT_* key from the state createGraphicsPipeline()
+// left in pApp->scenePipeline. Called by pApp->sceneVariants on first use of the key.
+//
+// With pipeline libraries only the fragment shader part is compiled; it is linked with the
+// shared parts without optimization, which is much faster than a full compile, so a new key
+// costs little on the frame that first draws with it. optimizeSceneVariant() then builds
+// the optimized pipeline in the background.
+VkPipeline compileSceneVariant(void *data, uint32_t key, VkPipelineCache cache, VkPipeline *library) {
+  App *pApp = data;
+  ScenePipelineState *state = &pApp->scenePipeline;
+  if (!pApp->hasPipelineLibrary) {
+    return createSceneVariant(pApp, key, cache);
+  }
+
+  SceneVariantInfo info;
+  initSceneVariantInfo(state, key, &info);
+  *library = pipelineLibraryCreatePart(pApp->device, &info.pipelineInfo,
+                                       VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT, cache,
+                                       pApp->pAllocator);
+  VkPipeline parts[PIPELINE_LIBRARY_PART_COUNT];
+  memcpy(parts, state->libraries, sizeof(parts));
+  parts[2] = *library;
+  return pipelineLibraryLink(pApp->device, pApp->pipelineLayout, parts, false, cache, pApp->pAllocator);
+}
+
+// Runs on a job system worker; everything it reads is immutable once the variants exist.
+VkPipeline optimizeSceneVariant(void *data, uint32_t key, VkPipelineCache cache, VkPipeline library) {
+  App *pApp = data;
+  VkPipeline parts[PIPELINE_LIBRARY_PART_COUNT];
+  memcpy(parts, pApp->scenePipeline.libraries, sizeof(parts));
+  parts[2] = library;
+  return pipelineLibraryLink(pApp->device, pApp->pipelineLayout, parts, true, cache, pApp->pAllocator);
+}
+
+// Compares the two ways to build the starting variant, without the pipeline cache so
+// neither is a cache hit: a full compile against compiling its fragment shader part and
+// linking it, with and without link-time optimization.
+void reportPipelineLibraryTimes(App *pApp, double sharedPartsMs) {
+  ScenePipelineState *state = &pApp->scenePipeline;
+  double start = nowMs();
+  VkPipeline monolithic = createSceneVariant(pApp, sceneVariant, VK_NULL_HANDLE);
+  double compiled = nowMs();
+
+  SceneVariantInfo info;
+  initSceneVariantInfo(state, sceneVariant, &info);
+  VkPipeline parts[PIPELINE_LIBRARY_PART_COUNT];
+  memcpy(parts, state->libraries, sizeof(parts));
+  parts[2] = pipelineLibraryCreatePart(pApp->device, &info.pipelineInfo,
+                                       VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT, VK_NULL_HANDLE,
+                                       pApp->pAllocator);
+  double partCompiled = nowMs();
+  VkPipeline fast =
+      pipelineLibraryLink(pApp->device, pApp->pipelineLayout, parts, false, VK_NULL_HANDLE, pApp->pAllocator);
+  double fastLinked = nowMs();
+  VkPipeline optimized =
+      pipelineLibraryLink(pApp->device, pApp->pipelineLayout, parts, true, VK_NULL_HANDLE, pApp->pAllocator);
+  double optimizedLinked = nowMs();
+
+  fprintf(stderr,
+          "Pipeline libraries: shared parts %.2f ms; variant 0x%08x: full compile %.2f ms, fragment part "
+          "%.2f ms + fast link %.2f ms, optimized link %.2f ms\n",
+          sharedPartsMs, sceneVariant, compiled - start, partCompiled - compiled, fastLinked - partCompiled,
+          optimizedLinked - fastLinked);
+  vkDestroyPipeline(pApp->device, optimized, pApp->pAllocator);
+  vkDestroyPipeline(pApp->device, fast, pApp->pAllocator);
+  vkDestroyPipeline(pApp->device, parts[2], pApp->pAllocator);
+  vkDestroyPipeline(pApp->device, monolithic, pApp->pAllocator);
+}
+
 void createGraphicsPipeline(App *pApp) {
+  ScenePipelineState *state = &pApp->scenePipeline;
   ShaderFile vertShader = {};
   ShaderFile fragShader = {};
-  readFile("shaders/vert.spv", &vertShader);
-  readFile("shaders/frag.spv", &fragShader);
-
-  VkShaderModule vertShaderModule = createShaderModule(pApp, &vertShader);
-  VkShaderModule fragShaderModule = createShaderModule(pApp, &fragShader);
+  ShaderFile fragLightsShader = {};
+  readFile(VERT_SHADER_PATH, &vertShader);
+  readFile(FRAG_SHADER_PATH, &fragShader);
+  readFile(FRAG_LIGHTS_SHADER_PATH, &fragLightsShader);
+
+  // Kept until cleanup: variants are compiled whenever a new key is first drawn with.
+  state->vertShaderModule = createShaderModule(pApp, &vertShader);
+  state->fragShaderModule = createShaderModule(pApp, &fragShader);
+  state->fragLightsShaderModule = createShaderModule(pApp, &fragLightsShader);
+  free(vertShader.code);
+  free(fragShader.code);
+  free(fragLightsShader.code);
 
-  VkPipelineShaderStageCreateInfo vertShaderStageInfo = {
+  state->shaderStages[0] = (VkPipelineShaderStageCreateInfo){
       .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
       .stage = VK_SHADER_STAGE_VERTEX_BIT,
-      .module = vertShaderModule,
-      .pName = "main"
-      //.pSpecializationInfo = NULL
-  };
+      .module = state->vertShaderModule,
+      .pName = "main"};
 
-  VkPipelineShaderStageCreateInfo fragShaderStageInfo = {
+  // Specialization constants are set per variant, see compileSceneVariant().
+  state->shaderStages[1] = (VkPipelineShaderStageCreateInfo){
       .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
       .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-      .module = fragShaderModule,
+      .module = state->fragShaderModule,
       .pName = "main"};
 
-  VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
-
-  VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
+  // Binding 0: the mesh. Binding 1: the culled SceneInstances, one per instance.
+  VkVertexInputBindingDescription vertexBindings[] = {
+      {.binding = 0, .stride = sizeof(SceneVertex), .inputRate = VK_VERTEX_INPUT_RATE_VERTEX},
+      {.binding = 1, .stride = sizeof(SceneInstance), .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE}};
+  VkVertexInputAttributeDescription vertexAttributes[] = {
+      {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(SceneVertex, position)},
+      {1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(SceneVertex, normal)},
+      {2, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(SceneInstance, model) + 0 * sizeof(Vec4)},
+      {3, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(SceneInstance, model) + 1 * sizeof(Vec4)},
+      {4, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(SceneInstance, model) + 2 * sizeof(Vec4)},
+      {5, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(SceneInstance, model) + 3 * sizeof(Vec4)},
+      {6, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(SceneInstance, color)}};
+  const uint32_t vertexBindingCount = sizeof(vertexBindings) / sizeof(vertexBindings[0]);
+  const uint32_t vertexAttributeCount = sizeof(vertexAttributes) / sizeof(vertexAttributes[0]);
+  _Static_assert(sizeof(vertexBindings) == sizeof(state->vertexBindings), "vertex bindings");
+  _Static_assert(sizeof(vertexAttributes) == sizeof(state->vertexAttributes), "vertex attributes");
+  memcpy(state->vertexBindings, vertexBindings, sizeof(vertexBindings));
+  memcpy(state->vertexAttributes, vertexAttributes, sizeof(vertexAttributes));
+
+  state->vertexInput = (VkPipelineVertexInputStateCreateInfo){
       .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-      .vertexBindingDescriptionCount = 0,
-      .pVertexBindingDescriptions = NULL, // Optional
-      .vertexAttributeDescriptionCount = 0,
-      .pVertexAttributeDescriptions = NULL // Optional
-  };
+      .vertexBindingDescriptionCount = vertexBindingCount,
+      .pVertexBindingDescriptions = state->vertexBindings,
+      .vertexAttributeDescriptionCount = vertexAttributeCount,
+      .pVertexAttributeDescriptions = state->vertexAttributes};
 
-  uint32_t dynamicStatesSize = 2;
-  VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+  state->dynamicStates[0] = VK_DYNAMIC_STATE_VIEWPORT;
+  state->dynamicStates[1] = VK_DYNAMIC_STATE_SCISSOR;
 
-  VkPipelineDynamicStateCreateInfo dynamicState = {.sType =
-                                                       VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-                                                   .dynamicStateCount = dynamicStatesSize,
-                                                   .pDynamicStates = dynamicStates};
+  state->dynamicState = (VkPipelineDynamicStateCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+      .dynamicStateCount = 2,
+      .pDynamicStates = state->dynamicStates};
 
-  VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
+  state->inputAssembly = (VkPipelineInputAssemblyStateCreateInfo){
       .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
       .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
       .primitiveRestartEnable = VK_FALSE};
 
-  VkViewport viewport = {.x = 0.0f,
-                         .y = 0.0f,
-                         .width = (float)pApp->swapChainExtent.width,
-                         .height = (float)pApp->swapChainExtent.height,
-                         .minDepth = 0.0f,
-                         .maxDepth = 1.0f};
-
-  VkRect2D scissor = {.offset = {0, 0}, .extent = pApp->swapChainExtent};
-
-  VkPipelineViewportStateCreateInfo viewportState = {
+  // Viewport and scissor are dynamic; only the counts matter here.
+  state->viewportState = (VkPipelineViewportStateCreateInfo){
       .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
       .viewportCount = 1,
-      .pViewports = &viewport,
-      .scissorCount = 1,
-      .pScissors = &scissor};
+      .scissorCount = 1};
 
-  VkPipelineRasterizationStateCreateInfo rasterizer = {
+  state->rasterizer = (VkPipelineRasterizationStateCreateInfo){
       .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
       .depthClampEnable = VK_FALSE,
       .rasterizerDiscardEnable = VK_FALSE,
       .polygonMode = VK_POLYGON_MODE_FILL,
       .lineWidth = 1.0f,
       .cullMode = VK_CULL_MODE_BACK_BIT,
-      .frontFace = VK_FRONT_FACE_CLOCKWISE,
+      .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
       .depthBiasEnable = VK_FALSE,
       .depthBiasConstantFactor = 0.0f, // Optional
       .depthBiasClamp = 0.0f,          // Optional
       .depthBiasSlopeFactor = 0.0f     // Optional
   };
 
-  VkPipelineMultisampleStateCreateInfo multisampling = {
+  state->multisampling = (VkPipelineMultisampleStateCreateInfo){
       .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
       .sampleShadingEnable = VK_FALSE,
-      .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+      .rasterizationSamples = pApp->msaaSamples,
       .minSampleShading = 1.0f,          // Optional
       .pSampleMask = NULL,               // Optional
       .alphaToCoverageEnable = VK_FALSE, // Optional
       .alphaToOneEnable = VK_FALSE       // Optional
   };
 
-  VkPipelineColorBlendAttachmentState colorBlendAttachment = {
+  state->colorBlendAttachment = (VkPipelineColorBlendAttachmentState){
       .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT |
                         VK_COLOR_COMPONENT_A_BIT,
       .blendEnable = VK_FALSE,
@@ -951,27 +2922,42 @@ void createGraphicsPipeline(App *pApp) {
       .alphaBlendOp = VK_BLEND_OP_ADD              // Optional
   };
 
-  VkPipelineColorBlendStateCreateInfo colorBlending = {
+  state->colorBlending = (VkPipelineColorBlendStateCreateInfo){
       .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
       .logicOpEnable = VK_FALSE,
       .logicOp = VK_LOGIC_OP_COPY, // Optional
       .attachmentCount = 1,
-      .pAttachments = &colorBlendAttachment,
+      .pAttachments = &state->colorBlendAttachment,
       .blendConstants[0] = 0.0f, // Optional
       .blendConstants[1] = 0.0f, // Optional
       .blendConstants[2] = 0.0f, // Optional
       .blendConstants[3] = 0.0f  // Optional
   };
 
+  state->depthStencil = (VkPipelineDepthStencilStateCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+      .depthTestEnable = VK_TRUE,
+      .depthWriteEnable = VK_TRUE,
+      .depthCompareOp = VK_COMPARE_OP_LESS,
+      .depthBoundsTestEnable = VK_FALSE,
+      .stencilTestEnable = VK_FALSE};
+
+  VkPushConstantRange pushConstantRange = {
+      .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+      .offset = 0,
+      .size = sizeof(ScenePushConstants)};
+
+  // Only variants with SCENE_FEATURE_LIGHT_BUFFER read the set; the others leave it unbound.
+  pApp->clusterSetLayout = clustersCreateSetLayout(pApp->device, pApp->pAllocator);
   VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
       .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-      .setLayoutCount = 0,         // Optional
-      .pSetLayouts = NULL,         // Optional
-      .pushConstantRangeCount = 0, // Optional
-      .pPushConstantRanges = NULL  // Optional
-  };
+      .setLayoutCount = 1,
+      .pSetLayouts = &pApp->clusterSetLayout,
+      .pushConstantRangeCount = 1,
+      .pPushConstantRanges = &pushConstantRange};
 
-  if (vkCreatePipelineLayout(pApp->device, &pipelineLayoutInfo, NULL, &pApp->pipelineLayout) != VK_SUCCESS) {
+  if (vkCreatePipelineLayout(pApp->device, &pipelineLayoutInfo, pApp->pAllocator, &pApp->pipelineLayout) !=
+      VK_SUCCESS) {
     fprintf(stderr, "failed to create pipeline layout!");
     exit(EXIT_FAILURE);
   }
@@ -980,66 +2966,132 @@ void createGraphicsPipeline(App *pApp) {
   pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipelineInfo.stageCount = 2;
   pipelineInfo.flags = 0;
-  pipelineInfo.pStages = shaderStages;
-  pipelineInfo.pVertexInputState = &vertexInputInfo;
-  pipelineInfo.pInputAssemblyState = &inputAssembly;
-  pipelineInfo.pViewportState = &viewportState;
-  pipelineInfo.pRasterizationState = &rasterizer;
-  pipelineInfo.pMultisampleState = &multisampling;
-  pipelineInfo.pDepthStencilState = NULL; // Optional
-  pipelineInfo.pColorBlendState = &colorBlending;
-  pipelineInfo.pDynamicState = &dynamicState;
+  pipelineInfo.pStages = state->shaderStages;
+  pipelineInfo.pVertexInputState = &state->vertexInput;
+  pipelineInfo.pInputAssemblyState = &state->inputAssembly;
+  pipelineInfo.pViewportState = &state->viewportState;
+  pipelineInfo.pRasterizationState = &state->rasterizer;
+  pipelineInfo.pMultisampleState = &state->multisampling;
+  pipelineInfo.pDepthStencilState = &state->depthStencil;
+  pipelineInfo.pColorBlendState = &state->colorBlending;
+  pipelineInfo.pDynamicState = &state->dynamicState;
   pipelineInfo.layout = pApp->pipelineLayout;
   pipelineInfo.renderPass = pApp->renderPass;
   pipelineInfo.subpass = 0;
   pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
   pipelineInfo.basePipelineIndex = -1;              // Optional
-
-  if (vkCreateGraphicsPipelines(pApp->device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL,
-                                &pApp->graphicsPipeline) != VK_SUCCESS) {
+  state->pipelineInfo = pipelineInfo;
+
+  // The variants of the starting key are compiled now rather than on the first frame.
+  pipelineVariantsCreate(&pApp->sceneVariants, &pApp->deviceCaps, pApp->device, pApp->pAllocator,
+                         compileSceneVariant, pApp->hasPipelineLibrary ? optimizeSceneVariant : NULL, pApp,
+                         pApp->jobSystem, getenv("SE_PIPELINE_CACHE"));
+  if (pApp->hasPipelineLibrary) {
+    double start = nowMs();
+    for (uint32_t i = 0; i < PIPELINE_LIBRARY_PART_COUNT; i++) {
+      if (PIPELINE_LIBRARY_PARTS[i] != VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT) {
+        state->libraries[i] = pipelineLibraryCreatePart(pApp->device, &pipelineInfo,
+                                                        PIPELINE_LIBRARY_PARTS[i], pApp->sceneVariants.cache,
+                                                        pApp->pAllocator);
+      }
+    }
+    reportPipelineLibraryTimes(pApp, nowMs() - start);
+  }
+  pipelineVariantsGet(&pApp->sceneVariants, sceneVariant);
+  pipelineVariantsGet(&pApp->sceneVariants, sceneVariant | SCENE_VARIANT_DEPTH_EQUAL);
+
+  // The specialization constants depend on the variant drawn with; recordCommandBuffer fills them in.
+  CapturePipeline desc = {.topology = state->inputAssembly.topology,
+                          .polygonMode = state->rasterizer.polygonMode,
+                          .cullMode = state->rasterizer.cullMode,
+                          .frontFace = state->rasterizer.frontFace,
+                          .samples = state->multisampling.rasterizationSamples,
+                          .blendEnable = state->colorBlendAttachment.blendEnable,
+                          .colorWriteMask = state->colorBlendAttachment.colorWriteMask,
+                          .depthTestEnable = state->depthStencil.depthTestEnable,
+                          .depthWriteEnable = state->depthStencil.depthWriteEnable,
+                          .depthCompareOp = state->depthStencil.depthCompareOp,
+                          .pushConstantSize = pushConstantRange.size,
+                          .vertexBindingCount = vertexBindingCount,
+                          .vertexAttributeCount = vertexAttributeCount};
+  memcpy(desc.vertexBindings, vertexBindings, sizeof(vertexBindings));
+  memcpy(desc.vertexAttributes, vertexAttributes, sizeof(vertexAttributes));
+  pApp->graphicsPipelineDesc = desc;
+
+  desc.depthWriteEnable = VK_FALSE;
+  desc.depthCompareOp = VK_COMPARE_OP_EQUAL;
+  pApp->depthEqualPipelineDesc = desc;
+
+  // Depth pre-pass: vertex stage only, no color writes.
+  VkPipelineColorBlendAttachmentState noColor = state->colorBlendAttachment;
+  noColor.colorWriteMask = 0;
+  VkPipelineColorBlendStateCreateInfo colorBlending = state->colorBlending;
+  colorBlending.pAttachments = &noColor;
+  pipelineInfo.pColorBlendState = &colorBlending;
+  pipelineInfo.stageCount = 1;
+  if (vkCreateGraphicsPipelines(pApp->device, pApp->sceneVariants.cache, 1, &pipelineInfo, pApp->pAllocator,
+                                &pApp->depthPrepassPipeline) != VK_SUCCESS) {
     fprintf(stderr, "Failed to create graphics pipeline!\n");
     exit(9);
   }
-
-  free(vertShader.code);
-  free(fragShader.code);
-  vkDestroyShaderModule(pApp->device, fragShaderModule, NULL);
-  vkDestroyShaderModule(pApp->device, vertShaderModule, NULL);
+  desc.depthWriteEnable = VK_TRUE;
+  desc.depthCompareOp = VK_COMPARE_OP_LESS;
+  desc.colorWriteMask = noColor.colorWriteMask;
+  desc.fragmentShader = CAPTURE_NO_SHADER;
+  pApp->depthPrepassPipelineDesc = desc;
 }
 
 void createCommandPool(App *pApp) {
-  QueueFamilyIndices indices = findQueueFamilies(pApp->physicalDevice, pApp->surface);
+  QueueFamilyIndices indices = pApp->queueFamilyIndices;
 
   VkCommandPoolCreateInfo poolInfo = {};
   poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
   poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
   poolInfo.queueFamilyIndex = indices.graphicsFamily;
 
-  if (vkCreateCommandPool(pApp->device, &poolInfo, NULL, &pApp->commandPool) != VK_SUCCESS) {
+  if (vkCreateCommandPool(pApp->device, &poolInfo, pApp->pAllocator, &pApp->commandPool) != VK_SUCCESS) {
     fprintf(stderr, "failed to create command pool!\n");
     exit(EXIT_FAILURE);
   }
 }
 
+// Each view records into its own command buffers, all from the one pool; so does the HUD.
 void createCommandBuffers(App *pApp) {
-  pApp->commandBuffers = malloc(sizeof(VkCommandBuffer) * MAX_FRAMES_IN_FLIGHT);
-
-  VkCommandBufferAllocateInfo allocInfo = {};
-  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  allocInfo.commandPool = pApp->commandPool;
-  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  allocInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+  for (uint32_t i = 0; i < pApp->viewCount; i++) {
+    View *view = &pApp->views[i];
+    view->commandBuffers = arenaPushArray(&pApp->deviceArena, VkCommandBuffer, MAX_FRAMES_IN_FLIGHT);
+
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = pApp->commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+
+    if (vkAllocateCommandBuffers(pApp->device, &allocInfo, view->commandBuffers) != VK_SUCCESS) {
+      fprintf(stderr, "failed to allocate command buffers!\n");
+      exit(EXIT_FAILURE);
+    }
+  }
 
-  if (vkAllocateCommandBuffers(pApp->device, &allocInfo, pApp->commandBuffers) != VK_SUCCESS) {
+  pApp->hudCommandBuffers = arenaPushArray(&pApp->deviceArena, VkCommandBuffer, MAX_FRAMES_IN_FLIGHT);
+  VkCommandBufferAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                                           .commandPool = pApp->commandPool,
+                                           .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                                           .commandBufferCount = MAX_FRAMES_IN_FLIGHT};
+  if (vkAllocateCommandBuffers(pApp->device, &allocInfo, pApp->hudCommandBuffers) != VK_SUCCESS) {
     fprintf(stderr, "failed to allocate command buffers!\n");
     exit(EXIT_FAILURE);
   }
 }
 
+// An acquire semaphore per view; the frame's single submit signals one semaphore and one fence.
 void createSyncObjects(App *pApp) {
-  pApp->imageAvailableSemaphores = malloc(sizeof(VkSemaphore) * MAX_FRAMES_IN_FLIGHT);
-  pApp->renderFinishedSemaphores = malloc(sizeof(VkSemaphore) * MAX_FRAMES_IN_FLIGHT);
-  pApp->inFlightFences = malloc(sizeof(VkFence) * MAX_FRAMES_IN_FLIGHT);
+  for (uint32_t i = 0; i < pApp->viewCount; i++) {
+    pApp->views[i].imageAvailableSemaphores =
+        arenaPushArray(&pApp->deviceArena, VkSemaphore, MAX_FRAMES_IN_FLIGHT);
+  }
+  pApp->renderFinishedSemaphores = arenaPushArray(&pApp->deviceArena, VkSemaphore, MAX_FRAMES_IN_FLIGHT);
+  pApp->inFlightFences = arenaPushArray(&pApp->deviceArena, VkFence, MAX_FRAMES_IN_FLIGHT);
 
   VkSemaphoreCreateInfo semaphoreInfo = {};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -1049,17 +3101,19 @@ void createSyncObjects(App *pApp) {
   fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
   for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-    if (vkCreateSemaphore(pApp->device, &semaphoreInfo, NULL, &pApp->imageAvailableSemaphores[i]) !=
-        VK_SUCCESS) {
-      fprintf(stderr, "Failed to create imageAvailableSemaphore!\n");
-      exit(EXIT_FAILURE);
+    for (uint32_t j = 0; j < pApp->viewCount; j++) {
+      if (vkCreateSemaphore(pApp->device, &semaphoreInfo, pApp->pAllocator,
+                            &pApp->views[j].imageAvailableSemaphores[i]) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create imageAvailableSemaphore!\n");
+        exit(EXIT_FAILURE);
+      }
     }
-    if (vkCreateSemaphore(pApp->device, &semaphoreInfo, NULL, &pApp->renderFinishedSemaphores[i]) !=
-        VK_SUCCESS) {
+    if (vkCreateSemaphore(pApp->device, &semaphoreInfo, pApp->pAllocator,
+                          &pApp->renderFinishedSemaphores[i]) != VK_SUCCESS) {
       fprintf(stderr, "Failed to create renderFinishedSemaphore!\n");
       exit(EXIT_FAILURE);
     }
-    if (vkCreateFence(pApp->device, &fenceInfo, NULL, &pApp->inFlightFences[i]) != VK_SUCCESS) {
+    if (vkCreateFence(pApp->device, &fenceInfo, pApp->pAllocator, &pApp->inFlightFences[i]) != VK_SUCCESS) {
       fprintf(stderr, "Failed to create fence!\n");
       exit(EXIT_FAILURE);
     }
@@ -1085,35 +3139,312 @@ void setupDebugMessenger(App *pApp) {
     VkDebugUtilsMessengerCreateInfoEXT createInfo = {};
     populateDebugMessengerCreateInfo(&createInfo);
 
-    if (CreateDebugUtilsMessengerEXT(pApp->instance, &createInfo, NULL, &pApp->debugMessenger)) {
+    if (CreateDebugUtilsMessengerEXT(pApp->instance, &createInfo, pApp->pAllocator, &pApp->debugMessenger)) {
       fprintf(stderr, "Failed to setup debug messenger!\n");
       exit(EXIT_FAILURE);
     }
   }
 }
 
+void createBuffer(App *pApp, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+                  VkBuffer *buffer, VkDeviceMemory *memory) {
+  VkBufferCreateInfo bufferInfo = {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                   .size = size,
+                                   .usage = usage,
+                                   .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
+  if (vkCreateBuffer(pApp->device, &bufferInfo, pApp->pAllocator, buffer) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create buffer!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  VkMemoryRequirements memRequirements;
+  vkGetBufferMemoryRequirements(pApp->device, *buffer, &memRequirements);
+  uint32_t memoryType =
+      deviceCapsFindMemoryType(&pApp->deviceCaps, memRequirements.memoryTypeBits, properties);
+  VkMemoryAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                                    .allocationSize = memRequirements.size,
+                                    .memoryTypeIndex = memoryType};
+  if (memoryType == UINT32_MAX ||
+      memoryBudgetAllocate(&pApp->memoryBudget, pApp->device, &allocInfo, pApp->pAllocator, memory) !=
+          VK_SUCCESS) {
+    fprintf(stderr, "Failed to allocate buffer memory!\n");
+    exit(EXIT_FAILURE);
+  }
+  vkBindBufferMemory(pApp->device, *buffer, *memory, 0);
+}
+
+void uploadBuffer(App *pApp, const void *contents, VkDeviceSize size, VkBufferUsageFlags usage,
+                  VkBuffer *buffer, VkDeviceMemory *memory) {
+  createBuffer(pApp, size, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+               buffer, memory);
+  void *data;
+  vkMapMemory(pApp->device, *memory, 0, size, 0, &data);
+  memcpy(data, contents, size);
+  vkUnmapMemory(pApp->device, *memory);
+}
+
+void createScene(App *pApp) {
+  const char *objects = getenv("SE_SCENE_OBJECTS");
+  uint32_t boxCount = objects && atoi(objects) > 0 ? (uint32_t)atoi(objects) : DEFAULT_SCENE_OBJECTS;
+  const char *lights = getenv("SE_SCENE_LIGHTS");
+  uint32_t lightCount = lights && atoi(lights) > 0 ? (uint32_t)atoi(lights) : DEFAULT_SCENE_LIGHTS;
+  sceneCreate(&pApp->scene, boxCount, lightCount);
+  pApp->bufferLightCount = lightCount;
+
+  uploadBuffer(pApp, pApp->scene.vertices, sizeof(SceneVertex) * pApp->scene.vertexCount,
+               VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &pApp->vertexBuffer, &pApp->vertexBufferMemory);
+  uploadBuffer(pApp, pApp->scene.indices, sizeof(uint16_t) * pApp->scene.indexCount,
+               VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &pApp->indexBuffer, &pApp->indexBufferMemory);
+
+  ShaderFile cullShader = {};
+  ShaderFile hizShader = {};
+  ShaderFile hizMsShader = {};
+  ShaderFile clusterShader = {};
+  readFile(CULL_SHADER_PATH, &cullShader);
+  readFile(HIZ_SHADER_PATH, &hizShader);
+  VkShaderModule cullShaderModule = createShaderModule(pApp, &cullShader);
+  VkShaderModule hizShaderModule = createShaderModule(pApp, &hizShader);
+  readFile(CLUSTER_SHADER_PATH, &clusterShader);
+  VkShaderModule clusterShaderModule = createShaderModule(pApp, &clusterShader);
+  VkShaderModule hizMsShaderModule = VK_NULL_HANDLE;
+  if (pApp->msaaSamples > VK_SAMPLE_COUNT_1_BIT) {
+    readFile(HIZ_MS_SHADER_PATH, &hizMsShader);
+    hizMsShaderModule = createShaderModule(pApp, &hizMsShader);
+  }
+
+  // Each view culls against its own depth buffer.
+  for (uint32_t i = 0; i < pApp->viewCount; i++) {
+    View *view = &pApp->views[i];
+    occlusionCreate(&view->occlusion, &pApp->deviceCaps, pApp->device, pApp->pAllocator, &pApp->memoryBudget,
+                    cullShaderModule, hizShaderModule, hizMsShaderModule, &pApp->scene, MAX_FRAMES_IN_FLIGHT,
+                    view->depthImageView, pApp->msaaSamples, view->swapChainExtent);
+    clustersCreate(&view->clusters, &pApp->deviceCaps, pApp->device, pApp->pAllocator, &pApp->memoryBudget,
+                   clusterShaderModule, pApp->clusterSetLayout, &pApp->scene, MAX_FRAMES_IN_FLIGHT);
+  }
+
+  free(cullShader.code);
+  free(clusterShader.code);
+  free(hizShader.code);
+  free(hizMsShader.code);
+  vkDestroyShaderModule(pApp->device, hizMsShaderModule, pApp->pAllocator);
+  vkDestroyShaderModule(pApp->device, hizShaderModule, pApp->pAllocator);
+  vkDestroyShaderModule(pApp->device, cullShaderModule, pApp->pAllocator);
+  vkDestroyShaderModule(pApp->device, clusterShaderModule, pApp->pAllocator);
+
+  pApp->framePending = arenaPushArray(&pApp->deviceArena, bool, MAX_FRAMES_IN_FLIGHT);
+  memset(pApp->framePending, 0, sizeof(bool) * MAX_FRAMES_IN_FLIGHT);
+  pApp->statsPending = arenaPushArray(&pApp->deviceArena, bool, MAX_FRAMES_IN_FLIGHT);
+  memset(pApp->statsPending, 0, sizeof(bool) * MAX_FRAMES_IN_FLIGHT);
+
+  fprintf(stderr, "Scene: %u instances, %u lights (K); depth pre-pass %s (Z), occlusion culling %s (O)\n",
+          pApp->scene.instanceCount, pApp->scene.lightCount, depthPrepassEnabled ? "on" : "off",
+          occlusionCullingEnabled ? "on" : "off");
+}
+
+void createPostChain(App *pApp) {
+  if (!pApp->isPostProcessing) {
+    return;
+  }
+
+  const char *paths[] = {BLUR_SHADER_PATH, TONEMAP_SHADER_PATH, SHARPEN_SHADER_PATH};
+  const PostEffect pathEffects[] = {POST_BLOOM, POST_TONEMAP, POST_SHARPEN};
+  ShaderFile shaders[3] = {};
+  VkShaderModule modules[3] = {};
+  for (uint32_t i = 0; i < 3; i++) {
+    for (uint32_t j = 0; j < pApp->postEffectCount; j++) {
+      if (pApp->postEffects[j] == pathEffects[i] && modules[i] == VK_NULL_HANDLE) {
+        readFile(paths[i], &shaders[i]);
+        modules[i] = createShaderModule(pApp, &shaders[i]);
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < pApp->viewCount; i++) {
+    View *view = &pApp->views[i];
+    postCreate(&view->post, &pApp->deviceCaps, pApp->device, pApp->pAllocator, &pApp->memoryBudget,
+               pApp->postEffects, pApp->postEffectCount, modules[0], modules[1], modules[2],
+               pApp->queueFamilyIndices.graphicsFamily, MAX_FRAMES_IN_FLIGHT, view->sceneImageView,
+               view->swapChainExtent);
+  }
+
+  for (uint32_t i = 0; i < 3; i++) {
+    free(shaders[i].code);
+    vkDestroyShaderModule(pApp->device, modules[i], pApp->pAllocator);
+  }
+}
+
+// Fragment shader invocations per frame show how much overdraw the pre-pass and culling remove.
+void createStatsQueryPool(App *pApp) {
+  if (!pApp->deviceCaps.features.pipelineStatisticsQuery) {
+    fprintf(stderr, "Pipeline statistics queries not supported; reporting drawn instances only.\n");
+    return;
+  }
+
+  VkQueryPoolCreateInfo queryInfo = {
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+      .queryCount = MAX_FRAMES_IN_FLIGHT,
+      .pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+                            VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT};
+  if (vkCreateQueryPool(pApp->device, &queryInfo, pApp->pAllocator, &pApp->statsQueryPool) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create query pool!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// GPU time of each frame, from its first command to the end of the upscale. Drives dynamic
+// resolution and is reported with the frame statistics.
+void createTimestampQueryPool(App *pApp) {
+  const DeviceCaps *caps = &pApp->deviceCaps;
+  if (caps->queueFamilies[pApp->queueFamilyIndices.graphicsFamily].timestampValidBits == 0 ||
+      caps->properties.limits.timestampPeriod <= 0.0f) {
+    if (pApp->isVariantSweep) {
+      fprintf(stderr, "GPU timestamps not supported; variant sweep disabled.\n");
+      pApp->isVariantSweep = false;
+    }
+    if (pApp->isLightSweep) {
+      fprintf(stderr, "GPU timestamps not supported; light sweep disabled.\n");
+      pApp->isLightSweep = false;
+    }
+    return;
+  }
+
+  VkQueryPoolCreateInfo queryInfo = {.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                                     .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                                     .queryCount = 2 * MAX_FRAMES_IN_FLIGHT};
+  if (vkCreateQueryPool(pApp->device, &queryInfo, pApp->pAllocator, &pApp->timestampQueryPool) !=
+      VK_SUCCESS) {
+    fprintf(stderr, "Failed to create query pool!\n");
+    exit(EXIT_FAILURE);
+  }
+  pApp->frameRenderScale = arenaPushArray(&pApp->deviceArena, float, MAX_FRAMES_IN_FLIGHT);
+}
+
+void createReadback(App *pApp) {
+  const char *target = getenv("SE_READBACK");
+  if (target == NULL) {
+    return;
+  }
+  if (!(pApp->swapChainImageUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+    fprintf(stderr, "Swap chain images cannot be copied; readback disabled.\n");
+    return;
+  }
+
+  // Two spare slots beyond the frames in flight give the writer thread some slack.
+  pApp->isReadbackEnabled =
+      readbackCreate(&pApp->readback, &pApp->deviceCaps, pApp->device, pApp->pAllocator, &pApp->memoryBudget,
+                     pApp->swapChainImageFormat, pApp->views[0].swapChainExtent, MAX_FRAMES_IN_FLIGHT,
+                     MAX_FRAMES_IN_FLIGHT + 2, target, readbackParseFormat(getenv("SE_READBACK_FORMAT")));
+}
+
+// Created whether or not it starts enabled, so H shows it without a stall.
+void createHud(App *pApp) {
+  ShaderFile vertShader = {};
+  ShaderFile fragShader = {};
+  readFile(HUD_VERT_SHADER_PATH, &vertShader);
+  readFile(HUD_FRAG_SHADER_PATH, &fragShader);
+  VkShaderModule vertModule = createShaderModule(pApp, &vertShader);
+  VkShaderModule fragModule = createShaderModule(pApp, &fragShader);
+
+  const View *view = &pApp->views[0];
+  hudCreate(&pApp->hud, &pApp->deviceCaps, pApp->device, pApp->pAllocator, &pApp->memoryBudget, vertModule,
+            fragModule, pApp->swapChainImageFormat, MAX_FRAMES_IN_FLIGHT, view->swapChainImageViews,
+            view->swapChainImageCount, view->swapChainExtent);
+
+  free(vertShader.code);
+  free(fragShader.code);
+  vkDestroyShaderModule(pApp->device, vertModule, pApp->pAllocator);
+  vkDestroyShaderModule(pApp->device, fragModule, pApp->pAllocator);
+}
+
 void initVulkan(App *pApp) {
+  double start = nowMs();
+
   // TODO: use this as a reference for separate source files
   createInstance(pApp);
   setupDebugMessenger(pApp);
   createSurface(pApp);
   pickPhysicalDevice(pApp);
   createLogicalDevice(pApp);
-  createSwapChain(pApp);
-  createImageViews(pApp);
+  choosePresentMode(pApp);
+  checkViewSurfaces(pApp);
+  for (uint32_t i = 0; i < pApp->viewCount; i++) {
+    createSwapChain(pApp, &pApp->views[i]);
+    createImageViews(pApp, &pApp->views[i]);
+  }
+  chooseDepthFormat(pApp);
+  chooseMsaaSamples(pApp);
+  choosePostProcessing(pApp);
+  chooseDynamicResolution(pApp);
+  for (uint32_t i = 0; i < pApp->viewCount; i++) {
+    createAttachments(pApp, &pApp->views[i]);
+  }
+  reportMsaaFootprint(pApp);
   createRenderPass(pApp);
   createGraphicsPipeline(pApp);
-  createFramebuffers(pApp);
+  for (uint32_t i = 0; i < pApp->viewCount; i++) {
+    createFramebuffers(pApp, &pApp->views[i]);
+    memoryBudgetRegister(&pApp->memoryBudget, &pApp->views[i].evictable, evictView, &pApp->views[i]);
+  }
   createCommandPool(pApp);
   createCommandBuffers(pApp);
   createSyncObjects(pApp);
+  createScene(pApp);
+  createPostChain(pApp);
+  createStatsQueryPool(pApp);
+  createTimestampQueryPool(pApp);
+  createReadback(pApp);
+  createHud(pApp);
+
+  fprintf(stderr, "Vulkan initialized in %.1f ms\n", nowMs() - start);
 }
 
 int main(void) {
   App app = {};
 
+  hostAllocatorInit(&app.hostAllocator);
+  const char *hostAllocator = getenv("SE_HOST_ALLOCATOR");
+  app.pAllocator = hostAllocator && strcmp(hostAllocator, "0") == 0 ? NULL : &app.hostAllocator.callbacks;
+  arenaInit(&app.deviceArena, 1024);
+  const char *depthPrepass = getenv("SE_DEPTH_PREPASS");
+  depthPrepassEnabled = !(depthPrepass && strcmp(depthPrepass, "0") == 0);
+  const char *occlusion = getenv("SE_OCCLUSION");
+  occlusionCullingEnabled = !(occlusion && strcmp(occlusion, "0") == 0);
+  const char *fpsLimit = getenv("SE_FPS_LIMIT");
+  framePacerInit(&app.pacer, fpsLimit ? atof(fpsLimit) : 0.0);
+  const char *variantSweep = getenv("SE_VARIANT_SWEEP");
+  app.isVariantSweep = variantSweep && strcmp(variantSweep, "0") != 0;
+  const char *views = getenv("SE_VIEWS");
+  app.viewCount = views && atoi(views) > 0 ? (uint32_t)atoi(views) : 1;
+  if (app.viewCount > MAX_VIEWS) {
+    fprintf(stderr, "At most %u views; SE_VIEWS=%u ignored.\n", MAX_VIEWS, app.viewCount);
+    app.viewCount = MAX_VIEWS;
+  }
+  // The sweeps all step through report intervals, so only one runs at a time.
+  const char *viewSweep = getenv("SE_VIEW_SWEEP");
+  app.isViewSweep = viewSweep && strcmp(viewSweep, "0") != 0 && !app.isVariantSweep;
+  const char *lightSweep = getenv("SE_LIGHT_SWEEP");
+  app.isLightSweep = lightSweep && strcmp(lightSweep, "0") != 0 && !app.isVariantSweep && !app.isViewSweep;
+  const char *hud = getenv("SE_HUD");
+  hudEnabled = hud && strcmp(hud, "0") != 0;
+  app.activeViewCount = app.isViewSweep ? 1 : app.viewCount;
+
+  app.jobSystem = jobSystemCreate(JOB_WORKERS_AUTO);
   initWindow(&app);
   initVulkan(&app);
+
+  // The session starts after initialization so its CPU time is that of rendering alone.
+  // The sweeps need frames back to back.
+  const char *onDemand = getenv("SE_RENDER_ON_DEMAND");
+  const char *animationFps = getenv("SE_ANIMATION_FPS");
+  const char *sessionSeconds = getenv("SE_SESSION_SECONDS");
+  double start = nowMs();
+  bool sweeping = app.isVariantSweep || app.isViewSweep || app.isLightSweep;
+  onDemandInit(&app.onDemand, onDemand && strcmp(onDemand, "0") != 0 && !sweeping,
+               animationFps ? atof(animationFps) : ON_DEMAND_DEFAULT_FPS, start);
+  app.sessionEndMs = sessionSeconds ? start + 1e3 * atof(sessionSeconds) : 0.0;
+  fprintf(stderr, "Render on demand %s (R), animation %s (Space)\n", app.onDemand.enabled ? "on" : "off",
+          app.onDemand.animating ? "running" : "paused");
   mainLoop(&app);
   cleanup(&app);
 }
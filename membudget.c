@@ -0,0 +1,265 @@
+#include "membudget.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_ALLOCATION_CAPACITY 64
+
+static double toMiB(VkDeviceSize bytes) { return (double)bytes / (1024.0 * 1024.0); }
+
+bool memoryBudgetSupported(const DeviceCaps *caps) {
+  return caps->properties.apiVersion >= VK_API_VERSION_1_1 &&
+         deviceCapsHasExtension(caps, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+}
+
+void memoryBudgetInit(MemoryBudget *mb, const DeviceCaps *caps, bool hasBudgetExtension, float watermark,
+                      uint32_t protectedFrames) {
+  *mb = (MemoryBudget){.physicalDevice = caps->physicalDevice,
+                       .hasBudgetExtension = hasBudgetExtension,
+                       .watermark = watermark,
+                       .protectedFrames = protectedFrames,
+                       .allocationCapacity = INITIAL_ALLOCATION_CAPACITY};
+  mb->allocations = calloc(mb->allocationCapacity, sizeof(MemoryAllocation));
+  if (mb->allocations == NULL) {
+    fprintf(stderr, "Failed to allocate memory budget table!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  const VkPhysicalDeviceMemoryProperties *properties = &caps->memoryProperties;
+  for (uint32_t i = 0; i < properties->memoryTypeCount; i++) {
+    mb->typeHeap[i] = properties->memoryTypes[i].heapIndex;
+  }
+  mb->heapCount = properties->memoryHeapCount;
+  for (uint32_t i = 0; i < mb->heapCount; i++) {
+    mb->heaps[i].size = properties->memoryHeaps[i].size;
+    mb->heaps[i].budget = properties->memoryHeaps[i].size;
+  }
+}
+
+void memoryBudgetDestroy(MemoryBudget *mb) {
+  if (mb->allocationCount > 0) {
+    fprintf(stderr, "%u device memory allocations (%.1f MiB) were never freed\n", mb->allocationCount,
+            toMiB(memoryBudgetAllocated(mb)));
+  }
+  free(mb->allocations);
+  mb->allocations = NULL;
+}
+
+static uint32_t slotOf(const MemoryBudget *mb, VkDeviceMemory memory) {
+  // Non-dispatchable handles are 64-bit everywhere, but pointers on 64-bit platforms.
+  uint64_t key = 0;
+  memcpy(&key, &memory, sizeof(memory));
+  return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & (mb->allocationCapacity - 1);
+}
+
+static void insert(MemoryBudget *mb, MemoryAllocation allocation) {
+  uint32_t slot = slotOf(mb, allocation.memory);
+  while (mb->allocations[slot].memory != VK_NULL_HANDLE) {
+    slot = (slot + 1) & (mb->allocationCapacity - 1);
+  }
+  mb->allocations[slot] = allocation;
+  mb->allocationCount++;
+}
+
+static void grow(MemoryBudget *mb) {
+  MemoryAllocation *old = mb->allocations;
+  uint32_t oldCapacity = mb->allocationCapacity;
+  mb->allocationCapacity *= 2;
+  mb->allocations = calloc(mb->allocationCapacity, sizeof(MemoryAllocation));
+  if (mb->allocations == NULL) {
+    fprintf(stderr, "Failed to grow memory budget table!\n");
+    exit(EXIT_FAILURE);
+  }
+  mb->allocationCount = 0;
+  for (uint32_t i = 0; i < oldCapacity; i++) {
+    if (old[i].memory != VK_NULL_HANDLE) {
+      insert(mb, old[i]);
+    }
+  }
+  free(old);
+}
+
+// Removes the allocation and returns it, shifting later entries of its probe run back so
+// lookups never need tombstones.
+static MemoryAllocation removeAllocation(MemoryBudget *mb, VkDeviceMemory memory) {
+  uint32_t mask = mb->allocationCapacity - 1;
+  uint32_t slot = slotOf(mb, memory);
+  while (mb->allocations[slot].memory != memory) {
+    if (mb->allocations[slot].memory == VK_NULL_HANDLE) {
+      fprintf(stderr, "Freeing device memory that was not allocated through the budget!\n");
+      exit(EXIT_FAILURE);
+    }
+    slot = (slot + 1) & mask;
+  }
+  MemoryAllocation removed = mb->allocations[slot];
+  mb->allocationCount--;
+
+  uint32_t hole = slot;
+  for (uint32_t next = (hole + 1) & mask; mb->allocations[next].memory != VK_NULL_HANDLE;
+       next = (next + 1) & mask) {
+    uint32_t home = slotOf(mb, mb->allocations[next].memory);
+    // Move the entry into the hole unless its home lies cyclically in (hole, next].
+    bool homeBetween = hole <= next ? (home > hole && home <= next) : (home > hole || home <= next);
+    if (!homeBetween) {
+      mb->allocations[hole] = mb->allocations[next];
+      hole = next;
+    }
+  }
+  mb->allocations[hole] = (MemoryAllocation){0};
+  return removed;
+}
+
+VkResult memoryBudgetAllocate(MemoryBudget *mb, VkDevice device, const VkMemoryAllocateInfo *info,
+                              const VkAllocationCallbacks *pAllocator, VkDeviceMemory *memory) {
+  VkResult result = vkAllocateMemory(device, info, pAllocator, memory);
+  if (result != VK_SUCCESS) {
+    return result;
+  }
+  if (2 * (mb->allocationCount + 1) > mb->allocationCapacity) {
+    grow(mb);
+  }
+  uint32_t heapIndex = mb->typeHeap[info->memoryTypeIndex];
+  insert(mb, (MemoryAllocation){.memory = *memory, .size = info->allocationSize, .heap = heapIndex});
+
+  // Usage is re-read from the driver each frame; until then it moves with our allocations.
+  MemoryHeapBudget *heap = &mb->heaps[heapIndex];
+  heap->allocated += info->allocationSize;
+  heap->usage += info->allocationSize;
+  heap->allocationCount++;
+  if (heap->allocated > heap->peakAllocated) {
+    heap->peakAllocated = heap->allocated;
+  }
+  return VK_SUCCESS;
+}
+
+void memoryBudgetFree(MemoryBudget *mb, VkDevice device, VkDeviceMemory memory,
+                      const VkAllocationCallbacks *pAllocator) {
+  if (memory == VK_NULL_HANDLE) {
+    return;
+  }
+  MemoryAllocation allocation = removeAllocation(mb, memory);
+  vkFreeMemory(device, memory, pAllocator);
+
+  MemoryHeapBudget *heap = &mb->heaps[allocation.heap];
+  heap->allocated -= allocation.size;
+  heap->usage -= allocation.size < heap->usage ? allocation.size : heap->usage;
+  heap->allocationCount--;
+}
+
+static void unlink(MemoryBudget *mb, MemoryEvictable *evictable) {
+  if (evictable->prev != NULL) {
+    evictable->prev->next = evictable->next;
+  } else {
+    mb->mostRecent = evictable->next;
+  }
+  if (evictable->next != NULL) {
+    evictable->next->prev = evictable->prev;
+  } else {
+    mb->leastRecent = evictable->prev;
+  }
+  evictable->prev = NULL;
+  evictable->next = NULL;
+}
+
+static void pushMostRecent(MemoryBudget *mb, MemoryEvictable *evictable) {
+  evictable->prev = NULL;
+  evictable->next = mb->mostRecent;
+  if (mb->mostRecent != NULL) {
+    mb->mostRecent->prev = evictable;
+  } else {
+    mb->leastRecent = evictable;
+  }
+  mb->mostRecent = evictable;
+}
+
+void memoryBudgetRegister(MemoryBudget *mb, MemoryEvictable *evictable, MemoryEvictFn evict, void *data) {
+  *evictable = (MemoryEvictable){.evict = evict, .data = data, .lastUsedFrame = mb->frame, .resident = true};
+  pushMostRecent(mb, evictable);
+}
+
+void memoryBudgetUnregister(MemoryBudget *mb, MemoryEvictable *evictable) { unlink(mb, evictable); }
+
+bool memoryBudgetTouch(MemoryBudget *mb, MemoryEvictable *evictable) {
+  bool wasResident = evictable->resident;
+  evictable->resident = true;
+  evictable->lastUsedFrame = mb->frame;
+  if (mb->mostRecent != evictable) {
+    unlink(mb, evictable);
+    pushMostRecent(mb, evictable);
+  }
+  return wasResident;
+}
+
+static bool overWatermark(const MemoryBudget *mb) {
+  for (uint32_t i = 0; i < mb->heapCount; i++) {
+    const MemoryHeapBudget *heap = &mb->heaps[i];
+    if (heap->budget > 0 && (double)heap->usage > (double)mb->watermark * (double)heap->budget) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void memoryBudgetUpdate(MemoryBudget *mb) {
+  mb->frame++;
+  if (mb->hasBudgetExtension) {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT};
+    VkPhysicalDeviceMemoryProperties2 properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2, .pNext = &budget};
+    vkGetPhysicalDeviceMemoryProperties2(mb->physicalDevice, &properties);
+    for (uint32_t i = 0; i < mb->heapCount; i++) {
+      mb->heaps[i].budget = budget.heapBudget[i];
+      mb->heaps[i].usage = budget.heapUsage[i];
+    }
+  }
+
+  // The list is in order of use, so once the least recent resident resource is still
+  // protected, so is every other.
+  MemoryEvictable *victim = mb->leastRecent;
+  while (victim != NULL && overWatermark(mb)) {
+    if (!victim->resident) {
+      victim = victim->prev;
+      continue;
+    }
+    if (victim->lastUsedFrame + mb->protectedFrames > mb->frame) {
+      break;
+    }
+    VkDeviceSize before = memoryBudgetAllocated(mb);
+    victim->evict(victim->data);
+    victim->resident = false;
+    mb->evictions++;
+    mb->evictedBytes += before - memoryBudgetAllocated(mb);
+    victim = victim->prev;
+  }
+}
+
+VkDeviceSize memoryBudgetAllocated(const MemoryBudget *mb) {
+  VkDeviceSize total = 0;
+  for (uint32_t i = 0; i < mb->heapCount; i++) {
+    total += mb->heaps[i].allocated;
+  }
+  return total;
+}
+
+VkDeviceSize memoryBudgetUsage(const MemoryBudget *mb) {
+  VkDeviceSize total = 0;
+  for (uint32_t i = 0; i < mb->heapCount; i++) {
+    total += mb->heaps[i].usage;
+  }
+  return total;
+}
+
+void memoryBudgetReport(const MemoryBudget *mb, FILE *out) {
+  fprintf(out, "Device memory (%s):", mb->hasBudgetExtension ? "driver budget" : "heap sizes");
+  for (uint32_t i = 0; i < mb->heapCount; i++) {
+    const MemoryHeapBudget *heap = &mb->heaps[i];
+    if (heap->allocationCount == 0 && heap->usage == 0) {
+      continue;
+    }
+    fprintf(out, " heap %u %.1f/%.1f MiB (%.0f%%, ours %.1f in %u, peak %.1f)", i, toMiB(heap->usage),
+            toMiB(heap->budget), heap->budget > 0 ? 100.0 * (double)heap->usage / (double)heap->budget : 0.0,
+            toMiB(heap->allocated), heap->allocationCount, toMiB(heap->peakAllocated));
+  }
+  fprintf(out, ", %u evictions (%.1f MiB)\n", mb->evictions, toMiB(mb->evictedBytes));
+}
@@ -0,0 +1,105 @@
+#ifndef MEMBUDGET_H
+#define MEMBUDGET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vulkan/vulkan.h>
+
+#include "devicecaps.h"
+
+// Device memory accounting against the driver's budget. Every allocation goes through
+// memoryBudgetAllocate() so usage per heap is known exactly. Once per frame
+// memoryBudgetUpdate() reads the budget and the whole process's usage from
+// VK_EXT_memory_budget, or assumes the full heap size and only our allocations without it.
+// While any heap is above the watermark, resources registered as evictable are released,
+// least recently used first, by calling back into their owner.
+//
+// Not thread safe: allocations, frees and updates must come from one thread.
+
+#define MEMORY_BUDGET_DEFAULT_WATERMARK 0.9f
+
+typedef struct MemoryHeapBudget {
+  VkDeviceSize size;
+  VkDeviceSize budget; // what the driver suggests the process uses at most
+  VkDeviceSize usage;  // whole process; our own allocations without the extension
+  VkDeviceSize allocated;
+  VkDeviceSize peakAllocated;
+  uint32_t allocationCount;
+} MemoryHeapBudget;
+
+// Frees the resource's memory. The owner recreates it before its next use, which it learns
+// from memoryBudgetTouch().
+typedef void (*MemoryEvictFn)(void *data);
+
+typedef struct MemoryEvictable {
+  MemoryEvictFn evict;
+  void *data;
+  uint64_t lastUsedFrame;
+  bool resident;
+  struct MemoryEvictable *prev; // more recently used
+  struct MemoryEvictable *next;
+} MemoryEvictable;
+
+typedef struct MemoryAllocation {
+  VkDeviceMemory memory; // VK_NULL_HANDLE marks an empty slot
+  VkDeviceSize size;
+  uint32_t heap;
+} MemoryAllocation;
+
+typedef struct MemoryBudget {
+  VkPhysicalDevice physicalDevice;
+  bool hasBudgetExtension;
+  float watermark; // fraction of the budget
+  // Evictables used within this many frames may still be read by the GPU.
+  uint32_t protectedFrames;
+  uint64_t frame;
+
+  uint32_t heapCount;
+  uint32_t typeHeap[VK_MAX_MEMORY_TYPES];
+  MemoryHeapBudget heaps[VK_MAX_MEMORY_HEAPS];
+
+  // Live allocations by handle, open addressing with linear probing.
+  MemoryAllocation *allocations;
+  uint32_t allocationCapacity; // power of two
+  uint32_t allocationCount;
+
+  MemoryEvictable *mostRecent;
+  MemoryEvictable *leastRecent;
+  uint32_t evictions;
+  VkDeviceSize evictedBytes;
+} MemoryBudget;
+
+// Whether the device has VK_EXT_memory_budget. The instance must target Vulkan 1.1.
+bool memoryBudgetSupported(const DeviceCaps *caps);
+// `hasBudgetExtension` only if VK_EXT_memory_budget is enabled on the device.
+void memoryBudgetInit(MemoryBudget *mb, const DeviceCaps *caps, bool hasBudgetExtension, float watermark,
+                      uint32_t protectedFrames);
+// Reports allocations still live, which are leaks.
+void memoryBudgetDestroy(MemoryBudget *mb);
+
+// vkAllocateMemory() and vkFreeMemory(), accounted. Freeing VK_NULL_HANDLE does nothing.
+VkResult memoryBudgetAllocate(MemoryBudget *mb, VkDevice device, const VkMemoryAllocateInfo *info,
+                              const VkAllocationCallbacks *pAllocator, VkDeviceMemory *memory);
+void memoryBudgetFree(MemoryBudget *mb, VkDevice device, VkDeviceMemory memory,
+                      const VkAllocationCallbacks *pAllocator);
+
+// Registers a resident resource that may be evicted under pressure.
+void memoryBudgetRegister(MemoryBudget *mb, MemoryEvictable *evictable, MemoryEvictFn evict, void *data);
+void memoryBudgetUnregister(MemoryBudget *mb, MemoryEvictable *evictable);
+// The resource is used by the current frame. Returns false if it was evicted, in which case
+// the owner must recreate it; it counts as resident again from here on.
+bool memoryBudgetTouch(MemoryBudget *mb, MemoryEvictable *evictable);
+
+// Starts a frame: re-reads the driver's budget and evicts while a heap is above the
+// watermark. Call once the fence of the oldest frame in flight has been waited on.
+void memoryBudgetUpdate(MemoryBudget *mb);
+// Our own allocations across all heaps.
+VkDeviceSize memoryBudgetAllocated(const MemoryBudget *mb);
+// Usage across all heaps as the driver reports it; our own allocations without the extension.
+VkDeviceSize memoryBudgetUsage(const MemoryBudget *mb);
+// One line: usage against budget for each heap in use, and evictions so far.
+void memoryBudgetReport(const MemoryBudget *mb, FILE *out);
+
+#endif
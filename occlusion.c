@@ -0,0 +1,491 @@
+#include "occlusion.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OCCLUSION_MAX_LEVELS 16 // 32768 x 32768
+
+_Static_assert(sizeof(OcclusionCullParams) == 256, "OcclusionCullParams must match std140 in cull.comp");
+
+typedef struct HizPushConstants {
+  int32_t srcSize[2];
+  int32_t dstSize[2];
+  int32_t samples;
+} HizPushConstants;
+
+static void createBuffer(Occlusion *oc, VkDeviceSize size, VkBufferUsageFlags usage,
+                         VkMemoryPropertyFlags properties, VkBuffer *buffer, VkDeviceMemory *memory) {
+  VkBufferCreateInfo bufferInfo = {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                   .size = size,
+                                   .usage = usage,
+                                   .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
+  if (vkCreateBuffer(oc->device, &bufferInfo, oc->pAllocator, buffer) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create culling buffer!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  VkMemoryRequirements memRequirements;
+  vkGetBufferMemoryRequirements(oc->device, *buffer, &memRequirements);
+  uint32_t memoryType = deviceCapsFindMemoryType(oc->caps, memRequirements.memoryTypeBits, properties);
+  if (memoryType == UINT32_MAX) {
+    fprintf(stderr, "Failed to find suitable memory type!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  VkMemoryAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                                    .allocationSize = memRequirements.size,
+                                    .memoryTypeIndex = memoryType};
+  if (memoryBudgetAllocate(oc->budget, oc->device, &allocInfo, oc->pAllocator, memory) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to allocate culling buffer memory!\n");
+    exit(EXIT_FAILURE);
+  }
+  vkBindBufferMemory(oc->device, *buffer, *memory, 0);
+}
+
+static void *createMappedBuffer(Occlusion *oc, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer *buffer,
+                                VkDeviceMemory *memory) {
+  createBuffer(oc, size, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+               buffer, memory);
+  void *mapped;
+  vkMapMemory(oc->device, *memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+  return mapped;
+}
+
+static VkPipeline createComputePipeline(Occlusion *oc, VkShaderModule shader, VkPipelineLayout layout) {
+  VkComputePipelineCreateInfo pipelineInfo = {
+      .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+      .stage = {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = shader,
+                .pName = "main"},
+      .layout = layout,
+      .basePipelineIndex = -1};
+  VkPipeline pipeline;
+  if (vkCreateComputePipelines(oc->device, VK_NULL_HANDLE, 1, &pipelineInfo, oc->pAllocator, &pipeline) !=
+      VK_SUCCESS) {
+    fprintf(stderr, "Failed to create culling pipeline!\n");
+    exit(EXIT_FAILURE);
+  }
+  return pipeline;
+}
+
+static void createPipelines(Occlusion *oc, VkShaderModule cullShader, VkShaderModule hizShader,
+                            VkShaderModule hizMultisampleShader) {
+  VkDescriptorSetLayoutBinding cullBindings[] = {
+      {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL},
+      {1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL},
+      {2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL},
+      {3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL},
+      {4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, &oc->sampler}};
+  VkDescriptorSetLayoutCreateInfo cullSetInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+                                                 .bindingCount = 5,
+                                                 .pBindings = cullBindings};
+  VkDescriptorSetLayoutBinding hizBindings[] = {
+      {0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, &oc->sampler},
+      {1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL}};
+  VkDescriptorSetLayoutCreateInfo hizSetInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+                                                .bindingCount = 2,
+                                                .pBindings = hizBindings};
+  if (vkCreateDescriptorSetLayout(oc->device, &cullSetInfo, oc->pAllocator, &oc->cullSetLayout) !=
+          VK_SUCCESS ||
+      vkCreateDescriptorSetLayout(oc->device, &hizSetInfo, oc->pAllocator, &oc->hizSetLayout) !=
+          VK_SUCCESS) {
+    fprintf(stderr, "Failed to create culling descriptor set layouts!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  VkPushConstantRange hizPushConstants = {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HizPushConstants)};
+  VkPipelineLayoutCreateInfo cullLayoutInfo = {.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                                               .setLayoutCount = 1,
+                                               .pSetLayouts = &oc->cullSetLayout};
+  VkPipelineLayoutCreateInfo hizLayoutInfo = {.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                                              .setLayoutCount = 1,
+                                              .pSetLayouts = &oc->hizSetLayout,
+                                              .pushConstantRangeCount = 1,
+                                              .pPushConstantRanges = &hizPushConstants};
+  if (vkCreatePipelineLayout(oc->device, &cullLayoutInfo, oc->pAllocator, &oc->cullPipelineLayout) !=
+          VK_SUCCESS ||
+      vkCreatePipelineLayout(oc->device, &hizLayoutInfo, oc->pAllocator, &oc->hizPipelineLayout) !=
+          VK_SUCCESS) {
+    fprintf(stderr, "Failed to create culling pipeline layouts!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  oc->cullPipeline = createComputePipeline(oc, cullShader, oc->cullPipelineLayout);
+  oc->hizPipeline = createComputePipeline(oc, hizShader, oc->hizPipelineLayout);
+  if (oc->depthSamples > VK_SAMPLE_COUNT_1_BIT) {
+    oc->hizMultisamplePipeline = createComputePipeline(oc, hizMultisampleShader, oc->hizPipelineLayout);
+  }
+}
+
+static void createPyramid(Occlusion *oc, VkExtent2D extent) {
+  oc->hizExtent = extent;
+  oc->hizLevels = 1;
+  while ((extent.width | extent.height) >> oc->hizLevels) {
+    oc->hizLevels++;
+  }
+
+  VkImageCreateInfo imageInfo = {.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                                 .imageType = VK_IMAGE_TYPE_2D,
+                                 .format = VK_FORMAT_R32_SFLOAT,
+                                 .extent = {extent.width, extent.height, 1},
+                                 .mipLevels = oc->hizLevels,
+                                 .arrayLayers = 1,
+                                 .samples = VK_SAMPLE_COUNT_1_BIT,
+                                 .tiling = VK_IMAGE_TILING_OPTIMAL,
+                                 .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+                                 .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                                 .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+  if (vkCreateImage(oc->device, &imageInfo, oc->pAllocator, &oc->hizImage) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create Hi-Z image!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  VkMemoryRequirements memRequirements;
+  vkGetImageMemoryRequirements(oc->device, oc->hizImage, &memRequirements);
+  uint32_t memoryType = deviceCapsFindMemoryType(oc->caps, memRequirements.memoryTypeBits,
+                                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  VkMemoryAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                                    .allocationSize = memRequirements.size,
+                                    .memoryTypeIndex = memoryType};
+  if (memoryType == UINT32_MAX ||
+      memoryBudgetAllocate(oc->budget, oc->device, &allocInfo, oc->pAllocator, &oc->hizMemory) !=
+          VK_SUCCESS) {
+    fprintf(stderr, "Failed to allocate Hi-Z image memory!\n");
+    exit(EXIT_FAILURE);
+  }
+  vkBindImageMemory(oc->device, oc->hizImage, oc->hizMemory, 0);
+
+  VkImageViewCreateInfo viewInfo = {.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                                    .image = oc->hizImage,
+                                    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                                    .format = VK_FORMAT_R32_SFLOAT,
+                                    .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                    .subresourceRange.levelCount = oc->hizLevels,
+                                    .subresourceRange.layerCount = 1};
+  if (vkCreateImageView(oc->device, &viewInfo, oc->pAllocator, &oc->hizView) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create Hi-Z image view!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  oc->hizLevelViews = arenaPushArray(&oc->pyramidArena, VkImageView, oc->hizLevels);
+  oc->hizSets = arenaPushArray(&oc->pyramidArena, VkDescriptorSet, oc->hizLevels);
+  for (uint32_t level = 0; level < oc->hizLevels; level++) {
+    viewInfo.subresourceRange.baseMipLevel = level;
+    viewInfo.subresourceRange.levelCount = 1;
+    if (vkCreateImageView(oc->device, &viewInfo, oc->pAllocator, &oc->hizLevelViews[level]) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to create Hi-Z image view!\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // Descriptor sets reference the views, so the whole pool is rebuilt with them.
+  vkResetDescriptorPool(oc->device, oc->descriptorPool, 0);
+
+  VkDescriptorSetLayout hizLayouts[OCCLUSION_MAX_LEVELS];
+  for (uint32_t level = 0; level < oc->hizLevels; level++) {
+    hizLayouts[level] = oc->hizSetLayout;
+  }
+  VkDescriptorSetAllocateInfo hizAllocInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                                              .descriptorPool = oc->descriptorPool,
+                                              .descriptorSetCount = oc->hizLevels,
+                                              .pSetLayouts = hizLayouts};
+  if (vkAllocateDescriptorSets(oc->device, &hizAllocInfo, oc->hizSets) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to allocate Hi-Z descriptor sets!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (uint32_t level = 0; level < oc->hizLevels; level++) {
+    VkDescriptorImageInfo src = {.imageView = level ? oc->hizLevelViews[level - 1] : oc->depthView,
+                                 .imageLayout = level ? VK_IMAGE_LAYOUT_GENERAL
+                                                      : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+    VkDescriptorImageInfo dst = {.imageView = oc->hizLevelViews[level],
+                                 .imageLayout = VK_IMAGE_LAYOUT_GENERAL};
+    VkWriteDescriptorSet writes[] = {{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                      .dstSet = oc->hizSets[level],
+                                      .dstBinding = 0,
+                                      .descriptorCount = 1,
+                                      .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                      .pImageInfo = &src},
+                                     {.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                      .dstSet = oc->hizSets[level],
+                                      .dstBinding = 1,
+                                      .descriptorCount = 1,
+                                      .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                      .pImageInfo = &dst}};
+    vkUpdateDescriptorSets(oc->device, 2, writes, 0, NULL);
+  }
+
+  for (uint32_t i = 0; i < oc->frameCount; i++) {
+    OcclusionFrame *frame = &oc->frames[i];
+    VkDescriptorSetAllocateInfo allocSetInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                                                .descriptorPool = oc->descriptorPool,
+                                                .descriptorSetCount = 1,
+                                                .pSetLayouts = &oc->cullSetLayout};
+    if (vkAllocateDescriptorSets(oc->device, &allocSetInfo, &frame->cullSet) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to allocate culling descriptor set!\n");
+      exit(EXIT_FAILURE);
+    }
+
+    VkDescriptorBufferInfo buffers[] = {{frame->paramsBuffer, 0, VK_WHOLE_SIZE},
+                                        {oc->instanceBuffer, 0, VK_WHOLE_SIZE},
+                                        {frame->visibleBuffer, 0, VK_WHOLE_SIZE},
+                                        {frame->indirectBuffer, 0, VK_WHOLE_SIZE}};
+    VkDescriptorImageInfo hiz = {.imageView = oc->hizView, .imageLayout = VK_IMAGE_LAYOUT_GENERAL};
+    VkWriteDescriptorSet writes[5];
+    for (uint32_t binding = 0; binding < 4; binding++) {
+      writes[binding] = (VkWriteDescriptorSet){
+          .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+          .dstSet = frame->cullSet,
+          .dstBinding = binding,
+          .descriptorCount = 1,
+          .descriptorType = binding ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+          .pBufferInfo = &buffers[binding]};
+    }
+    writes[4] = (VkWriteDescriptorSet){.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                       .dstSet = frame->cullSet,
+                                       .dstBinding = 4,
+                                       .descriptorCount = 1,
+                                       .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                       .pImageInfo = &hiz};
+    vkUpdateDescriptorSets(oc->device, 5, writes, 0, NULL);
+  }
+
+  oc->hizInitialized = false;
+  oc->hizValid = false;
+}
+
+static void destroyPyramid(Occlusion *oc) {
+  for (uint32_t level = 0; level < oc->hizLevels; level++) {
+    vkDestroyImageView(oc->device, oc->hizLevelViews[level], oc->pAllocator);
+  }
+  vkDestroyImageView(oc->device, oc->hizView, oc->pAllocator);
+  vkDestroyImage(oc->device, oc->hizImage, oc->pAllocator);
+  memoryBudgetFree(oc->budget, oc->device, oc->hizMemory, oc->pAllocator);
+  arenaReset(&oc->pyramidArena);
+}
+
+void occlusionCreate(Occlusion *oc, const DeviceCaps *caps, VkDevice device,
+                     const VkAllocationCallbacks *pAllocator, MemoryBudget *budget, VkShaderModule cullShader,
+                     VkShaderModule hizShader, VkShaderModule hizMultisampleShader, const Scene *scene,
+                     uint32_t frameCount, VkImageView depthView, VkSampleCountFlagBits depthSamples,
+                     VkExtent2D extent) {
+  *oc = (Occlusion){.caps = caps,
+                    .device = device,
+                    .pAllocator = pAllocator,
+                    .budget = budget,
+                    .instanceCount = scene->instanceCount,
+                    .indexCount = scene->indexCount,
+                    .frameCount = frameCount,
+                    .depthView = depthView,
+                    .depthSamples = depthSamples};
+  arenaInit(&oc->arena, 4096);
+  arenaInit(&oc->pyramidArena, 1024);
+  oc->frames = arenaPushArray(&oc->arena, OcclusionFrame, frameCount);
+  memset(oc->frames, 0, sizeof(OcclusionFrame) * frameCount);
+
+  // Nearest filtering: the pyramid already holds the conservative value of each footprint.
+  VkSamplerCreateInfo samplerInfo = {.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+                                     .magFilter = VK_FILTER_NEAREST,
+                                     .minFilter = VK_FILTER_NEAREST,
+                                     .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+                                     .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                                     .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                                     .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                                     .maxLod = VK_LOD_CLAMP_NONE};
+  if (vkCreateSampler(device, &samplerInfo, pAllocator, &oc->sampler) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create Hi-Z sampler!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  createPipelines(oc, cullShader, hizShader, hizMultisampleShader);
+
+  VkDescriptorPoolSize poolSizes[] = {
+      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frameCount},
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * frameCount},
+      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, frameCount + OCCLUSION_MAX_LEVELS},
+      {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, OCCLUSION_MAX_LEVELS},
+  };
+  VkDescriptorPoolCreateInfo poolInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                                         .maxSets = frameCount + OCCLUSION_MAX_LEVELS,
+                                         .poolSizeCount = 4,
+                                         .pPoolSizes = poolSizes};
+  if (vkCreateDescriptorPool(device, &poolInfo, pAllocator, &oc->descriptorPool) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create culling descriptor pool!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  VkDeviceSize instancesSize = sizeof(SceneInstance) * scene->instanceCount;
+  void *instances = createMappedBuffer(oc, instancesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                       &oc->instanceBuffer, &oc->instanceMemory);
+  memcpy(instances, scene->instances, instancesSize);
+  vkUnmapMemory(device, oc->instanceMemory);
+
+  for (uint32_t i = 0; i < frameCount; i++) {
+    OcclusionFrame *frame = &oc->frames[i];
+    frame->params = createMappedBuffer(oc, sizeof(OcclusionCullParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                       &frame->paramsBuffer, &frame->paramsMemory);
+    createBuffer(oc, instancesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &frame->visibleBuffer, &frame->visibleMemory);
+    frame->indirect =
+        createMappedBuffer(oc, sizeof(VkDrawIndexedIndirectCommand),
+                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                           &frame->indirectBuffer, &frame->indirectMemory);
+    *frame->indirect = (VkDrawIndexedIndirectCommand){.indexCount = oc->indexCount};
+  }
+
+  createPyramid(oc, extent);
+}
+
+void occlusionResize(Occlusion *oc, VkImageView depthView, VkExtent2D extent) {
+  destroyPyramid(oc);
+  oc->depthView = depthView;
+  createPyramid(oc, extent);
+}
+
+uint32_t occlusionVisibleCount(const Occlusion *oc, uint32_t frameIndex) {
+  return oc->frames[frameIndex].indirect->instanceCount;
+}
+
+void occlusionRecordCull(Occlusion *oc, VkCommandBuffer commandBuffer, uint32_t frameIndex,
+                         const Mat4 *viewProj, bool useHiz) {
+  OcclusionFrame *frame = &oc->frames[frameIndex];
+
+  // The frame's fence has signaled, so both host-visible blocks are free to rewrite.
+  *frame->indirect = (VkDrawIndexedIndirectCommand){.indexCount = oc->indexCount};
+  *frame->params = (OcclusionCullParams){
+      .viewProj = *viewProj,
+      .prevViewProj = oc->hizViewProj,
+      .frustum = frustumFromMatrix(viewProj),
+      .hizSize = {(float)oc->hizExtent.width, (float)oc->hizExtent.height},
+      .instanceCount = oc->instanceCount,
+      .flags = useHiz && oc->hizValid ? OCCLUSION_FLAG_HIZ : 0,
+      .hizScale = {(float)oc->hizRenderExtent.width / (float)oc->hizExtent.width,
+                   (float)oc->hizRenderExtent.height / (float)oc->hizExtent.height},
+  };
+
+  // Without a valid pyramid the image may still be UNDEFINED; the shader never samples it then,
+  // but the descriptor must name a valid layout.
+  if (!oc->hizInitialized) {
+    VkImageMemoryBarrier toGeneral = {.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                                      .srcAccessMask = 0,
+                                      .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                      .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                                      .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+                                      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                      .image = oc->hizImage,
+                                      .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                      .subresourceRange.levelCount = oc->hizLevels,
+                                      .subresourceRange.layerCount = 1};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &toGeneral);
+    oc->hizInitialized = true;
+  }
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, oc->cullPipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, oc->cullPipelineLayout, 0, 1,
+                          &frame->cullSet, 0, NULL);
+  vkCmdDispatch(commandBuffer, (oc->instanceCount + 63) / 64, 1, 1);
+
+  // The host reads the visible count back once the frame's fence has signaled.
+  VkMemoryBarrier toDraw = {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                            .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+                                             VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_HOST_READ_BIT};
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+                           VK_PIPELINE_STAGE_HOST_BIT,
+                       0, 1, &toDraw, 0, NULL, 0, NULL);
+}
+
+void occlusionRecordBuild(Occlusion *oc, VkCommandBuffer commandBuffer, const Mat4 *viewProj,
+                          VkExtent2D renderExtent) {
+  // The culling pass of this frame has finished reading the previous pyramid.
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0, NULL, 0, NULL);
+
+  // `covered` is the part of each level that depends on the render area. Texels past it keep
+  // whatever an earlier build left there; the boundary texels mix both, which only makes them
+  // farther and so stays conservative.
+  VkExtent2D src = oc->hizExtent;
+  VkExtent2D covered = renderExtent;
+  for (uint32_t level = 0; level < oc->hizLevels; level++) {
+    // Only level 0 reads the depth buffer itself; the rest read single-sampled levels.
+    bool multisampled = level == 0 && oc->hizMultisamplePipeline;
+    if (level == 0 || (level == 1 && oc->hizMultisamplePipeline)) {
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                        multisampled ? oc->hizMultisamplePipeline : oc->hizPipeline);
+    }
+
+    VkExtent2D dst = {oc->hizExtent.width >> level, oc->hizExtent.height >> level};
+    dst.width = dst.width ? dst.width : 1;
+    dst.height = dst.height ? dst.height : 1;
+    if (level > 0) {
+      covered.width = (covered.width * dst.width + src.width - 1) / src.width;
+      covered.height = (covered.height * dst.height + src.height - 1) / src.height;
+    }
+
+    HizPushConstants pushConstants = {{(int32_t)src.width, (int32_t)src.height},
+                                      {(int32_t)dst.width, (int32_t)dst.height},
+                                      (int32_t)oc->depthSamples};
+    vkCmdPushConstants(commandBuffer, oc->hizPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(pushConstants), &pushConstants);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, oc->hizPipelineLayout, 0, 1,
+                            &oc->hizSets[level], 0, NULL);
+    vkCmdDispatch(commandBuffer, (covered.width + 7) / 8, (covered.height + 7) / 8, 1);
+
+    // Makes the level readable by the next level and by the next frame's culling pass.
+    VkImageMemoryBarrier written = {.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                                    .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                                    .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+                                    .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+                                    .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+                                    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                    .image = oc->hizImage,
+                                    .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                    .subresourceRange.baseMipLevel = level,
+                                    .subresourceRange.levelCount = 1,
+                                    .subresourceRange.layerCount = 1};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &written);
+    src = dst;
+  }
+
+  oc->hizViewProj = *viewProj;
+  oc->hizRenderExtent = renderExtent;
+  oc->hizValid = true;
+}
+
+void occlusionInvalidate(Occlusion *oc) {
+  oc->hizValid = false;
+}
+
+void occlusionDestroy(Occlusion *oc) {
+  for (uint32_t i = 0; i < oc->frameCount; i++) {
+    OcclusionFrame *frame = &oc->frames[i];
+    vkDestroyBuffer(oc->device, frame->paramsBuffer, oc->pAllocator);
+    memoryBudgetFree(oc->budget, oc->device, frame->paramsMemory, oc->pAllocator);
+    vkDestroyBuffer(oc->device, frame->visibleBuffer, oc->pAllocator);
+    memoryBudgetFree(oc->budget, oc->device, frame->visibleMemory, oc->pAllocator);
+    vkDestroyBuffer(oc->device, frame->indirectBuffer, oc->pAllocator);
+    memoryBudgetFree(oc->budget, oc->device, frame->indirectMemory, oc->pAllocator);
+  }
+  vkDestroyBuffer(oc->device, oc->instanceBuffer, oc->pAllocator);
+  memoryBudgetFree(oc->budget, oc->device, oc->instanceMemory, oc->pAllocator);
+
+  destroyPyramid(oc);
+  vkDestroyDescriptorPool(oc->device, oc->descriptorPool, oc->pAllocator);
+  vkDestroyPipeline(oc->device, oc->cullPipeline, oc->pAllocator);
+  vkDestroyPipeline(oc->device, oc->hizPipeline, oc->pAllocator);
+  vkDestroyPipeline(oc->device, oc->hizMultisamplePipeline, oc->pAllocator);
+  vkDestroyPipelineLayout(oc->device, oc->cullPipelineLayout, oc->pAllocator);
+  vkDestroyPipelineLayout(oc->device, oc->hizPipelineLayout, oc->pAllocator);
+  vkDestroyDescriptorSetLayout(oc->device, oc->cullSetLayout, oc->pAllocator);
+  vkDestroyDescriptorSetLayout(oc->device, oc->hizSetLayout, oc->pAllocator);
+  vkDestroySampler(oc->device, oc->sampler, oc->pAllocator);
+  arenaDestroy(&oc->pyramidArena);
+  arenaDestroy(&oc->arena);
+}
@@ -0,0 +1,114 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "devicecaps.h"
+#include "hostalloc.h"
+#include "membudget.h"
+#include "scene.h"
+#include "vecmath.h"
+
+// GPU occlusion culling with a hierarchical-Z pyramid. After the scene is drawn, its depth
+// buffer is reduced into a max-depth mip chain; before the next frame is drawn, a compute pass
+// projects every instance's bounds with the camera that pyramid was rendered from and drops
+// instances that lie entirely behind it. Survivors are compacted into a per-frame buffer that
+// is drawn with one indexed indirect draw.
+//
+// Using last frame's depth means something that becomes visible this frame may appear one
+// frame late; with a slowly moving camera that is not noticeable.
+
+// Uniform block of shaders/cull.comp (std140).
+typedef struct OcclusionCullParams {
+  Mat4 viewProj;
+  Mat4 prevViewProj;
+  Frustum frustum;
+  float hizSize[2];
+  uint32_t instanceCount;
+  uint32_t flags;
+  float hizScale[2]; // part of level 0 the pyramid was built from
+} OcclusionCullParams;
+
+#define OCCLUSION_FLAG_HIZ 1u
+
+typedef struct OcclusionFrame {
+  VkBuffer paramsBuffer;
+  VkDeviceMemory paramsMemory;
+  OcclusionCullParams *params;
+  VkBuffer visibleBuffer; // compacted SceneInstances; vertex buffer binding 1
+  VkDeviceMemory visibleMemory;
+  VkBuffer indirectBuffer;
+  VkDeviceMemory indirectMemory;
+  VkDrawIndexedIndirectCommand *indirect; // host visible, so the visible count can be read back
+  VkDescriptorSet cullSet;
+} OcclusionFrame;
+
+typedef struct Occlusion {
+  const DeviceCaps *caps;
+  VkDevice device;
+  const VkAllocationCallbacks *pAllocator;
+  MemoryBudget *budget;
+  uint32_t instanceCount;
+  uint32_t indexCount;
+  VkBuffer instanceBuffer; // every instance of the scene
+  VkDeviceMemory instanceMemory;
+
+  uint32_t frameCount;
+  OcclusionFrame *frames;
+  Arena arena;        // frames
+  Arena pyramidArena; // per-level arrays, reset on resize
+
+  VkDescriptorSetLayout cullSetLayout;
+  VkPipelineLayout cullPipelineLayout;
+  VkPipeline cullPipeline;
+  VkDescriptorSetLayout hizSetLayout;
+  VkPipelineLayout hizPipelineLayout;
+  VkPipeline hizPipeline;
+  VkPipeline hizMultisamplePipeline; // level 0 from a multisampled depth buffer, if any
+  VkDescriptorPool descriptorPool;
+  VkSampler sampler;
+
+  VkImage hizImage; // R32_SFLOAT, full resolution at level 0, kept in GENERAL layout
+  VkDeviceMemory hizMemory;
+  VkImageView hizView; // every level; sampled by the culling pass
+  VkExtent2D hizExtent;
+  uint32_t hizLevels;
+  VkImageView *hizLevelViews;
+  VkDescriptorSet *hizSets; // one per level: source (depth or previous level) to destination
+  VkImageView depthView;
+  VkSampleCountFlagBits depthSamples;
+  bool hizInitialized; // layout has been transitioned from UNDEFINED
+  bool hizValid;       // holds the depth of the last frame drawn
+  Mat4 hizViewProj;
+  VkExtent2D hizRenderExtent; // render area of that frame; texels beyond it are stale
+} Occlusion;
+
+// `depthView` is the scene depth attachment; it must be in DEPTH_STENCIL_READ_ONLY_OPTIMAL
+// layout when occlusionRecordBuild() runs. A multisampled depth buffer needs
+// `hizMultisampleShader` (hiz.comp built with MULTISAMPLED); otherwise it may be VK_NULL_HANDLE.
+void occlusionCreate(Occlusion *oc, const DeviceCaps *caps, VkDevice device,
+                     const VkAllocationCallbacks *pAllocator, MemoryBudget *budget, VkShaderModule cullShader,
+                     VkShaderModule hizShader, VkShaderModule hizMultisampleShader, const Scene *scene,
+                     uint32_t frameCount, VkImageView depthView, VkSampleCountFlagBits depthSamples,
+                     VkExtent2D extent);
+// Swapchain recreation: the device must be idle. The pyramid is invalid until rebuilt.
+void occlusionResize(Occlusion *oc, VkImageView depthView, VkExtent2D extent);
+// Call after waiting for the frame's fence: instances drawn the last time it was submitted.
+uint32_t occlusionVisibleCount(const Occlusion *oc, uint32_t frameIndex);
+// Outside a render pass, before the frame's draws. Occlusion testing needs a valid pyramid;
+// otherwise only the frustum is tested.
+void occlusionRecordCull(Occlusion *oc, VkCommandBuffer commandBuffer, uint32_t frameIndex,
+                         const Mat4 *viewProj, bool useHiz);
+// After the render pass that wrote the depth buffer with `viewProj`. Only the top-left
+// `renderExtent` of the depth buffer is read (the render area, smaller than the attachment
+// with dynamic resolution).
+void occlusionRecordBuild(Occlusion *oc, VkCommandBuffer commandBuffer, const Mat4 *viewProj,
+                          VkExtent2D renderExtent);
+// Marks the pyramid stale, e.g. while occlusion culling is switched off.
+void occlusionInvalidate(Occlusion *oc);
+void occlusionDestroy(Occlusion *oc);
+
+#endif
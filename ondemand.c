@@ -0,0 +1,91 @@
+#include "ondemand.h"
+
+#include <math.h>
+#include <time.h>
+
+// Process CPU time across all threads, so job system workers are included.
+static double cpuMs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec * 1e-6;
+}
+
+void onDemandInit(RenderOnDemand *od, bool enabled, double animationFps, double nowMs) {
+  *od = (RenderOnDemand){.enabled = enabled,
+                         .animating = animationFps > 0.0,
+                         .tickIntervalMs = 1e3 / (animationFps > 0.0 ? animationFps : ON_DEMAND_DEFAULT_FPS),
+                         .nextTickMs = nowMs,
+                         .pendingFrames = ON_DEMAND_SETTLE_FRAMES,
+                         .animationStartMs = nowMs,
+                         .pausedAtMs = nowMs,
+                         .sessionStartMs = nowMs,
+                         .sessionStartCpuMs = cpuMs()};
+}
+
+void onDemandSetEnabled(RenderOnDemand *od, bool enabled, double nowMs) {
+  od->enabled = enabled;
+  od->nextTickMs = nowMs;
+  onDemandInvalidate(od);
+}
+
+void onDemandInvalidate(RenderOnDemand *od) { od->pendingFrames = ON_DEMAND_SETTLE_FRAMES; }
+
+void onDemandSetAnimating(RenderOnDemand *od, bool animating, double nowMs) {
+  if (animating == od->animating) {
+    return;
+  }
+  if (animating) {
+    // Resume where the animation stopped.
+    od->animationStartMs += nowMs - od->pausedAtMs;
+    od->nextTickMs = nowMs;
+  } else {
+    od->pausedAtMs = nowMs;
+  }
+  od->animating = animating;
+  onDemandInvalidate(od);
+}
+
+double onDemandAnimationSeconds(const RenderOnDemand *od, double nowMs) {
+  return ((od->animating ? nowMs : od->pausedAtMs) - od->animationStartMs) * 1e-3;
+}
+
+double onDemandTimeoutMs(const RenderOnDemand *od, double nowMs) {
+  if (!od->enabled || od->pendingFrames > 0) {
+    return 0.0;
+  }
+  if (!od->animating) {
+    return INFINITY;
+  }
+  return fmax(od->nextTickMs - nowMs, 0.0);
+}
+
+void onDemandFrameRendered(RenderOnDemand *od, double nowMs) {
+  od->frames++;
+  if (od->pendingFrames > 0) {
+    od->pendingFrames--;
+  }
+  if (nowMs >= od->nextTickMs) {
+    // A late tick is not made up for: the next one is a full interval away.
+    od->nextTickMs += od->tickIntervalMs;
+    if (od->nextTickMs <= nowMs) {
+      od->nextTickMs = nowMs + od->tickIntervalMs;
+    }
+  }
+}
+
+void onDemandWaited(RenderOnDemand *od, double waitMs, bool hidden) {
+  od->waitMs += waitMs;
+  if (hidden) {
+    od->hiddenMs += waitMs;
+  }
+}
+
+void onDemandReport(const RenderOnDemand *od, FILE *out, double nowMs) {
+  double wallMs = nowMs - od->sessionStartMs;
+  double usedMs = cpuMs() - od->sessionStartCpuMs;
+  fprintf(out,
+          "Session (render on demand %s): %.1f s, %u frames (%.1f fps), CPU %.1f%% of one core, "
+          "%.1f s waiting for events (%.1f s hidden)\n",
+          od->enabled ? "on" : "off", wallMs * 1e-3, od->frames, od->frames / (wallMs * 1e-3),
+          100.0 * usedMs / wallMs, od->waitMs * 1e-3, od->hiddenMs * 1e-3);
+}
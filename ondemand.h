@@ -0,0 +1,56 @@
+#ifndef ONDEMAND_H
+#define ONDEMAND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Render on demand: instead of rendering continuously, a frame is rendered only when
+// something changed — input, a resize, the window being exposed, or a tick of the scene
+// animation. In between, the main loop blocks in glfwWaitEventsTimeout() for
+// onDemandTimeoutMs().
+//
+// Also owns the scene animation clock, which can be paused, and accounts for the whole
+// session (frames, time blocked, process CPU time) so idle cost can be compared with the
+// mode on and off.
+
+// Frames rendered after each change. Occlusion culling tests against the previous frame's
+// depth, so the first frame after a change can still cull with stale depth.
+#define ON_DEMAND_SETTLE_FRAMES 2
+#define ON_DEMAND_DEFAULT_FPS 60.0
+
+typedef struct RenderOnDemand {
+  bool enabled;
+  bool animating;
+  double tickIntervalMs; // animation frame period while enabled
+  double nextTickMs;
+  uint32_t pendingFrames; // still owed to earlier changes
+  double animationStartMs;
+  double pausedAtMs;
+
+  double sessionStartMs;
+  double sessionStartCpuMs;
+  double waitMs;   // blocked waiting for events
+  double hiddenMs; // of which the window was iconified or occluded
+  uint32_t frames;
+} RenderOnDemand;
+
+// `animationFps` is the tick rate of a running animation while enabled; <= 0 starts with the
+// animation paused, to run at ON_DEMAND_DEFAULT_FPS once resumed.
+void onDemandInit(RenderOnDemand *od, bool enabled, double animationFps, double nowMs);
+void onDemandSetEnabled(RenderOnDemand *od, bool enabled, double nowMs);
+// Something visible changed: the next ON_DEMAND_SETTLE_FRAMES frames are needed.
+void onDemandInvalidate(RenderOnDemand *od);
+void onDemandSetAnimating(RenderOnDemand *od, bool animating, double nowMs);
+// Scene time: stands still while the animation is paused.
+double onDemandAnimationSeconds(const RenderOnDemand *od, double nowMs);
+
+// Milliseconds until the next frame is due: 0 renders now, INFINITY waits for an event.
+// Always 0 when disabled.
+double onDemandTimeoutMs(const RenderOnDemand *od, double nowMs);
+void onDemandFrameRendered(RenderOnDemand *od, double nowMs);
+void onDemandWaited(RenderOnDemand *od, double waitMs, bool hidden);
+// Frames rendered, wall and CPU time since onDemandInit().
+void onDemandReport(const RenderOnDemand *od, FILE *out, double nowMs);
+
+#endif
@@ -0,0 +1,90 @@
+#include "pacing.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PACING_SPIN_MS 1.0 // sleep until this long before the deadline, then spin
+
+static double nowMs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec * 1e-6;
+}
+
+static void sleepUntil(double deadlineMs) {
+  time_t seconds = (time_t)(deadlineMs / 1e3);
+  struct timespec ts = {.tv_sec = seconds, .tv_nsec = (long)((deadlineMs - (double)seconds * 1e3) * 1e6)};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+  }
+}
+
+static int compareFloat(const void *a, const void *b) {
+  float x = *(const float *)a, y = *(const float *)b;
+  return (x > y) - (x < y);
+}
+
+// Sorts `values` in place, so the maximum is last afterwards.
+static float percentile(float *values, uint32_t count, double fraction) {
+  qsort(values, count, sizeof(float), compareFloat);
+  uint32_t index = (uint32_t)(fraction * (double)(count - 1) + 0.5);
+  return values[index];
+}
+
+void framePacerInit(FramePacer *pacer, double fpsLimit) {
+  *pacer = (FramePacer){.intervalMs = fpsLimit > 0.0 ? 1e3 / fpsLimit : 0.0, .nextFrameMs = nowMs()};
+}
+
+void framePacerWait(FramePacer *pacer) {
+  if (pacer->intervalMs == 0.0) {
+    return;
+  }
+
+  double start = nowMs();
+  if (pacer->nextFrameMs - start > PACING_SPIN_MS) {
+    sleepUntil(pacer->nextFrameMs - PACING_SPIN_MS);
+  }
+  double now = nowMs();
+  while (now < pacer->nextFrameMs) {
+    now = nowMs();
+  }
+  pacer->sleptMs += now - start;
+
+  pacer->nextFrameMs += pacer->intervalMs;
+  if (pacer->nextFrameMs < now) {
+    pacer->nextFrameMs = now + pacer->intervalMs;
+  }
+}
+
+void framePacerRecord(FramePacer *pacer, double acquireStartMs, double acquiredMs, double presentedMs) {
+  pacer->frames++;
+  if (pacer->sampleCount == PACING_MAX_SAMPLES) {
+    return;
+  }
+  pacer->acquireMs[pacer->sampleCount] = (float)(acquiredMs - acquireStartMs);
+  pacer->latencyMs[pacer->sampleCount] = (float)(presentedMs - acquireStartMs);
+  pacer->sampleCount++;
+}
+
+void framePacerReport(FramePacer *pacer, FILE *out, const char *presentMode) {
+  uint32_t count = pacer->sampleCount;
+  if (count > 0) {
+    fprintf(out, "Present mode %s", presentMode);
+    if (pacer->intervalMs > 0.0) {
+      fprintf(out, ", limit %.1f fps (%.2f ms slept per frame)", 1e3 / pacer->intervalMs,
+              pacer->sleptMs / (double)pacer->frames);
+    }
+    float acquireMedian = percentile(pacer->acquireMs, count, 0.5);
+    float acquireP99 = percentile(pacer->acquireMs, count, 0.99);
+    float latencyMedian = percentile(pacer->latencyMs, count, 0.5);
+    float latencyP99 = percentile(pacer->latencyMs, count, 0.99);
+    fprintf(out,
+            ": acquire wait %.2f/%.2f/%.2f ms, acquire to present %.2f/%.2f/%.2f ms (median/p99/max)\n",
+            acquireMedian, acquireP99, pacer->acquireMs[count - 1], latencyMedian, latencyP99,
+            pacer->latencyMs[count - 1]);
+  }
+
+  pacer->frames = 0;
+  pacer->sampleCount = 0;
+  pacer->sleptMs = 0.0;
+}
@@ -0,0 +1,34 @@
+#ifndef PACING_H
+#define PACING_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Frame pacing: an optional CPU frame limiter and acquire-to-present latency statistics.
+//
+// The limiter sleeps until each frame's start time and spins for the last stretch, since a
+// plain sleep routinely oversleeps by a scheduler tick. Frames that start late do not build
+// up debt: after a stall the schedule restarts from the current time.
+
+#define PACING_MAX_SAMPLES 256 // per report; later frames are counted but not sampled
+
+typedef struct FramePacer {
+  double intervalMs; // 0: no limit
+  double nextFrameMs;
+  double sleptMs; // since the last report
+  uint32_t frames;
+  uint32_t sampleCount;
+  float acquireMs[PACING_MAX_SAMPLES]; // blocked in vkAcquireNextImageKHR
+  float latencyMs[PACING_MAX_SAMPLES]; // acquire call to vkQueuePresentKHR return
+} FramePacer;
+
+// `fpsLimit` <= 0 disables the limiter.
+void framePacerInit(FramePacer *pacer, double fpsLimit);
+// Blocks until the next frame may start. Call before sampling input for the frame.
+void framePacerWait(FramePacer *pacer);
+// Timestamps on the nowMs() clock (CLOCK_MONOTONIC, milliseconds).
+void framePacerRecord(FramePacer *pacer, double acquireStartMs, double acquiredMs, double presentedMs);
+// Prints median, 99th percentile and maximum of both timings, then starts a new report.
+void framePacerReport(FramePacer *pacer, FILE *out, const char *presentMode);
+
+#endif
@@ -0,0 +1,114 @@
+#include "pipelinelib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+bool pipelineLibrarySupported(const DeviceCaps *caps) {
+  if (!deviceCapsHasExtension(caps, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) ||
+      !deviceCapsHasExtension(caps, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) ||
+      caps->properties.apiVersion < VK_API_VERSION_1_1) {
+    return false;
+  }
+  VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT library = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT};
+  VkPhysicalDeviceFeatures2 features = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+                                        .pNext = &library};
+  vkGetPhysicalDeviceFeatures2(caps->physicalDevice, &features);
+  return library.graphicsPipelineLibrary;
+}
+
+VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipelineLibraryFeatures(void *pNext) {
+  return (VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT){
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT,
+      .pNext = pNext,
+      .graphicsPipelineLibrary = VK_TRUE};
+}
+
+VkPipeline pipelineLibraryCreatePart(VkDevice device, const VkGraphicsPipelineCreateInfo *info,
+                                     VkGraphicsPipelineLibraryFlagBitsEXT part, VkPipelineCache cache,
+                                     const VkAllocationCallbacks *pAllocator) {
+  VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo = {
+      .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT,
+      .pNext = info->pNext,
+      .flags = part};
+
+  // Shader stages must belong to the part being built, so they are filtered; other state is
+  // ignored by the driver but cleared anyway to make the split explicit.
+  VkShaderStageFlags partStages = part == VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT
+                                      ? VK_SHADER_STAGE_VERTEX_BIT
+                                  : part == VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT
+                                      ? VK_SHADER_STAGE_FRAGMENT_BIT
+                                      : 0;
+  VkPipelineShaderStageCreateInfo stages[2];
+  uint32_t stageCount = 0;
+  for (uint32_t i = 0; i < info->stageCount && stageCount < 2; i++) {
+    if (info->pStages[i].stage & partStages) {
+      stages[stageCount++] = info->pStages[i];
+    }
+  }
+
+  VkGraphicsPipelineCreateInfo partInfo = {
+      .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+      .pNext = &libraryInfo,
+      .flags = info->flags | VK_PIPELINE_CREATE_LIBRARY_BIT_KHR |
+               VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT,
+      .stageCount = stageCount,
+      .pStages = stages,
+      .pDynamicState = info->pDynamicState,
+      .basePipelineIndex = -1};
+  switch (part) {
+  case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+    partInfo.pVertexInputState = info->pVertexInputState;
+    partInfo.pInputAssemblyState = info->pInputAssemblyState;
+    break;
+  case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+    partInfo.pViewportState = info->pViewportState;
+    partInfo.pRasterizationState = info->pRasterizationState;
+    partInfo.pTessellationState = info->pTessellationState;
+    partInfo.layout = info->layout;
+    partInfo.renderPass = info->renderPass;
+    partInfo.subpass = info->subpass;
+    break;
+  case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+    partInfo.pDepthStencilState = info->pDepthStencilState;
+    partInfo.pMultisampleState = info->pMultisampleState;
+    partInfo.layout = info->layout;
+    partInfo.renderPass = info->renderPass;
+    partInfo.subpass = info->subpass;
+    break;
+  case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT:
+  default:
+    partInfo.pColorBlendState = info->pColorBlendState;
+    partInfo.pMultisampleState = info->pMultisampleState;
+    partInfo.renderPass = info->renderPass;
+    partInfo.subpass = info->subpass;
+    break;
+  }
+
+  VkPipeline library;
+  if (vkCreateGraphicsPipelines(device, cache, 1, &partInfo, pAllocator, &library) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create pipeline library!\n");
+    exit(EXIT_FAILURE);
+  }
+  return library;
+}
+
+VkPipeline pipelineLibraryLink(VkDevice device, VkPipelineLayout layout, const VkPipeline *parts,
+                               bool optimize, VkPipelineCache cache, const VkAllocationCallbacks *pAllocator) {
+  VkPipelineLibraryCreateInfoKHR libraries = {.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR,
+                                              .libraryCount = PIPELINE_LIBRARY_PART_COUNT,
+                                              .pLibraries = parts};
+  VkGraphicsPipelineCreateInfo linkInfo = {
+      .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+      .pNext = &libraries,
+      .flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0,
+      .layout = layout,
+      .basePipelineIndex = -1};
+
+  VkPipeline pipeline;
+  if (vkCreateGraphicsPipelines(device, cache, 1, &linkInfo, pAllocator, &pipeline) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to link graphics pipeline!\n");
+    exit(EXIT_FAILURE);
+  }
+  return pipeline;
+}
@@ -0,0 +1,43 @@
+#ifndef PIPELINELIB_H
+#define PIPELINELIB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "devicecaps.h"
+
+// Graphics pipeline libraries (VK_EXT_graphics_pipeline_library). A graphics pipeline is
+// compiled as four separate parts; linking parts into a pipeline is cheap enough to do on
+// first use, and a second link with link-time optimization gives code as good as a
+// monolithic compile. Parts shared by many pipelines are compiled once.
+//
+// Needs VK_KHR_pipeline_library and VK_EXT_graphics_pipeline_library enabled, with the
+// graphicsPipelineLibrary feature (see pipelineLibraryFeatures()).
+
+#define PIPELINE_LIBRARY_PART_COUNT 4
+
+// In link order.
+static const VkGraphicsPipelineLibraryFlagBitsEXT PIPELINE_LIBRARY_PARTS[PIPELINE_LIBRARY_PART_COUNT] = {
+    VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT};
+
+// Whether the device has the extensions and the feature. The instance must target Vulkan 1.1.
+bool pipelineLibrarySupported(const DeviceCaps *caps);
+// Enabled-feature struct to chain into VkDeviceCreateInfo.
+VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipelineLibraryFeatures(void *pNext);
+
+// Compiles the state of `info` that belongs to `part` as a library; everything else in `info`
+// is ignored. Link-time optimization information is retained for pipelineLibraryLink().
+VkPipeline pipelineLibraryCreatePart(VkDevice device, const VkGraphicsPipelineCreateInfo *info,
+                                     VkGraphicsPipelineLibraryFlagBitsEXT part, VkPipelineCache cache,
+                                     const VkAllocationCallbacks *pAllocator);
+// Links one library of each part into a complete pipeline. `optimize` runs link-time
+// optimization: slower, but the result performs like a monolithic pipeline.
+VkPipeline pipelineLibraryLink(VkDevice device, VkPipelineLayout layout, const VkPipeline *parts,
+                               bool optimize, VkPipelineCache cache, const VkAllocationCallbacks *pAllocator);
+
+#endif
@@ -0,0 +1,449 @@
+#include "post.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define POST_BLOOM_THRESHOLD 0.7f
+#define POST_BLOOM_STRENGTH 0.6f
+#define POST_EXPOSURE 1.4f
+#define POST_SHARPEN_STRENGTH 0.5f
+#define POST_BLUR_TILE 256 // local_size_x of shaders/blur.comp
+
+// Push constants shared by every post shader.
+typedef struct PostPushConstants {
+  int32_t size[2];
+  int32_t direction;
+  float threshold;
+  float strength;
+} PostPushConstants;
+
+static const char *const effectNames[POST_EFFECT_COUNT] = {"bloom", "tonemap", "sharpen"};
+
+bool postParseEffects(const char *list, PostEffect *effects, uint32_t *effectCount) {
+  *effectCount = 0;
+  bool used[POST_EFFECT_COUNT] = {};
+  const char *name = list;
+  while (*name) {
+    size_t length = strcspn(name, ",");
+    bool found = false;
+    for (uint32_t i = 0; i < POST_EFFECT_COUNT && !found; i++) {
+      if (strlen(effectNames[i]) == length && strncmp(name, effectNames[i], length) == 0 && !used[i]) {
+        used[i] = true;
+        effects[(*effectCount)++] = (PostEffect)i;
+        found = true;
+      }
+    }
+    if (!found) {
+      return false;
+    }
+    name += length;
+    name += *name == ',';
+  }
+  return true;
+}
+
+const char *postEffectName(PostEffect effect) {
+  return effectNames[effect];
+}
+
+static VkPipeline createComputePipeline(PostChain *post, VkShaderModule shader) {
+  VkComputePipelineCreateInfo pipelineInfo = {
+      .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+      .stage = {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = shader,
+                .pName = "main"},
+      .layout = post->pipelineLayout,
+      .basePipelineIndex = -1};
+  VkPipeline pipeline;
+  if (vkCreateComputePipelines(post->device, VK_NULL_HANDLE, 1, &pipelineInfo, post->pAllocator, &pipeline) !=
+      VK_SUCCESS) {
+    fprintf(stderr, "Failed to create post-processing pipeline!\n");
+    exit(EXIT_FAILURE);
+  }
+  return pipeline;
+}
+
+static bool hasEffect(const PostChain *post, PostEffect effect) {
+  for (uint32_t i = 0; i < post->effectCount; i++) {
+    if (post->effects[i] == effect) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void createImages(PostChain *post, VkExtent2D extent) {
+  post->extent = extent;
+  // Image 1 is only needed once two effects run; image 2 only for bloom.
+  bool needed[3] = {true, post->effectCount > 1, hasEffect(post, POST_BLOOM)};
+
+  for (uint32_t i = 0; i < 3; i++) {
+    if (!needed[i]) {
+      continue;
+    }
+
+    VkImageCreateInfo imageInfo = {.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                                   .imageType = VK_IMAGE_TYPE_2D,
+                                   .format = POST_FORMAT,
+                                   .extent = {extent.width, extent.height, 1},
+                                   .mipLevels = 1,
+                                   .arrayLayers = 1,
+                                   .samples = VK_SAMPLE_COUNT_1_BIT,
+                                   .tiling = VK_IMAGE_TILING_OPTIMAL,
+                                   .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                   .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                                   .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+    if (vkCreateImage(post->device, &imageInfo, post->pAllocator, &post->images[i]) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to create post-processing image!\n");
+      exit(EXIT_FAILURE);
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(post->device, post->images[i], &memRequirements);
+    uint32_t memoryType = deviceCapsFindMemoryType(post->caps, memRequirements.memoryTypeBits,
+                                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VkMemoryAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                                      .allocationSize = memRequirements.size,
+                                      .memoryTypeIndex = memoryType};
+    if (memoryType == UINT32_MAX ||
+        memoryBudgetAllocate(post->budget, post->device, &allocInfo, post->pAllocator,
+                             &post->imageMemory[i]) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to allocate post-processing image memory!\n");
+      exit(EXIT_FAILURE);
+    }
+    vkBindImageMemory(post->device, post->images[i], post->imageMemory[i], 0);
+
+    VkImageViewCreateInfo viewInfo = {.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                                      .image = post->images[i],
+                                      .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                                      .format = POST_FORMAT,
+                                      .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                      .subresourceRange.levelCount = 1,
+                                      .subresourceRange.layerCount = 1};
+    if (vkCreateImageView(post->device, &viewInfo, post->pAllocator, &post->imageViews[i]) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to create post-processing image view!\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // Each effect reads what the previous one wrote; outputs alternate between images 0 and 1.
+  post->dispatchCount = 0;
+  VkImageView input = post->sceneView;
+  for (uint32_t i = 0; i < post->effectCount; i++) {
+    uint32_t output = i % 2;
+    PostDispatch *dispatch = &post->dispatches[post->dispatchCount];
+    switch (post->effects[i]) {
+    case POST_BLOOM:
+      post->dispatches[post->dispatchCount++] = (PostDispatch){.effect = POST_BLOOM,
+                                                               .pipeline = post->blurPipeline,
+                                                               .src = input,
+                                                               .dst = post->imageViews[2],
+                                                               .base = input,
+                                                               .direction = 0,
+                                                               .threshold = POST_BLOOM_THRESHOLD};
+      post->dispatches[post->dispatchCount++] = (PostDispatch){.effect = POST_BLOOM,
+                                                               .pipeline = post->blurPipeline,
+                                                               .src = post->imageViews[2],
+                                                               .dst = post->imageViews[output],
+                                                               .base = input,
+                                                               .direction = 1,
+                                                               .strength = POST_BLOOM_STRENGTH};
+      break;
+    case POST_TONEMAP:
+      *dispatch = (PostDispatch){.effect = POST_TONEMAP,
+                                 .pipeline = post->tonemapPipeline,
+                                 .src = input,
+                                 .dst = post->imageViews[output],
+                                 .base = input,
+                                 .strength = POST_EXPOSURE};
+      post->dispatchCount++;
+      break;
+    case POST_SHARPEN:
+    default:
+      *dispatch = (PostDispatch){.effect = POST_SHARPEN,
+                                 .pipeline = post->sharpenPipeline,
+                                 .src = input,
+                                 .dst = post->imageViews[output],
+                                 .base = input,
+                                 .strength = POST_SHARPEN_STRENGTH};
+      post->dispatchCount++;
+      break;
+    }
+    input = post->imageViews[output];
+    post->output = post->images[output];
+  }
+
+  // Descriptor sets reference the views, so the whole pool is rebuilt with them.
+  vkResetDescriptorPool(post->device, post->descriptorPool, 0);
+  VkDescriptorSetLayout layouts[POST_MAX_DISPATCHES];
+  for (uint32_t i = 0; i < post->dispatchCount; i++) {
+    layouts[i] = post->setLayout;
+  }
+  VkDescriptorSetAllocateInfo allocSetInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                                              .descriptorPool = post->descriptorPool,
+                                              .descriptorSetCount = post->dispatchCount,
+                                              .pSetLayouts = layouts};
+  if (vkAllocateDescriptorSets(post->device, &allocSetInfo, post->sets) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to allocate post-processing descriptor sets!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (uint32_t i = 0; i < post->dispatchCount; i++) {
+    const PostDispatch *dispatch = &post->dispatches[i];
+    VkDescriptorImageInfo images[] = {{.imageView = dispatch->src, .imageLayout = VK_IMAGE_LAYOUT_GENERAL},
+                                      {.imageView = dispatch->dst, .imageLayout = VK_IMAGE_LAYOUT_GENERAL},
+                                      {.imageView = dispatch->base, .imageLayout = VK_IMAGE_LAYOUT_GENERAL}};
+    VkWriteDescriptorSet writes[3];
+    for (uint32_t binding = 0; binding < 3; binding++) {
+      writes[binding] = (VkWriteDescriptorSet){.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                               .dstSet = post->sets[i],
+                                               .dstBinding = binding,
+                                               .descriptorCount = 1,
+                                               .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                               .pImageInfo = &images[binding]};
+    }
+    vkUpdateDescriptorSets(post->device, 3, writes, 0, NULL);
+  }
+
+  post->imagesInitialized = false;
+}
+
+static void destroyImages(PostChain *post) {
+  for (uint32_t i = 0; i < 3; i++) {
+    if (post->images[i]) {
+      vkDestroyImageView(post->device, post->imageViews[i], post->pAllocator);
+      vkDestroyImage(post->device, post->images[i], post->pAllocator);
+      memoryBudgetFree(post->budget, post->device, post->imageMemory[i], post->pAllocator);
+    }
+    post->images[i] = VK_NULL_HANDLE;
+    post->imageViews[i] = VK_NULL_HANDLE;
+    post->imageMemory[i] = VK_NULL_HANDLE;
+  }
+}
+
+void postCreate(PostChain *post, const DeviceCaps *caps, VkDevice device,
+                const VkAllocationCallbacks *pAllocator, MemoryBudget *budget, const PostEffect *effects,
+                uint32_t effectCount,
+                VkShaderModule blurShader, VkShaderModule tonemapShader, VkShaderModule sharpenShader,
+                uint32_t queueFamilyIndex, uint32_t frameCount, VkImageView sceneView, VkExtent2D extent) {
+  *post = (PostChain){.caps = caps,
+                      .device = device,
+                      .pAllocator = pAllocator,
+                      .budget = budget,
+                      .effectCount = effectCount,
+                      .frameCount = frameCount,
+                      .sceneView = sceneView};
+  memcpy(post->effects, effects, sizeof(PostEffect) * effectCount);
+  arenaInit(&post->arena, 256);
+
+  // binding 2 is only read by the second bloom pass; the other passes bind their input there.
+  VkDescriptorSetLayoutBinding bindings[] = {
+      {0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL},
+      {1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL},
+      {2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL}};
+  VkDescriptorSetLayoutCreateInfo setInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+                                             .bindingCount = 3,
+                                             .pBindings = bindings};
+  if (vkCreateDescriptorSetLayout(device, &setInfo, pAllocator, &post->setLayout) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create post-processing descriptor set layout!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  VkPushConstantRange pushConstants = {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PostPushConstants)};
+  VkPipelineLayoutCreateInfo layoutInfo = {.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                                           .setLayoutCount = 1,
+                                           .pSetLayouts = &post->setLayout,
+                                           .pushConstantRangeCount = 1,
+                                           .pPushConstantRanges = &pushConstants};
+  if (vkCreatePipelineLayout(device, &layoutInfo, pAllocator, &post->pipelineLayout) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create post-processing pipeline layout!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (hasEffect(post, POST_BLOOM)) {
+    post->blurPipeline = createComputePipeline(post, blurShader);
+  }
+  if (hasEffect(post, POST_TONEMAP)) {
+    post->tonemapPipeline = createComputePipeline(post, tonemapShader);
+  }
+  if (hasEffect(post, POST_SHARPEN)) {
+    post->sharpenPipeline = createComputePipeline(post, sharpenShader);
+  }
+
+  VkDescriptorPoolSize poolSize = {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3 * POST_MAX_DISPATCHES};
+  VkDescriptorPoolCreateInfo poolInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                                         .maxSets = POST_MAX_DISPATCHES,
+                                         .poolSizeCount = 1,
+                                         .pPoolSizes = &poolSize};
+  if (vkCreateDescriptorPool(device, &poolInfo, pAllocator, &post->descriptorPool) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create post-processing descriptor pool!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  uint32_t validBits = caps->queueFamilies[queueFamilyIndex].timestampValidBits;
+  if (validBits > 0 && caps->properties.limits.timestampPeriod > 0.0f) {
+    post->timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+    VkQueryPoolCreateInfo queryInfo = {.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                                       .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                                       .queryCount = (effectCount + 1) * frameCount};
+    if (vkCreateQueryPool(device, &queryInfo, pAllocator, &post->queryPool) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to create post-processing query pool!\n");
+      exit(EXIT_FAILURE);
+    }
+    post->timingPending = arenaPushArray(&post->arena, bool, frameCount);
+    memset(post->timingPending, 0, sizeof(bool) * frameCount);
+  }
+
+  createImages(post, extent);
+}
+
+void postResize(PostChain *post, VkImageView sceneView, VkExtent2D extent) {
+  destroyImages(post);
+  post->sceneView = sceneView;
+  createImages(post, extent);
+}
+
+VkImage postRecord(PostChain *post, VkCommandBuffer commandBuffer, uint32_t frameIndex,
+                   VkExtent2D renderExtent) {
+  uint32_t firstQuery = frameIndex * (post->effectCount + 1);
+  if (post->queryPool) {
+    vkCmdResetQueryPool(commandBuffer, post->queryPool, firstQuery, post->effectCount + 1);
+  }
+
+  // The images are shared by all frames in flight: the previous frame's blit out of the
+  // output has to finish before it is written again. The scene pass writes the input.
+  VkImageMemoryBarrier initialize[3];
+  uint32_t initializeCount = 0;
+  if (!post->imagesInitialized) {
+    for (uint32_t i = 0; i < 3; i++) {
+      if (post->images[i]) {
+        initialize[initializeCount++] =
+            (VkImageMemoryBarrier){.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                                   .srcAccessMask = 0,
+                                   .dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                                   .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                                   .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+                                   .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                   .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                   .image = post->images[i],
+                                   .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                   .subresourceRange.levelCount = 1,
+                                   .subresourceRange.layerCount = 1};
+      }
+    }
+    post->imagesInitialized = true;
+  }
+  VkMemoryBarrier rendered = {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                              .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                              .dstAccessMask = VK_ACCESS_SHADER_READ_BIT};
+  vkCmdPipelineBarrier(commandBuffer,
+                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &rendered, 0, NULL, initializeCount,
+                       initialize);
+
+  if (post->queryPool) {
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, post->queryPool, firstQuery);
+  }
+
+  VkMemoryBarrier written = {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                             .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                             .dstAccessMask = VK_ACCESS_SHADER_READ_BIT};
+  uint32_t effect = 0;
+  for (uint32_t i = 0; i < post->dispatchCount; i++) {
+    const PostDispatch *dispatch = &post->dispatches[i];
+    if (i > 0) {
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &written, 0, NULL, 0, NULL);
+    }
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, dispatch->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, post->pipelineLayout, 0, 1,
+                            &post->sets[i], 0, NULL);
+    PostPushConstants pushConstants = {{(int32_t)renderExtent.width, (int32_t)renderExtent.height},
+                                       dispatch->direction,
+                                       dispatch->threshold,
+                                       dispatch->strength};
+    vkCmdPushConstants(commandBuffer, post->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(pushConstants), &pushConstants);
+
+    // The blur runs one workgroup per 256 texels of a row, or of a column.
+    if (dispatch->effect == POST_BLOOM) {
+      uint32_t along = dispatch->direction ? renderExtent.height : renderExtent.width;
+      uint32_t across = dispatch->direction ? renderExtent.width : renderExtent.height;
+      vkCmdDispatch(commandBuffer, (along + POST_BLUR_TILE - 1) / POST_BLUR_TILE, across, 1);
+    } else if (dispatch->effect == POST_TONEMAP) {
+      vkCmdDispatch(commandBuffer, (renderExtent.width + 7) / 8, (renderExtent.height + 7) / 8, 1);
+    } else {
+      vkCmdDispatch(commandBuffer, (renderExtent.width + 15) / 16, (renderExtent.height + 15) / 16, 1);
+    }
+
+    // Only the horizontal bloom pass is followed by another dispatch of the same effect.
+    if (dispatch->effect != POST_BLOOM || dispatch->direction == 1) {
+      effect++;
+      if (post->queryPool) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, post->queryPool,
+                            firstQuery + effect);
+      }
+    }
+  }
+  if (post->queryPool) {
+    post->timingPending[frameIndex] = true;
+  }
+
+  VkMemoryBarrier toTransfer = {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                                .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT};
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                       1, &toTransfer, 0, NULL, 0, NULL);
+  return post->output;
+}
+
+void postCollectTimings(PostChain *post, uint32_t frameIndex) {
+  if (!post->queryPool || !post->timingPending[frameIndex]) {
+    return;
+  }
+  post->timingPending[frameIndex] = false;
+
+  uint64_t timestamps[POST_EFFECT_COUNT + 1];
+  if (vkGetQueryPoolResults(post->device, post->queryPool, frameIndex * (post->effectCount + 1),
+                            post->effectCount + 1, sizeof(timestamps), timestamps, sizeof(timestamps[0]),
+                            VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+    return;
+  }
+  double period = post->caps->properties.limits.timestampPeriod;
+  for (uint32_t i = 0; i < post->effectCount; i++) {
+    uint64_t ticks = (timestamps[i + 1] - timestamps[i]) & post->timestampMask;
+    post->gpuMs[post->effects[i]] += (double)ticks * period * 1e-6;
+  }
+  post->timedFrames++;
+}
+
+void postReport(PostChain *post, FILE *out) {
+  if (post->timedFrames == 0) {
+    return;
+  }
+  fprintf(out, "Post-processing GPU time:");
+  for (uint32_t i = 0; i < post->effectCount; i++) {
+    PostEffect effect = post->effects[i];
+    fprintf(out, " %s %.3f ms", effectNames[effect], post->gpuMs[effect] / (double)post->timedFrames);
+    post->gpuMs[effect] = 0.0;
+  }
+  fprintf(out, "\n");
+  post->timedFrames = 0;
+}
+
+void postDestroy(PostChain *post) {
+  destroyImages(post);
+  if (post->queryPool) {
+    vkDestroyQueryPool(post->device, post->queryPool, post->pAllocator);
+  }
+  vkDestroyDescriptorPool(post->device, post->descriptorPool, post->pAllocator);
+  vkDestroyPipeline(post->device, post->blurPipeline, post->pAllocator);
+  vkDestroyPipeline(post->device, post->tonemapPipeline, post->pAllocator);
+  vkDestroyPipeline(post->device, post->sharpenPipeline, post->pAllocator);
+  vkDestroyPipelineLayout(post->device, post->pipelineLayout, post->pAllocator);
+  vkDestroyDescriptorSetLayout(post->device, post->setLayout, post->pAllocator);
+  arenaDestroy(&post->arena);
+  *post = (PostChain){};
+}
@@ -0,0 +1,103 @@
+#ifndef POST_H
+#define POST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vulkan/vulkan.h>
+
+#include "devicecaps.h"
+#include "hostalloc.h"
+#include "membudget.h"
+
+// Post-processing: a chain of compute passes over the rendered scene, each reading the
+// previous pass's output and writing an RGBA16F storage image. The renderer then blits the
+// last output into the swapchain image. Every effect is timed on the GPU.
+//
+// bloom:   bright pass and horizontal blur, then vertical blur added onto the image
+// tonemap: exposure and ACES curve
+// sharpen: neighbourhood-clamped unsharp mask
+
+typedef enum PostEffect {
+  POST_BLOOM,
+  POST_TONEMAP,
+  POST_SHARPEN,
+  POST_EFFECT_COUNT,
+} PostEffect;
+
+#define POST_FORMAT VK_FORMAT_R16G16B16A16_SFLOAT // scene color and every intermediate image
+#define POST_MAX_DISPATCHES (POST_EFFECT_COUNT + 1) // bloom takes two
+
+typedef struct PostDispatch {
+  PostEffect effect;
+  VkPipeline pipeline;
+  VkImageView src;
+  VkImageView dst;
+  VkImageView base; // added onto by the second bloom pass; otherwise `src`
+  int32_t direction;
+  float threshold;
+  float strength;
+} PostDispatch;
+
+typedef struct PostChain {
+  const DeviceCaps *caps;
+  VkDevice device;
+  const VkAllocationCallbacks *pAllocator;
+  MemoryBudget *budget;
+  uint32_t effectCount;
+  PostEffect effects[POST_EFFECT_COUNT]; // in the order they run
+
+  VkDescriptorSetLayout setLayout;
+  VkPipelineLayout pipelineLayout;
+  VkPipeline blurPipeline;
+  VkPipeline tonemapPipeline;
+  VkPipeline sharpenPipeline;
+  VkDescriptorPool descriptorPool;
+
+  // 0 and 1 alternate as pass outputs; 2 holds the horizontally blurred bright pass.
+  VkImage images[3];
+  VkDeviceMemory imageMemory[3];
+  VkImageView imageViews[3];
+  bool imagesInitialized; // transitioned to GENERAL
+  VkExtent2D extent;
+  VkImageView sceneView; // input of the first pass, in GENERAL layout
+  uint32_t dispatchCount;
+  PostDispatch dispatches[POST_MAX_DISPATCHES];
+  VkDescriptorSet sets[POST_MAX_DISPATCHES];
+  VkImage output; // written by the last pass
+
+  // A timestamp before the chain and after each effect, per frame in flight.
+  VkQueryPool queryPool; // VK_NULL_HANDLE without timestamp support
+  uint32_t frameCount;
+  uint64_t timestampMask;
+  bool *timingPending;
+  double gpuMs[POST_EFFECT_COUNT]; // summed since the last report
+  uint32_t timedFrames;
+  Arena arena;
+} PostChain;
+
+// Parses a comma-separated list such as "bloom,tonemap,sharpen". False on an unknown or
+// repeated name.
+bool postParseEffects(const char *list, PostEffect *effects, uint32_t *effectCount);
+const char *postEffectName(PostEffect effect);
+// Shader modules of effects not in the chain may be VK_NULL_HANDLE. `sceneView` is a
+// POST_FORMAT storage image in GENERAL layout whenever the chain is recorded.
+void postCreate(PostChain *post, const DeviceCaps *caps, VkDevice device,
+                const VkAllocationCallbacks *pAllocator, MemoryBudget *budget, const PostEffect *effects,
+                uint32_t effectCount,
+                VkShaderModule blurShader, VkShaderModule tonemapShader, VkShaderModule sharpenShader,
+                uint32_t queueFamilyIndex, uint32_t frameCount, VkImageView sceneView, VkExtent2D extent);
+// Swapchain recreation: the device must be idle.
+void postResize(PostChain *post, VkImageView sceneView, VkExtent2D extent);
+// After the scene pass. Processes the top-left `renderExtent` and returns the image holding the
+// result, in GENERAL layout and ready to be read by transfer commands.
+VkImage postRecord(PostChain *post, VkCommandBuffer commandBuffer, uint32_t frameIndex,
+                   VkExtent2D renderExtent);
+// Call after waiting for the frame's fence.
+void postCollectTimings(PostChain *post, uint32_t frameIndex);
+// Average GPU time of each effect since the last report.
+void postReport(PostChain *post, FILE *out);
+void postDestroy(PostChain *post);
+
+#endif
@@ -0,0 +1,433 @@
+#include "readback.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double nowMs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec * 1e-6;
+}
+
+static bool isBgra(VkFormat format) {
+  return format == VK_FORMAT_B8G8R8A8_SRGB || format == VK_FORMAT_B8G8R8A8_UNORM;
+}
+
+static bool isRgba(VkFormat format) {
+  return format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_R8G8B8A8_UNORM;
+}
+
+ReadbackFormat readbackParseFormat(const char *name) {
+  if (name && strcmp(name, "raw") == 0) {
+    return READBACK_FORMAT_RAW;
+  }
+  if (name && strcmp(name, "y4m") == 0) {
+    return READBACK_FORMAT_Y4M;
+  }
+  return READBACK_FORMAT_PPM;
+}
+
+static void createSlots(Readback *rb) {
+  rb->frameSize = (VkDeviceSize)rb->extent.width * rb->extent.height * 4;
+  rb->slots = arenaPushArray(&rb->slotArena, ReadbackSlot, rb->slotCount);
+  memset(rb->slots, 0, sizeof(ReadbackSlot) * rb->slotCount);
+  rb->convertBuffer = arenaPush(&rb->slotArena, (size_t)rb->extent.width * rb->extent.height * 3, 16);
+
+  for (uint32_t i = 0; i < rb->slotCount; i++) {
+    ReadbackSlot *slot = &rb->slots[i];
+    VkBufferCreateInfo bufferInfo = {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                     .size = rb->frameSize,
+                                     .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                     .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
+    if (vkCreateBuffer(rb->device, &bufferInfo, rb->pAllocator, &slot->buffer) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to create readback buffer!\n");
+      exit(EXIT_FAILURE);
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(rb->device, slot->buffer, &memRequirements);
+
+    // CPU reads from uncached memory are very slow, so prefer cached and invalidate by hand.
+    uint32_t memoryType =
+        deviceCapsFindMemoryType(rb->caps, memRequirements.memoryTypeBits,
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    rb->coherent = false;
+    if (memoryType == UINT32_MAX) {
+      memoryType =
+          deviceCapsFindMemoryType(rb->caps, memRequirements.memoryTypeBits,
+                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+      rb->coherent = true;
+    }
+    if (memoryType == UINT32_MAX) {
+      fprintf(stderr, "Failed to find suitable memory type!\n");
+      exit(EXIT_FAILURE);
+    }
+
+    VkMemoryAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                                      .allocationSize = memRequirements.size,
+                                      .memoryTypeIndex = memoryType};
+    if (memoryBudgetAllocate(rb->budget, rb->device, &allocInfo, rb->pAllocator, &slot->memory) !=
+        VK_SUCCESS) {
+      fprintf(stderr, "Failed to allocate readback buffer memory!\n");
+      exit(EXIT_FAILURE);
+    }
+    vkBindBufferMemory(rb->device, slot->buffer, slot->memory, 0);
+    vkMapMemory(rb->device, slot->memory, 0, VK_WHOLE_SIZE, 0, &slot->mapped);
+    slot->state = READBACK_SLOT_FREE;
+  }
+}
+
+static void destroySlots(Readback *rb) {
+  for (uint32_t i = 0; i < rb->slotCount; i++) {
+    vkUnmapMemory(rb->device, rb->slots[i].memory);
+    vkDestroyBuffer(rb->device, rb->slots[i].buffer, rb->pAllocator);
+    memoryBudgetFree(rb->budget, rb->device, rb->slots[i].memory, rb->pAllocator);
+  }
+  arenaReset(&rb->slotArena);
+  rb->slots = NULL;
+  rb->convertBuffer = NULL;
+}
+
+static bool writeBytes(Readback *rb, FILE *out, const void *data, size_t size) {
+  if (fwrite(data, 1, size, out) != size) {
+    if (!rb->writeError) {
+      fprintf(stderr, "Readback output failed; further frames are discarded.\n");
+    }
+    rb->writeError = true;
+    return false;
+  }
+  rb->stats.bytesWritten += size;
+  return true;
+}
+
+static void toRgb(const Readback *rb, const ReadbackSlot *slot, uint8_t *dst) {
+  const uint8_t *src = slot->mapped;
+  size_t pixels = (size_t)slot->extent.width * slot->extent.height;
+  int r = isBgra(rb->imageFormat) ? 2 : 0;
+  int b = 2 - r;
+  for (size_t i = 0; i < pixels; i++) {
+    dst[i * 3 + 0] = src[i * 4 + r];
+    dst[i * 3 + 1] = src[i * 4 + 1];
+    dst[i * 3 + 2] = src[i * 4 + b];
+  }
+}
+
+// BT.601 limited range, planar 4:4:4.
+static void toYuv444(const Readback *rb, const ReadbackSlot *slot, uint8_t *dst) {
+  const uint8_t *src = slot->mapped;
+  size_t pixels = (size_t)slot->extent.width * slot->extent.height;
+  int ri = isBgra(rb->imageFormat) ? 2 : 0;
+  int bi = 2 - ri;
+  uint8_t *yPlane = dst, *uPlane = dst + pixels, *vPlane = dst + 2 * pixels;
+  for (size_t i = 0; i < pixels; i++) {
+    int r = src[i * 4 + ri], g = src[i * 4 + 1], b = src[i * 4 + bi];
+    yPlane[i] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    uPlane[i] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    vPlane[i] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+  }
+}
+
+static void writeFrame(Readback *rb, ReadbackSlot *slot) {
+  if (rb->writeError) {
+    return;
+  }
+
+  FILE *out = rb->out;
+  if (rb->pathPattern[0]) {
+    char path[300];
+    snprintf(path, sizeof(path), rb->pathPattern, (int)slot->frameNumber);
+    out = fopen(path, "wb");
+    if (out == NULL) {
+      fprintf(stderr, "Failed to open %s\n", path);
+      rb->writeError = true;
+      return;
+    }
+  }
+
+  uint32_t width = slot->extent.width, height = slot->extent.height;
+  size_t pixels = (size_t)width * height;
+  char header[128];
+
+  switch (rb->format) {
+  case READBACK_FORMAT_RAW:
+    writeBytes(rb, out, slot->mapped, pixels * 4);
+    break;
+  case READBACK_FORMAT_PPM:
+    toRgb(rb, slot, rb->convertBuffer);
+    writeBytes(rb, out, header, (size_t)snprintf(header, sizeof(header), "P6\n%u %u\n255\n", width, height));
+    writeBytes(rb, out, rb->convertBuffer, pixels * 3);
+    break;
+  case READBACK_FORMAT_Y4M:
+    if (!rb->y4mHeaderWritten) {
+      writeBytes(rb, out, header,
+                 (size_t)snprintf(header, sizeof(header), "YUV4MPEG2 W%u H%u F60:1 Ip A1:1 C444\n", width, height));
+      rb->streamExtent = slot->extent;
+      rb->y4mHeaderWritten = true;
+    }
+    if (width != rb->streamExtent.width || height != rb->streamExtent.height) {
+      break; // a Y4M stream cannot change size; frames after a resize are skipped
+    }
+    toYuv444(rb, slot, rb->convertBuffer);
+    writeBytes(rb, out, "FRAME\n", 6);
+    writeBytes(rb, out, rb->convertBuffer, pixels * 3);
+    break;
+  }
+
+  if (out != rb->out) {
+    fclose(out);
+  }
+}
+
+static void *writerMain(void *arg) {
+  Readback *rb = arg;
+
+  pthread_mutex_lock(&rb->mutex);
+  for (;;) {
+    while (rb->queueCount == 0 && !rb->quit) {
+      pthread_cond_wait(&rb->cond, &rb->mutex);
+    }
+    if (rb->queueCount == 0) {
+      break;
+    }
+
+    ReadbackSlot *slot = &rb->slots[rb->queue[rb->queueHead]];
+    rb->queueHead = (rb->queueHead + 1) % rb->slotCount;
+    rb->queueCount--;
+    slot->state = READBACK_SLOT_WRITING;
+    pthread_mutex_unlock(&rb->mutex);
+
+    double start = nowMs();
+    writeFrame(rb, slot);
+    double busy = nowMs() - start;
+
+    pthread_mutex_lock(&rb->mutex);
+    rb->stats.writerBusyMs += busy;
+    rb->stats.framesWritten++;
+    slot->state = READBACK_SLOT_FREE;
+    pthread_cond_broadcast(&rb->cond);
+  }
+  pthread_mutex_unlock(&rb->mutex);
+
+  if (rb->out) {
+    fflush(rb->out);
+  }
+  return NULL;
+}
+
+bool readbackCreate(Readback *rb, const DeviceCaps *caps, VkDevice device,
+                    const VkAllocationCallbacks *pAllocator, MemoryBudget *budget, VkFormat imageFormat,
+                    VkExtent2D extent, uint32_t framesInFlight, uint32_t slotCount, const char *target,
+                    ReadbackFormat format) {
+  *rb = (Readback){.caps = caps,
+                   .device = device,
+                   .pAllocator = pAllocator,
+                   .budget = budget,
+                   .imageFormat = imageFormat,
+                   .extent = extent,
+                   .slotCount = slotCount > framesInFlight ? slotCount : framesInFlight + 1,
+                   .framesInFlight = framesInFlight,
+                   .format = format};
+
+  if (format != READBACK_FORMAT_RAW && !isBgra(imageFormat) && !isRgba(imageFormat)) {
+    fprintf(stderr, "Readback can only convert 8-bit RGBA/BGRA images; writing raw frames.\n");
+    rb->format = READBACK_FORMAT_RAW;
+  }
+
+  if (strchr(target, '%')) {
+    snprintf(rb->pathPattern, sizeof(rb->pathPattern), "%s", target);
+  } else if (strcmp(target, "-") == 0) {
+    rb->out = stdout;
+  } else if (target[0] == '|') {
+    signal(SIGPIPE, SIG_IGN); // a dead consumer shows up as a write error instead
+    rb->out = popen(target + 1, "w");
+    rb->isPipe = true;
+  } else {
+    rb->out = fopen(target, "wb");
+  }
+  if (!rb->pathPattern[0] && rb->out == NULL) {
+    fprintf(stderr, "Failed to open readback output %s\n", target);
+    return false;
+  }
+
+  rb->inFlightSlots = malloc(sizeof(int32_t) * framesInFlight);
+  for (uint32_t i = 0; i < framesInFlight; i++) {
+    rb->inFlightSlots[i] = -1;
+  }
+  rb->queue = malloc(sizeof(uint32_t) * rb->slotCount);
+  arenaInit(&rb->slotArena, 64 * 1024);
+  createSlots(rb);
+
+  pthread_mutex_init(&rb->mutex, NULL);
+  pthread_cond_init(&rb->cond, NULL);
+  if (pthread_create(&rb->thread, NULL, writerMain, rb) != 0) {
+    fprintf(stderr, "Failed to create readback writer thread!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  rb->stats.startMs = nowMs();
+  return true;
+}
+
+void readbackFrameComplete(Readback *rb, uint32_t frameIndex) {
+  int32_t index = rb->inFlightSlots[frameIndex];
+  if (index < 0) {
+    return;
+  }
+  double start = nowMs();
+  rb->inFlightSlots[frameIndex] = -1;
+
+  ReadbackSlot *slot = &rb->slots[index];
+  if (!rb->coherent) {
+    VkMappedMemoryRange range = {.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+                                 .memory = slot->memory,
+                                 .offset = 0,
+                                 .size = VK_WHOLE_SIZE};
+    vkInvalidateMappedMemoryRanges(rb->device, 1, &range);
+  }
+
+  pthread_mutex_lock(&rb->mutex);
+  slot->state = READBACK_SLOT_QUEUED;
+  rb->queue[(rb->queueHead + rb->queueCount) % rb->slotCount] = (uint32_t)index;
+  rb->queueCount++;
+  rb->stats.framesCopied++;
+  pthread_cond_broadcast(&rb->cond);
+  pthread_mutex_unlock(&rb->mutex);
+
+  rb->stats.renderThreadMs += nowMs() - start;
+}
+
+void readbackRecordCopy(Readback *rb, VkCommandBuffer commandBuffer, VkImage image, uint32_t frameIndex) {
+  double start = nowMs();
+  uint64_t frameNumber = rb->frameNumber++;
+
+  // Never wait for the writer: if every slot is busy this frame is simply not read back.
+  int32_t index = -1;
+  pthread_mutex_lock(&rb->mutex);
+  for (uint32_t i = 0; i < rb->slotCount; i++) {
+    if (rb->slots[i].state == READBACK_SLOT_FREE) {
+      index = (int32_t)i;
+      rb->slots[i].state = READBACK_SLOT_COPYING;
+      break;
+    }
+  }
+  if (index < 0) {
+    rb->stats.framesDropped++;
+  }
+  pthread_mutex_unlock(&rb->mutex);
+
+  rb->inFlightSlots[frameIndex] = index;
+  if (index < 0) {
+    rb->stats.renderThreadMs += nowMs() - start;
+    return;
+  }
+
+  ReadbackSlot *slot = &rb->slots[index];
+  slot->frameNumber = frameNumber;
+  slot->extent = rb->extent;
+
+  VkImageMemoryBarrier toTransfer = {.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                                     .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                                     .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+                                     .oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                                     .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                     .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                     .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                     .image = image,
+                                     .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                     .subresourceRange.levelCount = 1,
+                                     .subresourceRange.layerCount = 1};
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &toTransfer);
+
+  VkBufferImageCopy region = {.bufferOffset = 0,
+                              .bufferRowLength = 0,
+                              .bufferImageHeight = 0,
+                              .imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                              .imageSubresource.layerCount = 1,
+                              .imageExtent = {rb->extent.width, rb->extent.height, 1}};
+  vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer, 1, &region);
+
+  VkImageMemoryBarrier toPresent = toTransfer;
+  toPresent.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  toPresent.dstAccessMask = 0;
+  toPresent.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  toPresent.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+  VkBufferMemoryBarrier toHost = {.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                                  .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                                  .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+                                  .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                  .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                  .buffer = slot->buffer,
+                                  .offset = 0,
+                                  .size = VK_WHOLE_SIZE};
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 1, &toHost,
+                       1, &toPresent);
+
+  rb->stats.renderThreadMs += nowMs() - start;
+}
+
+static void drain(Readback *rb) {
+  for (uint32_t i = 0; i < rb->framesInFlight; i++) {
+    readbackFrameComplete(rb, i);
+  }
+
+  pthread_mutex_lock(&rb->mutex);
+  for (;;) {
+    bool busy = rb->queueCount > 0;
+    for (uint32_t i = 0; i < rb->slotCount && !busy; i++) {
+      busy = rb->slots[i].state != READBACK_SLOT_FREE;
+    }
+    if (!busy) {
+      break;
+    }
+    pthread_cond_wait(&rb->cond, &rb->mutex);
+  }
+  pthread_mutex_unlock(&rb->mutex);
+}
+
+void readbackResize(Readback *rb, VkFormat imageFormat, VkExtent2D extent) {
+  drain(rb);
+  destroySlots(rb);
+  rb->imageFormat = imageFormat;
+  rb->extent = extent;
+  createSlots(rb);
+}
+
+void readbackDestroy(Readback *rb) {
+  for (uint32_t i = 0; i < rb->framesInFlight; i++) {
+    readbackFrameComplete(rb, i);
+  }
+
+  pthread_mutex_lock(&rb->mutex);
+  rb->quit = true;
+  pthread_cond_broadcast(&rb->cond);
+  pthread_mutex_unlock(&rb->mutex);
+  pthread_join(rb->thread, NULL);
+
+  double elapsedMs = nowMs() - rb->stats.startMs;
+  uint64_t frames = rb->stats.framesCopied + rb->stats.framesDropped;
+  fprintf(stderr,
+          "Readback: %llu frames copied, %llu written, %llu dropped; render thread %.3f ms/frame; "
+          "writer %.1f MB/s, busy %.0f%%\n",
+          (unsigned long long)rb->stats.framesCopied, (unsigned long long)rb->stats.framesWritten,
+          (unsigned long long)rb->stats.framesDropped, frames ? rb->stats.renderThreadMs / (double)frames : 0.0,
+          elapsedMs > 0.0 ? (double)rb->stats.bytesWritten / (elapsedMs * 1e3) : 0.0,
+          elapsedMs > 0.0 ? 100.0 * rb->stats.writerBusyMs / elapsedMs : 0.0);
+
+  if (rb->isPipe) {
+    pclose(rb->out);
+  } else if (rb->out && rb->out != stdout) {
+    fclose(rb->out);
+  }
+
+  destroySlots(rb);
+  arenaDestroy(&rb->slotArena);
+  pthread_cond_destroy(&rb->cond);
+  pthread_mutex_destroy(&rb->mutex);
+  free(rb->inFlightSlots);
+  free(rb->queue);
+}
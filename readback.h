@@ -0,0 +1,107 @@
+#ifndef READBACK_H
+#define READBACK_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vulkan/vulkan.h>
+
+#include "devicecaps.h"
+#include "hostalloc.h"
+#include "membudget.h"
+
+// Asynchronous frame readback. Each frame's swapchain image is copied into one of a ring of
+// persistently mapped host buffers; the buffer is only read once that frame's fence has
+// signaled, and a background thread streams it out. When the writer falls behind, frames are
+// dropped rather than stalling the render loop.
+
+typedef enum ReadbackFormat {
+  READBACK_FORMAT_RAW, // pixels as stored in the swapchain image
+  READBACK_FORMAT_PPM, // binary RGB netpbm; one image per frame
+  READBACK_FORMAT_Y4M, // YUV4MPEG2 4:4:4 stream
+} ReadbackFormat;
+
+typedef enum ReadbackSlotState {
+  READBACK_SLOT_FREE,
+  READBACK_SLOT_COPYING, // copy recorded, frame fence not yet signaled
+  READBACK_SLOT_QUEUED,  // waiting for the writer thread
+  READBACK_SLOT_WRITING,
+} ReadbackSlotState;
+
+typedef struct ReadbackSlot {
+  VkBuffer buffer;
+  VkDeviceMemory memory;
+  void *mapped;
+  ReadbackSlotState state;
+  uint64_t frameNumber;
+  VkExtent2D extent;
+} ReadbackSlot;
+
+typedef struct ReadbackStats {
+  uint64_t framesCopied;
+  uint64_t framesWritten;
+  uint64_t framesDropped; // no free slot; the frame was presented without readback
+  uint64_t bytesWritten;
+  double renderThreadMs; // time the render loop spent in readback calls
+  double writerBusyMs;   // time the writer thread spent converting and writing
+  double startMs;
+} ReadbackStats;
+
+typedef struct Readback {
+  const DeviceCaps *caps;
+  VkDevice device;
+  const VkAllocationCallbacks *pAllocator;
+  MemoryBudget *budget;
+  VkFormat imageFormat;
+  VkExtent2D extent;
+  VkDeviceSize frameSize;
+  bool coherent;
+
+  uint32_t slotCount;
+  ReadbackSlot *slots;
+  Arena slotArena; // slots and convertBuffer; reset when the ring is resized
+  uint32_t framesInFlight;
+  int32_t *inFlightSlots; // slot copied by each frame in flight, or -1
+  uint64_t frameNumber;
+
+  ReadbackFormat format;
+  FILE *out;
+  bool isPipe;
+  char pathPattern[256]; // contains %d: one file per frame
+  bool writeError;
+  bool y4mHeaderWritten;
+  VkExtent2D streamExtent;
+  uint8_t *convertBuffer;
+
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  uint32_t *queue; // FIFO of slot indices
+  uint32_t queueHead;
+  uint32_t queueCount;
+  bool quit;
+
+  ReadbackStats stats;
+} Readback;
+
+// `target` is a file path, a pattern containing %d (one file per frame), "-" for stdout, or
+// "|command" to pipe into a process (e.g. "|ffmpeg -i - out.mp4").
+bool readbackCreate(Readback *rb, const DeviceCaps *caps, VkDevice device,
+                    const VkAllocationCallbacks *pAllocator, MemoryBudget *budget, VkFormat imageFormat,
+                    VkExtent2D extent, uint32_t framesInFlight, uint32_t slotCount, const char *target,
+                    ReadbackFormat format);
+// Swapchain recreation: the device must be idle. Drains the writer and resizes the ring.
+void readbackResize(Readback *rb, VkFormat imageFormat, VkExtent2D extent);
+// Call after waiting for frame `frameIndex`'s fence: hands its copy to the writer thread.
+void readbackFrameComplete(Readback *rb, uint32_t frameIndex);
+// Records the copy of `image` (in PRESENT_SRC_KHR layout after the render pass) and returns
+// it to PRESENT_SRC_KHR.
+void readbackRecordCopy(Readback *rb, VkCommandBuffer commandBuffer, VkImage image, uint32_t frameIndex);
+// Device must be idle. Flushes remaining frames, prints statistics and frees everything.
+void readbackDestroy(Readback *rb);
+
+ReadbackFormat readbackParseFormat(const char *name);
+
+#endif
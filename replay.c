@@ -0,0 +1,872 @@
+// Headless replay of a frame capture (F12 in the main app) for driver and build comparisons.
+// Usage: replay <capture.vkcap> [iterations]
+//
+// REPLAY_PIPELINE_ROUNDS=<n> first times building every captured pipeline n times: a full
+// compile against graphics pipeline library parts, a fast link and an optimized link. Turn
+// off the driver's own shader cache (MESA_SHADER_CACHE_DISABLE=true on Mesa) or later rounds
+// measure cache hits.
+//
+// REPLAY_SOAK=1 re-records the command buffer every iteration and recreates the render
+// targets every SOAK_RECREATE_INTERVAL iterations, as a resize would. Our own device memory
+// must not grow between the end of warm-up (the first tenth of the iterations) and the last
+// iteration, or replay fails. The whole process's usage as VK_EXT_memory_budget reports it is
+// printed too but not checked: it includes driver allocations, such as command pool growth,
+// that the replay does not control.
+//
+// REPLAY_SOAK=evict also drops the memory watermark to zero with the render target registered
+// as evictable, so the target is evicted after every iteration and recreated when the next one
+// touches it. Replay fails unless every eviction was followed by a recreation.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vulkan/vulkan.h>
+
+#include "capture.h"
+#include "devicecaps.h"
+#include "membudget.h"
+#include "pipelinelib.h"
+
+#define SOAK_RECREATE_INTERVAL 100
+
+typedef struct Replay {
+  VkInstance instance;
+  VkPhysicalDevice physicalDevice;
+  VkPhysicalDeviceProperties properties;
+  uint32_t queueFamily;
+  bool hasTimestamps;
+  bool hasPipelineLibrary;
+  MemoryBudget budget;
+  VkDevice device;
+  VkQueue queue;
+  VkCommandPool commandPool;
+  VkCommandBuffer commandBuffer;
+  VkFence fence;
+  VkQueryPool queryPool;
+  VkImage colorImage;
+  VkDeviceMemory colorMemory;
+  VkImageView colorImageView;
+  VkImage depthImage;
+  VkDeviceMemory depthMemory;
+  VkImageView depthImageView;
+  VkRenderPass renderPass;
+  VkFramebuffer framebuffer;
+  MemoryEvictable target; // the attachments and framebuffer, with REPLAY_SOAK=evict
+  VkPipelineLayout pipelineLayout;
+  uint32_t pushConstantSize;
+  VkPipeline *pipelines;
+  VkBuffer *buffers;
+  VkDeviceMemory *bufferMemories;
+} Replay;
+
+static double nowMs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec * 1e-6;
+}
+
+static int compareDouble(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+static uint32_t findMemoryType(Replay *pReplay, uint32_t typeBits, VkMemoryPropertyFlags properties) {
+  VkPhysicalDeviceMemoryProperties memProperties;
+  vkGetPhysicalDeviceMemoryProperties(pReplay->physicalDevice, &memProperties);
+
+  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+    if ((typeBits & (1u << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+      return i;
+    }
+  }
+
+  fprintf(stderr, "Failed to find suitable memory type!\n");
+  exit(EXIT_FAILURE);
+}
+
+static void createDevice(Replay *pReplay) {
+  VkApplicationInfo appInfo = {.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+                               .pApplicationName = "SeEngine replay",
+                               .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
+                               .pEngineName = "No Engine",
+                               .engineVersion = VK_MAKE_VERSION(1, 0, 0),
+                               .apiVersion = VK_API_VERSION_1_1};
+  VkInstanceCreateInfo instanceInfo = {.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+                                       .pApplicationInfo = &appInfo};
+  if (vkCreateInstance(&instanceInfo, NULL, &pReplay->instance) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create Vulkan Instance!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  uint32_t numDevices = 0;
+  vkEnumeratePhysicalDevices(pReplay->instance, &numDevices, NULL);
+  if (!numDevices) {
+    fprintf(stderr, "Failed to find a GPU with Vulkan support!\n");
+    exit(EXIT_FAILURE);
+  }
+  VkPhysicalDevice devices[numDevices];
+  vkEnumeratePhysicalDevices(pReplay->instance, &numDevices, devices);
+
+  // Environment override so the same capture can be replayed on every installed driver.
+  const char *deviceIndex = getenv("REPLAY_DEVICE");
+  uint32_t first = deviceIndex ? (uint32_t)atoi(deviceIndex) : 0;
+  for (uint32_t d = first; d < numDevices && !pReplay->physicalDevice; d++) {
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(devices[d], &queueFamilyCount, NULL);
+    VkQueueFamilyProperties queueFamilies[queueFamilyCount];
+    vkGetPhysicalDeviceQueueFamilyProperties(devices[d], &queueFamilyCount, queueFamilies);
+
+    for (uint32_t i = 0; i < queueFamilyCount; i++) {
+      if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+        pReplay->physicalDevice = devices[d];
+        pReplay->queueFamily = i;
+        pReplay->hasTimestamps = queueFamilies[i].timestampValidBits > 0;
+        break;
+      }
+    }
+  }
+  if (!pReplay->physicalDevice) {
+    fprintf(stderr, "Failed to find a stuitable GPU!\n");
+    exit(EXIT_FAILURE);
+  }
+  vkGetPhysicalDeviceProperties(pReplay->physicalDevice, &pReplay->properties);
+  pReplay->hasTimestamps = pReplay->hasTimestamps && pReplay->properties.limits.timestampPeriod > 0.0f;
+
+  float queuePriority = 1.0f;
+  VkDeviceQueueCreateInfo queueInfo = {.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                                       .queueFamilyIndex = pReplay->queueFamily,
+                                       .queueCount = 1,
+                                       .pQueuePriorities = &queuePriority};
+  const char *extensions[3];
+  uint32_t extensionCount = 0;
+  VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipelineLibraryFeature = pipelineLibraryFeatures(NULL);
+  DeviceCaps caps;
+  deviceCapsInit(&caps, pReplay->physicalDevice);
+  pReplay->hasPipelineLibrary = pipelineLibrarySupported(&caps);
+  if (pReplay->hasPipelineLibrary) {
+    extensions[extensionCount++] = VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME;
+    extensions[extensionCount++] = VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME;
+  }
+  bool hasMemoryBudget = memoryBudgetSupported(&caps);
+  if (hasMemoryBudget) {
+    extensions[extensionCount++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+  }
+  VkDeviceCreateInfo deviceInfo = {.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+                                   .pNext = pReplay->hasPipelineLibrary ? &pipelineLibraryFeature : NULL,
+                                   .queueCreateInfoCount = 1,
+                                   .pQueueCreateInfos = &queueInfo,
+                                   .enabledExtensionCount = extensionCount,
+                                   .ppEnabledExtensionNames = extensions};
+  if (vkCreateDevice(pReplay->physicalDevice, &deviceInfo, NULL, &pReplay->device) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create logical device!\n");
+    exit(EXIT_FAILURE);
+  }
+  // Nothing is evictable here; the budget only accounts.
+  memoryBudgetInit(&pReplay->budget, &caps, hasMemoryBudget, MEMORY_BUDGET_DEFAULT_WATERMARK, 1);
+  deviceCapsDestroy(&caps);
+  vkGetDeviceQueue(pReplay->device, pReplay->queueFamily, 0, &pReplay->queue);
+
+  VkCommandPoolCreateInfo poolInfo = {.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                                      .queueFamilyIndex = pReplay->queueFamily};
+  if (vkCreateCommandPool(pReplay->device, &poolInfo, NULL, &pReplay->commandPool) != VK_SUCCESS) {
+    fprintf(stderr, "failed to create command pool!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  VkCommandBufferAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                                           .commandPool = pReplay->commandPool,
+                                           .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                                           .commandBufferCount = 1};
+  if (vkAllocateCommandBuffers(pReplay->device, &allocInfo, &pReplay->commandBuffer) != VK_SUCCESS) {
+    fprintf(stderr, "failed to allocate command buffers!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  VkFenceCreateInfo fenceInfo = {.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+  if (vkCreateFence(pReplay->device, &fenceInfo, NULL, &pReplay->fence) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create fence!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (pReplay->hasTimestamps) {
+    VkQueryPoolCreateInfo queryInfo = {.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                                       .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                                       .queryCount = 2};
+    if (vkCreateQueryPool(pReplay->device, &queryInfo, NULL, &pReplay->queryPool) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to create query pool!\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+static void createImage(Replay *pReplay, VkFormat format, VkExtent2D extent, VkSampleCountFlagBits samples,
+                        VkImageUsageFlags usage, VkImageAspectFlags aspect, VkImage *image,
+                        VkDeviceMemory *memory, VkImageView *view) {
+  VkImageCreateInfo imageInfo = {.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                                 .imageType = VK_IMAGE_TYPE_2D,
+                                 .format = format,
+                                 .extent = {extent.width, extent.height, 1},
+                                 .mipLevels = 1,
+                                 .arrayLayers = 1,
+                                 .samples = samples,
+                                 .tiling = VK_IMAGE_TILING_OPTIMAL,
+                                 .usage = usage,
+                                 .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                                 .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+  if (vkCreateImage(pReplay->device, &imageInfo, NULL, image) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create target image!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  VkMemoryRequirements memRequirements;
+  vkGetImageMemoryRequirements(pReplay->device, *image, &memRequirements);
+  VkMemoryAllocateInfo allocInfo = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+      .allocationSize = memRequirements.size,
+      .memoryTypeIndex =
+          findMemoryType(pReplay, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)};
+  if (memoryBudgetAllocate(&pReplay->budget, pReplay->device, &allocInfo, NULL, memory) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to allocate target image memory!\n");
+    exit(EXIT_FAILURE);
+  }
+  vkBindImageMemory(pReplay->device, *image, *memory, 0);
+
+  VkImageViewCreateInfo viewInfo = {.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                                    .image = *image,
+                                    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                                    .format = format,
+                                    .subresourceRange.aspectMask = aspect,
+                                    .subresourceRange.levelCount = 1,
+                                    .subresourceRange.layerCount = 1};
+  if (vkCreateImageView(pReplay->device, &viewInfo, NULL, view) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create image views!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static VkSampleCountFlagBits targetSamples(const CaptureFile *file) {
+  return file->pipelineCount ? (VkSampleCountFlagBits)file->pipelines[0]->samples : VK_SAMPLE_COUNT_1_BIT;
+}
+
+// Images and framebuffer of the target; the render pass outlives them.
+static void createAttachments(Replay *pReplay, const CaptureFile *file) {
+  VkExtent2D extent = {file->header->width, file->header->height};
+  VkSampleCountFlagBits samples = targetSamples(file);
+  createImage(pReplay, (VkFormat)file->header->colorFormat, extent, samples,
+              VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+              VK_IMAGE_ASPECT_COLOR_BIT, &pReplay->colorImage, &pReplay->colorMemory,
+              &pReplay->colorImageView);
+  createImage(pReplay, (VkFormat)file->header->depthFormat, extent, samples,
+              VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, &pReplay->depthImage,
+              &pReplay->depthMemory, &pReplay->depthImageView);
+
+  VkImageView views[] = {pReplay->colorImageView, pReplay->depthImageView};
+  VkFramebufferCreateInfo framebufferInfo = {.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+                                             .renderPass = pReplay->renderPass,
+                                             .attachmentCount = 2,
+                                             .pAttachments = views,
+                                             .width = extent.width,
+                                             .height = extent.height,
+                                             .layers = 1};
+  if (vkCreateFramebuffer(pReplay->device, &framebufferInfo, NULL, &pReplay->framebuffer) != VK_SUCCESS) {
+    fprintf(stderr, "failed to create framebuffer!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Handles are cleared so that destroying an evicted target again does nothing.
+static void destroyAttachments(Replay *pReplay) {
+  vkDestroyFramebuffer(pReplay->device, pReplay->framebuffer, NULL);
+  vkDestroyImageView(pReplay->device, pReplay->depthImageView, NULL);
+  vkDestroyImage(pReplay->device, pReplay->depthImage, NULL);
+  memoryBudgetFree(&pReplay->budget, pReplay->device, pReplay->depthMemory, NULL);
+  vkDestroyImageView(pReplay->device, pReplay->colorImageView, NULL);
+  vkDestroyImage(pReplay->device, pReplay->colorImage, NULL);
+  memoryBudgetFree(&pReplay->budget, pReplay->device, pReplay->colorMemory, NULL);
+  pReplay->framebuffer = VK_NULL_HANDLE;
+  pReplay->depthImageView = VK_NULL_HANDLE;
+  pReplay->depthImage = VK_NULL_HANDLE;
+  pReplay->depthMemory = VK_NULL_HANDLE;
+  pReplay->colorImageView = VK_NULL_HANDLE;
+  pReplay->colorImage = VK_NULL_HANDLE;
+  pReplay->colorMemory = VK_NULL_HANDLE;
+}
+
+// Each submission is waited on, so the target is idle whenever the budget evicts it.
+static void evictTarget(void *data) { destroyAttachments(data); }
+
+// The swapchain image is replaced by an offscreen image of the captured format and size.
+static void createTarget(Replay *pReplay, const CaptureFile *file) {
+  VkFormat format = (VkFormat)file->header->colorFormat;
+  VkSampleCountFlagBits samples = targetSamples(file);
+  VkFormat depthFormat = (VkFormat)file->header->depthFormat;
+
+  VkAttachmentDescription colorAttachment = {.format = format,
+                                             .samples = samples,
+                                             .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                                             .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                                             .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                                             .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                                             .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                                             .finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  VkAttachmentDescription depthAttachment = {.format = depthFormat,
+                                             .samples = samples,
+                                             .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                                             .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                                             .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                                             .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                                             .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                                             .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+  VkAttachmentDescription attachments[] = {colorAttachment, depthAttachment};
+  VkAttachmentReference colorAttachmentRef = {.attachment = 0,
+                                              .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  VkAttachmentReference depthAttachmentRef = {.attachment = 1,
+                                              .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+  VkSubpassDescription subpass = {.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                  .colorAttachmentCount = 1,
+                                  .pColorAttachments = &colorAttachmentRef,
+                                  .pDepthStencilAttachment = &depthAttachmentRef};
+  // Iterations overwrite the same image, so order them like consecutive frames would be.
+  VkSubpassDependency dependency = {
+      .srcSubpass = VK_SUBPASS_EXTERNAL,
+      .dstSubpass = 0,
+      .srcStageMask =
+          VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+      .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+      .dstStageMask =
+          VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+      .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                       VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT};
+  VkRenderPassCreateInfo renderPassInfo = {.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+                                           .attachmentCount = 2,
+                                           .pAttachments = attachments,
+                                           .subpassCount = 1,
+                                           .pSubpasses = &subpass,
+                                           .dependencyCount = 1,
+                                           .pDependencies = &dependency};
+  if (vkCreateRenderPass(pReplay->device, &renderPassInfo, NULL, &pReplay->renderPass) != VK_SUCCESS) {
+    fprintf(stderr, "failed to create render pass!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  createAttachments(pReplay, file);
+}
+
+static VkShaderModule createShaderModule(Replay *pReplay, CaptureView code) {
+  VkShaderModuleCreateInfo createInfo = {.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+                                         .codeSize = code.size,
+                                         .pCode = code.data};
+  VkShaderModule shaderModule;
+  if (vkCreateShaderModule(pReplay->device, &createInfo, NULL, &shaderModule) != VK_SUCCESS) {
+    fprintf(stderr, "failed to create shader module!\n");
+    exit(EXIT_FAILURE);
+  }
+  return shaderModule;
+}
+
+static void printStats(const char *label, double *samples, int count) {
+  double sum = 0.0;
+  for (int i = 0; i < count; i++) {
+    sum += samples[i];
+  }
+  qsort(samples, count, sizeof(double), compareDouble);
+  printf("%-8s avg %8.4f ms  min %8.4f  median %8.4f  p95 %8.4f  max %8.4f\n", label, sum / count, samples[0],
+         samples[count / 2], samples[(int)(count * 0.95)], samples[count - 1]);
+}
+
+// Create info of a captured pipeline; pipelineInfo points into the struct.
+typedef struct PipelineState {
+  VkSpecializationMapEntry specializationEntries[CAPTURE_SPECIALIZATION_CONSTANTS];
+  VkSpecializationInfo specialization;
+  VkPipelineShaderStageCreateInfo shaderStages[2];
+  VkPipelineVertexInputStateCreateInfo vertexInput;
+  VkPipelineInputAssemblyStateCreateInfo inputAssembly;
+  VkPipelineViewportStateCreateInfo viewportState;
+  VkPipelineRasterizationStateCreateInfo rasterizer;
+  VkPipelineMultisampleStateCreateInfo multisampling;
+  VkPipelineDepthStencilStateCreateInfo depthStencil;
+  VkPipelineColorBlendAttachmentState colorBlendAttachment;
+  VkPipelineColorBlendStateCreateInfo colorBlending;
+  VkDynamicState dynamicStates[2];
+  VkPipelineDynamicStateCreateInfo dynamicState;
+  VkGraphicsPipelineCreateInfo pipelineInfo;
+} PipelineState;
+
+static void initPipelineState(Replay *pReplay, const CapturePipeline *desc, const VkShaderModule *modules,
+                              PipelineState *state) {
+  state->shaderStages[0] = (VkPipelineShaderStageCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage = VK_SHADER_STAGE_VERTEX_BIT,
+      .module = modules[desc->vertexShader],
+      .pName = "main"};
+  state->shaderStages[1] = (VkPipelineShaderStageCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+      .module = desc->fragmentShader == CAPTURE_NO_SHADER ? VK_NULL_HANDLE : modules[desc->fragmentShader],
+      .pName = "main"};
+  for (uint32_t i = 0; i < CAPTURE_SPECIALIZATION_CONSTANTS; i++) {
+    state->specializationEntries[i] = (VkSpecializationMapEntry){i, i * sizeof(uint32_t), sizeof(uint32_t)};
+  }
+  state->specialization = (VkSpecializationInfo){.mapEntryCount = CAPTURE_SPECIALIZATION_CONSTANTS,
+                                                 .pMapEntries = state->specializationEntries,
+                                                 .dataSize = sizeof(desc->specialization),
+                                                 .pData = desc->specialization};
+  state->shaderStages[1].pSpecializationInfo = &state->specialization;
+
+  state->vertexInput = (VkPipelineVertexInputStateCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+      .vertexBindingDescriptionCount = desc->vertexBindingCount,
+      .pVertexBindingDescriptions = desc->vertexBindings,
+      .vertexAttributeDescriptionCount = desc->vertexAttributeCount,
+      .pVertexAttributeDescriptions = desc->vertexAttributes};
+  state->inputAssembly = (VkPipelineInputAssemblyStateCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+      .topology = (VkPrimitiveTopology)desc->topology};
+  state->viewportState = (VkPipelineViewportStateCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO, .viewportCount = 1, .scissorCount = 1};
+  state->rasterizer = (VkPipelineRasterizationStateCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+      .polygonMode = (VkPolygonMode)desc->polygonMode,
+      .lineWidth = 1.0f,
+      .cullMode = desc->cullMode,
+      .frontFace = (VkFrontFace)desc->frontFace};
+  state->multisampling = (VkPipelineMultisampleStateCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+      .rasterizationSamples = (VkSampleCountFlagBits)desc->samples,
+      .minSampleShading = 1.0f};
+  state->depthStencil = (VkPipelineDepthStencilStateCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+      .depthTestEnable = desc->depthTestEnable,
+      .depthWriteEnable = desc->depthWriteEnable,
+      .depthCompareOp = (VkCompareOp)desc->depthCompareOp};
+  state->colorBlendAttachment = (VkPipelineColorBlendAttachmentState){
+      .colorWriteMask = desc->colorWriteMask,
+      .blendEnable = desc->blendEnable,
+      .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+      .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+      .colorBlendOp = VK_BLEND_OP_ADD,
+      .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+      .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+      .alphaBlendOp = VK_BLEND_OP_ADD};
+  state->colorBlending = (VkPipelineColorBlendStateCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+      .attachmentCount = 1,
+      .pAttachments = &state->colorBlendAttachment};
+  state->dynamicStates[0] = VK_DYNAMIC_STATE_VIEWPORT;
+  state->dynamicStates[1] = VK_DYNAMIC_STATE_SCISSOR;
+  state->dynamicState = (VkPipelineDynamicStateCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+      .dynamicStateCount = 2,
+      .pDynamicStates = state->dynamicStates};
+
+  state->pipelineInfo = (VkGraphicsPipelineCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+      .stageCount = desc->fragmentShader == CAPTURE_NO_SHADER ? 1 : 2,
+      .pStages = state->shaderStages,
+      .pVertexInputState = &state->vertexInput,
+      .pInputAssemblyState = &state->inputAssembly,
+      .pViewportState = &state->viewportState,
+      .pRasterizationState = &state->rasterizer,
+      .pMultisampleState = &state->multisampling,
+      .pDepthStencilState = &state->depthStencil,
+      .pColorBlendState = &state->colorBlending,
+      .pDynamicState = &state->dynamicState,
+      .layout = pReplay->pipelineLayout,
+      .renderPass = pReplay->renderPass,
+      .subpass = 0,
+      .basePipelineIndex = -1};
+}
+
+// Neither path uses a pipeline cache, so every round does the driver's full work.
+static void benchPipelines(Replay *pReplay, const CaptureFile *file, const VkShaderModule *modules,
+                           int rounds) {
+  if (!pReplay->hasPipelineLibrary) {
+    printf("pipelines: VK_EXT_graphics_pipeline_library not supported, only timing full compiles\n");
+  }
+  double *compileMs = malloc(sizeof(double) * rounds);
+  double *partsMs = malloc(sizeof(double) * rounds);
+  double *linkMs = malloc(sizeof(double) * rounds);
+  double *optimizedLinkMs = malloc(sizeof(double) * rounds);
+
+  for (uint32_t i = 0; i < file->pipelineCount; i++) {
+    PipelineState state;
+    initPipelineState(pReplay, file->pipelines[i], modules, &state);
+    for (int r = 0; r < rounds; r++) {
+      double start = nowMs();
+      VkPipeline pipeline;
+      if (vkCreateGraphicsPipelines(pReplay->device, VK_NULL_HANDLE, 1, &state.pipelineInfo, NULL,
+                                    &pipeline) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create graphics pipeline!\n");
+        exit(EXIT_FAILURE);
+      }
+      compileMs[r] = nowMs() - start;
+      vkDestroyPipeline(pReplay->device, pipeline, NULL);
+      if (!pReplay->hasPipelineLibrary) {
+        continue;
+      }
+
+      start = nowMs();
+      VkPipeline parts[PIPELINE_LIBRARY_PART_COUNT];
+      for (uint32_t p = 0; p < PIPELINE_LIBRARY_PART_COUNT; p++) {
+        parts[p] = pipelineLibraryCreatePart(pReplay->device, &state.pipelineInfo, PIPELINE_LIBRARY_PARTS[p],
+                                             VK_NULL_HANDLE, NULL);
+      }
+      double partsDone = nowMs();
+      VkPipeline fast = pipelineLibraryLink(pReplay->device, pReplay->pipelineLayout, parts, false,
+                                            VK_NULL_HANDLE, NULL);
+      double fastDone = nowMs();
+      VkPipeline optimized = pipelineLibraryLink(pReplay->device, pReplay->pipelineLayout, parts, true,
+                                                 VK_NULL_HANDLE, NULL);
+      partsMs[r] = partsDone - start;
+      linkMs[r] = fastDone - partsDone;
+      optimizedLinkMs[r] = nowMs() - fastDone;
+
+      vkDestroyPipeline(pReplay->device, optimized, NULL);
+      vkDestroyPipeline(pReplay->device, fast, NULL);
+      for (uint32_t p = 0; p < PIPELINE_LIBRARY_PART_COUNT; p++) {
+        vkDestroyPipeline(pReplay->device, parts[p], NULL);
+      }
+    }
+
+    printf("pipeline %u (%d rounds):\n", i, rounds);
+    printStats("compile", compileMs, rounds);
+    if (pReplay->hasPipelineLibrary) {
+      printStats("parts", partsMs, rounds);
+      printStats("link", linkMs, rounds);
+      printStats("link-lto", optimizedLinkMs, rounds);
+    }
+  }
+
+  free(compileMs);
+  free(partsMs);
+  free(linkMs);
+  free(optimizedLinkMs);
+}
+
+static void createPipelines(Replay *pReplay, const CaptureFile *file) {
+  // One layout for every pipeline, so push constants survive pipeline binds as they did live.
+  for (uint32_t i = 0; i < file->pipelineCount; i++) {
+    if (file->pipelines[i]->pushConstantSize > pReplay->pushConstantSize) {
+      pReplay->pushConstantSize = file->pipelines[i]->pushConstantSize;
+    }
+  }
+  VkPushConstantRange pushConstantRange = {CAPTURE_PUSH_CONSTANT_STAGES, 0, pReplay->pushConstantSize};
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      .pushConstantRangeCount = pReplay->pushConstantSize ? 1 : 0,
+      .pPushConstantRanges = &pushConstantRange};
+  if (vkCreatePipelineLayout(pReplay->device, &pipelineLayoutInfo, NULL, &pReplay->pipelineLayout) !=
+      VK_SUCCESS) {
+    fprintf(stderr, "failed to create pipeline layout!");
+    exit(EXIT_FAILURE);
+  }
+
+  VkShaderModule modules[file->shaderCount ? file->shaderCount : 1];
+  for (uint32_t i = 0; i < file->shaderCount; i++) {
+    modules[i] = createShaderModule(pReplay, file->shaders[i]);
+  }
+
+  pReplay->pipelines = calloc(file->pipelineCount ? file->pipelineCount : 1, sizeof(VkPipeline));
+  for (uint32_t i = 0; i < file->pipelineCount; i++) {
+    PipelineState state;
+    initPipelineState(pReplay, file->pipelines[i], modules, &state);
+    if (vkCreateGraphicsPipelines(pReplay->device, VK_NULL_HANDLE, 1, &state.pipelineInfo, NULL,
+                                  &pReplay->pipelines[i]) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to create graphics pipeline!\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  const char *rounds = getenv("REPLAY_PIPELINE_ROUNDS");
+  if (rounds && atoi(rounds) > 0) {
+    benchPipelines(pReplay, file, modules, atoi(rounds));
+  }
+
+  for (uint32_t i = 0; i < file->shaderCount; i++) {
+    vkDestroyShaderModule(pReplay->device, modules[i], NULL);
+  }
+}
+
+// Captured buffers are uploaded once into host-visible memory straight from the mapping.
+static void createBuffers(Replay *pReplay, const CaptureFile *file) {
+  uint32_t count = file->bufferCount ? file->bufferCount : 1;
+  pReplay->buffers = calloc(count, sizeof(VkBuffer));
+  pReplay->bufferMemories = calloc(count, sizeof(VkDeviceMemory));
+
+  for (uint32_t i = 0; i < file->bufferCount; i++) {
+    const CaptureBuffer *captured = file->buffers[i];
+    VkBufferCreateInfo bufferInfo = {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                     .size = captured->size,
+                                     .usage = captured->usage,
+                                     .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
+    if (vkCreateBuffer(pReplay->device, &bufferInfo, NULL, &pReplay->buffers[i]) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to create buffer!\n");
+      exit(EXIT_FAILURE);
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(pReplay->device, pReplay->buffers[i], &memRequirements);
+    VkMemoryAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = memRequirements.size,
+        .memoryTypeIndex = findMemoryType(pReplay, memRequirements.memoryTypeBits,
+                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)};
+    if (memoryBudgetAllocate(&pReplay->budget, pReplay->device, &allocInfo, NULL,
+                             &pReplay->bufferMemories[i]) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to allocate buffer memory!\n");
+      exit(EXIT_FAILURE);
+    }
+    vkBindBufferMemory(pReplay->device, pReplay->buffers[i], pReplay->bufferMemories[i], 0);
+
+    void *data;
+    vkMapMemory(pReplay->device, pReplay->bufferMemories[i], 0, captured->size, 0, &data);
+    memcpy(data, captured + 1, captured->size);
+    vkUnmapMemory(pReplay->device, pReplay->bufferMemories[i]);
+  }
+}
+
+// Translates the captured command stream; the command buffer is then resubmitted as is, except
+// in a soak run.
+static void recordReplay(Replay *pReplay, const CaptureFile *file) {
+  VkCommandBuffer commandBuffer = pReplay->commandBuffer;
+  VkCommandBufferBeginInfo beginInfo = {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+    fprintf(stderr, "failed to begin recording command buffer!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (pReplay->hasTimestamps) {
+    vkCmdResetQueryPool(commandBuffer, pReplay->queryPool, 0, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pReplay->queryPool, 0);
+  }
+
+  for (const CaptureCommand *command = captureNextCommand(file, NULL); command;
+       command = captureNextCommand(file, command)) {
+    const void *payload = captureCommandPayload(command);
+
+    switch ((CaptureOpcode)command->opcode) {
+    case CAPTURE_CMD_BEGIN_RENDER_PASS: {
+      const CaptureBeginRenderPass *begin = payload;
+      const float *c = begin->clearColor;
+      VkClearValue clearValues[] = {{.color = {{c[0], c[1], c[2], c[3]}}},
+                                    {.depthStencil = {begin->clearDepth, 0}}};
+      VkRenderPassBeginInfo renderPassInfo = {.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+                                              .renderPass = pReplay->renderPass,
+                                              .framebuffer = pReplay->framebuffer,
+                                              .renderArea.extent = {begin->width, begin->height},
+                                              .clearValueCount = 2,
+                                              .pClearValues = clearValues};
+      vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+      break;
+    }
+    case CAPTURE_CMD_END_RENDER_PASS:
+      vkCmdEndRenderPass(commandBuffer);
+      break;
+    case CAPTURE_CMD_BIND_PIPELINE:
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        pReplay->pipelines[*(const uint32_t *)payload]);
+      break;
+    case CAPTURE_CMD_SET_VIEWPORT:
+      vkCmdSetViewport(commandBuffer, 0, 1, payload);
+      break;
+    case CAPTURE_CMD_SET_SCISSOR:
+      vkCmdSetScissor(commandBuffer, 0, 1, payload);
+      break;
+    case CAPTURE_CMD_BIND_VERTEX_BUFFER: {
+      const CaptureBindBuffer *bind = payload;
+      VkDeviceSize offset = bind->offset;
+      vkCmdBindVertexBuffers(commandBuffer, bind->binding, 1, &pReplay->buffers[bind->buffer], &offset);
+      break;
+    }
+    case CAPTURE_CMD_BIND_INDEX_BUFFER: {
+      const CaptureBindBuffer *bind = payload;
+      vkCmdBindIndexBuffer(commandBuffer, pReplay->buffers[bind->buffer], bind->offset,
+                           (VkIndexType)bind->binding);
+      break;
+    }
+    case CAPTURE_CMD_DRAW: {
+      const CaptureDraw *draw = payload;
+      vkCmdDraw(commandBuffer, draw->vertexCount, draw->instanceCount, draw->firstVertex, draw->firstInstance);
+      break;
+    }
+    case CAPTURE_CMD_DRAW_INDEXED: {
+      const CaptureDrawIndexed *draw = payload;
+      vkCmdDrawIndexed(commandBuffer, draw->indexCount, draw->instanceCount, draw->firstIndex, draw->vertexOffset,
+                       draw->firstInstance);
+      break;
+    }
+    case CAPTURE_CMD_PUSH_CONSTANTS: {
+      const CapturePushConstants *push = payload;
+      // Older captures recorded the vertex stage only; the layout needs every stage of its range.
+      vkCmdPushConstants(commandBuffer, pReplay->pipelineLayout, CAPTURE_PUSH_CONSTANT_STAGES, push->offset,
+                         command->size - (uint32_t)sizeof(*push), push + 1);
+      break;
+    }
+    default:
+      fprintf(stderr, "Skipping unknown capture opcode %u\n", command->opcode);
+      break;
+    }
+  }
+
+  if (pReplay->hasTimestamps) {
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pReplay->queryPool, 1);
+  }
+
+  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+    fprintf(stderr, "failed to record command buffer!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void cleanup(Replay *pReplay, const CaptureFile *file) {
+  for (uint32_t i = 0; i < file->bufferCount; i++) {
+    vkDestroyBuffer(pReplay->device, pReplay->buffers[i], NULL);
+    memoryBudgetFree(&pReplay->budget, pReplay->device, pReplay->bufferMemories[i], NULL);
+  }
+  for (uint32_t i = 0; i < file->pipelineCount; i++) {
+    vkDestroyPipeline(pReplay->device, pReplay->pipelines[i], NULL);
+  }
+  free(pReplay->buffers);
+  free(pReplay->bufferMemories);
+  free(pReplay->pipelines);
+
+  vkDestroyPipelineLayout(pReplay->device, pReplay->pipelineLayout, NULL);
+  if (pReplay->target.evict) {
+    memoryBudgetUnregister(&pReplay->budget, &pReplay->target);
+  }
+  destroyAttachments(pReplay);
+  vkDestroyRenderPass(pReplay->device, pReplay->renderPass, NULL);
+  if (pReplay->queryPool) {
+    vkDestroyQueryPool(pReplay->device, pReplay->queryPool, NULL);
+  }
+  vkDestroyFence(pReplay->device, pReplay->fence, NULL);
+  vkDestroyCommandPool(pReplay->device, pReplay->commandPool, NULL);
+  memoryBudgetDestroy(&pReplay->budget);
+  vkDestroyDevice(pReplay->device, NULL);
+  vkDestroyInstance(pReplay->instance, NULL);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <capture.vkcap> [iterations]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  int iterations = argc > 2 ? atoi(argv[2]) : 1000;
+  if (iterations < 1) {
+    iterations = 1;
+  }
+
+  CaptureFile file;
+  if (!captureOpen(argv[1], &file)) {
+    return EXIT_FAILURE;
+  }
+
+  Replay replay = {};
+  createDevice(&replay);
+  createTarget(&replay, &file);
+  createPipelines(&replay, &file);
+  createBuffers(&replay, &file);
+  recordReplay(&replay, &file);
+
+  printf("device: %s\n", replay.properties.deviceName);
+  printf("capture: %ux%u, %u pipelines, %u buffers, %u command bytes, %d iterations\n", file.header->width,
+         file.header->height, file.pipelineCount, file.bufferCount, file.commands.size, iterations);
+
+  const char *soakEnv = getenv("REPLAY_SOAK");
+  bool soak = soakEnv && strcmp(soakEnv, "0") != 0;
+  bool evict = soak && strcmp(soakEnv, "evict") == 0;
+  int warmup = iterations / 10;
+  VkDeviceSize warmAllocated = 0, warmUsage = 0;
+  uint32_t recreations = 0, restorations = 0;
+  if (evict) {
+    replay.budget.watermark = 0.0f;
+    memoryBudgetRegister(&replay.budget, &replay.target, evictTarget, &replay);
+  }
+
+  double *cpuMs = malloc(sizeof(double) * iterations);
+  double *gpuMs = malloc(sizeof(double) * iterations);
+  VkSubmitInfo submitInfo = {.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                             .commandBufferCount = 1,
+                             .pCommandBuffers = &replay.commandBuffer};
+
+  // One submission in flight at a time so each sample is the full submit-to-completion latency.
+  for (int i = 0; i < iterations; i++) {
+    if (soak && i > 0) {
+      // The previous submission has completed, so the target can be replaced right away.
+      if (evict && !memoryBudgetTouch(&replay.budget, &replay.target)) {
+        createAttachments(&replay, &file);
+        restorations++;
+      } else if (i % SOAK_RECREATE_INTERVAL == 0) {
+        destroyAttachments(&replay);
+        createAttachments(&replay, &file);
+        recreations++;
+      }
+      vkResetCommandPool(replay.device, replay.commandPool, 0);
+      recordReplay(&replay, &file);
+    }
+    double start = nowMs();
+    if (vkQueueSubmit(replay.queue, 1, &submitInfo, replay.fence) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to submit replay command buffer!\n");
+      exit(EXIT_FAILURE);
+    }
+    vkWaitForFences(replay.device, 1, &replay.fence, VK_TRUE, UINT64_MAX);
+    cpuMs[i] = nowMs() - start;
+    vkResetFences(replay.device, 1, &replay.fence);
+
+    if (replay.hasTimestamps) {
+      uint64_t timestamps[2];
+      vkGetQueryPoolResults(replay.device, replay.queryPool, 0, 2, sizeof(timestamps), timestamps,
+                            sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+      gpuMs[i] = (double)(timestamps[1] - timestamps[0]) * replay.properties.limits.timestampPeriod * 1e-6;
+    }
+
+    memoryBudgetUpdate(&replay.budget);
+    if (i == warmup) {
+      warmAllocated = memoryBudgetAllocated(&replay.budget);
+      warmUsage = memoryBudgetUsage(&replay.budget);
+    }
+  }
+
+  printStats("cpu", cpuMs, iterations);
+  if (replay.hasTimestamps) {
+    printStats("gpu", gpuMs, iterations);
+  } else {
+    printf("gpu      timestamps not supported on this queue\n");
+  }
+
+  bool failed = false;
+  if (soak) {
+    VkDeviceSize allocated = memoryBudgetAllocated(&replay.budget);
+    VkDeviceSize usage = memoryBudgetUsage(&replay.budget);
+    printf("soak     %d iterations after warm-up, %u target recreations: ours %llu -> %llu bytes, "
+           "process %llu -> %llu bytes%s\n",
+           iterations - 1 - warmup, recreations, (unsigned long long)warmAllocated,
+           (unsigned long long)allocated, (unsigned long long)warmUsage, (unsigned long long)usage,
+           replay.budget.hasBudgetExtension ? " (not checked)" : " (no VK_EXT_memory_budget: ours only)");
+    if (evict) {
+      printf("evict    %u evictions, %u restorations\n", replay.budget.evictions, restorations);
+    }
+    memoryBudgetReport(&replay.budget, stdout);
+    if (allocated > warmAllocated) {
+      fprintf(stderr, "Device memory grew during the soak run!\n");
+      failed = true;
+    }
+    // The last eviction follows the last iteration, so nothing touches the target after it.
+    if (evict && (replay.budget.evictions == 0 || restorations + 1 != replay.budget.evictions)) {
+      fprintf(stderr, "The render target was not evicted and restored every iteration!\n");
+      failed = true;
+    }
+  }
+
+  free(cpuMs);
+  free(gpuMs);
+  vkDeviceWaitIdle(replay.device);
+  cleanup(&replay, &file);
+  captureClose(&file);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,166 @@
+#include "scene.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SCENE_WALLS_PER_AXIS 6
+
+// Unit cube centered on the origin: 4 vertices per face so every face has its own normal.
+// Faces are counter-clockwise seen from outside.
+static void createCube(Scene *scene) {
+  static const float axes[6][3][3] = {
+      // normal, u, v with u x v = normal
+      {{1, 0, 0}, {0, 0, -1}, {0, 1, 0}}, {{-1, 0, 0}, {0, 0, 1}, {0, 1, 0}},
+      {{0, 1, 0}, {1, 0, 0}, {0, 0, -1}}, {{0, -1, 0}, {1, 0, 0}, {0, 0, 1}},
+      {{0, 0, 1}, {1, 0, 0}, {0, 1, 0}},  {{0, 0, -1}, {-1, 0, 0}, {0, 1, 0}},
+  };
+  static const float corners[4][2] = {{-1, -1}, {1, -1}, {1, 1}, {-1, 1}};
+
+  scene->vertexCount = 24;
+  scene->indexCount = 36;
+  scene->vertices = malloc(sizeof(SceneVertex) * scene->vertexCount);
+  scene->indices = malloc(sizeof(uint16_t) * scene->indexCount);
+  if (scene->vertices == NULL || scene->indices == NULL) {
+    fprintf(stderr, "Out of memory while building the scene!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (uint32_t face = 0; face < 6; face++) {
+    const float *n = axes[face][0], *u = axes[face][1], *v = axes[face][2];
+    for (uint32_t c = 0; c < 4; c++) {
+      SceneVertex *vertex = &scene->vertices[face * 4 + c];
+      for (uint32_t i = 0; i < 3; i++) {
+        vertex->position[i] = 0.5f * (n[i] + corners[c][0] * u[i] + corners[c][1] * v[i]);
+        vertex->normal[i] = n[i];
+      }
+    }
+    uint16_t base = (uint16_t)(face * 4);
+    uint16_t *index = &scene->indices[face * 6];
+    index[0] = base;
+    index[1] = base + 1;
+    index[2] = base + 2;
+    index[3] = base;
+    index[4] = base + 2;
+    index[5] = base + 3;
+  }
+}
+
+// Deterministic so captures and runs are comparable.
+static float randomFloat(uint32_t *state) {
+  *state = *state * 1664525u + 1013904223u;
+  return (float)(*state >> 8) / 16777216.0f;
+}
+
+static SceneInstance makeInstance(Vec3 center, Vec3 size, float yaw, Vec4 color) {
+  Mat4 rotate = mat4RotateY(yaw);
+  Mat4 scale = mat4Scale(size);
+  Mat4 translate = mat4Translate(center);
+  Mat4 rotateScale = mat4Multiply(&rotate, &scale);
+  float radius = 0.5f * sqrtf(size.x * size.x + size.y * size.y + size.z * size.z);
+  return (SceneInstance){.model = mat4Multiply(&translate, &rotateScale),
+                         .color = color,
+                         .sphere = {center.x, center.y, center.z, radius}};
+}
+
+// Every fourth light is a spotlight pointing down at a slant; the others are point lights.
+static void createLights(Scene *scene, uint32_t lightCount) {
+  scene->lightCount = lightCount;
+  scene->lights = malloc(sizeof(SceneLight) * (lightCount ? lightCount : 1));
+  if (scene->lights == NULL) {
+    fprintf(stderr, "Out of memory while building the scene!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // pi r^2 lightCount = SCENE_LIGHTS_PER_POINT * area of the field
+  float area = 4.0f * scene->extent * scene->extent;
+  float range = sqrtf(SCENE_LIGHTS_PER_POINT * area / (3.14159265f * (float)(lightCount ? lightCount : 1)));
+  uint32_t seed = 7;
+  for (uint32_t i = 0; i < lightCount; i++) {
+    SceneLight *light = &scene->lights[i];
+    float x = scene->extent * (2.0f * randomFloat(&seed) - 1.0f);
+    float z = scene->extent * (2.0f * randomFloat(&seed) - 1.0f);
+    float y = 0.3f + 2.7f * randomFloat(&seed);
+    light->positionRange = (Vec4){x, y, z, range * (0.75f + 0.5f * randomFloat(&seed))};
+    float hue = 6.2831853f * randomFloat(&seed);
+    light->color = (Vec4){0.3f * (0.5f + 0.5f * cosf(hue)), 0.3f * (0.5f + 0.5f * cosf(hue + 2.094f)),
+                          0.3f * (0.5f + 0.5f * cosf(hue + 4.189f)), 0.0f};
+    if (i % 4 == 3) {
+      float yaw = 6.2831853f * randomFloat(&seed);
+      Vec3 direction = vec3Normalize(vec3(0.5f * cosf(yaw), -1.0f, 0.5f * sinf(yaw)));
+      light->spot = (Vec4){direction.x, direction.y, direction.z, 0.7f + 0.25f * randomFloat(&seed)};
+    } else {
+      light->spot = (Vec4){0.0f, -1.0f, 0.0f, -1.0f};
+    }
+  }
+}
+
+void sceneCreate(Scene *scene, uint32_t boxCount, uint32_t lightCount) {
+  *scene = (Scene){};
+  createCube(scene);
+
+  uint32_t side = 1;
+  while (side * side < boxCount) {
+    side++;
+  }
+  const float spacing = 1.5f;
+  scene->extent = 0.5f * spacing * (float)side;
+  scene->instanceCount = side * side + 2 * SCENE_WALLS_PER_AXIS;
+  scene->instances = malloc(sizeof(SceneInstance) * scene->instanceCount);
+  if (scene->instances == NULL) {
+    fprintf(stderr, "Out of memory while building the scene!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  uint32_t seed = 1;
+  uint32_t count = 0;
+  for (uint32_t z = 0; z < side; z++) {
+    for (uint32_t x = 0; x < side; x++) {
+      float height = 0.4f + 1.2f * randomFloat(&seed);
+      Vec3 center = vec3(-scene->extent + spacing * ((float)x + 0.5f), 0.5f * height,
+                         -scene->extent + spacing * ((float)z + 0.5f));
+      Vec4 color = {0.3f + 0.7f * randomFloat(&seed), 0.3f + 0.7f * randomFloat(&seed),
+                    0.3f + 0.7f * randomFloat(&seed), 1.0f};
+      scene->instances[count++] =
+          makeInstance(center, vec3(0.8f, height, 0.8f), 6.2831853f * randomFloat(&seed), color);
+    }
+  }
+
+  // A grid of walls, taller than the camera, so every view has large occluders close by.
+  const float wallHeight = 6.0f;
+  const Vec4 wallColor = {0.6f, 0.6f, 0.65f, 1.0f};
+  for (uint32_t i = 0; i < SCENE_WALLS_PER_AXIS; i++) {
+    float offset = -scene->extent + 2.0f * scene->extent * ((float)i + 0.5f) / SCENE_WALLS_PER_AXIS;
+    float length = 1.6f * scene->extent;
+    scene->instances[count++] = makeInstance(vec3(0.0f, 0.5f * wallHeight, offset),
+                                             vec3(length, wallHeight, 0.4f), 0.0f, wallColor);
+    scene->instances[count++] = makeInstance(vec3(offset, 0.5f * wallHeight, 0.0f),
+                                             vec3(0.4f, wallHeight, length), 0.0f, wallColor);
+  }
+
+  createLights(scene, lightCount);
+}
+
+void sceneDestroy(Scene *scene) {
+  free(scene->vertices);
+  free(scene->indices);
+  free(scene->instances);
+  free(scene->lights);
+  *scene = (Scene){};
+}
+
+Mat4 sceneView(const Scene *scene, double seconds) {
+  float angle = (float)fmod(seconds * 0.1, 6.283185307179586);
+  float radius = 0.7f * scene->extent;
+  Vec3 eye = vec3(radius * cosf(angle), 2.5f, radius * sinf(angle));
+  Vec3 center = vec3(0.0f, 1.5f, 0.0f);
+  return mat4LookAt(eye, center, vec3(0.0f, 1.0f, 0.0f));
+}
+
+float sceneZFar(const Scene *scene) { return 4.0f * scene->extent; }
+
+Mat4 sceneViewProj(const Scene *scene, double seconds, float aspect) {
+  Mat4 view = sceneView(scene, seconds);
+  Mat4 proj = mat4Perspective(SCENE_FOV_Y, aspect, SCENE_Z_NEAR, sceneZFar(scene));
+  return mat4Multiply(&proj, &view);
+}
@@ -0,0 +1,64 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdint.h>
+
+#include "vecmath.h"
+
+// Procedural test scene: a field of instanced boxes crossed by long walls, viewed by a camera
+// circling close to the ground. The walls hide most of the field from any position, which is
+// what depth pre-pass and occlusion culling are measured against.
+
+typedef struct SceneVertex {
+  float position[3];
+  float normal[3];
+} SceneVertex;
+
+// Per-instance vertex input (binding 1) and the element type of the culling shader's std430
+// instance buffers, so the layout must not change without updating shaders/cull.comp.
+typedef struct SceneInstance {
+  Mat4 model;
+  Vec4 color;
+  Vec4 sphere; // world-space bounding sphere: center xyz, radius w
+} SceneInstance;
+
+_Static_assert(sizeof(SceneInstance) == 96, "SceneInstance must match the std430 layout in cull.comp");
+
+// Element type of the light buffer of shaders/cluster.comp and shaders/shader.frag (std430).
+typedef struct SceneLight {
+  Vec4 positionRange; // world-space position xyz, range w: the light reaches no farther
+  Vec4 color;         // linear rgb, w unused
+  Vec4 spot;          // direction xyz, w: cosine of the cone's half angle; -1 for point lights
+} SceneLight;
+
+_Static_assert(sizeof(SceneLight) == 48, "SceneLight must match the std430 layout in cluster.comp");
+
+// Camera of sceneViewProj().
+#define SCENE_FOV_Y 1.0f // radians
+#define SCENE_Z_NEAR 0.1f
+
+typedef struct Scene {
+  uint32_t vertexCount;
+  SceneVertex *vertices;
+  uint32_t indexCount;
+  uint16_t *indices;
+  uint32_t instanceCount;
+  SceneInstance *instances;
+  float extent; // the field covers [-extent, extent] on x and z
+  uint32_t lightCount;
+  SceneLight *lights;
+} Scene;
+
+// `boxCount` boxes (rounded up to a square grid) plus the walls, and `lightCount` point and
+// spot lights scattered over the field. Their ranges are such that any point on the field is
+// reached by about SCENE_LIGHTS_PER_POINT of them.
+#define SCENE_LIGHTS_PER_POINT 16.0f
+void sceneCreate(Scene *scene, uint32_t boxCount, uint32_t lightCount);
+void sceneDestroy(Scene *scene);
+// Camera position at `seconds`, as a view-projection matrix for the given aspect ratio.
+Mat4 sceneViewProj(const Scene *scene, double seconds, float aspect);
+// The view part of sceneViewProj().
+Mat4 sceneView(const Scene *scene, double seconds);
+float sceneZFar(const Scene *scene);
+
+#endif
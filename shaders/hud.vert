@@ -0,0 +1,19 @@
+#version 450
+
+// HUD quads in pixels from the top-left corner; see hud.h.
+layout(push_constant) uniform PushConstants {
+    vec2 pixelToNdc;
+} pc;
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec2 inUv;
+layout(location = 2) in vec4 inColor;
+
+layout(location = 0) out vec2 fragUv;
+layout(location = 1) out vec4 fragColor;
+
+void main() {
+    gl_Position = vec4(inPosition * pc.pixelToNdc - 1.0, 0.0, 1.0);
+    fragUv = inUv;
+    fragColor = inColor;
+}
@@ -1,9 +1,125 @@
 #version 450
 
+// Shading features. A specialized pipeline has them as constants, so the compiler drops the
+// disabled paths and unrolls the light loop; with SPECIALIZED false the same code reads them
+// from push constants and branches at run time. The bits match SCENE_FEATURE_* in main.c.
+layout(constant_id = 0) const bool SPECIALIZED = true;
+layout(constant_id = 1) const uint FEATURES = 3u;
+layout(constant_id = 2) const uint LIGHT_COUNT = 0u;
+
+const uint FEATURE_INSTANCE_COLOR = 1u; // per-instance color; otherwise a constant grey
+const uint FEATURE_LIGHTING = 2u;       // directional plus point lights; otherwise unlit
+const uint MAX_LIGHTS = 64u;
+
+// Built with -DLIGHT_BUFFER (frag_lights.spv) the scene's lights can come from a buffer
+// instead: every one of them per fragment, or only those the cluster pass (cluster.comp)
+// listed for the fragment's cluster. They replace the ring of point lights.
+#ifdef LIGHT_BUFFER
+const uint FEATURE_LIGHT_BUFFER = 4u;
+const uint FEATURE_CLUSTERED = 8u;
+
+struct Light {
+    vec4 positionRange; // world-space position xyz, range w
+    vec4 color;
+    vec4 spot; // direction xyz, cosine of the cone's half angle w (-1 for point lights)
+};
+
+layout(set = 0, binding = 0) uniform ClusterParams {
+    mat4 view;
+    vec2 tanHalfFov;
+    float zNear;
+    float zFar;
+    vec2 tileScale;
+    float sliceScale;
+    float sliceBias;
+    uvec3 gridSize;
+    uint lightCount;
+    float rangeScale;
+    uint maxClusterLights;
+} params;
+
+layout(std430, set = 0, binding = 1) readonly buffer Lights {
+    Light lights[];
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer Counts {
+    uint counts[];
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer Indices {
+    uint indices[];
+};
+#endif
+
+layout(push_constant) uniform PushConstants {
+    mat4 viewProj;
+    uint features;
+    uint lightCount;
+    float lightRadius; // point lights circle the origin at this distance
+} pc;
+
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec3 fragNormal;
+layout(location = 2) in vec3 fragPosition;
 
 layout(location = 0) out vec4 outColor;
 
+const vec3 lightDir = vec3(0.371, 0.928, 0.278);
+
+#ifdef LIGHT_BUFFER
+uint clusterIndex() {
+    // Depth along the view direction, from the [0, 1] window depth of the perspective.
+    float depth = params.zNear * params.zFar / (params.zFar - gl_FragCoord.z * (params.zFar - params.zNear));
+    float slice = log(depth) * params.sliceScale - params.sliceBias;
+    uint z = uint(clamp(slice, 0.0, float(params.gridSize.z - 1u)));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy * params.tileScale), params.gridSize.xy - 1u);
+    return tile.x + params.gridSize.x * (tile.y + params.gridSize.y * z);
+}
+
+vec3 shadeLight(Light light, vec3 normal) {
+    vec3 toLight = light.positionRange.xyz - fragPosition;
+    float distance2 = dot(toLight, toLight);
+    float range = light.positionRange.w * params.rangeScale;
+    // Reaches exactly zero at the range, so lights outside a cluster's list contribute nothing.
+    float falloff = clamp(1.0 - distance2 / (range * range), 0.0, 1.0);
+    vec3 direction = toLight * inversesqrt(distance2);
+    float cone = light.spot.w <= -1.0 ? 1.0 : smoothstep(light.spot.w, mix(light.spot.w, 1.0, 0.2),
+                                                         dot(-direction, light.spot.xyz));
+    return light.color.rgb * (falloff * falloff * cone * max(dot(normal, direction), 0.0));
+}
+#endif
+
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    uint features = SPECIALIZED ? FEATURES : pc.features;
+    uint lightCount = min(SPECIALIZED ? LIGHT_COUNT : pc.lightCount, MAX_LIGHTS);
+
+    vec3 albedo = (features & FEATURE_INSTANCE_COLOR) != 0u ? fragColor : vec3(0.7);
+    vec3 light = vec3(1.0);
+    if ((features & FEATURE_LIGHTING) != 0u) {
+        vec3 normal = normalize(fragNormal);
+        light = vec3(0.25 + 0.75 * max(dot(normal, lightDir), 0.0));
+#ifdef LIGHT_BUFFER
+        if ((features & FEATURE_CLUSTERED) != 0u) {
+            uint cluster = clusterIndex();
+            uint base = cluster * params.maxClusterLights;
+            for (uint i = 0u; i < counts[cluster]; i++) {
+                light += shadeLight(lights[indices[base + i]], normal);
+            }
+            lightCount = 0u;
+        } else if ((features & FEATURE_LIGHT_BUFFER) != 0u) {
+            for (uint i = 0u; i < params.lightCount; i++) {
+                light += shadeLight(lights[i], normal);
+            }
+            lightCount = 0u;
+        }
+#endif
+        for (uint i = 0u; i < lightCount; i++) {
+            float angle = 6.2831853 * float(i) / float(lightCount);
+            vec3 toLight = vec3(pc.lightRadius * cos(angle), 2.0, pc.lightRadius * sin(angle)) - fragPosition;
+            float distance2 = dot(toLight, toLight);
+            vec3 color = 0.5 + 0.5 * cos(angle + vec3(0.0, 2.094, 4.189));
+            light += color * max(dot(normal, toLight) * inversesqrt(distance2), 0.0) / (1.0 + 0.1 * distance2);
+        }
+    }
+    outColor = vec4(albedo * light, 1.0);
 }
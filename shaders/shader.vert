@@ -1,20 +1,30 @@
 #version 450
 
-layout(location = 0) out vec3 fragColor;
+// Shared with shader.frag; see ScenePushConstants in main.c.
+layout(push_constant) uniform PushConstants {
+    mat4 viewProj;
+    uint features;
+    uint lightCount;
+    float lightRadius;
+} pc;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in mat4 inModel; // locations 2-5, per instance
+layout(location = 6) in vec4 inColor;
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragNormal;
+layout(location = 2) out vec3 fragPosition;
 
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+// The depth pre-pass and the color pass must produce bit-identical depth for EQUAL testing.
+invariant gl_Position;
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
+    vec4 position = inModel * vec4(inPosition, 1.0);
+    gl_Position = pc.viewProj * position;
+    // Models are rotation times axis-aligned scale, so face normals keep their direction.
+    fragNormal = mat3(inModel) * inNormal;
+    fragColor = inColor.rgb;
+    fragPosition = position.xyz;
 }
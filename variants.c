@@ -0,0 +1,222 @@
+#include "variants.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define VARIANTS_INITIAL_CAPACITY 16
+
+static double nowMs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec * 1e-6;
+}
+
+// Feature masks differ in a few low bits; the finalizer of MurmurHash3 spreads them over
+// the whole word.
+static uint32_t hashKey(uint32_t key) {
+  key ^= key >> 16;
+  key *= 0x85ebca6bu;
+  key ^= key >> 13;
+  key *= 0xc2b2ae35u;
+  key ^= key >> 16;
+  return key;
+}
+
+static PipelineVariant **findSlot(PipelineVariant **slots, uint32_t capacity, uint32_t key) {
+  uint32_t index = hashKey(key) & (capacity - 1);
+  while (slots[index] && slots[index]->key != key) {
+    index = (index + 1) & (capacity - 1);
+  }
+  return &slots[index];
+}
+
+// The old table stays in the arena until destruction; it is small and tables only grow.
+static void grow(PipelineVariants *variants) {
+  uint32_t capacity = variants->capacity ? 2 * variants->capacity : VARIANTS_INITIAL_CAPACITY;
+  PipelineVariant **slots = arenaPushArray(&variants->arena, PipelineVariant *, capacity);
+  memset(slots, 0, sizeof(PipelineVariant *) * capacity);
+  for (uint32_t i = 0; i < variants->capacity; i++) {
+    if (variants->slots[i]) {
+      *findSlot(slots, capacity, variants->slots[i]->key) = variants->slots[i];
+    }
+  }
+  variants->slots = slots;
+  variants->capacity = capacity;
+}
+
+static void optimizeJob(void *data) {
+  PipelineVariant *variant = data;
+  PipelineVariants *variants = variant->owner;
+  double start = nowMs();
+  variant->optimizedPipeline =
+      variants->optimize(variants->compileData, variant->key, variants->cache, variant->library);
+  variant->optimizeMs = nowMs() - start;
+  atomic_store_explicit(&variant->optimized, true, memory_order_release);
+}
+
+// Returns the file's contents if its header matches this device, otherwise NULL.
+static void *loadCache(const DeviceCaps *caps, const char *path, size_t *size) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+  fseek(file, 0L, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0L, SEEK_SET);
+
+  void *data = NULL;
+  VkPipelineCacheHeaderVersionOne header;
+  if (length >= (long)sizeof(header)) {
+    data = malloc((size_t)length);
+    if (fread(data, (size_t)length, 1, file) != 1) {
+      free(data);
+      data = NULL;
+    }
+  }
+  fclose(file);
+  if (data == NULL) {
+    return NULL;
+  }
+
+  // A driver rejects data from another device or driver build, but a mismatch is cheaper
+  // to detect here and worth reporting.
+  memcpy(&header, data, sizeof(header));
+  if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+      header.vendorID != caps->properties.vendorID || header.deviceID != caps->properties.deviceID ||
+      memcmp(header.pipelineCacheUUID, caps->properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+    fprintf(stderr, "Pipeline cache %s is from another device or driver; ignored.\n", path);
+    free(data);
+    return NULL;
+  }
+  *size = (size_t)length;
+  return data;
+}
+
+void pipelineVariantsCreate(PipelineVariants *variants, const DeviceCaps *caps, VkDevice device,
+                            const VkAllocationCallbacks *pAllocator, PipelineVariantCompile compile,
+                            PipelineVariantOptimize optimize, void *compileData, JobSystem *js,
+                            const char *cachePath) {
+  *variants = (PipelineVariants){.caps = caps,
+                                 .device = device,
+                                 .pAllocator = pAllocator,
+                                 .compile = compile,
+                                 .optimize = js && jobSystemThreadCount(js) > 1 ? optimize : NULL,
+                                 .compileData = compileData,
+                                 .js = js};
+  arenaInit(&variants->arena, sizeof(PipelineVariant) * 2 * VARIANTS_INITIAL_CAPACITY);
+  grow(variants);
+
+  size_t size = 0;
+  void *data = cachePath ? loadCache(caps, cachePath, &size) : NULL;
+  VkPipelineCacheCreateInfo cacheInfo = {.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+                                         .initialDataSize = size,
+                                         .pInitialData = data};
+  if (vkCreatePipelineCache(device, &cacheInfo, pAllocator, &variants->cache) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create pipeline cache!\n");
+    exit(EXIT_FAILURE);
+  }
+  variants->loadedCacheSize = size;
+  free(data);
+}
+
+VkPipeline pipelineVariantsGet(PipelineVariants *variants, uint32_t key) {
+  variants->lookups++;
+  PipelineVariant **slot = findSlot(variants->slots, variants->capacity, key);
+  PipelineVariant *variant = *slot;
+  if (variant) {
+    if (variant->retiredPipeline == VK_NULL_HANDLE &&
+        atomic_load_explicit(&variant->optimized, memory_order_acquire)) {
+      variant->retiredPipeline = variant->pipeline;
+      variant->pipeline = variant->optimizedPipeline;
+      variants->optimizedCount++;
+    }
+    return variant->pipeline;
+  }
+
+  variant = arenaPushArray(&variants->arena, PipelineVariant, 1);
+  *variant = (PipelineVariant){.owner = variants, .key = key};
+  double start = nowMs();
+  variant->pipeline = variants->compile(variants->compileData, key, variants->cache, &variant->library);
+  variant->compileMs = nowMs() - start;
+  variants->compileMs += variant->compileMs;
+
+  if (2 * (variants->count + 1) > variants->capacity) {
+    grow(variants);
+    slot = findSlot(variants->slots, variants->capacity, key);
+  }
+  *slot = variant;
+  variants->count++;
+
+  if (variants->optimize) {
+    jobRun(variants->js, &(JobDecl){optimizeJob, variant}, 1, &variants->optimizeJobs);
+  }
+  return variant->pipeline;
+}
+
+bool pipelineVariantsHas(const PipelineVariants *variants, uint32_t key) {
+  return *findSlot(variants->slots, variants->capacity, key) != NULL;
+}
+
+void pipelineVariantsReport(const PipelineVariants *variants, FILE *out) {
+  fprintf(out, "Pipeline variants: %u compiled in %.1f ms, %u optimized, %llu lookups", variants->count,
+          variants->compileMs, variants->optimizedCount, (unsigned long long)variants->lookups);
+  if (variants->loadedCacheSize) {
+    fprintf(out, ", %zu bytes of pipeline cache loaded", variants->loadedCacheSize);
+  }
+  fprintf(out, "\n");
+  for (uint32_t i = 0; i < variants->capacity; i++) {
+    const PipelineVariant *variant = variants->slots[i];
+    if (variant == NULL) {
+      continue;
+    }
+    fprintf(out, "  0x%08x: %.2f ms", variant->key, variant->compileMs);
+    if (variant->retiredPipeline) {
+      fprintf(out, ", optimized in %.2f ms", variant->optimizeMs);
+    }
+    fprintf(out, "\n");
+  }
+}
+
+static void saveCache(PipelineVariants *variants, const char *path) {
+  size_t size = 0;
+  if (vkGetPipelineCacheData(variants->device, variants->cache, &size, NULL) != VK_SUCCESS || size == 0) {
+    return;
+  }
+  void *data = malloc(size);
+  if (vkGetPipelineCacheData(variants->device, variants->cache, &size, data) == VK_SUCCESS) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL || fwrite(data, size, 1, file) != 1) {
+      fprintf(stderr, "Failed to write pipeline cache %s\n", path);
+    }
+    if (file) {
+      fclose(file);
+    }
+  }
+  free(data);
+}
+
+void pipelineVariantsDestroy(PipelineVariants *variants, const char *cachePath) {
+  if (variants->optimize) {
+    jobWait(variants->js, &variants->optimizeJobs);
+  }
+  if (cachePath) {
+    saveCache(variants, cachePath);
+  }
+  for (uint32_t i = 0; i < variants->capacity; i++) {
+    PipelineVariant *variant = variants->slots[i];
+    if (variant == NULL) {
+      continue;
+    }
+    // An optimized pipeline that finished after the last lookup was never swapped in.
+    if (variant->retiredPipeline == VK_NULL_HANDLE) {
+      vkDestroyPipeline(variants->device, variant->optimizedPipeline, variants->pAllocator);
+    }
+    vkDestroyPipeline(variants->device, variant->pipeline, variants->pAllocator);
+    vkDestroyPipeline(variants->device, variant->retiredPipeline, variants->pAllocator);
+    vkDestroyPipeline(variants->device, variant->library, variants->pAllocator);
+  }
+  vkDestroyPipelineCache(variants->device, variants->cache, variants->pAllocator);
+  arenaDestroy(&variants->arena);
+  *variants = (PipelineVariants){};
+}
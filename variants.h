@@ -0,0 +1,92 @@
+#ifndef VARIANTS_H
+#define VARIANTS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vulkan/vulkan.h>
+
+#include "devicecaps.h"
+#include "hostalloc.h"
+#include "jobs.h"
+
+// Pipeline variants: pipelines that differ only in a 32-bit key, usually the values of their
+// shaders' specialization constants. A variant is compiled the first time its key is asked for
+// and kept in an open-addressing hash table; every compile goes through one VkPipelineCache,
+// which can be loaded from and saved to a file so later runs skip the driver's compile too.
+//
+// With an optimize callback, the first compile may be a quick one (a fast pipeline library
+// link) and a better pipeline is built on a job system worker; lookups switch to it once it
+// is ready, without ever waiting for it.
+
+// Builds the pipeline for `key`. Must pass `cache` to vkCreate*Pipelines. May store a
+// per-variant pipeline library in `library` for the optimize step; it lives as long as the
+// variant.
+typedef VkPipeline (*PipelineVariantCompile)(void *data, uint32_t key, VkPipelineCache cache,
+                                             VkPipeline *library);
+// Builds the replacement for a compiled variant. Runs on a worker thread, concurrently with
+// lookups and compiles of other variants.
+typedef VkPipeline (*PipelineVariantOptimize)(void *data, uint32_t key, VkPipelineCache cache,
+                                              VkPipeline library);
+
+typedef struct PipelineVariants PipelineVariants;
+
+typedef struct PipelineVariant {
+  PipelineVariants *owner;
+  uint32_t key;
+  VkPipeline pipeline; // what lookups return
+  VkPipeline library;
+  // Written by the optimize job before it sets `optimized`; swapped in by the next lookup.
+  VkPipeline optimizedPipeline;
+  atomic_bool optimized;
+  // The pipeline replaced by optimizedPipeline. Frames in flight may still use it, so it is
+  // only destroyed with the variant.
+  VkPipeline retiredPipeline;
+  double compileMs;
+  double optimizeMs;
+} PipelineVariant;
+
+struct PipelineVariants {
+  const DeviceCaps *caps;
+  VkDevice device;
+  const VkAllocationCallbacks *pAllocator;
+  PipelineVariantCompile compile;
+  PipelineVariantOptimize optimize; // NULL: compiled pipelines are final
+  void *compileData;
+  JobSystem *js;
+  JobCounter optimizeJobs;
+  VkPipelineCache cache;
+  size_t loadedCacheSize; // bytes accepted from the cache file; 0 if none
+
+  uint32_t capacity; // power of two, at most half full
+  uint32_t count;
+  PipelineVariant **slots; // NULL: empty slot; variants themselves never move
+  Arena arena;
+
+  uint64_t lookups;
+  uint32_t optimizedCount; // variants whose optimized pipeline is in use
+  double compileMs;        // total of all variants
+};
+
+// `cachePath` (optional) is read if it holds data for this device; a missing or foreign file
+// just starts an empty cache. `optimize` (optional) runs as a job on `js`; it is dropped
+// when the job system has no worker threads, since the owning thread only runs jobs while
+// it waits on a counter.
+void pipelineVariantsCreate(PipelineVariants *variants, const DeviceCaps *caps, VkDevice device,
+                            const VkAllocationCallbacks *pAllocator, PipelineVariantCompile compile,
+                            PipelineVariantOptimize optimize, void *compileData, JobSystem *js,
+                            const char *cachePath);
+// Compiles the variant on first use, and queues its optimize job; later calls are a hash
+// lookup that picks up the optimized pipeline once its job has finished.
+VkPipeline pipelineVariantsGet(PipelineVariants *variants, uint32_t key);
+// Whether `key` is already compiled.
+bool pipelineVariantsHas(const PipelineVariants *variants, uint32_t key);
+// Compile and optimize time of every variant so far, in the order of the table.
+void pipelineVariantsReport(const PipelineVariants *variants, FILE *out);
+// Waits for outstanding optimize jobs, writes the pipeline cache to `cachePath` (optional)
+// and destroys every variant.
+void pipelineVariantsDestroy(PipelineVariants *variants, const char *cachePath);
+
+#endif
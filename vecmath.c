@@ -0,0 +1,483 @@
+#include "vecmath.h"
+
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VECMATH_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+Vec3 vec3(float x, float y, float z) { return (Vec3){x, y, z}; }
+
+Vec3 vec3Sub(Vec3 a, Vec3 b) { return (Vec3){a.x - b.x, a.y - b.y, a.z - b.z}; }
+
+Vec3 vec3Cross(Vec3 a, Vec3 b) {
+  return (Vec3){a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+float vec3Dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+Vec3 vec3Normalize(Vec3 v) {
+  float len = sqrtf(vec3Dot(v, v));
+  if (len == 0.0f) {
+    return v;
+  }
+  return (Vec3){v.x / len, v.y / len, v.z / len};
+}
+
+Mat4 mat4Identity(void) {
+  Mat4 r = {.m = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f}};
+  return r;
+}
+
+Mat4 mat4Multiply(const Mat4 *a, const Mat4 *b) {
+  Mat4 r;
+  for (int c = 0; c < 4; c++) {
+    for (int row = 0; row < 4; row++) {
+      r.m[c * 4 + row] = a->m[0 * 4 + row] * b->m[c * 4 + 0] + a->m[1 * 4 + row] * b->m[c * 4 + 1] +
+                         a->m[2 * 4 + row] * b->m[c * 4 + 2] + a->m[3 * 4 + row] * b->m[c * 4 + 3];
+    }
+  }
+  return r;
+}
+
+Mat4 mat4Translate(Vec3 t) {
+  Mat4 r = mat4Identity();
+  r.m[12] = t.x;
+  r.m[13] = t.y;
+  r.m[14] = t.z;
+  return r;
+}
+
+Mat4 mat4Scale(Vec3 s) {
+  Mat4 r = mat4Identity();
+  r.m[0] = s.x;
+  r.m[5] = s.y;
+  r.m[10] = s.z;
+  return r;
+}
+
+Mat4 mat4RotateY(float radians) {
+  Mat4 r = mat4Identity();
+  float c = cosf(radians), s = sinf(radians);
+  r.m[0] = c;
+  r.m[2] = -s;
+  r.m[8] = s;
+  r.m[10] = c;
+  return r;
+}
+
+Mat4 mat4RotateZ(float radians) {
+  Mat4 r = mat4Identity();
+  float c = cosf(radians), s = sinf(radians);
+  r.m[0] = c;
+  r.m[1] = s;
+  r.m[4] = -s;
+  r.m[5] = c;
+  return r;
+}
+
+Mat4 mat4LookAt(Vec3 eye, Vec3 center, Vec3 up) {
+  Vec3 f = vec3Normalize(vec3Sub(center, eye));
+  Vec3 s = vec3Normalize(vec3Cross(f, up));
+  Vec3 u = vec3Cross(s, f);
+
+  Mat4 r = mat4Identity();
+  r.m[0] = s.x;
+  r.m[4] = s.y;
+  r.m[8] = s.z;
+  r.m[1] = u.x;
+  r.m[5] = u.y;
+  r.m[9] = u.z;
+  r.m[2] = -f.x;
+  r.m[6] = -f.y;
+  r.m[10] = -f.z;
+  r.m[12] = -vec3Dot(s, eye);
+  r.m[13] = -vec3Dot(u, eye);
+  r.m[14] = vec3Dot(f, eye);
+  return r;
+}
+
+Mat4 mat4Perspective(float fovyRadians, float aspect, float zNear, float zFar) {
+  float f = 1.0f / tanf(fovyRadians * 0.5f);
+
+  Mat4 r = {};
+  r.m[0] = f / aspect;
+  r.m[5] = -f; // Vulkan clip space has y pointing down
+  r.m[10] = zFar / (zNear - zFar);
+  r.m[11] = -1.0f;
+  r.m[14] = (zNear * zFar) / (zNear - zFar);
+  return r;
+}
+
+Vec4 mat4MulVec4(const Mat4 *m, Vec4 v) {
+  const float *a = m->m;
+  return (Vec4){a[0] * v.x + a[4] * v.y + a[8] * v.z + a[12] * v.w,
+                a[1] * v.x + a[5] * v.y + a[9] * v.z + a[13] * v.w,
+                a[2] * v.x + a[6] * v.y + a[10] * v.z + a[14] * v.w,
+                a[3] * v.x + a[7] * v.y + a[11] * v.z + a[15] * v.w};
+}
+
+static Vec4 normalizePlane(float a, float b, float c, float d) {
+  float len = sqrtf(a * a + b * b + c * c);
+  return (Vec4){a / len, b / len, c / len, d / len};
+}
+
+Frustum frustumFromMatrix(const Mat4 *viewProj) {
+  const float *m = viewProj->m;
+  // Row r of a column-major matrix is (m[r], m[4 + r], m[8 + r], m[12 + r]).
+#define ROW(r, i) m[(i) * 4 + (r)]
+  Frustum f;
+  f.planes[0] = normalizePlane(ROW(3, 0) + ROW(0, 0), ROW(3, 1) + ROW(0, 1), ROW(3, 2) + ROW(0, 2),
+                               ROW(3, 3) + ROW(0, 3));
+  f.planes[1] = normalizePlane(ROW(3, 0) - ROW(0, 0), ROW(3, 1) - ROW(0, 1), ROW(3, 2) - ROW(0, 2),
+                               ROW(3, 3) - ROW(0, 3));
+  f.planes[2] = normalizePlane(ROW(3, 0) + ROW(1, 0), ROW(3, 1) + ROW(1, 1), ROW(3, 2) + ROW(1, 2),
+                               ROW(3, 3) + ROW(1, 3));
+  f.planes[3] = normalizePlane(ROW(3, 0) - ROW(1, 0), ROW(3, 1) - ROW(1, 1), ROW(3, 2) - ROW(1, 2),
+                               ROW(3, 3) - ROW(1, 3));
+  // Depth range is [0, 1], so the near plane is just the third row.
+  f.planes[4] = normalizePlane(ROW(2, 0), ROW(2, 1), ROW(2, 2), ROW(2, 3));
+  f.planes[5] = normalizePlane(ROW(3, 0) - ROW(2, 0), ROW(3, 1) - ROW(2, 1), ROW(3, 2) - ROW(2, 2),
+                               ROW(3, 3) - ROW(2, 3));
+#undef ROW
+  return f;
+}
+
+// Scalar kernels
+
+static void mat4MulBatchScalar(const Mat4 *a, const Mat4 *b, Mat4 *out, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    out[i] = mat4Multiply(a, &b[i]);
+  }
+}
+
+static void boundingSpheresBatchScalar(const Mat4 *models, const SpheresSoA *local, SpheresSoA *world) {
+  for (size_t i = 0; i < local->count; i++) {
+    const float *m = models[i].m;
+    float x = local->x[i], y = local->y[i], z = local->z[i];
+
+    world->x[i] = m[0] * x + m[4] * y + m[8] * z + m[12];
+    world->y[i] = m[1] * x + m[5] * y + m[9] * z + m[13];
+    world->z[i] = m[2] * x + m[6] * y + m[10] * z + m[14];
+
+    float sx = m[0] * m[0] + m[1] * m[1] + m[2] * m[2];
+    float sy = m[4] * m[4] + m[5] * m[5] + m[6] * m[6];
+    float sz = m[8] * m[8] + m[9] * m[9] + m[10] * m[10];
+    float s = sx > sy ? sx : sy;
+    s = s > sz ? s : sz;
+    world->radius[i] = local->radius[i] * sqrtf(s);
+  }
+  world->count = local->count;
+}
+
+static size_t cullSpheresBatchScalar(const Frustum *frustum, const SpheresSoA *spheres, uint8_t *visible) {
+  size_t visibleCount = 0;
+  for (size_t i = 0; i < spheres->count; i++) {
+    uint8_t inside = 1;
+    for (int p = 0; p < 6; p++) {
+      const Vec4 *pl = &frustum->planes[p];
+      float d = pl->x * spheres->x[i] + pl->y * spheres->y[i] + pl->z * spheres->z[i] + pl->w;
+      if (d < -spheres->radius[i]) {
+        inside = 0;
+        break;
+      }
+    }
+    visible[i] = inside;
+    visibleCount += inside;
+  }
+  return visibleCount;
+}
+
+static const VecmathKernels scalarKernels = {VECMATH_ISA_SCALAR, mat4MulBatchScalar, boundingSpheresBatchScalar,
+                                             cullSpheresBatchScalar};
+
+#ifdef VECMATH_X86
+
+// SSE kernels (4 lanes)
+
+__attribute__((target("sse2"))) static void mat4MulBatchSse(const Mat4 *a, const Mat4 *b, Mat4 *out,
+                                                            size_t count) {
+  __m128 a0 = _mm_load_ps(&a->m[0]);
+  __m128 a1 = _mm_load_ps(&a->m[4]);
+  __m128 a2 = _mm_load_ps(&a->m[8]);
+  __m128 a3 = _mm_load_ps(&a->m[12]);
+
+  for (size_t i = 0; i < count; i++) {
+    const float *bm = b[i].m;
+    for (int c = 0; c < 4; c++) {
+      __m128 r = _mm_mul_ps(a0, _mm_set1_ps(bm[c * 4 + 0]));
+      r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(bm[c * 4 + 1])));
+      r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(bm[c * 4 + 2])));
+      r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(bm[c * 4 + 3])));
+      _mm_store_ps(&out[i].m[c * 4], r);
+    }
+  }
+}
+
+__attribute__((target("sse2"))) static void boundingSpheresBatchSse(const Mat4 *models, const SpheresSoA *local,
+                                                                    SpheresSoA *world) {
+  size_t count = local->count;
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    // Transpose each column of four matrices so that lane k holds object i + k.
+    __m128 col[4][4];
+    for (int c = 0; c < 4; c++) {
+      col[c][0] = _mm_load_ps(&models[i + 0].m[c * 4]);
+      col[c][1] = _mm_load_ps(&models[i + 1].m[c * 4]);
+      col[c][2] = _mm_load_ps(&models[i + 2].m[c * 4]);
+      col[c][3] = _mm_load_ps(&models[i + 3].m[c * 4]);
+      _MM_TRANSPOSE4_PS(col[c][0], col[c][1], col[c][2], col[c][3]);
+    }
+
+    __m128 x = _mm_loadu_ps(&local->x[i]);
+    __m128 y = _mm_loadu_ps(&local->y[i]);
+    __m128 z = _mm_loadu_ps(&local->z[i]);
+
+    for (int r = 0; r < 3; r++) {
+      __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(col[0][r], x), _mm_mul_ps(col[1][r], y)),
+                            _mm_add_ps(_mm_mul_ps(col[2][r], z), col[3][r]));
+      float *dst = r == 0 ? world->x : r == 1 ? world->y : world->z;
+      _mm_storeu_ps(&dst[i], v);
+    }
+
+    __m128 scale[3];
+    for (int c = 0; c < 3; c++) {
+      scale[c] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(col[c][0], col[c][0]), _mm_mul_ps(col[c][1], col[c][1])),
+                            _mm_mul_ps(col[c][2], col[c][2]));
+    }
+    __m128 s = _mm_max_ps(_mm_max_ps(scale[0], scale[1]), scale[2]);
+    _mm_storeu_ps(&world->radius[i], _mm_mul_ps(_mm_loadu_ps(&local->radius[i]), _mm_sqrt_ps(s)));
+  }
+
+  SpheresSoA tailLocal = {local->x + i, local->y + i, local->z + i, local->radius + i, count - i};
+  SpheresSoA tailWorld = {world->x + i, world->y + i, world->z + i, world->radius + i, 0};
+  boundingSpheresBatchScalar(models + i, &tailLocal, &tailWorld);
+  world->count = count;
+}
+
+__attribute__((target("sse2"))) static size_t cullSpheresBatchSse(const Frustum *frustum,
+                                                                  const SpheresSoA *spheres, uint8_t *visible) {
+  __m128 px[6], py[6], pz[6], pw[6];
+  for (int p = 0; p < 6; p++) {
+    px[p] = _mm_set1_ps(frustum->planes[p].x);
+    py[p] = _mm_set1_ps(frustum->planes[p].y);
+    pz[p] = _mm_set1_ps(frustum->planes[p].z);
+    pw[p] = _mm_set1_ps(frustum->planes[p].w);
+  }
+
+  size_t count = spheres->count;
+  size_t visibleCount = 0;
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(&spheres->x[i]);
+    __m128 y = _mm_loadu_ps(&spheres->y[i]);
+    __m128 z = _mm_loadu_ps(&spheres->z[i]);
+    __m128 negR = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres->radius[i]));
+
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int p = 0; p < 6; p++) {
+      __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], x), _mm_mul_ps(py[p], y)),
+                            _mm_add_ps(_mm_mul_ps(pz[p], z), pw[p]));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+    }
+
+    int bits = _mm_movemask_ps(inside);
+    for (int k = 0; k < 4; k++) {
+      visible[i + k] = (bits >> k) & 1;
+    }
+    visibleCount += __builtin_popcount(bits);
+  }
+
+  SpheresSoA tail = {spheres->x + i, spheres->y + i, spheres->z + i, spheres->radius + i, count - i};
+  return visibleCount + cullSpheresBatchScalar(frustum, &tail, visible + i);
+}
+
+static const VecmathKernels sseKernels = {VECMATH_ISA_SSE, mat4MulBatchSse, boundingSpheresBatchSse,
+                                          cullSpheresBatchSse};
+
+// AVX2 + FMA kernels (8 lanes)
+
+__attribute__((target("avx2,fma"))) static void mat4MulBatchAvx2(const Mat4 *a, const Mat4 *b, Mat4 *out,
+                                                                 size_t count) {
+  // Each column of `a` is duplicated into both 128-bit lanes so two output columns are
+  // produced per iteration.
+  __m256 a0 = _mm256_broadcast_ps((const __m128 *)&a->m[0]);
+  __m256 a1 = _mm256_broadcast_ps((const __m128 *)&a->m[4]);
+  __m256 a2 = _mm256_broadcast_ps((const __m128 *)&a->m[8]);
+  __m256 a3 = _mm256_broadcast_ps((const __m128 *)&a->m[12]);
+
+  for (size_t i = 0; i < count; i++) {
+    for (int c = 0; c < 4; c += 2) {
+      __m256 bc = _mm256_loadu_ps(&b[i].m[c * 4]);
+      __m256 r = _mm256_mul_ps(a0, _mm256_permute_ps(bc, 0x00));
+      r = _mm256_fmadd_ps(a1, _mm256_permute_ps(bc, 0x55), r);
+      r = _mm256_fmadd_ps(a2, _mm256_permute_ps(bc, 0xAA), r);
+      r = _mm256_fmadd_ps(a3, _mm256_permute_ps(bc, 0xFF), r);
+      _mm256_storeu_ps(&out[i].m[c * 4], r);
+    }
+  }
+}
+
+__attribute__((target("avx2,fma"))) static void
+boundingSpheresBatchAvx2(const Mat4 *models, const SpheresSoA *local, SpheresSoA *world) {
+  // Matrices are 16 floats apart, so one gather per element picks it from 8 objects.
+  const __m256i stride = _mm256_setr_epi32(0, 16, 32, 48, 64, 80, 96, 112);
+
+  size_t count = local->count;
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const float *base = models[i].m;
+    __m256 m[16];
+    for (int e = 0; e < 16; e++) {
+      if ((e & 3) == 3) {
+        continue; // w row is not needed for affine transforms
+      }
+      m[e] = _mm256_i32gather_ps(base + e, stride, 4);
+    }
+
+    __m256 x = _mm256_loadu_ps(&local->x[i]);
+    __m256 y = _mm256_loadu_ps(&local->y[i]);
+    __m256 z = _mm256_loadu_ps(&local->z[i]);
+
+    __m256 wx = _mm256_fmadd_ps(m[0], x, _mm256_fmadd_ps(m[4], y, _mm256_fmadd_ps(m[8], z, m[12])));
+    __m256 wy = _mm256_fmadd_ps(m[1], x, _mm256_fmadd_ps(m[5], y, _mm256_fmadd_ps(m[9], z, m[13])));
+    __m256 wz = _mm256_fmadd_ps(m[2], x, _mm256_fmadd_ps(m[6], y, _mm256_fmadd_ps(m[10], z, m[14])));
+    _mm256_storeu_ps(&world->x[i], wx);
+    _mm256_storeu_ps(&world->y[i], wy);
+    _mm256_storeu_ps(&world->z[i], wz);
+
+    __m256 sx = _mm256_fmadd_ps(m[0], m[0], _mm256_fmadd_ps(m[1], m[1], _mm256_mul_ps(m[2], m[2])));
+    __m256 sy = _mm256_fmadd_ps(m[4], m[4], _mm256_fmadd_ps(m[5], m[5], _mm256_mul_ps(m[6], m[6])));
+    __m256 sz = _mm256_fmadd_ps(m[8], m[8], _mm256_fmadd_ps(m[9], m[9], _mm256_mul_ps(m[10], m[10])));
+    __m256 s = _mm256_max_ps(_mm256_max_ps(sx, sy), sz);
+    _mm256_storeu_ps(&world->radius[i], _mm256_mul_ps(_mm256_loadu_ps(&local->radius[i]), _mm256_sqrt_ps(s)));
+  }
+
+  SpheresSoA tailLocal = {local->x + i, local->y + i, local->z + i, local->radius + i, count - i};
+  SpheresSoA tailWorld = {world->x + i, world->y + i, world->z + i, world->radius + i, 0};
+  boundingSpheresBatchScalar(models + i, &tailLocal, &tailWorld);
+  world->count = count;
+}
+
+__attribute__((target("avx2,fma"))) static size_t cullSpheresBatchAvx2(const Frustum *frustum,
+                                                                       const SpheresSoA *spheres,
+                                                                       uint8_t *visible) {
+  __m256 px[6], py[6], pz[6], pw[6];
+  for (int p = 0; p < 6; p++) {
+    px[p] = _mm256_set1_ps(frustum->planes[p].x);
+    py[p] = _mm256_set1_ps(frustum->planes[p].y);
+    pz[p] = _mm256_set1_ps(frustum->planes[p].z);
+    pw[p] = _mm256_set1_ps(frustum->planes[p].w);
+  }
+
+  size_t count = spheres->count;
+  size_t visibleCount = 0;
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 x = _mm256_loadu_ps(&spheres->x[i]);
+    __m256 y = _mm256_loadu_ps(&spheres->y[i]);
+    __m256 z = _mm256_loadu_ps(&spheres->z[i]);
+    __m256 negR = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&spheres->radius[i]));
+
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int p = 0; p < 6; p++) {
+      __m256 d = _mm256_fmadd_ps(px[p], x, _mm256_fmadd_ps(py[p], y, _mm256_fmadd_ps(pz[p], z, pw[p])));
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negR, _CMP_GE_OQ));
+    }
+
+    int bits = _mm256_movemask_ps(inside);
+    for (int k = 0; k < 8; k++) {
+      visible[i + k] = (bits >> k) & 1;
+    }
+    visibleCount += __builtin_popcount(bits);
+  }
+
+  SpheresSoA tail = {spheres->x + i, spheres->y + i, spheres->z + i, spheres->radius + i, count - i};
+  return visibleCount + cullSpheresBatchScalar(frustum, &tail, visible + i);
+}
+
+static const VecmathKernels avx2Kernels = {VECMATH_ISA_AVX2, mat4MulBatchAvx2, boundingSpheresBatchAvx2,
+                                           cullSpheresBatchAvx2};
+
+static bool osSavesAvxState(void) {
+  uint32_t lo, hi;
+  __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  (void)hi;
+  return (lo & 0x6) == 0x6; // XMM and YMM state enabled in XCR0
+}
+
+#endif // VECMATH_X86
+
+bool vecmathIsaSupported(VecmathIsa isa) {
+  if (isa == VECMATH_ISA_SCALAR) {
+    return true;
+  }
+#ifdef VECMATH_X86
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  bool sse2 = edx & bit_SSE2;
+  if (isa == VECMATH_ISA_SSE) {
+    return sse2;
+  }
+
+  bool fma = ecx & bit_FMA;
+  bool avx = (ecx & bit_AVX) && (ecx & bit_OSXSAVE) && osSavesAvxState();
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  bool avx2 = ebx & bit_AVX2;
+  if (isa == VECMATH_ISA_AVX2) {
+    return sse2 && avx && avx2 && fma;
+  }
+#endif
+  return false;
+}
+
+VecmathIsa vecmathDetectIsa(void) {
+  for (int isa = VECMATH_ISA_COUNT - 1; isa > VECMATH_ISA_SCALAR; isa--) {
+    if (vecmathIsaSupported((VecmathIsa)isa)) {
+      return (VecmathIsa)isa;
+    }
+  }
+  return VECMATH_ISA_SCALAR;
+}
+
+const char *vecmathIsaName(VecmathIsa isa) {
+  switch (isa) {
+  case VECMATH_ISA_SSE:
+    return "sse";
+  case VECMATH_ISA_AVX2:
+    return "avx2";
+  default:
+    return "scalar";
+  }
+}
+
+const VecmathKernels *vecmathKernels(VecmathIsa isa) {
+  if (!vecmathIsaSupported(isa)) {
+    return &scalarKernels;
+  }
+#ifdef VECMATH_X86
+  switch (isa) {
+  case VECMATH_ISA_SSE:
+    return &sseKernels;
+  case VECMATH_ISA_AVX2:
+    return &avx2Kernels;
+  default:
+    break;
+  }
+#endif
+  return &scalarKernels;
+}
+
+const VecmathKernels *vecmathBest(void) {
+  static const VecmathKernels *best = NULL;
+  if (best == NULL) {
+    best = vecmathKernels(vecmathDetectIsa());
+  }
+  return best;
+}
@@ -0,0 +1,88 @@
+#ifndef VECMATH_H
+#define VECMATH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Matrices are column-major (m[col * 4 + row]) to match GLSL/SPIR-V layout, so they
+// can be copied into uniform and storage buffers without transposing.
+
+typedef struct Vec3 {
+  float x, y, z;
+} Vec3;
+
+typedef struct Vec4 {
+  float x, y, z, w;
+} Vec4;
+
+typedef struct Mat4 {
+  _Alignas(16) float m[16];
+} Mat4;
+
+// Plane i is (nx, ny, nz, d); a point p is inside when dot(n, p) + d >= 0.
+// Order: left, right, bottom, top, near, far.
+typedef struct Frustum {
+  Vec4 planes[6];
+} Frustum;
+
+// Structure-of-arrays bounding spheres; all arrays hold `count` entries.
+typedef struct SpheresSoA {
+  float *x;
+  float *y;
+  float *z;
+  float *radius;
+  size_t count;
+} SpheresSoA;
+
+typedef enum VecmathIsa {
+  VECMATH_ISA_SCALAR = 0,
+  VECMATH_ISA_SSE,
+  VECMATH_ISA_AVX2,
+  VECMATH_ISA_COUNT
+} VecmathIsa;
+
+// Batched kernels. One implementation per ISA, selected at runtime.
+typedef struct VecmathKernels {
+  VecmathIsa isa;
+  // out[i] = a * b[i]; e.g. viewProj * model[i].
+  void (*mat4MulBatch)(const Mat4 *a, const Mat4 *b, Mat4 *out, size_t count);
+  // World-space sphere of object i: center = model[i] * local center, radius scaled by the
+  // largest axis scale of model[i].
+  void (*boundingSpheresBatch)(const Mat4 *models, const SpheresSoA *local, SpheresSoA *world);
+  // visible[i] = 1 if sphere i intersects the frustum. Returns the number of visible spheres.
+  size_t (*cullSpheresBatch)(const Frustum *frustum, const SpheresSoA *spheres, uint8_t *visible);
+} VecmathKernels;
+
+// Best ISA supported by both the CPU (CPUID) and the operating system (XGETBV).
+VecmathIsa vecmathDetectIsa(void);
+bool vecmathIsaSupported(VecmathIsa isa);
+const char *vecmathIsaName(VecmathIsa isa);
+// Kernels for `isa`; falls back to scalar when the ISA is unavailable.
+const VecmathKernels *vecmathKernels(VecmathIsa isa);
+// Kernels for the best detected ISA (cached after the first call).
+const VecmathKernels *vecmathBest(void);
+
+// Scalar helpers for setting up per-frame state.
+Vec3 vec3(float x, float y, float z);
+Vec3 vec3Sub(Vec3 a, Vec3 b);
+Vec3 vec3Cross(Vec3 a, Vec3 b);
+float vec3Dot(Vec3 a, Vec3 b);
+Vec3 vec3Normalize(Vec3 v);
+
+Mat4 mat4Identity(void);
+Mat4 mat4Multiply(const Mat4 *a, const Mat4 *b);
+Mat4 mat4Translate(Vec3 t);
+Mat4 mat4Scale(Vec3 s);
+Mat4 mat4RotateY(float radians);
+Mat4 mat4RotateZ(float radians);
+// Right-handed view matrix.
+Mat4 mat4LookAt(Vec3 eye, Vec3 center, Vec3 up);
+// Vulkan clip space: depth in [0, 1], y pointing down.
+Mat4 mat4Perspective(float fovyRadians, float aspect, float zNear, float zFar);
+Vec4 mat4MulVec4(const Mat4 *m, Vec4 v);
+
+// Extracts normalized frustum planes from a view-projection matrix (Gribb/Hartmann).
+Frustum frustumFromMatrix(const Mat4 *viewProj);
+
+#endif